@@ -0,0 +1,89 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshProjector class
+
+#include "MeshBatchProjection.h"
+
+using namespace PmeshLib;
+
+
+// ***************************************************************************
+MeshProjector::MeshProjector( const ProjLib::Projection& sourceProj,
+                              const ProjLib::Projection& destProj ) throw()
+  : d_sourceProj(sourceProj), d_destProj(destProj),
+    d_pBatchSource(dynamic_cast<const MeshBatchProjection*>( &sourceProj )),
+    d_pBatchDest(dynamic_cast<const MeshBatchProjection*>( &destProj ))
+{
+}
+
+
+// ***************************************************************************
+long MeshProjector::project( double* x, double* y, long count,
+                             bool* valid ) const throw()
+{
+  long start, failed = 0;
+
+  // A point at a time needs no scratch space, so the batch size only
+  // matters when there is a batch interface
+  if ( !isBatched() )
+    return projectBatch( x, y, count, valid );
+
+  for ( start = 0; start < count; start += MESH_PROJECTOR_BATCH )
+  {
+    failed += projectBatch( x + start, y + start,
+                            ( count - start < MESH_PROJECTOR_BATCH ) ?
+                            count - start : MESH_PROJECTOR_BATCH,
+                            valid + start );
+  }
+  return failed;
+}
+
+
+// ***************************************************************************
+long MeshProjector::projectBatch( double* x, double* y, long count,
+                                  bool* valid ) const throw()
+{
+  bool geoValid[MESH_PROJECTOR_BATCH];
+  bool* pGeoValid = d_pBatchDest ? geoValid : valid;
+  long counter, failed = 0;
+
+  // To geographic, leaving the latitudes in y and the longitudes in x
+  if ( d_pBatchSource )
+  {
+    d_pBatchSource->projectArrayToGeo( x, y, count, y, x, pGeoValid );
+  }
+  else
+  {
+    for ( counter = 0; counter < count; counter++ )
+      pGeoValid[counter] = d_sourceProj.projectToGeo( x[counter], y[counter],
+                                                      y[counter],
+                                                      x[counter] );
+  }
+
+  // And on to the destination
+  if ( d_pBatchDest )
+  {
+    d_pBatchDest->projectArrayFromGeo( y, x, count, x, y, valid );
+    for ( counter = 0; counter < count; counter++ )
+    {
+      if ( !geoValid[counter] )
+      {
+        valid[counter] = false;
+        failed++;
+      }
+    }
+  }
+  else
+  {
+    for ( counter = 0; counter < count; counter++ )
+    {
+      if ( valid[counter] )
+        valid[counter] = d_destProj.projectFromGeo( y[counter], x[counter],
+                                                    x[counter], y[counter] );
+      else
+        failed++;
+    }
+  }
+  return failed;
+}
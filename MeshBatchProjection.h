@@ -0,0 +1,99 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Projecting arrays of points for calculateMesh().
+//
+// ProjLib::Projection converts one point per virtual call, which leaves a
+// projection that could transform arrays, or vectorize its math, no way
+// to.  Such a projection can implement MeshBatchProjection as well as
+// ProjLib::Projection:
+//
+//   class FastProjection : public ProjLib::Projection,
+//                          public PmeshLib::MeshBatchProjection
+//
+// and calculateMesh() and lazy tiles will hand it a row of nodes at a
+// time.  The mesh finds the interface with a dynamic_cast, so nothing
+// needs to be registered, and clone() must return the same class for the
+// threads of a multithreaded calculateMesh() to see it.  The batch
+// functions must give the same answers as projectToGeo() and
+// projectFromGeo() for the mesh to come out the same either way.
+//
+// MeshProjector is what the mesh projects through.  It uses the batch
+// interface of whichever of the two projections has one and falls back
+// to a point at a time for the other.
+
+#ifndef _MESHBATCHPROJECTION_H_
+#define _MESHBATCHPROJECTION_H_
+
+#include "ProjectionLib/Projection.h"
+
+namespace PmeshLib
+{
+
+class MeshBatchProjection
+{
+ public:
+  virtual ~MeshBatchProjection()
+  {
+  }
+
+  /* Converts the <count> points <x>, <y> to geographic <lat>, <lon>,
+     setting <valid> for each to whether it could be.  <lat> and <lon> may
+     be <y> and <x>, so both coordinates of a point have to be read before
+     either is written.  Returns how many could be converted */
+  virtual long projectArrayToGeo( const double* x, const double* y,
+                                  long count, double* lat, double* lon,
+                                  bool* valid ) const throw() = 0;
+
+  /* Converts the <count> geographic points <lat>, <lon> to <x>, <y>,
+     setting <valid> for each to whether it could be.  <x> and <y> may be
+     <lon> and <lat>.  Returns how many could be converted */
+  virtual long projectArrayFromGeo( const double* lat, const double* lon,
+                                    long count, double* x, double* y,
+                                    bool* valid ) const throw() = 0;
+};
+
+
+// Points MeshProjector hands a MeshBatchProjection at a time
+#define MESH_PROJECTOR_BATCH 256
+
+class MeshProjector
+{
+ public:
+  /* Projects from <sourceProj> to <destProj>, which must outlive this */
+  MeshProjector( const ProjLib::Projection& sourceProj,
+                 const ProjLib::Projection& destProj ) throw();
+
+  /* Returns true if either projection takes arrays */
+  bool isBatched() const throw();
+
+  /* Projects the <count> points <x>, <y> from the source to the
+     destination in place, the same as projectToGeo() then
+     projectFromGeo() on each, and sets <valid> for each to whether both
+     succeeded.  Returns how many points couldn't be converted to
+     geographic */
+  long project( double* x, double* y, long count, bool* valid ) const
+    throw();
+
+ private:
+  /* project() for at most MESH_PROJECTOR_BATCH points */
+  long projectBatch( double* x, double* y, long count, bool* valid ) const
+    throw();
+
+  const ProjLib::Projection& d_sourceProj;
+  const ProjLib::Projection& d_destProj;
+  const MeshBatchProjection* d_pBatchSource;   // NULL if it hasn't the
+  const MeshBatchProjection* d_pBatchDest;     // interface
+};
+
+
+// ***************************************************************************
+inline
+bool MeshProjector::isBatched() const throw()
+{
+  return ( d_pBatchSource || d_pBatchDest );
+}
+
+} // namespace
+
+#endif
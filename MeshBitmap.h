@@ -0,0 +1,68 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Helpers for the one bit per entry validity maps the Projection Mesh
+// keeps for its nodes and cells.  The maps are plain arrays of 32 bit
+// words with entry i in bit i % 32 of word i / 32.  Neighbouring entries
+// share words, so when other threads may be setting entries of a map at
+// the same time use setSharedBit(), which can't lose their changes.
+// testBit() reads the word in one go, so it can be used while they do.
+
+#ifndef _MESHBITMAP_H_
+#define _MESHBITMAP_H_
+
+#include <stddef.h>
+#include "PmeshThread.h"
+
+namespace PmeshLib
+{
+
+typedef unsigned int MeshBitWord;
+
+const long MESH_BITS_PER_WORD = 32;
+
+// ***************************************************************************
+// Number of words needed to hold <bits> bits
+inline
+size_t bitmapWords( long bits ) throw()
+{
+  return static_cast<size_t>( ( bits + MESH_BITS_PER_WORD - 1 ) /
+                              MESH_BITS_PER_WORD );
+}
+
+// ***************************************************************************
+inline
+bool testBit( const MeshBitWord* map, long bit ) throw()
+{
+  return 0 != ( ( atomicRead( map[ bit / MESH_BITS_PER_WORD ] ) >>
+                  ( bit % MESH_BITS_PER_WORD ) ) & 1u );
+}
+
+// ***************************************************************************
+inline
+void setBit( MeshBitWord* map, long bit, bool bValue ) throw()
+{
+  MeshBitWord mask = 1u << ( bit % MESH_BITS_PER_WORD );
+
+  if ( bValue )
+    map[ bit / MESH_BITS_PER_WORD ] |= mask;
+  else
+    map[ bit / MESH_BITS_PER_WORD ] &= ~mask;
+}
+
+// ***************************************************************************
+// setBit() as one indivisible operation on the word
+inline
+void setSharedBit( MeshBitWord* map, long bit, bool bValue ) throw()
+{
+  MeshBitWord mask = 1u << ( bit % MESH_BITS_PER_WORD );
+
+  if ( bValue )
+    atomicOr( map[ bit / MESH_BITS_PER_WORD ], mask );
+  else
+    atomicAnd( map[ bit / MESH_BITS_PER_WORD ], ~mask );
+}
+
+} // namespace
+
+#endif
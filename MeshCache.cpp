@@ -0,0 +1,277 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshHandle and MeshCache classes
+
+#include "MeshCache.h"
+#include <stdio.h>
+
+using namespace PmeshLib;
+
+namespace
+{
+// The cache getShared() hands out
+MeshCache g_sharedCache;
+
+// Works out the key a mesh is cached under.  The numbers are written in
+// full so that meshes only match if they'd come out the same.
+std::string makeKey( const ProjLib::Projection& sourceProj,
+                     const ProjLib::Projection& destProj,
+                     double left, double bottom, double right, double top,
+                     long width, long height, long interpolator )
+{
+  char numbers[160];
+
+  sprintf( numbers, "%.17g %.17g %.17g %.17g %ld %ld %ld", left, bottom,
+           right, top, width, height, interpolator );
+  return sourceProj.toString() + '\n' + destProj.toString() + '\n' +
+    numbers;
+}
+}
+
+
+// ***************************************************************************
+MeshHandle::MeshHandle() throw()
+  : d_pEntry(NULL)
+{
+}
+
+
+// ***************************************************************************
+MeshHandle::MeshHandle( MeshCacheEntry* pEntry ) throw()
+  : d_pEntry(pEntry)
+{
+  atomicIncrement( d_pEntry->references );
+}
+
+
+// ***************************************************************************
+MeshHandle::MeshHandle( const MeshHandle& other ) throw()
+  : d_pEntry(other.d_pEntry)
+{
+  if ( d_pEntry )
+    atomicIncrement( d_pEntry->references );
+}
+
+
+// ***************************************************************************
+MeshHandle& MeshHandle::operator=( const MeshHandle& other ) throw()
+{
+  // Take the new reference first in case they're the same mesh
+  if ( other.d_pEntry )
+    atomicIncrement( other.d_pEntry->references );
+  if ( d_pEntry )
+    dropReference( d_pEntry );
+  d_pEntry = other.d_pEntry;
+  return *this;
+}
+
+
+// ***************************************************************************
+MeshHandle::~MeshHandle()
+{
+  release();
+}
+
+
+// ***************************************************************************
+void MeshHandle::release() throw()
+{
+  if ( d_pEntry )
+    dropReference( d_pEntry );
+  d_pEntry = NULL;
+}
+
+
+// ***************************************************************************
+void MeshHandle::dropReference( MeshCacheEntry* pEntry ) throw()
+{
+  if ( 0 == atomicDecrement( pEntry->references ) )
+  {
+    delete pEntry->mesh;
+    delete pEntry;
+  }
+}
+
+
+// ***************************************************************************
+MeshCache::MeshCache( size_t budget ) throw()
+  : d_budget(budget), d_bytes(0), d_hits(0), d_misses(0), d_evictions(0)
+{
+}
+
+
+// ***************************************************************************
+MeshCache::~MeshCache()
+{
+  clear();
+}
+
+
+// ***************************************************************************
+MeshCache& MeshCache::getShared() throw()
+{
+  return g_sharedCache;
+}
+
+
+// ***************************************************************************
+MeshHandle MeshCache::acquire( const ProjLib::Projection& sourceProj,
+                               const ProjLib::Projection& destProj,
+                               double left, double bottom,
+                               double right, double top,
+                               long width, long height, long interpolator )
+  throw(PmeshException, std::bad_alloc)
+{
+  const std::string key = makeKey( sourceProj, destProj, left, bottom,
+                                   right, top, width, height, interpolator );
+  EntryMap::iterator found;
+  ProjectionMesh* pMesh;
+  MeshCacheEntry* pEntry;
+
+  {
+    PmeshLock lock( d_mutex );
+
+    found = d_entries.find( key );
+    if ( found != d_entries.end() )
+    {
+      d_hits++;
+      d_lru.splice( d_lru.begin(), d_lru, found->second->position );
+      return MeshHandle( found->second );
+    }
+    d_misses++;
+  }
+
+  // Calculate the mesh without holding up the other threads
+  if ( !( pMesh = new (std::nothrow) ProjectionMesh ) )
+    throw std::bad_alloc();
+
+  try
+  {
+    pMesh->setSourceMeshBounds( left, bottom, right, top );
+    pMesh->setMeshSize( width, height );
+    pMesh->setInterpolator( interpolator );
+    pMesh->calculateMesh( sourceProj, destProj );
+  }
+  catch(...)
+  {
+    delete pMesh;
+    throw;
+  }
+
+  if ( !( pEntry = new (std::nothrow) MeshCacheEntry ) )
+  {
+    delete pMesh;
+    throw std::bad_alloc();
+  }
+  pEntry->mesh       = pMesh;
+  pEntry->references = 0;
+  pEntry->bytes      = pMesh->getMemoryUsage();
+
+  MeshHandle handle( pEntry );
+  PmeshLock lock( d_mutex );
+
+  // Another thread may have put the same mesh in meanwhile, in which case
+  // everyone should share that one
+  found = d_entries.find( key );
+  if ( found != d_entries.end() )
+  {
+    d_lru.splice( d_lru.begin(), d_lru, found->second->position );
+    handle = MeshHandle( found->second );
+    return handle;
+  }
+
+  if ( pEntry->bytes <= d_budget )
+  {
+    pEntry->key = key;
+    d_lru.push_front( pEntry );
+    pEntry->position = d_lru.begin();
+    try
+    {
+      d_entries[key] = pEntry;
+    }
+    catch(std::bad_alloc &)
+    {
+      d_lru.pop_front();
+      throw;
+    }
+
+    atomicIncrement( pEntry->references );
+    d_bytes += pEntry->bytes;
+    evict( d_budget );
+  }
+  return handle;
+}
+
+
+// ***************************************************************************
+void MeshCache::setMemoryBudget( size_t budget ) throw()
+{
+  PmeshLock lock( d_mutex );
+
+  d_budget = budget;
+  evict( d_budget );
+}
+
+
+// ***************************************************************************
+size_t MeshCache::getMemoryBudget() const throw()
+{
+  PmeshLock lock( d_mutex );
+
+  return d_budget;
+}
+
+
+// ***************************************************************************
+void MeshCache::clear() throw()
+{
+  PmeshLock lock( d_mutex );
+
+  while ( !d_lru.empty() )
+    remove( d_lru.back() );
+}
+
+
+// ***************************************************************************
+void MeshCache::getStats( MeshCacheStats& stats ) const throw()
+{
+  PmeshLock lock( d_mutex );
+
+  stats.hits      = d_hits;
+  stats.misses    = d_misses;
+  stats.evictions = d_evictions;
+  stats.meshes    = static_cast<long>( d_entries.size() );
+  stats.bytes     = d_bytes;
+  stats.budget    = d_budget;
+}
+
+
+// ***************************************************************************
+void MeshCache::resetStats() throw()
+{
+  PmeshLock lock( d_mutex );
+
+  d_hits = d_misses = d_evictions = 0;
+}
+
+
+// ***************************************************************************
+void MeshCache::evict( size_t budget ) throw()
+{
+  while ( d_bytes > budget && !d_lru.empty() )
+  {
+    remove( d_lru.back() );
+    d_evictions++;
+  }
+}
+
+
+// ***************************************************************************
+void MeshCache::remove( MeshCacheEntry* pEntry ) throw()
+{
+  d_entries.erase( pEntry->key );
+  d_lru.erase( pEntry->position );
+  d_bytes -= pEntry->bytes;
+  MeshHandle::dropReference( pEntry );
+}
@@ -0,0 +1,201 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshCache shares calculated meshes across a process.  Meshes are keyed
+// by the source and destination projections (by their toString()), the
+// source bounds, the mesh size and the interpolator, so a program that
+// keeps asking for the same few meshes calculates each of them once.
+//
+// acquire() hands out a MeshHandle, a reference counted pointer to a
+// const ProjectionMesh.  The mesh can't be changed through it, and the
+// const members of ProjectionMesh may be called from any number of
+// threads at once, so one mesh can serve every thread that asks for it.
+// Handles are copied and released freely from any thread; the mesh is
+// deleted when the last handle to it goes and the cache has dropped it.
+//
+// The cache keeps meshes within a memory budget, by
+// ProjectionMesh::getMemoryUsage(), dropping the least recently acquired
+// first.  A mesh still held through handles stays alive after it is
+// dropped, it just isn't found again, so the budget bounds what the cache
+// keeps rather than what the process uses.  A mesh bigger than the whole
+// budget is handed out but not kept.
+//
+// Meshes are calculated with the ProjectionMesh defaults other than the
+// interpolator.  The lock is not held while a mesh is calculated, so two
+// threads missing on the same key at once may both calculate it; the
+// first to finish is kept and the other thread is handed that one.
+//
+// MeshCache::getShared() is a cache for the whole process.  It is
+// constructed before main(), so it must not be used by other static
+// constructors.
+
+#ifndef _MESHCACHE_H_
+#define _MESHCACHE_H_
+
+#include <new>
+#include <list>
+#include <map>
+#include <string>
+#include <stddef.h>
+#include "ProjectionMesh.h"
+#include "PmeshThread.h"
+
+namespace PmeshLib
+{
+
+// Default MeshCache memory budget, in bytes
+#define MESH_CACHE_BUDGET ( 256 * 1024 * 1024 )
+
+// What a MeshCache has done, filled in by MeshCache::getStats()
+struct MeshCacheStats
+{
+  unsigned long hits;         // acquire() calls that found their mesh
+  unsigned long misses;       // acquire() calls that calculated one
+  unsigned long evictions;    // meshes dropped to keep within the budget
+  long          meshes;       // meshes in the cache now
+  size_t        bytes;        // memory they take
+  size_t        budget;       // memory they may take
+};
+
+// A mesh and its reference count, shared by the cache and the handles
+struct MeshCacheEntry
+{
+  ProjectionMesh* mesh;
+  volatile long   references;
+  std::string     key;
+  size_t          bytes;
+  std::list<MeshCacheEntry*>::iterator position;  // in the LRU list
+};
+
+class MeshHandle
+{
+ public:
+  /* An empty handle */
+  MeshHandle() throw();
+
+  MeshHandle( const MeshHandle& other ) throw();
+  MeshHandle& operator=( const MeshHandle& other ) throw();
+  ~MeshHandle();
+
+  /* Gets the mesh, NULL if the handle is empty */
+  const ProjectionMesh* get() const throw();
+
+  const ProjectionMesh* operator->() const throw();
+  const ProjectionMesh& operator*() const throw();
+
+  /* Returns true if the handle holds no mesh */
+  bool isNull() const throw();
+
+  /* Lets go of the mesh, leaving the handle empty */
+  void release() throw();
+
+ private:
+  friend class MeshCache;
+
+  /* Takes a new reference to <pEntry> */
+  explicit MeshHandle( MeshCacheEntry* pEntry ) throw();
+
+  /* Drops a reference to <pEntry>, deleting it if it was the last */
+  static void dropReference( MeshCacheEntry* pEntry ) throw();
+
+  MeshCacheEntry* d_pEntry;
+};
+
+class MeshCache
+{
+ public:
+  /* An empty cache keeping at most <budget> bytes of meshes */
+  explicit MeshCache( size_t budget = MESH_CACHE_BUDGET ) throw();
+
+  /* Drops every mesh.  Handles still out keep theirs */
+  ~MeshCache();
+
+  /* Gets the cache shared by the whole process */
+  static MeshCache& getShared() throw();
+
+  /* Gets the mesh from <sourceProj> to <destProj> over the source bounds
+     <left>, <bottom>, <right>, <top> with <width> x <height> nodes and
+     interpolator <interpolator>, calculating it if the cache doesn't have
+     it.  Throws what calculateMesh() throws */
+  MeshHandle acquire( const ProjLib::Projection& sourceProj,
+                      const ProjLib::Projection& destProj,
+                      double left, double bottom, double right, double top,
+                      long width, long height,
+                      long interpolator = MathLib::DlgViewer )
+    throw(PmeshException, std::bad_alloc);
+
+  /* Sets the memory budget, dropping meshes to fit in it */
+  void setMemoryBudget( size_t budget ) throw();
+
+  /* Gets the memory budget */
+  size_t getMemoryBudget() const throw();
+
+  /* Drops every mesh */
+  void clear() throw();
+
+  /* Fills <stats> with the counts and what the cache holds */
+  void getStats( MeshCacheStats& stats ) const throw();
+
+  /* Zeroes the hit, miss and eviction counts */
+  void resetStats() throw();
+
+ private:
+  // Not copyable
+  MeshCache( const MeshCache& );
+  MeshCache& operator=( const MeshCache& );
+
+  typedef std::map<std::string, MeshCacheEntry*> EntryMap;
+  typedef std::list<MeshCacheEntry*>             EntryList;
+
+  /* Drops least recently used meshes until there are at most <budget>
+     bytes.  The lock must be held */
+  void evict( size_t budget ) throw();
+
+  /* Drops <pEntry> from the cache.  The lock must be held */
+  void remove( MeshCacheEntry* pEntry ) throw();
+
+  mutable PmeshMutex d_mutex;
+  EntryMap      d_entries;
+  EntryList     d_lru;          // most recently acquired first
+  size_t        d_budget;
+  size_t        d_bytes;
+  unsigned long d_hits;
+  unsigned long d_misses;
+  unsigned long d_evictions;
+};
+
+
+// ***************************************************************************
+inline
+const ProjectionMesh* MeshHandle::get() const throw()
+{
+  return d_pEntry ? d_pEntry->mesh : NULL;
+}
+
+
+// ***************************************************************************
+inline
+const ProjectionMesh* MeshHandle::operator->() const throw()
+{
+  return get();
+}
+
+
+// ***************************************************************************
+inline
+const ProjectionMesh& MeshHandle::operator*() const throw()
+{
+  return *get();
+}
+
+
+// ***************************************************************************
+inline
+bool MeshHandle::isNull() const throw()
+{
+  return ( NULL == d_pEntry );
+}
+
+} // namespace
+
+#endif
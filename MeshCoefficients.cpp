@@ -0,0 +1,235 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshCoefficients class
+
+#include "MeshCoefficients.h"
+#include "MathLib/Interpolator.h"
+
+using namespace PmeshLib;
+
+namespace
+{
+// Expands the cubic Lagrange basis polynomials through the nodes at
+// offsets <nodes> into power series.  basis[k][i] is the coefficient of
+// u^i in the polynomial that is 1 at nodes[k] and 0 at the others.
+void lagrangeBasis( const double* nodes, double basis[4][4] ) throw()
+{
+  int k, m, i;
+  double denom, root;
+  double poly[4];
+
+  for ( k = 0; k < 4; k++ )
+  {
+    poly[0] = 1.0;
+    poly[1] = poly[2] = poly[3] = 0.0;
+    denom = 1.0;
+
+    // Multiply in ( u - nodes[m] ) for every other node
+    for ( m = 0; m < 4; m++ )
+    {
+      if ( m == k )
+        continue;
+
+      root = nodes[m];
+      for ( i = 3; i > 0; i-- )
+        poly[i] = poly[i - 1] - root * poly[i];
+      poly[0] = -root * poly[0];
+      denom *= nodes[k] - nodes[m];
+    }
+
+    for ( i = 0; i < 4; i++ )
+      basis[k][i] = poly[i] / denom;
+  }
+}
+
+// Start of the size 4 stencil along an axis of <length> nodes for the
+// cell starting at <index>.  This is what ProjectionMesh::getGrid() uses.
+long stencilStart( long index, long length ) throw()
+{
+  long start = index - 2;
+
+  if ( start > length - 4 )
+    start = length - 4;
+  if ( start < 0 )
+    start = 0;
+  return start;
+}
+}
+
+
+// ***************************************************************************
+MeshCoefficients::MeshCoefficients() throw()
+  : d_type(0), d_width(0), d_height(0), d_stride(0),
+    d_pCoefficients(NULL)
+{
+}
+
+
+// ***************************************************************************
+MeshCoefficients::~MeshCoefficients()
+{
+  clear();
+}
+
+
+// ***************************************************************************
+bool MeshCoefficients::supports( long type ) throw()
+{
+  return ( 0 != coefficientsPerCell( type ) );
+}
+
+
+// ***************************************************************************
+long MeshCoefficients::coefficientsPerCell( long type ) throw()
+{
+  switch ( type )
+  {
+  case MathLib::DlgViewer:
+  case MathLib::LeastSquaresPlane:
+  case MathLib::BiPolynomial:
+  case MathLib::BiLinear:
+    return 8;
+  case MathLib::BiCubic:
+    return 32;
+  default:
+    return 0;
+  }
+}
+
+
+// ***************************************************************************
+void MeshCoefficients::clear() throw()
+{
+  delete [] d_pCoefficients;
+  d_pCoefficients = NULL;
+  d_type = 0;
+  d_width = d_height = d_stride = 0;
+}
+
+
+// ***************************************************************************
+size_t MeshCoefficients::getMemoryUsage() const throw()
+{
+  if ( !d_pCoefficients )
+    return 0;
+
+  return static_cast<size_t>( d_width ) * d_height * d_stride *
+    sizeof(double);
+}
+
+
+// ***************************************************************************
+bool MeshCoefficients::build( long type, const double* nodeX,
+                              const double* nodeY, long width, long height )
+  throw(std::bad_alloc)
+{
+  long col, row, rightCol, bottomRow;
+  long ul, ur, ll, lr;
+  const double* values;
+  double* c;
+  int axis;
+
+  clear();
+
+  if ( !supports( type ) || !nodeX || !nodeY || width < 1 || height < 1 )
+    return false;
+
+  // Bicubic stencils need four nodes each way
+  if ( MathLib::BiCubic == type && ( width < 4 || height < 4 ) )
+    return false;
+
+  d_stride = coefficientsPerCell( type );
+
+  if ( !( d_pCoefficients = new (std::nothrow)
+          double[ static_cast<size_t>( width ) * height * d_stride ] ) )
+    throw std::bad_alloc();
+
+  d_type   = type;
+  d_width  = width;
+  d_height = height;
+
+  // There is a cell for every node.  The ones on the right and bottom
+  // edges reuse their own column or row for the missing neighbors, the
+  // same as ProjectionMesh::projectPoint() does.
+  for ( row = 0; row < height; row++ )
+  {
+    bottomRow = ( row + 1 < height ) ? row + 1 : row;
+
+    for ( col = 0; col < width; col++ )
+    {
+      rightCol = ( col + 1 < width ) ? col + 1 : col;
+      c = d_pCoefficients + ( row * width + col ) * d_stride;
+
+      ul = row * width + col;
+      ur = row * width + rightCol;
+      ll = bottomRow * width + col;
+      lr = bottomRow * width + rightCol;
+
+      for ( axis = 0; axis < 2; axis++ )
+      {
+        values = axis ? nodeY : nodeX;
+
+        if ( MathLib::BiCubic == type )
+        {
+          biCubicCell( values, width, height, col, row, c );
+          c += 16;
+        }
+        else if ( MathLib::LeastSquaresPlane == type )
+        {
+          planeCell( values, ul, ur, ll, lr, c );
+          c += 4;
+        }
+        else
+        {
+          bilinearCell( values, ul, ur, ll, lr, c );
+          c += 4;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+
+// ***************************************************************************
+void MeshCoefficients::biCubicCell( const double* values, long width,
+                                    long height, long col, long row,
+                                    double* coefs ) throw()
+{
+  long gcol, grow;
+  int i, j, r, k;
+  double colNodes[4], rowNodes[4];
+  double colBasis[4][4], rowBasis[4][4];
+  double value;
+
+  gcol = stencilStart( col, width );
+  grow = stencilStart( row, height );
+
+  // Stencil node positions relative to this cell's upper left node
+  for ( k = 0; k < 4; k++ )
+  {
+    colNodes[k] = static_cast<double>( gcol + k - col );
+    rowNodes[k] = static_cast<double>( grow + k - row );
+  }
+
+  lagrangeBasis( colNodes, colBasis );
+  lagrangeBasis( rowNodes, rowBasis );
+
+  for ( i = 0; i < 16; i++ )
+    coefs[i] = 0.0;
+
+  // The bicubic through the stencil is the tensor product of the basis
+  // polynomials weighted by the node values
+  for ( r = 0; r < 4; r++ )
+  {
+    for ( k = 0; k < 4; k++ )
+    {
+      value = values[ ( grow + r ) * width + gcol + k ];
+
+      for ( j = 0; j < 4; j++ )
+        for ( i = 0; i < 4; i++ )
+          coefs[ j * 4 + i ] += value * rowBasis[r][j] * colBasis[k][i];
+    }
+  }
+}
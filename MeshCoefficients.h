@@ -0,0 +1,189 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshCoefficients holds the interpolation coefficients of every cell of
+// a ProjectionMesh so that projecting a point only takes finding its cell
+// and evaluating a short polynomial.  The polynomials are the closed forms
+// of what the MathLib interpolators compute for a cell:
+//
+//   DlgViewer, BiLinear, BiPolynomial   a + b*u + c*v + d*u*v
+//   LeastSquaresPlane                   a + b*u + c*v (the plane fitted to
+//                                       the four corners)
+//   BiCubic                             sum of c[i][j] * u^i * v^j, i,j < 4
+//                                       through the cell's 4x4 stencil
+//
+// where <u> and <v> are the offsets of the point in cells from the upper
+// left node of its cell.  They agree with the interpolators to within 32
+// units in the last place of the largest coordinate of the cell's corners,
+// and BiCubic to within 128 of the largest in its stencil, which
+// benchmarks/InterpolatorCheck.cpp checks.
+//
+// The static functions work out and evaluate the coefficients of a single
+// linear cell, for MeshQuery to do the same on the fly.
+
+#ifndef _MESHCOEFFICIENTS_H_
+#define _MESHCOEFFICIENTS_H_
+
+#include <new>
+#include <stddef.h>
+
+namespace PmeshLib
+{
+
+class MeshCoefficients
+{
+ public:
+  MeshCoefficients() throw();
+  ~MeshCoefficients();
+
+  /* Returns true if there is a closed form for interpolator <type> */
+  static bool supports( long type ) throw();
+
+  /* Returns how many doubles a cell takes for interpolator <type> */
+  static long coefficientsPerCell( long type ) throw();
+
+  /* Computes the coefficients of every cell of the <width> x <height>
+     mesh whose projected node coordinates are in <nodeX>, <nodeY> for
+     interpolator <type>.  Returns false, leaving nothing built, if <type>
+     isn't supported */
+  bool build( long type, const double* nodeX, const double* nodeY,
+              long width, long height ) throw(std::bad_alloc);
+
+  /* Throws away the coefficients */
+  void clear() throw();
+
+  /* Returns true if the coefficients have been built */
+  bool isBuilt() const throw();
+
+  /* Gets the interpolator type the coefficients were built for */
+  long getType() const throw();
+
+  /* Gets the number of bytes the coefficients use */
+  size_t getMemoryUsage() const throw();
+
+  /* Interpolates the cell whose upper left node is <col>, <row> at
+     the offsets <u>, <v> into <x>, <y>.  The coefficients are computed
+     whether or not the corners are valid, so the caller checks that */
+  void evaluate( long col, long row, double u, double v,
+                 double& x, double& y ) const throw();
+
+  /* Fills the 4 <coefs> of a bilinear cell for the coordinate held in
+     <values>, whose corners are at the indexes <ul>, <ur>, <ll>, <lr> */
+  static void bilinearCell( const double* values, long ul, long ur,
+                            long ll, long lr, double* coefs ) throw();
+
+  /* Same as bilinearCell() for the least squares plane */
+  static void planeCell( const double* values, long ul, long ur,
+                         long ll, long lr, double* coefs ) throw();
+
+  /* Evaluates the 8 coefficients of a bilinear or plane cell, x's then
+     y's, at <u>, <v> */
+  static void evaluateLinear( const double* coefs, double u, double v,
+                              double& x, double& y ) throw();
+
+  /* Evaluates the 32 coefficients of a bicubic cell at <u>, <v> */
+  static void evaluateCubic( const double* coefs, double u, double v,
+                             double& x, double& y ) throw();
+
+ private:
+  // Not copyable
+  MeshCoefficients( const MeshCoefficients& );
+  MeshCoefficients& operator=( const MeshCoefficients& );
+
+  /* Fills the 16 <coefs> of the bicubic cell at <col>, <row> of a
+     <width> x <height> mesh for the coordinate held in <values>.  The
+     mesh must be at least 4 x 4 */
+  static void biCubicCell( const double* values, long width, long height,
+                           long col, long row, double* coefs ) throw();
+
+  long    d_type;
+  long    d_width, d_height;
+  long    d_stride;         // doubles per cell, x's then y's
+  double* d_pCoefficients;
+};
+
+
+// ***************************************************************************
+inline
+bool MeshCoefficients::isBuilt() const throw()
+{
+  return ( NULL != d_pCoefficients );
+}
+
+// ***************************************************************************
+inline
+long MeshCoefficients::getType() const throw()
+{
+  return d_type;
+}
+
+// ***************************************************************************
+inline
+void MeshCoefficients::evaluate( long col, long row, double u, double v,
+                                 double& x, double& y ) const throw()
+{
+  const double* c = d_pCoefficients + ( row * d_width + col ) * d_stride;
+
+  if ( 8 == d_stride )
+    evaluateLinear( c, u, v, x, y );
+  else
+    evaluateCubic( c, u, v, x, y );
+}
+
+// ***************************************************************************
+inline
+void MeshCoefficients::bilinearCell( const double* values, long ul, long ur,
+                                     long ll, long lr, double* coefs )
+  throw()
+{
+  coefs[0] = values[ul];
+  coefs[1] = values[ur] - values[ul];
+  coefs[2] = values[ll] - values[ul];
+  coefs[3] = ( values[lr] - values[ll] ) - ( values[ur] - values[ul] );
+}
+
+// ***************************************************************************
+// The least squares plane through the corners of a square passes through
+// their mean with the average slope each way
+inline
+void MeshCoefficients::planeCell( const double* values, long ul, long ur,
+                                  long ll, long lr, double* coefs ) throw()
+{
+  coefs[1] = ( ( values[ur] + values[lr] ) -
+               ( values[ul] + values[ll] ) ) * 0.5;
+  coefs[2] = ( ( values[ll] + values[lr] ) -
+               ( values[ul] + values[ur] ) ) * 0.5;
+  coefs[0] = ( values[ul] + values[ur] + values[ll] + values[lr] ) * 0.25
+    - ( coefs[1] + coefs[2] ) * 0.5;
+  coefs[3] = 0.0;
+}
+
+// ***************************************************************************
+inline
+void MeshCoefficients::evaluateLinear( const double* c, double u, double v,
+                                       double& x, double& y ) throw()
+{
+  x = c[0] + c[1] * u + ( c[2] + c[3] * u ) * v;
+  y = c[4] + c[5] * u + ( c[6] + c[7] * u ) * v;
+}
+
+// ***************************************************************************
+// Horner in u for each power of v, then in v
+inline
+void MeshCoefficients::evaluateCubic( const double* c, double u, double v,
+                                      double& x, double& y ) throw()
+{
+  x = ( ( c[15] * u + c[14] ) * u + c[13] ) * u + c[12];
+  x = x * v + ( ( c[11] * u + c[10] ) * u + c[9] ) * u + c[8];
+  x = x * v + ( ( c[7] * u + c[6] ) * u + c[5] ) * u + c[4];
+  x = x * v + ( ( c[3] * u + c[2] ) * u + c[1] ) * u + c[0];
+  c += 16;
+  y = ( ( c[15] * u + c[14] ) * u + c[13] ) * u + c[12];
+  y = y * v + ( ( c[11] * u + c[10] ) * u + c[9] ) * u + c[8];
+  y = y * v + ( ( c[7] * u + c[6] ) * u + c[5] ) * u + c[4];
+  y = y * v + ( ( c[3] * u + c[2] ) * u + c[1] ) * u + c[0];
+}
+
+} // namespace
+
+#endif
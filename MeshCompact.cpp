@@ -0,0 +1,205 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshCompactNodes class
+
+#include "MeshCompact.h"
+#include <math.h>
+
+using namespace PmeshLib;
+
+
+// ***************************************************************************
+MeshCompactNodes::MeshCompactNodes() throw()
+  : d_width(0), d_height(0), d_anchorWidth(0), d_pAnchors(NULL),
+    d_pOffsets(NULL), d_maxError(0.0)
+{
+}
+
+
+// ***************************************************************************
+MeshCompactNodes::~MeshCompactNodes()
+{
+  clear();
+}
+
+
+// ***************************************************************************
+// Takes the anchors from the nodes, fills in the ones on invalid nodes,
+// then stores each node's offset from its prediction
+void MeshCompactNodes::build( const double* nodeX, const double* nodeY,
+                              const MeshBitWord* nodeValid,
+                              long width, long height )
+  throw(std::bad_alloc)
+{
+  const size_t nodes = static_cast<size_t>( width ) * height;
+  const long anchorWidth = ( width + ANCHOR_SPACING - 2 ) /
+                           ANCHOR_SPACING + 1;
+  const size_t anchors = static_cast<size_t>( anchorWidth ) * height;
+  long row, col, anchor, node;
+  double x, y, error;
+  char* bKnown;
+
+  clear();
+  if ( !( bKnown = new (std::nothrow) char[anchors] ) )
+    throw std::bad_alloc();
+  if ( !( d_pAnchors = new (std::nothrow) double[ 2 * anchors ] ) ||
+       !( d_pOffsets = new (std::nothrow) float[ 2 * nodes ] ) )
+  {
+    delete [] bKnown;
+    clear();
+    throw std::bad_alloc();
+  }
+  d_width       = width;
+  d_height      = height;
+  d_anchorWidth = anchorWidth;
+
+  for ( anchor = 0; anchor < static_cast<long>( anchors ); anchor++ )
+  {
+    col = anchor % anchorWidth * ANCHOR_SPACING;
+    row = anchor / anchorWidth;
+    node = row * width + ( ( col < width ) ? col : width - 1 );
+
+    bKnown[anchor] = testBit( nodeValid, node );
+    d_pAnchors[ 2 * anchor ]     = bKnown[anchor] ? nodeX[node] : 0.0;
+    d_pAnchors[ 2 * anchor + 1 ] = bKnown[anchor] ? nodeY[node] : 0.0;
+  }
+  fillAnchors( bKnown );
+  delete [] bKnown;
+
+  for ( row = 0; row < height; row++ )
+  {
+    for ( col = 0; col < width; col++ )
+    {
+      node = row * width + col;
+      predict( col, row, x, y );
+      d_pOffsets[ 2 * node ]     = static_cast<float>( nodeX[node] - x );
+      d_pOffsets[ 2 * node + 1 ] = static_cast<float>( nodeY[node] - y );
+
+      if ( testBit( nodeValid, node ) )
+      {
+        getNode( col, row, x, y );
+        error = hypot( x - nodeX[node], y - nodeY[node] );
+        if ( error > d_maxError )
+          d_maxError = error;
+      }
+    }
+  }
+}
+
+
+// ***************************************************************************
+// Each pass gives the anchors next to known ones the average of what the
+// known ones on each side extrapolate to, so the surface carries on
+// smoothly into invalid parts of the mesh and the valid nodes next to them
+// are still predicted closely.  Anchors with nothing known anywhere are
+// left at 0.
+void MeshCompactNodes::fillAnchors( char* bKnown ) throw()
+{
+  const long steps[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+  const long anchors = d_anchorWidth * d_height;
+  long anchor, col, row, step, closer, farther, count;
+  long closerCol, closerRow;
+  double sumX, sumY;
+  bool bFilled = true;
+
+  while ( bFilled )
+  {
+    bFilled = false;
+    for ( anchor = 0; anchor < anchors; anchor++ )
+    {
+      if ( bKnown[anchor] )
+        continue;
+
+      col = anchor % d_anchorWidth;
+      row = anchor / d_anchorWidth;
+      sumX = sumY = 0.0;
+      count = 0;
+      for ( step = 0; step < 4; step++ )
+      {
+        closerCol = col + steps[step][0];
+        closerRow = row + steps[step][1];
+        if ( closerCol < 0 || closerCol >= d_anchorWidth ||
+             closerRow < 0 || closerRow >= d_height )
+          continue;
+        closer = anchor + steps[step][1] * d_anchorWidth + steps[step][0];
+        if ( bKnown[closer] != 1 )
+          continue;
+
+        // Carry the line through the next two on if there are two
+        farther = closer + steps[step][1] * d_anchorWidth + steps[step][0];
+        closerCol += steps[step][0];
+        closerRow += steps[step][1];
+        if ( closerCol >= 0 && closerCol < d_anchorWidth &&
+             closerRow >= 0 && closerRow < d_height &&
+             1 == bKnown[farther] )
+        {
+          sumX += 2.0 * d_pAnchors[ 2 * closer ] -
+                  d_pAnchors[ 2 * farther ];
+          sumY += 2.0 * d_pAnchors[ 2 * closer + 1 ] -
+                  d_pAnchors[ 2 * farther + 1 ];
+        }
+        else
+        {
+          sumX += d_pAnchors[ 2 * closer ];
+          sumY += d_pAnchors[ 2 * closer + 1 ];
+        }
+        count++;
+      }
+
+      // Marked 2 until the pass is over so it doesn't feed its neighbours
+      if ( count > 0 )
+      {
+        d_pAnchors[ 2 * anchor ]     = sumX / count;
+        d_pAnchors[ 2 * anchor + 1 ] = sumY / count;
+        bKnown[anchor] = 2;
+        bFilled = true;
+      }
+    }
+
+    for ( anchor = 0; anchor < anchors; anchor++ )
+    {
+      if ( bKnown[anchor] )
+        bKnown[anchor] = 1;
+    }
+  }
+}
+
+
+// ***************************************************************************
+void MeshCompactNodes::clear() throw()
+{
+  delete [] d_pAnchors;
+  delete [] d_pOffsets;
+  d_pAnchors    = NULL;
+  d_pOffsets    = NULL;
+  d_width       = d_height = 0;
+  d_anchorWidth = 0;
+  d_maxError    = 0.0;
+}
+
+
+// ***************************************************************************
+void MeshCompactNodes::expand( double* nodeX, double* nodeY ) const throw()
+{
+  long row, col;
+
+  for ( row = 0; row < d_height; row++ )
+  {
+    for ( col = 0; col < d_width; col++ )
+      getNode( col, row, nodeX[ row * d_width + col ],
+               nodeY[ row * d_width + col ] );
+  }
+}
+
+
+// ***************************************************************************
+size_t MeshCompactNodes::getMemoryUsage() const throw()
+{
+  if ( !isBuilt() )
+    return 0;
+
+  return static_cast<size_t>( d_anchorWidth ) * d_height * 2 *
+    sizeof(double) +
+    static_cast<size_t>( d_width ) * d_height * 2 * sizeof(float);
+}
@@ -0,0 +1,283 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshCompactNodes keeps the projected nodes of a ProjectionMesh in under
+// two thirds of the memory of the double arrays.  Over a few nodes of a
+// row the projected nodes nearly follow a straight line, so every eighth
+// node of each row, and the last, is kept in doubles as an anchor and
+// each node only as the float offset of its x and y from the line between
+// the anchors either side.  A float rounds an offset by up to about one
+// part in ten million, so the error grows with how far the nodes curve
+// away from those lines.  Meshing plate carree onto a Lambert conformal
+// conic (see benchmarks/AccuracyHarness.cpp) with 257 x 257 nodes, packing
+// rounded the nodes by at most 0.0002 mm over a 7 x 4 degree state and
+// 0.017 mm over the conterminous US, and 0.001 mm with 1025 x 1025.
+// Anchors on invalid nodes are filled in from the valid anchors around
+// them.  The largest difference between a packed and an original valid
+// node is measured as the nodes are packed, and
+// ProjectionMesh::getCompactReport() gives it as maxNodeError to check
+// against the accuracy needed.
+//
+// MeshCompactQuery projects points through packed nodes with the same
+// policies as MeshQuery.  When a point lands in a new cell only the nodes
+// its policy reads are unpacked, into a small block laid out like the
+// mesh, and the policy sets the cell up from that.  It reads the nodes of
+// a MeshTileStore the same way.  The answers then differ from a MeshQuery
+// on the original nodes only by the rounding of those nodes: by at most
+// the largest node error for the bilinear and plane policies, whose
+// weights are positive and add up to 1, and by at most three times it for
+// the bicubic.
+
+#ifndef _MESHCOMPACT_H_
+#define _MESHCOMPACT_H_
+
+#include <new>
+#include <stddef.h>
+#include "MeshBitmap.h"
+#include "MeshKernels.h"
+
+namespace PmeshLib
+{
+
+class MeshCompactNodes
+{
+ public:
+  MeshCompactNodes() throw();
+  ~MeshCompactNodes();
+
+  /* Packs the <width> x <height> nodes <nodeX>, <nodeY>.  Only the nodes
+     set in <nodeValid> are used as anchors or count towards the largest
+     error */
+  void build( const double* nodeX, const double* nodeY,
+              const MeshBitWord* nodeValid, long width, long height )
+    throw(std::bad_alloc);
+
+  /* Throws the packed nodes away */
+  void clear() throw();
+
+  /* Returns true if the nodes have been packed */
+  bool isBuilt() const throw();
+
+  /* Unpacks the node at <col>, <row> into <x>, <y> */
+  void getNode( long col, long row, double& x, double& y ) const throw();
+
+  /* Unpacks the <size> x <size> nodes from <firstCol>, <firstRow> into
+     <blockX> and <blockY> row by row.  Nodes past the last column or row
+     repeat it */
+  void getBlock( long firstCol, long firstRow, long size,
+                 double* blockX, double* blockY ) const throw();
+
+  /* Unpacks every node into <nodeX> and <nodeY>, which hold width x
+     height doubles each */
+  void expand( double* nodeX, double* nodeY ) const throw();
+
+  /* Gets the largest distance between a packed valid node and the
+     original */
+  double getMaxError() const throw();
+
+  /* Gets the number of bytes the packed nodes use */
+  size_t getMemoryUsage() const throw();
+
+ private:
+  // Not copyable
+  MeshCompactNodes( const MeshCompactNodes& );
+  MeshCompactNodes& operator=( const MeshCompactNodes& );
+
+  // Nodes between anchors along a row
+  enum { ANCHOR_SPACING = 8 };
+
+  /* Fills in the anchors on invalid nodes from the valid ones around
+     them, in their row and the rows either side.  <bKnown> flags the
+     anchors that have values */
+  void fillAnchors( char* bKnown ) throw();
+
+  /* Predicts the node at <col>, <row> from the anchors either side of it
+     in its row */
+  void predict( long col, long row, double& x, double& y ) const throw();
+
+  long    d_width, d_height;
+  long    d_anchorWidth;     // anchors in each row
+  double* d_pAnchors;       // x and y of every ANCHOR_SPACING'th node of
+                            // each row, and the last, row by row
+  float*  d_pOffsets;       // x then y offset of each node from its
+                            // prediction, row by row
+  double  d_maxError;
+};
+
+
+// ***************************************************************************
+// Projects through packed nodes like MeshQuery<Policy> through the
+// originals.  <Nodes> can be anything with isBuilt() and getBlock() like
+// MeshCompactNodes.  The policy also needs
+//
+//   enum { STENCIL = n };            nodes across the block load() reads
+//   static long stencilStart( long index, long length );
+//                                    first column or row of that block for
+//                                    the cell at <index> of <length> nodes
+template <class Policy, class Nodes = MeshCompactNodes>
+class MeshCompactQuery
+{
+ public:
+  /* Queries <nodes> with the bounds and cell validity of <grid>, both of
+     which must stay in place while this is used */
+  MeshCompactQuery( const MeshKernelGrid& grid, const Nodes& nodes ) throw()
+    : d_grid(grid), d_nodes(nodes)
+  {
+  }
+
+  /* Returns true if the nodes are packed and suit the policy */
+  bool fits() const throw()
+  {
+    return ( d_nodes.isBuilt() &&
+             Policy::fits( d_grid.width, d_grid.height ) );
+  }
+
+  /* Projects <count> points spaced <stride> doubles apart in place, the
+     same as MeshQuery::projectPoints() */
+  long projectPoints( double* x, double* y, long stride, long count,
+                      bool* valid ) const throw()
+  {
+    double cell[ Policy::CELL_SIZE ];
+    double col, row;
+    long leftCol, topRow;
+    long lastCol = -1, lastRow = -1;
+    long counter, projected = 0;
+    bool bCellValid = false, bProjected;
+
+    for ( counter = 0; counter < count; counter++ )
+    {
+      double& px = x[ counter * stride ];
+      double& py = y[ counter * stride ];
+
+      col = ( px - d_grid.left ) / d_grid.horizSpacing;
+      row = ( d_grid.top - py ) / d_grid.vertSpacing;
+      bProjected = false;
+
+      // The same test and truncation as ProjectionMesh::locateCell()
+      if ( col > -1.0 && col < d_grid.width &&
+           row > -1.0 && row < d_grid.height )
+      {
+        leftCol = static_cast<long>( col );
+        topRow  = static_cast<long>( row );
+
+        if ( leftCol != lastCol || topRow != lastRow )
+        {
+          lastCol = leftCol;
+          lastRow = topRow;
+          bCellValid = testBit( d_grid.cellValid,
+                                topRow * d_grid.width + leftCol );
+          if ( bCellValid )
+            load( leftCol, topRow, cell );
+        }
+
+        if ( bCellValid )
+        {
+          Policy::evaluate( cell, col - leftCol, row - topRow, px, py );
+          bProjected = true;
+        }
+      }
+
+      if ( valid )
+        valid[counter] = bProjected;
+      if ( bProjected )
+        projected++;
+    }
+    return projected;
+  }
+
+ private:
+  /* Unpacks the block of nodes the cell at <col>, <row> reads and sets
+     the cell up from it.  Nodes past the last column or row repeat it,
+     the way the policies treat the cells on the edges. */
+  void load( long col, long row, double* cell ) const throw()
+  {
+    double blockX[ Policy::STENCIL * Policy::STENCIL ];
+    double blockY[ Policy::STENCIL * Policy::STENCIL ];
+    const long firstCol = Policy::stencilStart( col, d_grid.width );
+    const long firstRow = Policy::stencilStart( row, d_grid.height );
+
+    d_nodes.getBlock( firstCol, firstRow, Policy::STENCIL, blockX, blockY );
+    Policy::load( blockX, blockY, Policy::STENCIL, Policy::STENCIL,
+                  col - firstCol, row - firstRow, cell );
+  }
+
+  MeshKernelGrid d_grid;
+  const Nodes&   d_nodes;
+};
+
+
+// ***************************************************************************
+inline
+bool MeshCompactNodes::isBuilt() const throw()
+{
+  return ( NULL != d_pOffsets );
+}
+
+
+// ***************************************************************************
+inline
+void MeshCompactNodes::predict( long col, long row, double& x, double& y )
+  const throw()
+{
+  long anchor = col / ANCHOR_SPACING;
+  long start, end;
+
+  if ( anchor > d_anchorWidth - 2 )
+    anchor = ( d_anchorWidth > 1 ) ? d_anchorWidth - 2 : 0;
+  start = anchor * ANCHOR_SPACING;
+  end   = ( start + ANCHOR_SPACING < d_width ) ? start + ANCHOR_SPACING :
+          d_width - 1;
+
+  const double* first = d_pAnchors + 2 * ( row * d_anchorWidth + anchor );
+  const long next = ( anchor + 1 < d_anchorWidth ) ? 2 : 0;
+  const double fraction = ( end > start ) ?
+    static_cast<double>( col - start ) / ( end - start ) : 0.0;
+
+  x = first[0] + ( first[next] - first[0] ) * fraction;
+  y = first[1] + ( first[next + 1] - first[1] ) * fraction;
+}
+
+
+// ***************************************************************************
+inline
+void MeshCompactNodes::getNode( long col, long row, double& x, double& y )
+  const throw()
+{
+  const float* offset = d_pOffsets + 2 * ( row * d_width + col );
+
+  predict( col, row, x, y );
+  x += offset[0];
+  y += offset[1];
+}
+
+
+// ***************************************************************************
+inline
+void MeshCompactNodes::getBlock( long firstCol, long firstRow, long size,
+                                 double* blockX, double* blockY ) const
+  throw()
+{
+  long r, k, col, row;
+
+  for ( r = 0; r < size; r++ )
+  {
+    row = ( firstRow + r < d_height ) ? firstRow + r : d_height - 1;
+    for ( k = 0; k < size; k++ )
+    {
+      col = ( firstCol + k < d_width ) ? firstCol + k : d_width - 1;
+      getNode( col, row, blockX[ r * size + k ], blockY[ r * size + k ] );
+    }
+  }
+}
+
+
+// ***************************************************************************
+inline
+double MeshCompactNodes::getMaxError() const throw()
+{
+  return d_maxError;
+}
+
+} // namespace
+
+#endif
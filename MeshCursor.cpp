@@ -0,0 +1,336 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshCursor class
+
+#include "MeshCursor.h"
+#include <math.h>
+
+using namespace PmeshLib;
+
+
+// ***************************************************************************
+// Works out how the mesh's cells should be interpolated, the same way
+// ProjectionMesh::interpolateStrided() does
+MeshCursor::MeshCursor( const ProjectionMesh& mesh ) throw(PmeshException)
+  : d_mesh(mesh), d_mode(MESH), d_type(mesh.d_interpolatorType),
+    d_col(-1), d_row(-1), d_bCellValid(false), d_cellHits(0),
+    d_cellMoves(0)
+{
+  if ( !mesh.hasNodes() )
+    throw PmeshException(PMESH_NOT_CREATED_YET);
+
+  mesh.getKernelGrid( d_grid );
+
+  // Lazy meshes fill tiles in as they're needed, refined ones go through
+  // the quadtree, hybrid ones project some cells exactly and compact and
+  // tiled ones have no double nodes, all of which projectPoint() takes
+  // care of
+  if ( mesh.d_pTileReady || mesh.d_quadtree.isBuilt() ||
+       mesh.d_pCellError || !mesh.d_pNodeX )
+    return;
+
+  // Without the closed forms the MathLib interpolators are used
+  switch ( d_type )
+  {
+  case MathLib::DlgViewer:
+  case MathLib::BiLinear:
+  case MathLib::BiPolynomial:
+  case MathLib::LeastSquaresPlane:
+    if ( mesh.d_bClosedForm )
+      d_mode = LINEAR;
+    break;
+
+  case MathLib::BiCubic:
+    if ( mesh.d_bClosedForm &&
+         MeshBicubicPolicy::fits( d_grid.width, d_grid.height ) )
+      d_mode = BICUBIC;
+    break;
+
+  case MathLib::BiCubicSpline:
+    if ( mesh.d_spline.isBuilt() )
+      d_mode = SPLINE;
+    break;
+  }
+}
+
+
+// ***************************************************************************
+long MeshCursor::projectPoints( double* x, double* y, long count,
+                                bool* valid ) throw(PmeshException)
+{
+  long counter, projected = 0;
+  bool bProjected;
+
+  for ( counter = 0; counter < count; counter++ )
+  {
+    bProjected = projectPoint( x[counter], y[counter] );
+
+    if ( valid )
+      valid[counter] = bProjected;
+    if ( bProjected )
+      projected++;
+  }
+  return projected;
+}
+
+
+// ***************************************************************************
+// Walks each segment from grid crossing to grid crossing, carrying the
+// projected end of one piece over as the start of the next
+long MeshCursor::projectPolyline( const double* x, const double* y,
+                                  long count, double tolerance,
+                                  std::vector<double>& outX,
+                                  std::vector<double>& outY,
+                                  std::vector<bool>* valid )
+  throw(PmeshException, std::bad_alloc)
+{
+  // Crossings closer than this, as a fraction of the segment, are taken
+  // to be the same point, such as where a segment passes through a node
+  const double sameCrossing = 1e-9;
+  const bool bStraight = ( LINEAR == d_mode &&
+                            MathLib::LeastSquaresPlane == d_type );
+  std::vector<double> colCrossings, rowCrossings, pieceEnds;
+  std::vector<double> stepX( 1 ), stepY( 1 );
+  std::vector<bool> stepValid( 1 );
+  double startX, startY, endX, endY, midX, midY;
+  double dx, dy, pieceStart, pieceEnd, step, deviation, crossing;
+  long segment, piece, steps, k;
+  unsigned long colIndex, rowIndex;
+  long projected = 0;
+  bool bStart, bEnd;
+
+  outX.clear();
+  outY.clear();
+  if ( valid )
+    valid->clear();
+  if ( count <= 0 )
+    return 0;
+
+  startX = x[0];
+  startY = y[0];
+  bStart = projectPoint( startX, startY );
+
+  for ( segment = 1; segment < count; segment++ )
+  {
+    const double fromX = x[ segment - 1 ], fromY = y[ segment - 1 ];
+
+    dx = x[segment] - fromX;
+    dy = y[segment] - fromY;
+
+    // Where the segment enters a new cell, in order along it
+    colCrossings.clear();
+    rowCrossings.clear();
+    pieceEnds.clear();
+    gridCrossings( ( fromX - d_grid.left ) / d_grid.horizSpacing,
+                   ( x[segment] - d_grid.left ) / d_grid.horizSpacing,
+                   d_grid.width - 1, colCrossings );
+    gridCrossings( ( d_grid.top - fromY ) / d_grid.vertSpacing,
+                   ( d_grid.top - y[segment] ) / d_grid.vertSpacing,
+                   d_grid.height - 1, rowCrossings );
+
+    colIndex = rowIndex = 0;
+    while ( colIndex < colCrossings.size() || rowIndex < rowCrossings.size() )
+    {
+      if ( rowIndex >= rowCrossings.size() ||
+           ( colIndex < colCrossings.size() &&
+             colCrossings[colIndex] < rowCrossings[rowIndex] ) )
+        crossing = colCrossings[ colIndex++ ];
+      else
+        crossing = rowCrossings[ rowIndex++ ];
+
+      if ( crossing > ( pieceEnds.empty() ? 0.0 : pieceEnds.back() ) +
+                      sameCrossing &&
+           crossing < 1.0 - sameCrossing )
+        pieceEnds.push_back( crossing );
+    }
+    pieceEnds.push_back( 1.0 );
+
+    pieceStart = 0.0;
+    for ( piece = 0; piece < static_cast<long>( pieceEnds.size() ); piece++ )
+    {
+      pieceEnd = pieceEnds[piece];
+      if ( 1.0 == pieceEnd )
+      {
+        endX = x[segment];
+        endY = y[segment];
+      }
+      else
+      {
+        endX = fromX + dx * pieceEnd;
+        endY = fromY + dy * pieceEnd;
+      }
+      bEnd = projectPoint( endX, endY );
+
+      // Within a cell the deviation from the chord is largest in the
+      // middle.  The plane is straight within a cell and only jumps at
+      // its edges, which no vertices can follow.
+      steps = 1;
+      if ( bStart && bEnd && tolerance > 0.0 && !bStraight )
+      {
+        midX = fromX + dx * ( pieceStart + pieceEnd ) * 0.5;
+        midY = fromY + dy * ( pieceStart + pieceEnd ) * 0.5;
+        if ( projectPoint( midX, midY ) )
+        {
+          deviation = hypot( midX - ( startX + endX ) * 0.5,
+                             midY - ( startY + endY ) * 0.5 );
+          if ( deviation > tolerance )
+            steps = divideSteps( 1, deviation, tolerance );
+        }
+      }
+
+      stepX[0] = startX;
+      stepY[0] = startY;
+      for ( ;; )
+      {
+        step = ( pieceEnd - pieceStart ) / steps;
+        stepX.resize( steps + 1 );
+        stepY.resize( steps + 1 );
+        stepValid.resize( steps + 1 );
+        stepValid[0] = bStart;
+        for ( k = 1; k < steps; k++ )
+        {
+          stepX[k] = fromX + dx * ( pieceStart + k * step );
+          stepY[k] = fromY + dy * ( pieceStart + k * step );
+          stepValid[k] = projectPoint( stepX[k], stepY[k] );
+        }
+        stepX[steps] = endX;
+        stepY[steps] = endY;
+        stepValid[steps] = bEnd;
+
+        // The bilinear interpolators are parabolas within a cell, so the
+        // steps are right first time.  The cubics and refined meshes
+        // aren't, so the middle of each step is checked and the piece
+        // divided further if any is still off.
+        if ( LINEAR == d_mode || 1 == steps || steps >= MESH_CURSOR_MAX_STEPS )
+          break;
+
+        deviation = 0.0;
+        for ( k = 0; k < steps; k++ )
+        {
+          if ( !stepValid[k] || !stepValid[ k + 1 ] )
+            continue;
+          midX = fromX + dx * ( pieceStart + ( k + 0.5 ) * step );
+          midY = fromY + dy * ( pieceStart + ( k + 0.5 ) * step );
+          if ( !projectPoint( midX, midY ) )
+            continue;
+          midX -= ( stepX[k] + stepX[ k + 1 ] ) * 0.5;
+          midY -= ( stepY[k] + stepY[ k + 1 ] ) * 0.5;
+          if ( hypot( midX, midY ) > deviation )
+            deviation = hypot( midX, midY );
+        }
+        if ( deviation <= tolerance )
+          break;
+        steps = divideSteps( steps, deviation, tolerance );
+      }
+
+      for ( k = 0; k < steps; k++ )
+      {
+        addVertex( stepX[k], stepY[k], stepValid[k], outX, outY, valid );
+        if ( stepValid[k] )
+          projected++;
+      }
+
+      startX = endX;
+      startY = endY;
+      bStart = bEnd;
+      pieceStart = pieceEnd;
+    }
+  }
+
+  addVertex( startX, startY, bStart, outX, outY, valid );
+  if ( bStart )
+    projected++;
+  return projected;
+}
+
+
+// ***************************************************************************
+// n equal steps leave 1 / n^2 of the deviation.  A deviation only just
+// over the tolerance can round back to <steps>, which would measure the
+// same deviation again and never finish, so there's always at least one
+// more.
+long MeshCursor::divideSteps( long steps, double deviation, double tolerance )
+  throw()
+{
+  double divided = ceil( steps * sqrt( deviation / tolerance ) );
+
+  if ( divided <= steps )
+    divided = steps + 1;
+  return ( divided < MESH_CURSOR_MAX_STEPS ) ?
+         static_cast<long>( divided ) : MESH_CURSOR_MAX_STEPS;
+}
+
+
+// ***************************************************************************
+void MeshCursor::addVertex( double x, double y, bool bProjected,
+                            std::vector<double>& outX,
+                            std::vector<double>& outY,
+                            std::vector<bool>* valid ) throw(std::bad_alloc)
+{
+  outX.push_back( x );
+  outY.push_back( y );
+  if ( valid )
+    valid->push_back( bProjected );
+}
+
+
+// ***************************************************************************
+// locateCell() truncates, so the cell index changes at the whole numbers
+// 1 to <last>.  Anything beyond them is outside the mesh and left alone.
+void MeshCursor::gridCrossings( double from, double to, long last,
+                                std::vector<double>& crossings )
+  throw(std::bad_alloc)
+{
+  double first, final, line;
+
+  if ( from < to )
+  {
+    first = ( from < 0.0 ) ? 1.0 : floor( from ) + 1.0;
+    final = ( to > last ) ? last : ceil( to ) - 1.0;
+    for ( line = first; line <= final; line += 1.0 )
+      crossings.push_back( ( line - from ) / ( to - from ) );
+  }
+  else if ( from > to )
+  {
+    first = ( from > last ) ? last : ceil( from ) - 1.0;
+    final = ( to < 0.0 ) ? 1.0 : floor( to ) + 1.0;
+    for ( line = first; line >= final; line -= 1.0 )
+      crossings.push_back( ( from - line ) / ( from - to ) );
+  }
+}
+
+
+// ***************************************************************************
+// Sets the cell up the way the MeshQuery policies do
+void MeshCursor::moveTo( long col, long row ) throw()
+{
+  d_col = col;
+  d_row = row;
+  d_cellMoves++;
+
+  d_bCellValid = testBit( d_grid.cellValid, row * d_grid.width + col );
+  if ( !d_bCellValid )
+    return;
+
+  switch ( d_mode )
+  {
+  case LINEAR:
+    if ( MathLib::LeastSquaresPlane == d_type )
+      MeshPlanePolicy::load( d_grid.nodeX, d_grid.nodeY, d_grid.width,
+                             d_grid.height, col, row, d_cell );
+    else
+      MeshBilinearPolicy::load( d_grid.nodeX, d_grid.nodeY, d_grid.width,
+                                d_grid.height, col, row, d_cell );
+    break;
+
+  case BICUBIC:
+    MeshBicubicPolicy::load( d_grid.nodeX, d_grid.nodeY, d_grid.width,
+                             d_grid.height, col, row, d_cell );
+    break;
+
+  default:
+    d_mesh.d_spline.loadCell( d_grid, col, row, d_cell );
+    break;
+  }
+}
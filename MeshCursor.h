@@ -0,0 +1,204 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshCursor projects a stream of nearby points through a ProjectionMesh,
+// such as the vertices of DLG line and area features, which nearly
+// always fall in the same cell as the vertex before or the one next to
+// it.  The cursor remembers the cell the last point fell in, set up for
+// interpolation, and while the points stay in it only has to work out
+// where they are in the cell and evaluate it.  When a point leaves, the
+// cell it moved to is found directly from the grid and set up in its
+// place.  Unlike the batch functions the cell is kept from one call to
+// the next, so a feature can be projected a vertex at a time.
+//
+// The cursor interpolates the same way the batch functions do, through
+// the policies in MeshQuery.h if the mesh has setClosedForm() on or the
+// global spline, so its answers agree with projectPoint() to within
+// rounding.  Other meshes, and lazy, adaptively refined, hybrid, compact
+// and tiled ones, are projected with projectPoint() a point at a time.
+//
+// A cursor holds its own state and only reads the mesh, so any number of
+// threads can each project through their own cursor on one mesh.  A
+// cursor must not be shared between threads, and must be made again if
+// the mesh is calculated, loaded or resized.  Points projected through a
+// cursor aren't counted in the mesh's stats.
+//
+// projectPolyline() projects line work, adding vertices where the mesh
+// would bend a straight source segment further than a tolerance.  The
+// interpolation is only smooth inside a cell, so the segment is split
+// where it crosses the grid lines between cells and each piece is
+// densified on its own: straight pieces get no vertices and curved ones
+// get evenly spaced ones, as many as their curvature needs.
+
+#ifndef _MESHCURSOR_H_
+#define _MESHCURSOR_H_
+
+#include "ProjectionMesh.h"
+#include <vector>
+
+namespace PmeshLib
+{
+
+// Most vertices projectPolyline() adds inside one cell
+#define MESH_CURSOR_MAX_STEPS 1024
+
+class MeshCursor
+{
+ public:
+  /* A cursor on <mesh>.  Throws PMESH_NOT_CREATED_YET if the mesh hasn't
+     been calculated */
+  explicit MeshCursor( const ProjectionMesh& mesh ) throw(PmeshException);
+
+  /* Projects <x>, <y> in place, the same as ProjectionMesh::projectPoint()
+     but reusing the last point's cell.  Returns false if the point is
+     outside the mesh or in an invalid cell */
+  bool projectPoint( double& x, double& y ) throw(PmeshException);
+
+  /* Projects <count> points in place, the same as
+     ProjectionMesh::projectPoints() */
+  long projectPoints( double* x, double* y, long count, bool* valid = NULL )
+    throw(PmeshException);
+
+  /* Projects the polyline through the <count> source vertices <x>, <y>
+     into <outX> and <outY>, densified so that the projected line stays
+     within <tolerance> destination units of the mesh's projection of the
+     source segments.  Each segment is split at the grid lines it crosses.
+     Each piece between them has its ends and its middle projected, and
+     if the middle is further than <tolerance> from the middle of the
+     chord the piece is divided into the fewest equal steps that bring it
+     within tolerance, the deviation falling with the square of the step.
+     For the DlgViewer, BiLinear and BiPolynomial interpolators a piece is
+     a parabola, so this is exact and minimal, and for the plane it is a
+     straight line and never divided.  For the cubics and refined meshes
+     the middle of each step is checked too and the piece divided further
+     until they all pass, which bounds the deviation closely but not
+     exactly.  At most MESH_CURSOR_MAX_STEPS steps are taken in a piece.
+     A <tolerance> of 0 adds only the grid crossings.  Vertices
+     that fail are left as the unprojected source points and pieces
+     touching them aren't divided.  If <valid> is not NULL it is filled in
+     alongside <outX> and <outY>.  Returns the number of vertices output
+     that were projected */
+  long projectPolyline( const double* x, const double* y, long count,
+                        double tolerance, std::vector<double>& outX,
+                        std::vector<double>& outY,
+                        std::vector<bool>* valid = NULL )
+    throw(PmeshException, std::bad_alloc);
+
+  /* Gets how many points landed in the same cell as the point before
+     and how many in a different one */
+  unsigned long getCellHits() const throw();
+  unsigned long getCellMoves() const throw();
+
+ private:
+  // How the cells are interpolated
+  enum Mode
+  {
+    LINEAR,     // bilinear or plane coefficients in d_cell
+    BICUBIC,    // a MeshBicubicPolicy cell in d_cell
+    SPLINE,     // a MeshSpline cell in d_cell
+    MESH        // ProjectionMesh::projectPoint()
+  };
+
+  // Room in d_cell for the bigger of the cells it can hold.  The two
+  // sizes are from different enums, so they're compared as longs.
+  static const long CELL_SIZE =
+    ( static_cast<long>( MeshSpline::CELL_SIZE ) >
+      static_cast<long>( MeshBicubicPolicy::CELL_SIZE ) ) ?
+    static_cast<long>( MeshSpline::CELL_SIZE ) :
+    static_cast<long>( MeshBicubicPolicy::CELL_SIZE );
+
+  /* Makes the cell at <col>, <row> current */
+  void moveTo( long col, long row ) throw();
+
+  /* Gets how many steps to divide <steps> equal steps, the worst of
+     which is <deviation> from its chord, into to bring them all within
+     <tolerance>.  Always more than <steps>, up to MESH_CURSOR_MAX_STEPS */
+  static long divideSteps( long steps, double deviation, double tolerance )
+    throw();
+
+  /* Appends the vertex <x>, <y> to the polyline being output */
+  static void addVertex( double x, double y, bool bProjected,
+                         std::vector<double>& outX, std::vector<double>& outY,
+                         std::vector<bool>* valid ) throw(std::bad_alloc);
+
+  /* Appends to <crossings>, in increasing order, the fractions of the
+     way from <from> to <to> at which a grid coordinate crosses the lines
+     1 to <last> between cells */
+  static void gridCrossings( double from, double to, long last,
+                             std::vector<double>& crossings )
+    throw(std::bad_alloc);
+
+  const ProjectionMesh& d_mesh;
+  MeshKernelGrid d_grid;
+  Mode           d_mode;
+  long           d_type;        // interpolator when d_mode is LINEAR
+  long           d_col, d_row;  // current cell, -1 for none
+  bool           d_bCellValid;
+  double         d_cell[ CELL_SIZE ];
+  unsigned long  d_cellHits;
+  unsigned long  d_cellMoves;
+};
+
+
+// ***************************************************************************
+inline
+bool MeshCursor::projectPoint( double& x, double& y ) throw(PmeshException)
+{
+  double col, row;
+  long leftCol, topRow;
+
+  if ( MESH == d_mode )
+    return d_mesh.projectPoint( x, y );
+
+  // The same test and truncation as ProjectionMesh::locateCell()
+  col = ( x - d_grid.left ) / d_grid.horizSpacing;
+  row = ( d_grid.top - y ) / d_grid.vertSpacing;
+  if ( !( col > -1.0 && col < d_grid.width &&
+          row > -1.0 && row < d_grid.height ) )
+    return false;
+
+  leftCol = static_cast<long>( col );
+  topRow  = static_cast<long>( row );
+  if ( leftCol == d_col && topRow == d_row )
+    d_cellHits++;
+  else
+    moveTo( leftCol, topRow );
+
+  if ( !d_bCellValid )
+    return false;
+
+  switch ( d_mode )
+  {
+  case LINEAR:
+    MeshCoefficients::evaluateLinear( d_cell, col - leftCol, row - topRow,
+                                      x, y );
+    break;
+  case BICUBIC:
+    MeshBicubicPolicy::evaluate( d_cell, col - leftCol, row - topRow, x, y );
+    break;
+  default:
+    MeshSpline::evaluateCell( d_cell, col - leftCol, row - topRow, x, y );
+    break;
+  }
+  return true;
+}
+
+
+// ***************************************************************************
+inline
+unsigned long MeshCursor::getCellHits() const throw()
+{
+  return d_cellHits;
+}
+
+
+// ***************************************************************************
+inline
+unsigned long MeshCursor::getCellMoves() const throw()
+{
+  return d_cellMoves;
+}
+
+} // namespace
+
+#endif
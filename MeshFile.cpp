@@ -0,0 +1,294 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshFile class
+
+#include "MeshFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace PmeshLib;
+
+namespace
+{
+const char         MAGIC[8] = { 'P', 'M', 'E', 'S', 'H', 'M', 'A', 'P' };
+const unsigned int BYTE_ORDER_MARK = 0x01020304;
+
+// The header has to fit in the space set aside for it
+typedef char HeaderFits[ sizeof(MeshFileHeader) <= MESH_FILE_HEADER_SIZE
+                         ? 1 : -1 ];
+
+// Folds <size> bytes into the two halves of a key.  Each half is a 32 bit
+// FNV-1a hash, started from a different basis so they are independent.
+void hashBytes( const void* data, size_t size, unsigned int key[2] ) throw()
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>( data );
+
+  for ( size_t counter = 0; counter < size; counter++ )
+  {
+    key[0] = ( key[0] ^ bytes[counter] ) * 16777619u;
+    key[1] = ( key[1] ^ bytes[counter] ) * 16777619u;
+  }
+}
+
+// Writes <size> bytes, returning false on any error
+bool writeBytes( FILE* file, const void* data, size_t size ) throw()
+{
+  return 0 == size || 1 == fwrite( data, size, 1, file );
+}
+}
+
+
+// ***************************************************************************
+MeshFile::MeshFile() throw()
+  : d_pBase(NULL), d_size(0)
+#if defined(_WIN32)
+  , d_hMapping(NULL)
+#endif
+{
+}
+
+
+// ***************************************************************************
+MeshFile::~MeshFile()
+{
+  unmap();
+}
+
+
+// ***************************************************************************
+size_t MeshFile::fileSize( long width, long height ) throw()
+{
+  size_t nodes = static_cast<size_t>( width ) * height;
+
+  return MESH_FILE_HEADER_SIZE + 2 * nodes * sizeof(double) +
+    2 * bitmapWords( width * height ) * sizeof(MeshBitWord);
+}
+
+
+// ***************************************************************************
+void MeshFile::makeKey( const ProjLib::Projection& sourceProj,
+                        const ProjLib::Projection& destProj,
+                        double left, double top,
+                        double sourceWidth, double sourceHeight,
+                        long width, long height, unsigned int key[2] )
+  throw()
+{
+  std::string description;
+  double bounds[4];
+  long   size[2];
+
+  key[0] = 2166136261u;
+  key[1] = 2166136261u ^ 0x5bd1e995u;
+
+  // The separator keeps "ab" + "c" apart from "a" + "bc"
+  description = sourceProj.toString();
+  hashBytes( description.data(), description.size() + 1, key );
+  description = destProj.toString();
+  hashBytes( description.data(), description.size() + 1, key );
+
+  bounds[0] = left;
+  bounds[1] = top;
+  bounds[2] = sourceWidth;
+  bounds[3] = sourceHeight;
+  size[0]   = width;
+  size[1]   = height;
+  hashBytes( bounds, sizeof(bounds), key );
+  hashBytes( size, sizeof(size), key );
+}
+
+
+// ***************************************************************************
+bool MeshFile::write( const char* path, const MeshFileHeader& header,
+                      const double* nodeX, const double* nodeY,
+                      const MeshBitWord* nodeValid,
+                      const MeshBitWord* cellValid ) throw()
+{
+  char           block[MESH_FILE_HEADER_SIZE];
+  MeshFileHeader written = header;
+  size_t         nodes;
+  size_t         words;
+  char           suffix[32];
+  std::string    tempPath;
+  FILE*          file;
+  bool           bWritten;
+
+  memcpy( written.magic, MAGIC, sizeof(MAGIC) );
+  written.version   = MESH_FILE_VERSION;
+  written.byteOrder = BYTE_ORDER_MARK;
+  written.reserved  = 0;
+
+  memset( block, 0, sizeof(block) );
+  memcpy( block, &written, sizeof(written) );
+
+  nodes = static_cast<size_t>( header.width ) * header.height;
+  words = bitmapWords( header.width * header.height );
+
+  // Each process writes its own temporary so that several of them saving
+  // the same mesh at once don't trip over each other
+#if defined(_WIN32)
+  sprintf( suffix, ".%lu.tmp",
+           static_cast<unsigned long>( GetCurrentProcessId() ) );
+#else
+  sprintf( suffix, ".%lu.tmp", static_cast<unsigned long>( getpid() ) );
+#endif
+
+  try
+  {
+    tempPath = std::string( path ) + suffix;
+  }
+  catch(...)
+  {
+    return false;
+  }
+
+  if ( !( file = fopen( tempPath.c_str(), "wb" ) ) )
+    return false;
+
+  bWritten = writeBytes( file, block, sizeof(block) ) &&
+    writeBytes( file, nodeX, nodes * sizeof(double) ) &&
+    writeBytes( file, nodeY, nodes * sizeof(double) ) &&
+    writeBytes( file, nodeValid, words * sizeof(MeshBitWord) ) &&
+    writeBytes( file, cellValid, words * sizeof(MeshBitWord) );
+
+  bWritten = ( 0 == fclose( file ) ) && bWritten;
+
+  // Swap the finished file in.  Anyone who already has the old one mapped
+  // keeps their copy.
+#if defined(_WIN32)
+  bWritten = bWritten &&
+    0 != MoveFileExA( tempPath.c_str(), path, MOVEFILE_REPLACE_EXISTING );
+#else
+  bWritten = bWritten && ( 0 == rename( tempPath.c_str(), path ) );
+#endif
+
+  if ( !bWritten )
+    remove( tempPath.c_str() );
+
+  return bWritten;
+}
+
+
+// ***************************************************************************
+bool MeshFile::map( const char* path ) throw()
+{
+  const MeshFileHeader* header;
+  const char* base = NULL;
+  size_t size = 0;
+
+  unmap();
+
+#if defined(_WIN32)
+  HANDLE hFile, hMapping = NULL;
+  DWORD  sizeHigh;
+
+  hFile = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+  if ( INVALID_HANDLE_VALUE == hFile )
+    return false;
+
+  size = GetFileSize( hFile, &sizeHigh );
+  if ( 0 == sizeHigh && size >= MESH_FILE_HEADER_SIZE &&
+       ( hMapping = CreateFileMappingA( hFile, NULL, PAGE_READONLY,
+                                        0, 0, NULL ) ) )
+  {
+    base = static_cast<const char*>(
+      MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 ) );
+  }
+  CloseHandle( hFile );
+
+  if ( !base )
+  {
+    if ( hMapping )
+      CloseHandle( hMapping );
+    return false;
+  }
+  d_hMapping = hMapping;
+#else
+  struct stat status;
+  int fd;
+  void* mapping;
+
+  if ( ( fd = open( path, O_RDONLY ) ) < 0 )
+    return false;
+
+  if ( 0 == fstat( fd, &status ) &&
+       status.st_size >= MESH_FILE_HEADER_SIZE )
+  {
+    size = static_cast<size_t>( status.st_size );
+    mapping = mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+    if ( MAP_FAILED != mapping )
+      base = static_cast<const char*>( mapping );
+  }
+
+  // The mapping stays good after the descriptor is closed
+  close( fd );
+
+  if ( !base )
+    return false;
+#endif
+
+  d_pBase = base;
+  d_size  = size;
+
+  // Make sure it's a mesh file we can use as is
+  header = &getHeader();
+  if ( 0 != memcmp( header->magic, MAGIC, sizeof(MAGIC) ) ||
+       MESH_FILE_VERSION != header->version ||
+       BYTE_ORDER_MARK != header->byteOrder ||
+       header->width < 1 || header->height < 1 ||
+       fileSize( header->width, header->height ) != d_size )
+  {
+    unmap();
+    return false;
+  }
+  return true;
+}
+
+
+// ***************************************************************************
+void MeshFile::swap( MeshFile& other ) throw()
+{
+  const char* base = d_pBase;
+  size_t      size = d_size;
+
+  d_pBase       = other.d_pBase;
+  d_size        = other.d_size;
+  other.d_pBase = base;
+  other.d_size  = size;
+#if defined(_WIN32)
+  void* hMapping   = d_hMapping;
+  d_hMapping       = other.d_hMapping;
+  other.d_hMapping = hMapping;
+#endif
+}
+
+
+// ***************************************************************************
+void MeshFile::unmap() throw()
+{
+  if ( !d_pBase )
+    return;
+
+#if defined(_WIN32)
+  UnmapViewOfFile( d_pBase );
+  CloseHandle( d_hMapping );
+  d_hMapping = NULL;
+#else
+  munmap( const_cast<char*>( d_pBase ), d_size );
+#endif
+
+  d_pBase = NULL;
+  d_size  = 0;
+}
@@ -0,0 +1,161 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshFile saves a calculated ProjectionMesh to disk and maps it back in.
+// The file is a fixed header followed by the node arrays exactly as the
+// mesh holds them in memory:
+//
+//   MeshFileHeader        MESH_FILE_HEADER_SIZE bytes
+//   double nodeX[n]       n = width * height
+//   double nodeY[n]
+//   MeshBitWord nodeValid[bitmapWords(n)]
+//   MeshBitWord cellValid[bitmapWords(n)]
+//
+// so a mapped file can be used in place, and every process mapping the
+// same file shares one read only copy of it.  Files are written in the
+// byte order of the machine writing them and are refused elsewhere.
+//
+// The header carries a key made from the projections' descriptions, the
+// source bounds and the mesh size, so a file can be checked against the
+// mesh a program is about to calculate before it is used.
+
+#ifndef _MESHFILE_H_
+#define _MESHFILE_H_
+
+#include <stddef.h>
+#include "ProjectionLib/Projection.h"
+#include "MeshBitmap.h"
+
+namespace PmeshLib
+{
+
+// The version written by this code.  Bump it whenever the layout changes.
+#define MESH_FILE_VERSION     1
+#define MESH_FILE_HEADER_SIZE 128
+
+struct MeshFileHeader
+{
+  char         magic[8];        // "PMESHMAP"
+  unsigned int version;         // MESH_FILE_VERSION
+  unsigned int byteOrder;       // 0x01020304 as written
+  unsigned int key[2];          // see MeshFile::makeKey()
+  int          width, height;   // mesh size in nodes
+  int          interpolator;    // interpolator type when saved
+  int          reserved;
+  double       left, top;       // source bounds
+  double       sourceWidth, sourceHeight;
+  double       horizSpacing, vertSpacing;
+};
+
+class MeshFile
+{
+ public:
+  MeshFile() throw();
+  ~MeshFile();
+
+  /* Works out the key of a mesh calculated from <sourceProj> to
+     <destProj> over the source bounds <left>, <top>, <sourceWidth>,
+     <sourceHeight> with <width> x <height> nodes */
+  static void makeKey( const ProjLib::Projection& sourceProj,
+                       const ProjLib::Projection& destProj,
+                       double left, double top,
+                       double sourceWidth, double sourceHeight,
+                       long width, long height, unsigned int key[2] )
+    throw();
+
+  /* Writes <header> and the node arrays to <path>.  The file is written
+     under a temporary name and renamed into place so that a process
+     mapping <path> never sees it half written.  The magic, version and
+     byte order of <header> are filled in here.  Returns false if the file
+     could not be written */
+  static bool write( const char* path, const MeshFileHeader& header,
+                     const double* nodeX, const double* nodeY,
+                     const MeshBitWord* nodeValid,
+                     const MeshBitWord* cellValid ) throw();
+
+  /* Maps <path> read only, unmapping anything already mapped.  Returns
+     false if the file can't be opened or isn't a complete mesh file of
+     this version and byte order */
+  bool map( const char* path ) throw();
+
+  /* Unmaps the file */
+  void unmap() throw();
+
+  /* Trades mappings with <other> */
+  void swap( MeshFile& other ) throw();
+
+  /* Returns true if a file is mapped */
+  bool isMapped() const throw();
+
+  /* Get the parts of the mapped file */
+  const MeshFileHeader& getHeader() const throw();
+  const double*         getNodeX() const throw();
+  const double*         getNodeY() const throw();
+  const MeshBitWord*    getNodeValid() const throw();
+  const MeshBitWord*    getCellValid() const throw();
+
+ private:
+  // Not copyable
+  MeshFile( const MeshFile& );
+  MeshFile& operator=( const MeshFile& );
+
+  /* Returns the size of a file holding a <width> x <height> mesh */
+  static size_t fileSize( long width, long height ) throw();
+
+  const char* d_pBase;         // start of the mapping, NULL if unmapped
+  size_t      d_size;
+#if defined(_WIN32)
+  void*       d_hMapping;      // the file mapping object
+#endif
+};
+
+
+// ***************************************************************************
+inline
+bool MeshFile::isMapped() const throw()
+{
+  return ( NULL != d_pBase );
+}
+
+// ***************************************************************************
+inline
+const MeshFileHeader& MeshFile::getHeader() const throw()
+{
+  return *reinterpret_cast<const MeshFileHeader*>( d_pBase );
+}
+
+// ***************************************************************************
+inline
+const double* MeshFile::getNodeX() const throw()
+{
+  return reinterpret_cast<const double*>( d_pBase + MESH_FILE_HEADER_SIZE );
+}
+
+// ***************************************************************************
+inline
+const double* MeshFile::getNodeY() const throw()
+{
+  return getNodeX() +
+    static_cast<size_t>( getHeader().width ) * getHeader().height;
+}
+
+// ***************************************************************************
+inline
+const MeshBitWord* MeshFile::getNodeValid() const throw()
+{
+  return reinterpret_cast<const MeshBitWord*>(
+    getNodeY() + static_cast<size_t>( getHeader().width ) *
+    getHeader().height );
+}
+
+// ***************************************************************************
+inline
+const MeshBitWord* MeshFile::getCellValid() const throw()
+{
+  return getNodeValid() +
+    bitmapWords( getHeader().width * getHeader().height );
+}
+
+} // namespace
+
+#endif
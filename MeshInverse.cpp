@@ -0,0 +1,345 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshInverse class
+
+#include "MeshInverse.h"
+#include <math.h>
+
+using namespace PmeshLib;
+
+namespace
+{
+// How far outside a cell, in cells, a point may land and still count as
+// inside.  It only needs to cover rounding along shared edges.
+const double EDGE_SLOP = 1e-9;
+
+// Most points converge in three or four steps
+const int MAX_NEWTON_STEPS = 16;
+
+// Gets the projected bounding box of the cell whose upper left node is
+// <cell>
+void cellBounds( const MeshKernelGrid& grid, long cell,
+                 double& minX, double& minY, double& maxX, double& maxY )
+  throw()
+{
+  const long corners[4] = { cell, cell + 1, cell + grid.width,
+                            cell + grid.width + 1 };
+
+  minX = maxX = grid.nodeX[cell];
+  minY = maxY = grid.nodeY[cell];
+  for ( int counter = 1; counter < 4; counter++ )
+  {
+    double x = grid.nodeX[ corners[counter] ];
+    double y = grid.nodeY[ corners[counter] ];
+
+    minX = ( x < minX ) ? x : minX;
+    maxX = ( x > maxX ) ? x : maxX;
+    minY = ( y < minY ) ? y : minY;
+    maxY = ( y > maxY ) ? y : maxY;
+  }
+}
+
+// Returns true if the cell whose upper left node is <cell> has area and
+// valid corners
+bool isIndexedCell( const MeshKernelGrid& grid, long cell ) throw()
+{
+  return ( cell % grid.width ) + 1 < grid.width &&
+    ( cell / grid.width ) + 1 < grid.height &&
+    testBit( grid.cellValid, cell );
+}
+}
+
+
+// ***************************************************************************
+MeshInverse::MeshInverse() throw()
+  : d_minX(0.0), d_minY(0.0), d_bucketWidth(1.0), d_bucketHeight(1.0),
+    d_bucketCols(0), d_bucketRows(0), d_pBucketStart(NULL), d_pCells(NULL)
+{
+}
+
+
+// ***************************************************************************
+MeshInverse::~MeshInverse()
+{
+  clear();
+}
+
+
+// ***************************************************************************
+void MeshInverse::clear() throw()
+{
+  delete [] d_pBucketStart;
+  delete [] d_pCells;
+  d_pBucketStart = NULL;
+  d_pCells = NULL;
+  d_bucketCols = d_bucketRows = 0;
+}
+
+
+// ***************************************************************************
+size_t MeshInverse::getMemoryUsage() const throw()
+{
+  long buckets = d_bucketCols * d_bucketRows;
+
+  if ( !d_pBucketStart )
+    return 0;
+
+  return ( buckets + 1 + d_pBucketStart[buckets] ) * sizeof(long);
+}
+
+
+// ***************************************************************************
+void MeshInverse::getBuckets( double minX, double minY,
+                              double maxX, double maxY,
+                              long& firstCol, long& firstRow,
+                              long& lastCol, long& lastRow ) const throw()
+{
+  firstCol = static_cast<long>( ( minX - d_minX ) / d_bucketWidth );
+  lastCol  = static_cast<long>( ( maxX - d_minX ) / d_bucketWidth );
+  firstRow = static_cast<long>( ( minY - d_minY ) / d_bucketHeight );
+  lastRow  = static_cast<long>( ( maxY - d_minY ) / d_bucketHeight );
+
+  // The far edges of the extent land one past the last bucket
+  firstCol = ( firstCol < 0 ) ? 0 : firstCol;
+  firstRow = ( firstRow < 0 ) ? 0 : firstRow;
+  lastCol  = ( lastCol >= d_bucketCols ) ? d_bucketCols - 1 : lastCol;
+  lastRow  = ( lastRow >= d_bucketRows ) ? d_bucketRows - 1 : lastRow;
+}
+
+
+// ***************************************************************************
+void MeshInverse::build( const MeshKernelGrid& grid ) throw(std::bad_alloc)
+{
+  long cells = grid.width * grid.height;
+  long validCells = 0;
+  long cell, buckets, bucketCol, bucketRow;
+  long firstCol, firstRow, lastCol, lastRow;
+  double minX, minY, maxX, maxY;
+  double extentMaxX = 0.0, extentMaxY = 0.0;
+  double width, height;
+
+  clear();
+
+  // Find the projected extent of the valid cells
+  for ( cell = 0; cell < cells; cell++ )
+  {
+    if ( !isIndexedCell( grid, cell ) )
+      continue;
+
+    cellBounds( grid, cell, minX, minY, maxX, maxY );
+    if ( 0 == validCells )
+    {
+      d_minX = minX;
+      d_minY = minY;
+      extentMaxX = maxX;
+      extentMaxY = maxY;
+    }
+    else
+    {
+      d_minX = ( minX < d_minX ) ? minX : d_minX;
+      d_minY = ( minY < d_minY ) ? minY : d_minY;
+      extentMaxX = ( maxX > extentMaxX ) ? maxX : extentMaxX;
+      extentMaxY = ( maxY > extentMaxY ) ? maxY : extentMaxY;
+    }
+    validCells++;
+  }
+
+  // Lay out about one bucket per cell in the shape of the extent
+  width  = extentMaxX - d_minX;
+  height = extentMaxY - d_minY;
+  if ( width <= 0.0 || height <= 0.0 || 0 == validCells )
+  {
+    width  = ( width > 0.0 ) ? width : 1.0;
+    height = ( height > 0.0 ) ? height : 1.0;
+    d_bucketCols = d_bucketRows = 1;
+  }
+  else
+  {
+    d_bucketCols = static_cast<long>( sqrt( validCells * width / height ) );
+    d_bucketCols = ( d_bucketCols < 1 ) ? 1 : d_bucketCols;
+    d_bucketRows = validCells / d_bucketCols;
+    d_bucketRows = ( d_bucketRows < 1 ) ? 1 : d_bucketRows;
+  }
+  d_bucketWidth  = width / d_bucketCols;
+  d_bucketHeight = height / d_bucketRows;
+  buckets = d_bucketCols * d_bucketRows;
+
+  if ( !( d_pBucketStart = new (std::nothrow) long[ buckets + 1 ] ) )
+  {
+    clear();
+    throw std::bad_alloc();
+  }
+
+  // Count the cells in each bucket, then turn the counts into the starts
+  // of each bucket's run of entries
+  for ( long counter = 0; counter <= buckets; counter++ )
+    d_pBucketStart[counter] = 0;
+
+  for ( cell = 0; cell < cells; cell++ )
+  {
+    if ( !isIndexedCell( grid, cell ) )
+      continue;
+
+    cellBounds( grid, cell, minX, minY, maxX, maxY );
+    getBuckets( minX, minY, maxX, maxY,
+                firstCol, firstRow, lastCol, lastRow );
+    for ( bucketRow = firstRow; bucketRow <= lastRow; bucketRow++ )
+    {
+      for ( bucketCol = firstCol; bucketCol <= lastCol; bucketCol++ )
+        d_pBucketStart[ bucketRow * d_bucketCols + bucketCol + 1 ]++;
+    }
+  }
+
+  for ( long counter = 0; counter < buckets; counter++ )
+    d_pBucketStart[counter + 1] += d_pBucketStart[counter];
+
+  if ( !( d_pCells = new (std::nothrow) long[ d_pBucketStart[buckets] ] ) )
+  {
+    clear();
+    throw std::bad_alloc();
+  }
+
+  // Fill the runs in.  Each bucket's start is moved along as it's filled
+  // and moved back afterwards.
+  for ( cell = 0; cell < cells; cell++ )
+  {
+    if ( !isIndexedCell( grid, cell ) )
+      continue;
+
+    cellBounds( grid, cell, minX, minY, maxX, maxY );
+    getBuckets( minX, minY, maxX, maxY,
+                firstCol, firstRow, lastCol, lastRow );
+    for ( bucketRow = firstRow; bucketRow <= lastRow; bucketRow++ )
+    {
+      for ( bucketCol = firstCol; bucketCol <= lastCol; bucketCol++ )
+        d_pCells[ d_pBucketStart[ bucketRow * d_bucketCols +
+                                  bucketCol ]++ ] = cell;
+    }
+  }
+
+  for ( long counter = buckets; counter > 0; counter-- )
+    d_pBucketStart[counter] = d_pBucketStart[counter - 1];
+  d_pBucketStart[0] = 0;
+}
+
+
+// ***************************************************************************
+// Solves ul + b*u + c*v + d*u*v = point for <u>, <v>, which is the
+// bilinear bilinearBlend() evaluates written out by powers
+bool MeshInverse::invertCell( const MeshKernelGrid& grid, long cell,
+                              double x, double y, double& u, double& v )
+  throw()
+{
+  const long ul = cell;
+  const long ur = cell + 1;
+  const long ll = cell + grid.width;
+  const long lr = cell + grid.width + 1;
+  const double bx = grid.nodeX[ur] - grid.nodeX[ul];
+  const double cx = grid.nodeX[ll] - grid.nodeX[ul];
+  const double dx = grid.nodeX[lr] - grid.nodeX[ll] - bx;
+  const double by = grid.nodeY[ur] - grid.nodeY[ul];
+  const double cy = grid.nodeY[ll] - grid.nodeY[ul];
+  const double dy = grid.nodeY[lr] - grid.nodeY[ll] - by;
+  double fx, fy, dxdu, dxdv, dydu, dydv, det, du, dv;
+
+  // Most candidates from a bucket miss by a mile
+  if ( ( x < grid.nodeX[ul] && x < grid.nodeX[ur] &&
+         x < grid.nodeX[ll] && x < grid.nodeX[lr] ) ||
+       ( x > grid.nodeX[ul] && x > grid.nodeX[ur] &&
+         x > grid.nodeX[ll] && x > grid.nodeX[lr] ) ||
+       ( y < grid.nodeY[ul] && y < grid.nodeY[ur] &&
+         y < grid.nodeY[ll] && y < grid.nodeY[lr] ) ||
+       ( y > grid.nodeY[ul] && y > grid.nodeY[ur] &&
+         y > grid.nodeY[ll] && y > grid.nodeY[lr] ) )
+    return false;
+
+  u = v = 0.5;
+  for ( int step = 0; step < MAX_NEWTON_STEPS; step++ )
+  {
+    fx = bilinearBlend( grid.nodeX[ul], grid.nodeX[ur],
+                        grid.nodeX[ll], grid.nodeX[lr], u, v ) - x;
+    fy = bilinearBlend( grid.nodeY[ul], grid.nodeY[ur],
+                        grid.nodeY[ll], grid.nodeY[lr], u, v ) - y;
+
+    dxdu = bx + dx * v;
+    dxdv = cx + dx * u;
+    dydu = by + dy * v;
+    dydv = cy + dy * u;
+    det  = dxdu * dydv - dxdv * dydu;
+    if ( 0.0 == det )
+      return false;
+
+    du = ( fy * dxdv - fx * dydv ) / det;
+    dv = ( fx * dydu - fy * dxdu ) / det;
+    u += du;
+    v += dv;
+
+    if ( fabs( du ) + fabs( dv ) < 1e-13 )
+      break;
+
+    // Newton is all but exact after one step on a mesh cell, so a point
+    // still well outside isn't going to come back
+    if ( u < -1.0 || u > 2.0 || v < -1.0 || v > 2.0 )
+      return false;
+  }
+
+  // Written so that a diverged NaN fails too
+  if ( !( u >= -EDGE_SLOP && u <= 1.0 + EDGE_SLOP &&
+          v >= -EDGE_SLOP && v <= 1.0 + EDGE_SLOP ) )
+    return false;
+
+  u = ( u < 0.0 ) ? 0.0 : ( ( u > 1.0 ) ? 1.0 : u );
+  v = ( v < 0.0 ) ? 0.0 : ( ( v > 1.0 ) ? 1.0 : v );
+  return true;
+}
+
+
+// ***************************************************************************
+bool MeshInverse::invert( const MeshKernelGrid& grid, double& x, double& y,
+                          long& hintCell ) const throw()
+{
+  long bucket, entry, end, cell = -1;
+  long bucketCol, bucketRow, lastCol, lastRow;
+  double u, v;
+  bool bFound = false;
+
+  if ( !d_pBucketStart )
+    return false;
+
+  // Neighboring points usually share a cell
+  if ( hintCell >= 0 && invertCell( grid, hintCell, x, y, u, v ) )
+  {
+    cell = hintCell;
+    bFound = true;
+  }
+
+  if ( !bFound )
+  {
+    if ( x < d_minX || x > d_minX + d_bucketWidth * d_bucketCols ||
+         y < d_minY || y > d_minY + d_bucketHeight * d_bucketRows )
+      return false;
+
+    getBuckets( x, y, x, y, bucketCol, bucketRow, lastCol, lastRow );
+    bucket = bucketRow * d_bucketCols + bucketCol;
+    end = d_pBucketStart[bucket + 1];
+
+    for ( entry = d_pBucketStart[bucket]; entry < end; entry++ )
+    {
+      if ( invertCell( grid, d_pCells[entry], x, y, u, v ) )
+      {
+        cell = d_pCells[entry];
+        bFound = true;
+        break;
+      }
+    }
+  }
+
+  if ( !bFound )
+    return false;
+
+  hintCell = cell;
+  x = grid.left + ( cell % grid.width + u ) * grid.horizSpacing;
+  y = grid.top - ( cell / grid.width + v ) * grid.vertSpacing;
+  return true;
+}
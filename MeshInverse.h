@@ -0,0 +1,91 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshInverse projects points from the destination space of a calculated
+// ProjectionMesh back to its source space using the mesh's own nodes, so
+// the answers agree with the forward bilinear interpolation rather than
+// with a second mesh built the other way.
+//
+// In destination space the cells are arbitrary quadrilaterals, so they
+// are found through a uniform grid of buckets laid over the projected
+// extent of the mesh.  Each bucket lists the cells whose projected
+// bounding boxes overlap it, and there are about as many buckets as cells
+// so a lookup checks only a handful of them.  The point is then inverted
+// within each candidate cell by Newton's method on the same bilinear the
+// forward kernels evaluate, and the first cell it falls inside wins.
+
+#ifndef _MESHINVERSE_H_
+#define _MESHINVERSE_H_
+
+#include <new>
+#include <stddef.h>
+#include "MeshKernels.h"
+
+namespace PmeshLib
+{
+
+class MeshInverse
+{
+ public:
+  MeshInverse() throw();
+  ~MeshInverse();
+
+  /* Indexes the valid cells of <grid> */
+  void build( const MeshKernelGrid& grid ) throw(std::bad_alloc);
+
+  /* Throws away the index */
+  void clear() throw();
+
+  /* Returns true if the index has been built */
+  bool isBuilt() const throw();
+
+  /* Gets the number of bytes the index uses */
+  size_t getMemoryUsage() const throw();
+
+  /* Finds the cell of <grid> whose bilinear interpolation gives the
+     destination point <x>, <y>, and replaces them with the source point
+     that projects there.  <hintCell> is a cell to try first, such as the
+     one the previous point was found in, or -1; it is set to the cell the
+     point was found in.  Returns false, leaving <x> and <y> alone, if no
+     valid cell covers the point.  <grid> must be the one the index was
+     built from */
+  bool invert( const MeshKernelGrid& grid, double& x, double& y,
+               long& hintCell ) const throw();
+
+ private:
+  // Not copyable
+  MeshInverse( const MeshInverse& );
+  MeshInverse& operator=( const MeshInverse& );
+
+  /* Tries to invert <x>, <y> within the cell whose upper left node is
+     <cell>.  Sets <u>, <v> to the offsets in the cell and returns true if
+     the point is inside it */
+  static bool invertCell( const MeshKernelGrid& grid, long cell,
+                          double x, double y, double& u, double& v )
+    throw();
+
+  /* Gets the range of buckets the box <minX>..<maxX>, <minY>..<maxY>
+     covers */
+  void getBuckets( double minX, double minY, double maxX, double maxY,
+                   long& firstCol, long& firstRow,
+                   long& lastCol, long& lastRow ) const throw();
+
+  double d_minX, d_minY;           // projected extent of the valid cells
+  double d_bucketWidth, d_bucketHeight;
+  long   d_bucketCols, d_bucketRows;
+  long*  d_pBucketStart;           // first entry of each bucket in
+                                   // d_pCells, plus one past the end
+  long*  d_pCells;                 // cells listed bucket by bucket
+};
+
+
+// ***************************************************************************
+inline
+bool MeshInverse::isBuilt() const throw()
+{
+  return ( NULL != d_pBucketStart );
+}
+
+} // namespace
+
+#endif
@@ -0,0 +1,439 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the vectorized projection kernels
+
+#include <string.h>
+#include "MeshKernels.h"
+#include "PmeshThread.h"
+
+#if !defined(PMESH_NO_SIMD) && defined(__GNUC__) && \
+    ( defined(__x86_64__) || defined(__i386__) ) && \
+    ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) )
+#define PMESH_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace PmeshLib;
+
+namespace
+{
+typedef long (*BilinearKernel)( const MeshKernelGrid& grid,
+                                double* x, double* y, long stride,
+                                long count, bool* valid );
+
+
+// ***************************************************************************
+// One point at a time.  Also finishes off what the vector kernels leave.
+long scalarBilinear( const MeshKernelGrid& grid, double* x, double* y,
+                     long stride, long count, bool* valid ) throw()
+{
+  double col, row, u, v;
+  long leftCol, topRow, rightCol, bottomRow;
+  long ul, ur, ll, lr;
+  long counter, projected = 0;
+
+  for ( counter = 0; counter < count; counter++ )
+  {
+    double& px = x[ counter * stride ];
+    double& py = y[ counter * stride ];
+
+    col = ( px - grid.left ) / grid.horizSpacing;
+    row = ( grid.top - py ) / grid.vertSpacing;
+
+    if ( !( col > -1.0 && col < grid.width &&
+            row > -1.0 && row < grid.height ) )
+    {
+      if ( valid )
+        valid[counter] = false;
+      continue;
+    }
+
+    leftCol = static_cast<long>( col );
+    topRow  = static_cast<long>( row );
+    ul      = topRow * grid.width + leftCol;
+
+    if ( !testBit( grid.cellValid, ul ) )
+    {
+      if ( valid )
+        valid[counter] = false;
+      continue;
+    }
+
+    u         = col - leftCol;
+    v         = row - topRow;
+    rightCol  = ( leftCol + 1 < grid.width ) ? leftCol + 1 : leftCol;
+    bottomRow = ( topRow + 1 < grid.height ) ? topRow + 1 : topRow;
+    ur        = topRow * grid.width + rightCol;
+    ll        = bottomRow * grid.width + leftCol;
+    lr        = bottomRow * grid.width + rightCol;
+
+    px = bilinearBlend( grid.nodeX[ul], grid.nodeX[ur],
+                        grid.nodeX[ll], grid.nodeX[lr], u, v );
+    py = bilinearBlend( grid.nodeY[ul], grid.nodeY[ur],
+                        grid.nodeY[ll], grid.nodeY[lr], u, v );
+
+    if ( valid )
+      valid[counter] = true;
+    projected++;
+  }
+  return projected;
+}
+
+
+#if defined(PMESH_X86_SIMD)
+
+// ***************************************************************************
+// Four points at a time
+__attribute__((target("avx2")))
+long avx2Bilinear( const MeshKernelGrid& grid, double* x, double* y,
+                   long stride, long count, bool* valid ) throw()
+{
+  const __m256d left     = _mm256_set1_pd( grid.left );
+  const __m256d top      = _mm256_set1_pd( grid.top );
+  const __m256d hSpacing = _mm256_set1_pd( grid.horizSpacing );
+  const __m256d vSpacing = _mm256_set1_pd( grid.vertSpacing );
+  const __m256d minusOne = _mm256_set1_pd( -1.0 );
+  const __m256d width    = _mm256_set1_pd( static_cast<double>( grid.width ) );
+  const __m256d height   = _mm256_set1_pd( static_cast<double>( grid.height ) );
+  const __m256d zero     = _mm256_setzero_pd();
+  const __m128i one      = _mm_set1_epi32( 1 );
+  const __m128i bitMask  = _mm_set1_epi32( MESH_BITS_PER_WORD - 1 );
+  const __m128i rowSize  = _mm_set1_epi32( static_cast<int>( grid.width ) );
+  const __m128i lastCol  = _mm_set1_epi32( static_cast<int>( grid.width - 1 ) );
+  const __m128i lastRow  = _mm_set1_epi32( static_cast<int>( grid.height - 1 ) );
+  const int*    words    = reinterpret_cast<const int*>( grid.cellValid );
+  long counter, lane, projected = 0;
+  double outX[4], outY[4];
+
+  for ( counter = 0; counter + 4 <= count; counter += 4 )
+  {
+    double* px = x + counter * stride;
+    double* py = y + counter * stride;
+    __m256d vx = _mm256_set_pd( px[3 * stride], px[2 * stride],
+                                px[stride], px[0] );
+    __m256d vy = _mm256_set_pd( py[3 * stride], py[2 * stride],
+                                py[stride], py[0] );
+
+    // Find the cells, throwing out points outside of the mesh
+    __m256d col = _mm256_div_pd( _mm256_sub_pd( vx, left ), hSpacing );
+    __m256d row = _mm256_div_pd( _mm256_sub_pd( top, vy ), vSpacing );
+    __m256d in  = _mm256_and_pd(
+      _mm256_and_pd( _mm256_cmp_pd( col, minusOne, _CMP_GT_OQ ),
+                     _mm256_cmp_pd( col, width, _CMP_LT_OQ ) ),
+      _mm256_and_pd( _mm256_cmp_pd( row, minusOne, _CMP_GT_OQ ),
+                     _mm256_cmp_pd( row, height, _CMP_LT_OQ ) ) );
+    int inside = _mm256_movemask_pd( in );
+
+    if ( 0 == inside )
+    {
+      if ( valid )
+        valid[counter] = valid[counter + 1] = valid[counter + 2] =
+          valid[counter + 3] = false;
+      continue;
+    }
+
+    // Points outside are sent to cell 0 so every gather stays in the mesh
+    col = _mm256_blendv_pd( zero, col, in );
+    row = _mm256_blendv_pd( zero, row, in );
+
+    __m128i leftCol   = _mm256_cvttpd_epi32( col );
+    __m128i topRow    = _mm256_cvttpd_epi32( row );
+    __m256d u         = _mm256_sub_pd( col, _mm256_cvtepi32_pd( leftCol ) );
+    __m256d v         = _mm256_sub_pd( row, _mm256_cvtepi32_pd( topRow ) );
+    __m128i rightCol  = _mm_min_epi32( _mm_add_epi32( leftCol, one ),
+                                       lastCol );
+    __m128i topBase   = _mm_mullo_epi32( topRow, rowSize );
+    __m128i bottomBase = _mm_mullo_epi32(
+      _mm_min_epi32( _mm_add_epi32( topRow, one ), lastRow ), rowSize );
+    __m128i ul = _mm_add_epi32( topBase, leftCol );
+    __m128i ur = _mm_add_epi32( topBase, rightCol );
+    __m128i ll = _mm_add_epi32( bottomBase, leftCol );
+    __m128i lr = _mm_add_epi32( bottomBase, rightCol );
+
+    // One gather for the validity of the whole cell
+    __m128i bits = _mm_i32gather_epi32( words, _mm_srli_epi32( ul, 5 ), 4 );
+    bits = _mm_and_si128( _mm_srlv_epi32( bits, _mm_and_si128( ul, bitMask ) ),
+                          one );
+    int good = inside &
+      _mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( bits, one ) ) );
+
+    // Blend the corners
+    __m256d cul = _mm256_i32gather_pd( grid.nodeX, ul, 8 );
+    __m256d cur = _mm256_i32gather_pd( grid.nodeX, ur, 8 );
+    __m256d cll = _mm256_i32gather_pd( grid.nodeX, ll, 8 );
+    __m256d clr = _mm256_i32gather_pd( grid.nodeX, lr, 8 );
+    __m256d b   = _mm256_sub_pd( cur, cul );
+    __m256d rx  = _mm256_add_pd(
+      _mm256_add_pd( cul, _mm256_mul_pd( b, u ) ),
+      _mm256_mul_pd( _mm256_add_pd( _mm256_sub_pd( cll, cul ),
+        _mm256_mul_pd( _mm256_sub_pd( _mm256_sub_pd( clr, cll ), b ), u ) ),
+                     v ) );
+
+    cul = _mm256_i32gather_pd( grid.nodeY, ul, 8 );
+    cur = _mm256_i32gather_pd( grid.nodeY, ur, 8 );
+    cll = _mm256_i32gather_pd( grid.nodeY, ll, 8 );
+    clr = _mm256_i32gather_pd( grid.nodeY, lr, 8 );
+    b   = _mm256_sub_pd( cur, cul );
+    __m256d ry = _mm256_add_pd(
+      _mm256_add_pd( cul, _mm256_mul_pd( b, u ) ),
+      _mm256_mul_pd( _mm256_add_pd( _mm256_sub_pd( cll, cul ),
+        _mm256_mul_pd( _mm256_sub_pd( _mm256_sub_pd( clr, cll ), b ), u ) ),
+                     v ) );
+
+    _mm256_storeu_pd( outX, rx );
+    _mm256_storeu_pd( outY, ry );
+
+    for ( lane = 0; lane < 4; lane++ )
+    {
+      bool bGood = ( 0 != ( good & ( 1 << lane ) ) );
+
+      if ( bGood )
+      {
+        px[lane * stride] = outX[lane];
+        py[lane * stride] = outY[lane];
+        projected++;
+      }
+      if ( valid )
+        valid[counter + lane] = bGood;
+    }
+  }
+
+  return projected +
+    scalarBilinear( grid, x + counter * stride, y + counter * stride,
+                    stride, count - counter,
+                    valid ? valid + counter : NULL );
+}
+
+
+// ***************************************************************************
+// Eight points at a time
+__attribute__((target("avx512f")))
+long avx512Bilinear( const MeshKernelGrid& grid, double* x, double* y,
+                     long stride, long count, bool* valid ) throw()
+{
+  const __m512d left     = _mm512_set1_pd( grid.left );
+  const __m512d top      = _mm512_set1_pd( grid.top );
+  const __m512d hSpacing = _mm512_set1_pd( grid.horizSpacing );
+  const __m512d vSpacing = _mm512_set1_pd( grid.vertSpacing );
+  const __m512d minusOne = _mm512_set1_pd( -1.0 );
+  const __m512d width    = _mm512_set1_pd( static_cast<double>( grid.width ) );
+  const __m512d height   = _mm512_set1_pd( static_cast<double>( grid.height ) );
+  const __m512d zero     = _mm512_setzero_pd();
+  const __m256i one      = _mm256_set1_epi32( 1 );
+  const __m256i bitMask  = _mm256_set1_epi32( MESH_BITS_PER_WORD - 1 );
+  const __m256i rowSize  = _mm256_set1_epi32( static_cast<int>( grid.width ) );
+  const __m256i lastCol  = _mm256_set1_epi32( static_cast<int>( grid.width - 1 ) );
+  const __m256i lastRow  = _mm256_set1_epi32( static_cast<int>( grid.height - 1 ) );
+  const int*    words    = reinterpret_cast<const int*>( grid.cellValid );
+  long counter, lane, projected = 0;
+  double outX[8], outY[8];
+
+  for ( counter = 0; counter + 8 <= count; counter += 8 )
+  {
+    double* px = x + counter * stride;
+    double* py = y + counter * stride;
+    __m512d vx = _mm512_set_pd( px[7 * stride], px[6 * stride],
+                                px[5 * stride], px[4 * stride],
+                                px[3 * stride], px[2 * stride],
+                                px[stride], px[0] );
+    __m512d vy = _mm512_set_pd( py[7 * stride], py[6 * stride],
+                                py[5 * stride], py[4 * stride],
+                                py[3 * stride], py[2 * stride],
+                                py[stride], py[0] );
+
+    // Find the cells, throwing out points outside of the mesh
+    __m512d col = _mm512_div_pd( _mm512_sub_pd( vx, left ), hSpacing );
+    __m512d row = _mm512_div_pd( _mm512_sub_pd( top, vy ), vSpacing );
+    __mmask8 in = _mm512_cmp_pd_mask( col, minusOne, _CMP_GT_OQ ) &
+                  _mm512_cmp_pd_mask( col, width, _CMP_LT_OQ ) &
+                  _mm512_cmp_pd_mask( row, minusOne, _CMP_GT_OQ ) &
+                  _mm512_cmp_pd_mask( row, height, _CMP_LT_OQ );
+
+    if ( 0 == in )
+    {
+      if ( valid )
+        for ( lane = 0; lane < 8; lane++ )
+          valid[counter + lane] = false;
+      continue;
+    }
+
+    // Points outside are sent to cell 0 so every gather stays in the mesh
+    col = _mm512_mask_blend_pd( in, zero, col );
+    row = _mm512_mask_blend_pd( in, zero, row );
+
+    __m256i leftCol   = _mm512_cvttpd_epi32( col );
+    __m256i topRow    = _mm512_cvttpd_epi32( row );
+    __m512d u         = _mm512_sub_pd( col, _mm512_cvtepi32_pd( leftCol ) );
+    __m512d v         = _mm512_sub_pd( row, _mm512_cvtepi32_pd( topRow ) );
+    __m256i rightCol  = _mm256_min_epi32( _mm256_add_epi32( leftCol, one ),
+                                          lastCol );
+    __m256i topBase   = _mm256_mullo_epi32( topRow, rowSize );
+    __m256i bottomBase = _mm256_mullo_epi32(
+      _mm256_min_epi32( _mm256_add_epi32( topRow, one ), lastRow ), rowSize );
+    __m256i ul = _mm256_add_epi32( topBase, leftCol );
+    __m256i ur = _mm256_add_epi32( topBase, rightCol );
+    __m256i ll = _mm256_add_epi32( bottomBase, leftCol );
+    __m256i lr = _mm256_add_epi32( bottomBase, rightCol );
+
+    // One gather for the validity of the whole cell
+    __m256i bits = _mm256_i32gather_epi32( words,
+                                           _mm256_srli_epi32( ul, 5 ), 4 );
+    bits = _mm256_and_si256(
+      _mm256_srlv_epi32( bits, _mm256_and_si256( ul, bitMask ) ), one );
+    __mmask8 good = in & static_cast<__mmask8>( _mm256_movemask_ps(
+      _mm256_castsi256_ps( _mm256_cmpeq_epi32( bits, one ) ) ) );
+
+    // Blend the corners
+    __m512d cul = _mm512_i32gather_pd( ul, grid.nodeX, 8 );
+    __m512d cur = _mm512_i32gather_pd( ur, grid.nodeX, 8 );
+    __m512d cll = _mm512_i32gather_pd( ll, grid.nodeX, 8 );
+    __m512d clr = _mm512_i32gather_pd( lr, grid.nodeX, 8 );
+    __m512d b   = _mm512_sub_pd( cur, cul );
+    __m512d rx  = _mm512_add_pd(
+      _mm512_add_pd( cul, _mm512_mul_pd( b, u ) ),
+      _mm512_mul_pd( _mm512_add_pd( _mm512_sub_pd( cll, cul ),
+        _mm512_mul_pd( _mm512_sub_pd( _mm512_sub_pd( clr, cll ), b ), u ) ),
+                     v ) );
+
+    cul = _mm512_i32gather_pd( ul, grid.nodeY, 8 );
+    cur = _mm512_i32gather_pd( ur, grid.nodeY, 8 );
+    cll = _mm512_i32gather_pd( ll, grid.nodeY, 8 );
+    clr = _mm512_i32gather_pd( lr, grid.nodeY, 8 );
+    b   = _mm512_sub_pd( cur, cul );
+    __m512d ry = _mm512_add_pd(
+      _mm512_add_pd( cul, _mm512_mul_pd( b, u ) ),
+      _mm512_mul_pd( _mm512_add_pd( _mm512_sub_pd( cll, cul ),
+        _mm512_mul_pd( _mm512_sub_pd( _mm512_sub_pd( clr, cll ), b ), u ) ),
+                     v ) );
+
+    _mm512_storeu_pd( outX, rx );
+    _mm512_storeu_pd( outY, ry );
+
+    for ( lane = 0; lane < 8; lane++ )
+    {
+      bool bGood = ( 0 != ( good & ( 1 << lane ) ) );
+
+      if ( bGood )
+      {
+        px[lane * stride] = outX[lane];
+        py[lane * stride] = outY[lane];
+        projected++;
+      }
+      if ( valid )
+        valid[counter + lane] = bGood;
+    }
+  }
+
+  return projected +
+    scalarBilinear( grid, x + counter * stride, y + counter * stride,
+                    stride, count - counter,
+                    valid ? valid + counter : NULL );
+}
+
+#endif // PMESH_X86_SIMD
+
+
+// ***************************************************************************
+// The kernels, best first.  Nothing here is set up by a constructor, so
+// bilinear() works from the static constructors of other files too.
+struct KernelEntry
+{
+  const char*    name;
+  BilinearKernel kernel;
+};
+
+const KernelEntry KERNELS[] =
+{
+#if defined(PMESH_X86_SIMD)
+  { "avx512", avx512Bilinear },
+  { "avx2",   avx2Bilinear },
+#endif
+  { "scalar", scalarBilinear }
+};
+const long KERNEL_COUNT = sizeof( KERNELS ) / sizeof( KERNELS[0] );
+
+// One more than the index of the kernel bilinear() uses, 0 until the
+// first call picks one
+volatile long s_kernel = 0;
+
+
+// ***************************************************************************
+// Returns true if this CPU can run <kernel>
+bool canRun( BilinearKernel kernel ) throw()
+{
+#if defined(PMESH_X86_SIMD)
+  __builtin_cpu_init();
+
+  if ( avx512Bilinear == kernel )
+    return 0 != __builtin_cpu_supports( "avx512f" );
+  if ( avx2Bilinear == kernel )
+    return 0 != __builtin_cpu_supports( "avx2" );
+#endif
+  return true;
+}
+
+
+// ***************************************************************************
+// Gets the kernel bilinear() uses, the first time picking the best this CPU
+// can run.  Threads that get here together all pick the same one.
+const KernelEntry& currentKernel() throw()
+{
+  long index = atomicRead( s_kernel ) - 1;
+
+  if ( index < 0 )
+  {
+    for ( index = 0; !canRun( KERNELS[index].kernel ); index++ )
+      ;
+    atomicWrite( s_kernel, index + 1 );
+  }
+  return KERNELS[index];
+}
+}
+
+
+// ***************************************************************************
+long MeshKernels::bilinear( const MeshKernelGrid& grid, double* x, double* y,
+                            long stride, long count, bool* valid ) throw()
+{
+  if ( count <= 0 )
+    return 0;
+
+  // The vector kernels index the nodes with 32 bit integers
+  if ( static_cast<double>( grid.width ) * grid.height >= 2147483648.0 )
+    return scalarBilinear( grid, x, y, stride, count, valid );
+
+  return currentKernel().kernel( grid, x, y, stride, count, valid );
+}
+
+
+// ***************************************************************************
+const char* MeshKernels::getKernelName() throw()
+{
+  return currentKernel().name;
+}
+
+
+// ***************************************************************************
+bool MeshKernels::setKernel( const char* name ) throw()
+{
+  long index;
+
+  if ( !name )
+  {
+    atomicWrite( s_kernel, 0 );
+    return true;
+  }
+
+  for ( index = 0; index < KERNEL_COUNT; index++ )
+  {
+    if ( 0 == strcmp( KERNELS[index].name, name ) )
+    {
+      if ( !canRun( KERNELS[index].kernel ) )
+        return false;
+      atomicWrite( s_kernel, index + 1 );
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,75 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Vectorized projection kernels for the DlgViewer and BiLinear meshes.
+// The kernels find the cells of 4 (AVX2) or 8 (AVX-512) points at once,
+// check the validity of their corners and blend them, reading the mesh
+// nodes directly.  Which kernel runs is picked the first time one is
+// needed from what the CPU supports, falling back to a scalar loop on
+// other machines or when the library is built with PMESH_NO_SIMD defined.
+//
+// Every kernel evaluates the bilinear in the same order,
+//   ul + (ur - ul)*u + ((ll - ul) + ((lr - ll) - (ur - ul))*u)*v
+// so they agree with each other exactly.  They agree with the MathLib
+// BiLinear and DlgViewer interpolators to within 32 units in the last
+// place of the largest corner coordinate of the cell, which
+// benchmarks/InterpolatorCheck.cpp checks for each kernel the machine can
+// run.
+
+#ifndef _MESHKERNELS_H_
+#define _MESHKERNELS_H_
+
+#include "MeshBitmap.h"
+
+namespace PmeshLib
+{
+
+// The parts of a mesh a kernel needs
+struct MeshKernelGrid
+{
+  const double*      nodeX;      // projected node coordinates, row by row
+  const double*      nodeY;
+  const MeshBitWord* cellValid;  // one bit per cell, set if its four
+                                 // corners are valid
+  long               width, height;
+  double             left, top;
+  double             horizSpacing, vertSpacing;
+};
+
+class MeshKernels
+{
+ public:
+  /* Bilinearly projects <count> points spaced <stride> doubles apart in
+     <x>, <y> through <grid>, the same as ProjectionMesh::projectPoint().
+     Fills <valid> if it isn't NULL and returns the number of points
+     projected */
+  static long bilinear( const MeshKernelGrid& grid, double* x, double* y,
+                        long stride, long count, bool* valid ) throw();
+
+  /* Gets the name of the kernel bilinear() uses on this machine:
+     "avx512", "avx2" or "scalar" */
+  static const char* getKernelName() throw();
+
+  /* Makes bilinear() use the kernel called <name>, or the best one this
+     CPU can run again if <name> is NULL.  Returns false, changing
+     nothing, if there is no such kernel or the CPU can't run it.  Meant
+     for checking the kernels against each other; threads projecting at
+     the time may use either kernel */
+  static bool setKernel( const char* name ) throw();
+};
+
+
+// ***************************************************************************
+// The bilinear every kernel evaluates, for code that works a point at a time
+inline
+double bilinearBlend( double ul, double ur, double ll, double lr,
+                      double u, double v ) throw()
+{
+  double b = ur - ul;
+
+  return ul + b * u + ( ( ll - ul ) + ( ( lr - ll ) - b ) * u ) * v;
+}
+
+} // namespace
+
+#endif
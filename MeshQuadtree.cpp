@@ -0,0 +1,284 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshQuadtree class
+
+#include "MeshQuadtree.h"
+#include <math.h>
+
+using namespace PmeshLib;
+
+namespace
+{
+// Projects the source point <x>, <y> exactly, in place.  Returns false if
+// either projection fails.
+bool projectExact( const ProjLib::Projection& sourceProj,
+                   const ProjLib::Projection& destProj,
+                   double& x, double& y ) throw()
+{
+  return sourceProj.projectToGeo( x, y, y, x ) &&
+    destProj.projectFromGeo( y, x, x, y );
+}
+}
+
+
+// ***************************************************************************
+MeshQuadtree::MeshQuadtree() throw()
+  : d_pRoots(NULL), d_width(0), d_height(0), d_refinedCells(0),
+    d_addedPoints(0), d_tolerance(0.0), d_maxDepth(0)
+{
+}
+
+
+// ***************************************************************************
+MeshQuadtree::~MeshQuadtree()
+{
+  clear();
+}
+
+
+// ***************************************************************************
+void MeshQuadtree::clear() throw()
+{
+  std::vector<QuadCell>().swap( d_cells );
+  delete [] d_pRoots;
+  d_pRoots = NULL;
+  d_width = d_height = 0;
+  d_refinedCells = d_addedPoints = 0;
+}
+
+
+// ***************************************************************************
+long MeshQuadtree::getLeafCount() const throw()
+{
+  if ( !d_pRoots )
+    return 0;
+
+  // Each split turns one leaf into four
+  return ( d_width - 1 ) * ( d_height - 1 ) +
+    3 * static_cast<long>( d_cells.size() / 4 );
+}
+
+
+// ***************************************************************************
+size_t MeshQuadtree::getMemoryUsage() const throw()
+{
+  if ( !d_pRoots )
+    return 0;
+
+  return d_cells.capacity() * sizeof(QuadCell) +
+    static_cast<size_t>( d_width ) * d_height * sizeof(long);
+}
+
+
+// ***************************************************************************
+void MeshQuadtree::build( const MeshKernelGrid& grid,
+                          const ProjLib::Projection& sourceProj,
+                          const ProjLib::Projection& destProj,
+                          double tolerance, long maxDepth )
+  throw(std::bad_alloc)
+{
+  long col, row, cell;
+  long ul, ur, ll, lr;
+  double x[4], y[4];
+
+  clear();
+
+  if ( !( d_pRoots = new (std::nothrow)
+          long[ static_cast<size_t>( grid.width ) * grid.height ] ) )
+    throw std::bad_alloc();
+
+  d_width     = grid.width;
+  d_height    = grid.height;
+  d_tolerance = tolerance;
+  d_maxDepth  = maxDepth;
+
+  try
+  {
+    for ( row = 0; row < grid.height; row++ )
+    {
+      for ( col = 0; col < grid.width; col++ )
+      {
+        cell = row * grid.width + col;
+        d_pRoots[cell] = -1;
+
+        // The cells on the right and bottom edges have no area, and
+        // invalid cells aren't projected through at all
+        if ( col + 1 >= grid.width || row + 1 >= grid.height ||
+             !testBit( grid.cellValid, cell ) )
+          continue;
+
+        ul = cell;
+        ur = cell + 1;
+        ll = cell + grid.width;
+        lr = cell + grid.width + 1;
+        x[0] = grid.nodeX[ul];  y[0] = grid.nodeY[ul];
+        x[1] = grid.nodeX[ur];  y[1] = grid.nodeY[ur];
+        x[2] = grid.nodeX[ll];  y[2] = grid.nodeY[ll];
+        x[3] = grid.nodeX[lr];  y[3] = grid.nodeY[lr];
+
+        d_pRoots[cell] = refine( sourceProj, destProj,
+                                 grid.left + col * grid.horizSpacing,
+                                 grid.top - row * grid.vertSpacing,
+                                 grid.horizSpacing, grid.vertSpacing,
+                                 x, y, 0 );
+        if ( -1 != d_pRoots[cell] )
+          d_refinedCells++;
+      }
+    }
+  }
+  catch(...)
+  {
+    clear();
+    throw std::bad_alloc();
+  }
+}
+
+
+// ***************************************************************************
+long MeshQuadtree::refine( const ProjLib::Projection& sourceProj,
+                           const ProjLib::Projection& destProj,
+                           double left, double top,
+                           double width, double height,
+                           const double* x, const double* y, long depth )
+  throw(std::bad_alloc)
+{
+  double centerX, centerY;
+  double midX[4], midY[4];   // top, left, right and bottom edge midpoints
+  double childX[4], childY[4];
+  double halfWidth = width * 0.5;
+  double halfHeight = height * 0.5;
+  long first, counter;
+
+  if ( depth >= d_maxDepth )
+    return -1;
+
+  // See how far the interpolated center is from the real one
+  centerX = left + halfWidth;
+  centerY = top - halfHeight;
+  if ( !projectExact( sourceProj, destProj, centerX, centerY ) )
+    return -1;
+  d_addedPoints++;
+
+  if ( hypot( centerX - ( x[0] + x[1] + x[2] + x[3] ) * 0.25,
+              centerY - ( y[0] + y[1] + y[2] + y[3] ) * 0.25 )
+       <= d_tolerance )
+    return -1;
+
+  // Too far off, so get the edge midpoints and split.  If any of them
+  // can't be projected the cell is left as it is.
+  midX[0] = left + halfWidth;  midY[0] = top;
+  midX[1] = left;              midY[1] = top - halfHeight;
+  midX[2] = left + width;      midY[2] = top - halfHeight;
+  midX[3] = left + halfWidth;  midY[3] = top - height;
+
+  for ( counter = 0; counter < 4; counter++ )
+  {
+    if ( !projectExact( sourceProj, destProj, midX[counter], midY[counter] ) )
+      return -1;
+    d_addedPoints++;
+  }
+
+  first = static_cast<long>( d_cells.size() );
+  d_cells.resize( d_cells.size() + 4 );
+
+  // Upper left
+  d_cells[first].x[0] = x[0];     d_cells[first].y[0] = y[0];
+  d_cells[first].x[1] = midX[0];  d_cells[first].y[1] = midY[0];
+  d_cells[first].x[2] = midX[1];  d_cells[first].y[2] = midY[1];
+  d_cells[first].x[3] = centerX;  d_cells[first].y[3] = centerY;
+  // Upper right
+  d_cells[first + 1].x[0] = midX[0];  d_cells[first + 1].y[0] = midY[0];
+  d_cells[first + 1].x[1] = x[1];     d_cells[first + 1].y[1] = y[1];
+  d_cells[first + 1].x[2] = centerX;  d_cells[first + 1].y[2] = centerY;
+  d_cells[first + 1].x[3] = midX[2];  d_cells[first + 1].y[3] = midY[2];
+  // Lower left
+  d_cells[first + 2].x[0] = midX[1];  d_cells[first + 2].y[0] = midY[1];
+  d_cells[first + 2].x[1] = centerX;  d_cells[first + 2].y[1] = centerY;
+  d_cells[first + 2].x[2] = x[2];     d_cells[first + 2].y[2] = y[2];
+  d_cells[first + 2].x[3] = midX[3];  d_cells[first + 2].y[3] = midY[3];
+  // Lower right
+  d_cells[first + 3].x[0] = centerX;  d_cells[first + 3].y[0] = centerY;
+  d_cells[first + 3].x[1] = midX[2];  d_cells[first + 3].y[1] = midY[2];
+  d_cells[first + 3].x[2] = midX[3];  d_cells[first + 3].y[2] = midY[3];
+  d_cells[first + 3].x[3] = x[3];     d_cells[first + 3].y[3] = y[3];
+
+  // Check the children.  The vector can move as they split, so copy each
+  // child's corners out before recursing.
+  for ( counter = 0; counter < 4; counter++ )
+  {
+    long child;
+
+    for ( int corner = 0; corner < 4; corner++ )
+    {
+      childX[corner] = d_cells[first + counter].x[corner];
+      childY[corner] = d_cells[first + counter].y[corner];
+    }
+
+    child = refine( sourceProj, destProj,
+                    left + ( counter % 2 ) * halfWidth,
+                    top - ( counter / 2 ) * halfHeight,
+                    halfWidth, halfHeight, childX, childY, depth + 1 );
+    d_cells[first + counter].child = child;
+  }
+
+  return first;
+}
+
+
+// ***************************************************************************
+void MeshQuadtree::evaluate( const MeshKernelGrid& grid, long col, long row,
+                             double u, double v, double& x, double& y ) const
+  throw()
+{
+  long cell = row * grid.width + col;
+  long index = d_pRoots[cell];
+  long rightCol, bottomRow;
+  int quadrant;
+
+  // Unsplit cells interpolate the mesh nodes like the kernels do
+  if ( -1 == index )
+  {
+    rightCol  = ( col + 1 < grid.width ) ? col + 1 : col;
+    bottomRow = ( row + 1 < grid.height ) ? row + 1 : row;
+
+    x = bilinearBlend( grid.nodeX[cell],
+                       grid.nodeX[row * grid.width + rightCol],
+                       grid.nodeX[bottomRow * grid.width + col],
+                       grid.nodeX[bottomRow * grid.width + rightCol], u, v );
+    y = bilinearBlend( grid.nodeY[cell],
+                       grid.nodeY[row * grid.width + rightCol],
+                       grid.nodeY[bottomRow * grid.width + col],
+                       grid.nodeY[bottomRow * grid.width + rightCol], u, v );
+    return;
+  }
+
+  // Walk down to the leaf, rescaling the offsets to each child
+  for ( ;; )
+  {
+    quadrant = 0;
+    u *= 2.0;
+    v *= 2.0;
+
+    if ( u >= 1.0 )
+    {
+      u -= 1.0;
+      quadrant += 1;
+    }
+    if ( v >= 1.0 )
+    {
+      v -= 1.0;
+      quadrant += 2;
+    }
+
+    const QuadCell& quad = d_cells[ index + quadrant ];
+
+    if ( -1 == quad.child )
+    {
+      x = bilinearBlend( quad.x[0], quad.x[1], quad.x[2], quad.x[3], u, v );
+      y = bilinearBlend( quad.y[0], quad.y[1], quad.y[2], quad.y[3], u, v );
+      return;
+    }
+    index = quad.child;
+  }
+}
@@ -0,0 +1,121 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshQuadtree refines the cells of a ProjectionMesh where bilinear
+// interpolation of the cell's corners is not accurate enough.  Each cell
+// of the mesh is checked by projecting its center exactly and comparing
+// it with the interpolated center.  Cells that miss the tolerance are
+// split into four, and the children are checked the same way until they
+// pass or the maximum depth is reached.  Projecting a point then descends
+// from its mesh cell to the leaf containing it and interpolates that
+// leaf's corners bilinearly.
+//
+// Neighboring cells can be split to different depths, so the surface is
+// only continuous to within the tolerance across those edges.
+
+#ifndef _MESHQUADTREE_H_
+#define _MESHQUADTREE_H_
+
+#include <new>
+#include <vector>
+#include "ProjectionLib/Projection.h"
+#include "MeshKernels.h"
+
+namespace PmeshLib
+{
+
+class MeshQuadtree
+{
+ public:
+  MeshQuadtree() throw();
+  ~MeshQuadtree();
+
+  /* Refines every valid interior cell of <grid> until the distance
+     between the exact and interpolated centers of each leaf is at most
+     <tolerance> (in destination units) or it has been split <maxDepth>
+     times.  <sourceProj> and <destProj> are the projections the mesh was
+     calculated with */
+  void build( const MeshKernelGrid& grid,
+              const ProjLib::Projection& sourceProj,
+              const ProjLib::Projection& destProj,
+              double tolerance, long maxDepth ) throw(std::bad_alloc);
+
+  /* Throws away the tree */
+  void clear() throw();
+
+  /* Returns true if the tree has been built */
+  bool isBuilt() const throw();
+
+  /* Gets how many mesh cells were split */
+  long getRefinedCellCount() const throw();
+
+  /* Gets how many points were projected on top of the mesh nodes */
+  long getAddedPointCount() const throw();
+
+  /* Gets how many leaves the tree has, counting unsplit mesh cells */
+  long getLeafCount() const throw();
+
+  /* Gets the number of bytes the tree uses */
+  size_t getMemoryUsage() const throw();
+
+  /* Interpolates the point at offsets <u>, <v> inside the mesh cell whose
+     upper left node is <col>, <row> of <grid> into <x>, <y> */
+  void evaluate( const MeshKernelGrid& grid, long col, long row,
+                 double u, double v, double& x, double& y ) const throw();
+
+ private:
+  // Not copyable
+  MeshQuadtree( const MeshQuadtree& );
+  MeshQuadtree& operator=( const MeshQuadtree& );
+
+  // A piece of a split cell.  The four children of a cell are stored
+  // together in the order upper left, upper right, lower left, lower right.
+  struct QuadCell
+  {
+    double x[4], y[4];  // projected corners in the same order
+    long   child;       // first of this cell's children, -1 for a leaf
+  };
+
+  /* Checks the cell with source upper left corner <left>, <top>, size
+     <width> x <height> and projected corners <x>, <y>, splitting it if
+     needed.  Returns the index of its first child or -1 */
+  long refine( const ProjLib::Projection& sourceProj,
+               const ProjLib::Projection& destProj,
+               double left, double top, double width, double height,
+               const double* x, const double* y, long depth )
+    throw(std::bad_alloc);
+
+  std::vector<QuadCell> d_cells;
+  long*  d_pRoots;          // per mesh cell: first child or -1
+  long   d_width, d_height;
+  long   d_refinedCells;
+  long   d_addedPoints;
+  double d_tolerance;
+  long   d_maxDepth;
+};
+
+
+// ***************************************************************************
+inline
+bool MeshQuadtree::isBuilt() const throw()
+{
+  return ( NULL != d_pRoots );
+}
+
+// ***************************************************************************
+inline
+long MeshQuadtree::getRefinedCellCount() const throw()
+{
+  return d_refinedCells;
+}
+
+// ***************************************************************************
+inline
+long MeshQuadtree::getAddedPointCount() const throw()
+{
+  return d_addedPoints;
+}
+
+} // namespace
+
+#endif
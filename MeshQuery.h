@@ -0,0 +1,325 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshQuery projects points through a calculated mesh with the
+// interpolation fixed at compile time.  It is a template on an
+// interpolation policy, and optionally on the mesh dimensions, so the
+// whole query (finding the cell, checking its validity, setting the cell
+// up and evaluating it) inlines into the caller.  There are no virtual
+// calls, no switch on the interpolator type and no grids of points built
+// per cell, and with the dimensions fixed the node indexing uses
+// constants.
+//
+// A policy is a class with
+//
+//   enum { CELL_SIZE = n };          doubles a cell is set up into
+//   static bool fits( long width, long height );
+//                                    true if it can work on a mesh this size
+//   static void load( const double* nodeX, const double* nodeY,
+//                     long width, long height, long col, long row,
+//                     double* cell );
+//                                    sets the cell at <col>, <row> up
+//   static void evaluate( const double* cell, double u, double v,
+//                         double& x, double& y );
+//                                    interpolates it at offsets <u>, <v>
+//
+// and for MeshCompactQuery (see MeshCompact.h) also
+//
+//   enum { STENCIL = n };            nodes across the block load() reads
+//   static long stencilStart( long index, long length );
+//                                    the block's first column or row
+//
+// MeshBilinearPolicy (DlgViewer, BiLinear and BiPolynomial),
+// MeshPlanePolicy (LeastSquaresPlane) and MeshBicubicPolicy (BiCubic)
+// agree with the MathLib interpolators to within the tolerances given in
+// MeshCoefficients.h, which benchmarks/InterpolatorCheck.cpp checks.
+// ProjectionMesh uses them for those interpolators when
+// setClosedForm() is on, and a program that only ever uses one of them
+// can build a MeshQuery straight from the mesh's MeshKernelGrid and skip
+// the dispatch:
+//
+//   MeshKernelGrid grid;
+//   mesh.getQueryGrid( grid );
+//   MeshQuery<MeshBilinearPolicy, 65, 65> query( grid );
+//   if ( query.fits() )
+//     query.projectPoints( x, y, 1, count, valid );
+//
+// MeshQuery only reads the nodes, so lazy meshes must be filled in first
+// (ProjectionMesh::getQueryGrid() does that), adaptive refinement is not
+// seen, and it must not outlive the mesh's next calculateMesh().
+
+#ifndef _MESHQUERY_H_
+#define _MESHQUERY_H_
+
+#include "MeshKernels.h"
+#include "MeshCoefficients.h"
+
+namespace PmeshLib
+{
+
+// ***************************************************************************
+// a + b*u + c*v + d*u*v through the corners, evaluated the same way as the
+// MeshKernels and MeshCoefficients
+class MeshBilinearPolicy
+{
+ public:
+  enum { CELL_SIZE = 8, STENCIL = 2 };
+
+  static bool fits( long, long ) throw()
+  {
+    return true;
+  }
+
+  static long stencilStart( long index, long ) throw()
+  {
+    return index;
+  }
+
+  static void load( const double* nodeX, const double* nodeY,
+                    long width, long height, long col, long row,
+                    double* cell ) throw()
+  {
+    const long rightCol  = ( col + 1 < width ) ? col + 1 : col;
+    const long bottomRow = ( row + 1 < height ) ? row + 1 : row;
+    const long ul = row * width + col;
+    const long ur = row * width + rightCol;
+    const long ll = bottomRow * width + col;
+    const long lr = bottomRow * width + rightCol;
+
+    MeshCoefficients::bilinearCell( nodeX, ul, ur, ll, lr, cell );
+    MeshCoefficients::bilinearCell( nodeY, ul, ur, ll, lr, cell + 4 );
+  }
+
+  static void evaluate( const double* cell, double u, double v,
+                        double& x, double& y ) throw()
+  {
+    MeshCoefficients::evaluateLinear( cell, u, v, x, y );
+  }
+};
+
+
+// ***************************************************************************
+// The least squares plane through the corners
+class MeshPlanePolicy
+{
+ public:
+  enum { CELL_SIZE = 8, STENCIL = 2 };
+
+  static bool fits( long, long ) throw()
+  {
+    return true;
+  }
+
+  static long stencilStart( long index, long ) throw()
+  {
+    return index;
+  }
+
+  static void load( const double* nodeX, const double* nodeY,
+                    long width, long height, long col, long row,
+                    double* cell ) throw()
+  {
+    const long rightCol  = ( col + 1 < width ) ? col + 1 : col;
+    const long bottomRow = ( row + 1 < height ) ? row + 1 : row;
+    const long ul = row * width + col;
+    const long ur = row * width + rightCol;
+    const long ll = bottomRow * width + col;
+    const long lr = bottomRow * width + rightCol;
+
+    MeshCoefficients::planeCell( nodeX, ul, ur, ll, lr, cell );
+    MeshCoefficients::planeCell( nodeY, ul, ur, ll, lr, cell + 4 );
+  }
+
+  static void evaluate( const double* cell, double u, double v,
+                        double& x, double& y ) throw()
+  {
+    MeshCoefficients::evaluateLinear( cell, u, v, x, y );
+  }
+};
+
+
+// ***************************************************************************
+// The bicubic through the same 4x4 stencil ProjectionMesh::getGrid()
+// picks, evaluated in Lagrange form.  Setting a cell up is just copying
+// its stencil, which keeps scattered queries cheap; the power series
+// MeshCoefficients builds only pays off once per cell.
+class MeshBicubicPolicy
+{
+ public:
+  // 16 x's, 16 y's, then where the cell's upper left node is in the
+  // stencil
+  enum { CELL_SIZE = 34, STENCIL = 4 };
+
+  static bool fits( long width, long height ) throw()
+  {
+    return ( width >= 4 && height >= 4 );
+  }
+
+  // Start of the stencil along an axis of <length> nodes for the cell at
+  // <index>, as getGrid() and MeshCoefficients place it
+  static long stencilStart( long index, long length ) throw()
+  {
+    long start = index - 2;
+
+    if ( start > length - 4 )
+      start = length - 4;
+    if ( start < 0 )
+      start = 0;
+    return start;
+  }
+
+  static void load( const double* nodeX, const double* nodeY,
+                    long width, long height, long col, long row,
+                    double* cell ) throw()
+  {
+    const long firstCol = stencilStart( col, width );
+    const long firstRow = stencilStart( row, height );
+    long r, k, node;
+
+    for ( r = 0; r < 4; r++ )
+    {
+      node = ( firstRow + r ) * width + firstCol;
+      for ( k = 0; k < 4; k++ )
+      {
+        cell[ r * 4 + k ]      = nodeX[ node + k ];
+        cell[ 16 + r * 4 + k ] = nodeY[ node + k ];
+      }
+    }
+    cell[32] = static_cast<double>( col - firstCol );
+    cell[33] = static_cast<double>( row - firstRow );
+  }
+
+  static void evaluate( const double* cell, double u, double v,
+                        double& x, double& y ) throw()
+  {
+    double wu[4], wv[4];
+    double rowX, rowY;
+    int r;
+
+    weights( u + cell[32], wu );
+    weights( v + cell[33], wv );
+
+    x = y = 0.0;
+    for ( r = 0; r < 4; r++ )
+    {
+      const double* cx = cell + r * 4;
+      const double* cy = cell + 16 + r * 4;
+
+      rowX = wu[0] * cx[0] + wu[1] * cx[1] + wu[2] * cx[2] + wu[3] * cx[3];
+      rowY = wu[0] * cy[0] + wu[1] * cy[1] + wu[2] * cy[2] + wu[3] * cy[3];
+      x += wv[r] * rowX;
+      y += wv[r] * rowY;
+    }
+  }
+
+ private:
+  // The cubic Lagrange weights of nodes 0, 1, 2 and 3 at <s>
+  static void weights( double s, double* w ) throw()
+  {
+    const double d0 = s, d1 = s - 1.0, d2 = s - 2.0, d3 = s - 3.0;
+
+    w[0] = -( d1 * d2 * d3 ) / 6.0;
+    w[1] =  ( d0 * d2 * d3 ) * 0.5;
+    w[2] = -( d0 * d1 * d3 ) * 0.5;
+    w[3] =  ( d0 * d1 * d2 ) / 6.0;
+  }
+};
+
+
+// ***************************************************************************
+template <class Policy, long WIDTH = 0, long HEIGHT = 0>
+class MeshQuery
+{
+ public:
+  /* Queries <grid>, which must stay in place while this is used */
+  explicit MeshQuery( const MeshKernelGrid& grid ) throw() : d_grid(grid)
+  {
+  }
+
+  /* Returns true if <grid> can be queried: it has nodes, is the size
+     fixed by WIDTH and HEIGHT if they aren't 0, and suits the policy */
+  bool fits() const throw()
+  {
+    return ( d_grid.nodeX && ( !WIDTH || WIDTH == d_grid.width ) &&
+             ( !HEIGHT || HEIGHT == d_grid.height ) &&
+             Policy::fits( width(), height() ) );
+  }
+
+  /* Projects <x>, <y> in place.  Returns false if the point is outside
+     the mesh or in an invalid cell */
+  bool projectPoint( double& x, double& y ) const throw()
+  {
+    return ( 1 == projectPoints( &x, &y, 1, 1, NULL ) );
+  }
+
+  /* Projects <count> points spaced <stride> doubles apart in place, the
+     same as ProjectionMesh::projectPoints().  A cell is only set up
+     again when the point after it is in a different one */
+  long projectPoints( double* x, double* y, long stride, long count,
+                      bool* valid ) const throw()
+  {
+    double cell[ Policy::CELL_SIZE ];
+    double col, row;
+    long leftCol, topRow;
+    long lastCol = -1, lastRow = -1;
+    long counter, projected = 0;
+    bool bCellValid = false, bProjected;
+
+    for ( counter = 0; counter < count; counter++ )
+    {
+      double& px = x[ counter * stride ];
+      double& py = y[ counter * stride ];
+
+      col = ( px - d_grid.left ) / d_grid.horizSpacing;
+      row = ( d_grid.top - py ) / d_grid.vertSpacing;
+      bProjected = false;
+
+      // The same test and truncation as ProjectionMesh::locateCell()
+      if ( col > -1.0 && col < width() && row > -1.0 && row < height() )
+      {
+        leftCol = static_cast<long>( col );
+        topRow  = static_cast<long>( row );
+
+        if ( leftCol != lastCol || topRow != lastRow )
+        {
+          lastCol = leftCol;
+          lastRow = topRow;
+          bCellValid = testBit( d_grid.cellValid,
+                                topRow * width() + leftCol );
+          if ( bCellValid )
+            Policy::load( d_grid.nodeX, d_grid.nodeY, width(), height(),
+                          leftCol, topRow, cell );
+        }
+
+        if ( bCellValid )
+        {
+          Policy::evaluate( cell, col - leftCol, row - topRow, px, py );
+          bProjected = true;
+        }
+      }
+
+      if ( valid )
+        valid[counter] = bProjected;
+      if ( bProjected )
+        projected++;
+    }
+    return projected;
+  }
+
+ private:
+  long width() const throw()
+  {
+    return WIDTH ? WIDTH : d_grid.width;
+  }
+
+  long height() const throw()
+  {
+    return HEIGHT ? HEIGHT : d_grid.height;
+  }
+
+  MeshKernelGrid d_grid;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,330 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshSpline class
+
+#include "MeshSpline.h"
+
+using namespace PmeshLib;
+
+namespace
+{
+// The second difference of the values <f>, <stride> apart, at <index>
+inline double secondDifference( const double* f, long stride, long index )
+  throw()
+{
+  return f[ ( index - 1 ) * stride ] - 2.0 * f[ index * stride ] +
+    f[ ( index + 1 ) * stride ];
+}
+
+// Solves the spline equations for the <count> values <f> at unit spacing,
+// each <stride> apart, into the second derivatives <m>, each <mStride>
+// apart.  The ends are not-a-knot, so the first and last two cells are
+// one cubic and cubics come out exactly; the natural ends' zero curvature
+// would be wrong for nearly every projection and the error would carry a
+// few cells in.  <scratch> holds <count> doubles.
+void fitSpline( const double* f, long stride, long count,
+                double* m, long mStride, double* scratch ) throw()
+{
+  const long last = count - 1;
+  long counter;
+
+  if ( count < 3 )
+  {
+    for ( counter = 0; counter < count; counter++ )
+      m[ counter * mStride ] = 0.0;
+    return;
+  }
+  if ( 3 == count )
+  {
+    // A parabola
+    m[0] = m[ mStride ] = m[ 2 * mStride ] = secondDifference( f, stride, 1 );
+    return;
+  }
+
+  // M[i-1] + 4 M[i] + M[i+1] = 6 (f[i-1] - 2 f[i] + f[i+1]).  Not-a-knot
+  // makes M[0] = 2 M[1] - M[2], which turns the first equation into
+  // 6 M[1] = its right hand side, and the same at the other end.
+  m[ mStride ] = secondDifference( f, stride, 1 );
+  m[ ( last - 1 ) * mStride ] = secondDifference( f, stride, last - 1 );
+
+  // The rest are diagonally dominant, so the Thomas algorithm needs no
+  // pivoting.  The eliminated diagonal goes in scratch and the right hand
+  // side in m.
+  for ( counter = 2; counter < last - 1; counter++ )
+  {
+    double rhs = 6.0 * secondDifference( f, stride, counter );
+
+    if ( 2 == counter )
+    {
+      rhs -= m[ mStride ];
+      scratch[counter] = 4.0;
+    }
+    else
+    {
+      const double factor = 1.0 / scratch[ counter - 1 ];
+
+      rhs -= factor * m[ ( counter - 1 ) * mStride ];
+      scratch[counter] = 4.0 - factor;
+    }
+    if ( last - 2 == counter )
+      rhs -= m[ ( last - 1 ) * mStride ];
+    m[ counter * mStride ] = rhs;
+  }
+
+  for ( counter = last - 2; counter >= 2; counter-- )
+  {
+    if ( counter < last - 2 )
+      m[ counter * mStride ] -= m[ ( counter + 1 ) * mStride ];
+    m[ counter * mStride ] /= scratch[counter];
+  }
+
+  m[0] = 2.0 * m[ mStride ] - m[ 2 * mStride ];
+  m[ last * mStride ] = 2.0 * m[ ( last - 1 ) * mStride ] -
+    m[ ( last - 2 ) * mStride ];
+}
+}
+
+
+// ***************************************************************************
+MeshSpline::MeshSpline() throw()
+  : d_width(0), d_height(0), d_pDerivatives(NULL)
+{
+}
+
+
+// ***************************************************************************
+MeshSpline::~MeshSpline()
+{
+  clear();
+}
+
+
+// ***************************************************************************
+void MeshSpline::clear() throw()
+{
+  delete [] d_pDerivatives;
+  d_pDerivatives = NULL;
+  d_width = d_height = 0;
+}
+
+
+// ***************************************************************************
+size_t MeshSpline::getMemoryUsage() const throw()
+{
+  if ( !d_pDerivatives )
+    return 0;
+
+  return static_cast<size_t>( d_width ) * d_height * DERIVATIVES *
+    sizeof(double);
+}
+
+
+// ***************************************************************************
+void MeshSpline::fitLine( const double* values, long valueStride,
+                          const MeshBitWord* nodeValid, long firstNode,
+                          long nodeStep, long count, long secondIndex,
+                          double* scratch ) throw()
+{
+  long start = 0, end;
+
+  // Fit each run of valid nodes on its own, leaving 0 at invalid ones
+  while ( start < count )
+  {
+    if ( !testBit( nodeValid, firstNode + start * nodeStep ) )
+    {
+      d_pDerivatives[ ( firstNode + start * nodeStep ) * DERIVATIVES +
+                      secondIndex ] = 0.0;
+      start++;
+      continue;
+    }
+
+    for ( end = start + 1; end < count &&
+            testBit( nodeValid, firstNode + end * nodeStep ); end++ )
+      ;
+
+    fitSpline( values + ( firstNode + start * nodeStep ) * valueStride,
+               nodeStep * valueStride, end - start,
+               d_pDerivatives + ( firstNode + start * nodeStep ) *
+               DERIVATIVES + secondIndex,
+               nodeStep * DERIVATIVES, scratch );
+    start = end;
+  }
+}
+
+
+// ***************************************************************************
+void MeshSpline::build( const MeshKernelGrid& grid,
+                        const MeshBitWord* nodeValid ) throw(std::bad_alloc)
+{
+  const long width = grid.width, height = grid.height;
+  double* scratch;
+  long counter;
+  int axis;
+
+  clear();
+  if ( width < 2 || height < 2 )
+    return;
+
+  d_pDerivatives = new (std::nothrow)
+    double[ static_cast<size_t>( width ) * height * DERIVATIVES ];
+  scratch = new (std::nothrow)
+    double[ ( width > height ) ? width : height ];
+  if ( !d_pDerivatives || !scratch )
+  {
+    delete [] scratch;
+    clear();
+    throw std::bad_alloc();
+  }
+  d_width  = width;
+  d_height = height;
+
+  for ( axis = 0; axis < 2; axis++ )
+  {
+    const double* values = axis ? grid.nodeY : grid.nodeX;
+    const long xx = axis ? XX_Y : XX_X;
+    const long yy = axis ? YY_Y : YY_X;
+    const long xy = axis ? XY_Y : XY_X;
+
+    // Along the rows, then down the columns, then the cross derivative
+    // along the rows of the column derivatives
+    for ( counter = 0; counter < height; counter++ )
+      fitLine( values, 1, nodeValid, counter * width, 1, width, xx,
+               scratch );
+    for ( counter = 0; counter < width; counter++ )
+      fitLine( values, 1, nodeValid, counter, width, height, yy, scratch );
+    for ( counter = 0; counter < height; counter++ )
+      fitLine( d_pDerivatives + yy, DERIVATIVES, nodeValid,
+               counter * width, 1, width, xy, scratch );
+  }
+
+  delete [] scratch;
+}
+
+
+// ***************************************************************************
+void MeshSpline::evaluate( const MeshKernelGrid& grid, long col, long row,
+                           double u, double v, double& x, double& y ) const
+  throw()
+{
+  long rightCol = col + 1, bottomRow = row + 1;
+
+  // The edge cells have no nodes past them, so they stay on their own
+  // column or row
+  if ( rightCol >= d_width )
+  {
+    rightCol = col;
+    u = 0.0;
+  }
+  if ( bottomRow >= d_height )
+  {
+    bottomRow = row;
+    v = 0.0;
+  }
+
+  const long n00 = row * d_width + col;
+  const long n10 = row * d_width + rightCol;
+  const long n01 = bottomRow * d_width + col;
+  const long n11 = bottomRow * d_width + rightCol;
+  const double* d00 = d_pDerivatives + n00 * DERIVATIVES;
+  const double* d10 = d_pDerivatives + n10 * DERIVATIVES;
+  const double* d01 = d_pDerivatives + n01 * DERIVATIVES;
+  const double* d11 = d_pDerivatives + n11 * DERIVATIVES;
+
+  // The cubic spline weights of the values and second derivatives at
+  // each end of the cell
+  const double a0 = 1.0 - u, a1 = u;
+  const double c0 = ( a0 * a0 * a0 - a0 ) / 6.0;
+  const double c1 = ( a1 * a1 * a1 - a1 ) / 6.0;
+  const double b0 = 1.0 - v, b1 = v;
+  const double e0 = ( b0 * b0 * b0 - b0 ) / 6.0;
+  const double e1 = ( b1 * b1 * b1 - b1 ) / 6.0;
+
+  x = b0 * ( a0 * grid.nodeX[n00] + a1 * grid.nodeX[n10] +
+             c0 * d00[XX_X] + c1 * d10[XX_X] ) +
+      b1 * ( a0 * grid.nodeX[n01] + a1 * grid.nodeX[n11] +
+             c0 * d01[XX_X] + c1 * d11[XX_X] ) +
+      e0 * ( a0 * d00[YY_X] + a1 * d10[YY_X] +
+             c0 * d00[XY_X] + c1 * d10[XY_X] ) +
+      e1 * ( a0 * d01[YY_X] + a1 * d11[YY_X] +
+             c0 * d01[XY_X] + c1 * d11[XY_X] );
+
+  y = b0 * ( a0 * grid.nodeY[n00] + a1 * grid.nodeY[n10] +
+             c0 * d00[XX_Y] + c1 * d10[XX_Y] ) +
+      b1 * ( a0 * grid.nodeY[n01] + a1 * grid.nodeY[n11] +
+             c0 * d01[XX_Y] + c1 * d11[XX_Y] ) +
+      e0 * ( a0 * d00[YY_Y] + a1 * d10[YY_Y] +
+             c0 * d00[XY_Y] + c1 * d10[XY_Y] ) +
+      e1 * ( a0 * d01[YY_Y] + a1 * d11[YY_Y] +
+             c0 * d01[XY_Y] + c1 * d11[XY_Y] );
+}
+
+
+// ***************************************************************************
+// The cell holds, for x then y, the values at the upper left, upper
+// right, lower left and lower right corners, then the second derivatives
+// along the rows, down the columns and across both at the same corners.
+// The last two are set if the cell is on the right or bottom edge.
+void MeshSpline::loadCell( const MeshKernelGrid& grid, long col, long row,
+                           double* cell ) const throw()
+{
+  const long rightCol  = ( col + 1 < d_width ) ? col + 1 : col;
+  const long bottomRow = ( row + 1 < d_height ) ? row + 1 : row;
+  const long corners[4] = { row * d_width + col, row * d_width + rightCol,
+                            bottomRow * d_width + col,
+                            bottomRow * d_width + rightCol };
+  const double* derivatives;
+  long corner;
+
+  for ( corner = 0; corner < 4; corner++ )
+  {
+    derivatives = d_pDerivatives + corners[corner] * DERIVATIVES;
+
+    cell[corner]           = grid.nodeX[ corners[corner] ];
+    cell[4 + corner]       = derivatives[XX_X];
+    cell[8 + corner]       = derivatives[YY_X];
+    cell[12 + corner]      = derivatives[XY_X];
+    cell[16 + corner]      = grid.nodeY[ corners[corner] ];
+    cell[16 + 4 + corner]  = derivatives[XX_Y];
+    cell[16 + 8 + corner]  = derivatives[YY_Y];
+    cell[16 + 12 + corner] = derivatives[XY_Y];
+  }
+
+  // The edge cells have no nodes past them, so they stay on their own
+  // column or row
+  cell[32] = ( rightCol == col ) ? 1.0 : 0.0;
+  cell[33] = ( bottomRow == row ) ? 1.0 : 0.0;
+}
+
+
+// ***************************************************************************
+void MeshSpline::evaluateCell( const double* cell, double u, double v,
+                               double& x, double& y ) throw()
+{
+  const double* cx = cell;
+  const double* cy = cell + 16;
+
+  if ( 0.0 != cell[32] )
+    u = 0.0;
+  if ( 0.0 != cell[33] )
+    v = 0.0;
+
+  // The cubic spline weights of the values and second derivatives at
+  // each end of the cell
+  const double a0 = 1.0 - u, a1 = u;
+  const double c0 = ( a0 * a0 * a0 - a0 ) / 6.0;
+  const double c1 = ( a1 * a1 * a1 - a1 ) / 6.0;
+  const double b0 = 1.0 - v, b1 = v;
+  const double e0 = ( b0 * b0 * b0 - b0 ) / 6.0;
+  const double e1 = ( b1 * b1 * b1 - b1 ) / 6.0;
+
+  x = b0 * ( a0 * cx[0] + a1 * cx[1] + c0 * cx[4] + c1 * cx[5] ) +
+      b1 * ( a0 * cx[2] + a1 * cx[3] + c0 * cx[6] + c1 * cx[7] ) +
+      e0 * ( a0 * cx[8] + a1 * cx[9] + c0 * cx[12] + c1 * cx[13] ) +
+      e1 * ( a0 * cx[10] + a1 * cx[11] + c0 * cx[14] + c1 * cx[15] );
+
+  y = b0 * ( a0 * cy[0] + a1 * cy[1] + c0 * cy[4] + c1 * cy[5] ) +
+      b1 * ( a0 * cy[2] + a1 * cy[3] + c0 * cy[6] + c1 * cy[7] ) +
+      e0 * ( a0 * cy[8] + a1 * cy[9] + c0 * cy[12] + c1 * cy[13] ) +
+      e1 * ( a0 * cy[10] + a1 * cy[11] + c0 * cy[14] + c1 * cy[15] );
+}
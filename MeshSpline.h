@@ -0,0 +1,101 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshSpline fits one bicubic spline surface through all the nodes of a
+// ProjectionMesh, rather than a spline through the 4x4 nodes around each
+// point the way the MathLib BiCubicSpline interpolator does.  The surface
+// is the tensor product of cubic splines along the rows and the columns,
+// so it is twice continuously differentiable across the cells, and it
+// reproduces any bicubic exactly.
+//
+// The fit is done once by working out, at every node, the second
+// derivative of each projected coordinate along the row, along the column
+// and across both.  Projecting a point then only takes finding its cell
+// and evaluating a cubic from the cell's four corners and their
+// derivatives.  The derivatives take three times the memory of the nodes.
+//
+// Invalid nodes break the rows and columns into runs that are fitted on
+// their own, so the surface stays C2 wherever the nodes are valid.  The
+// cells on the right and bottom edges use their own column or row for
+// the missing corners, like the other interpolators.
+
+#ifndef _MESHSPLINE_H_
+#define _MESHSPLINE_H_
+
+#include <new>
+#include <stddef.h>
+#include "MeshKernels.h"
+
+namespace PmeshLib
+{
+
+class MeshSpline
+{
+ public:
+  // Doubles a cell is set up into by loadCell()
+  enum { CELL_SIZE = 34 };
+
+  MeshSpline() throw();
+  ~MeshSpline();
+
+  /* Fits the spline through the nodes of <grid> that are set in
+     <nodeValid>.  Does nothing if the mesh is less than 2 x 2 */
+  void build( const MeshKernelGrid& grid, const MeshBitWord* nodeValid )
+    throw(std::bad_alloc);
+
+  /* Throws away the fit */
+  void clear() throw();
+
+  /* Returns true if the spline has been fitted */
+  bool isBuilt() const throw();
+
+  /* Gets the number of bytes the fit uses */
+  size_t getMemoryUsage() const throw();
+
+  /* Interpolates the point at offsets <u>, <v> inside the mesh cell whose
+     upper left node is <col>, <row> of <grid> into <x>, <y> */
+  void evaluate( const MeshKernelGrid& grid, long col, long row,
+                 double u, double v, double& x, double& y ) const throw();
+
+  /* Copies what evaluating the cell whose upper left node is <col>, <row>
+     of <grid> needs into <cell>, for points that stay in one cell */
+  void loadCell( const MeshKernelGrid& grid, long col, long row,
+                 double* cell ) const throw();
+
+  /* Interpolates a cell set up by loadCell() at offsets <u>, <v>.  Gives
+     the same answer as evaluate() */
+  static void evaluateCell( const double* cell, double u, double v,
+                            double& x, double& y ) throw();
+
+ private:
+  // Not copyable
+  MeshSpline( const MeshSpline& );
+  MeshSpline& operator=( const MeshSpline& );
+
+  // The derivatives kept for each node, in this order
+  enum { XX_X, YY_X, XY_X, XX_Y, YY_Y, XY_Y, DERIVATIVES };
+
+  /* Fits splines along a line of <count> nodes, the first
+     <firstNode> and each <nodeStep> after it, to <values>, and stores
+     the second derivatives in <second>.  Each is indexed the same way as
+     the nodes times <valueStride> or DERIVATIVES.  <scratch> holds
+     2 * <count> doubles */
+  void fitLine( const double* values, long valueStride,
+                const MeshBitWord* nodeValid, long firstNode, long nodeStep,
+                long count, long secondIndex, double* scratch ) throw();
+
+  long    d_width, d_height;
+  double* d_pDerivatives;   // DERIVATIVES per node, row by row
+};
+
+
+// ***************************************************************************
+inline
+bool MeshSpline::isBuilt() const throw()
+{
+  return ( NULL != d_pDerivatives );
+}
+
+} // namespace
+
+#endif
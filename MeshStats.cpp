@@ -0,0 +1,192 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+#include "MeshStats.h"
+#include <string.h>
+#if defined(PMESH_STATS) && !defined(_WIN32)
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+#include "ProjectionMesh.h"
+
+using namespace PmeshLib;
+
+#if defined(PMESH_STATS)
+// ***************************************************************************
+// Construction
+MeshStats::MeshStats() throw()
+{
+  reset();
+}
+
+
+// ***************************************************************************
+// The finest clock the platform has
+double MeshStats::now() throw()
+{
+#if defined(_WIN32)
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter( &count );
+  QueryPerformanceFrequency( &frequency );
+  return static_cast<double>( count.QuadPart ) / frequency.QuadPart;
+#elif defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0
+  struct timespec time;
+
+  clock_gettime( CLOCK_MONOTONIC, &time );
+  return time.tv_sec + time.tv_nsec * 1e-9;
+#else
+  struct timeval time;
+
+  gettimeofday( &time, NULL );
+  return time.tv_sec + time.tv_usec * 1e-6;
+#endif
+}
+
+
+// ***************************************************************************
+// Records a calculateMesh()
+void MeshStats::addCalculate( double seconds, double projection,
+                              double validation ) throw()
+{
+  PmeshLock lock( d_timeMutex );
+
+  d_meshesCalculated++;
+  d_calculateSeconds  += seconds;
+  d_projectionSeconds += projection;
+  d_validationSeconds += validation;
+}
+
+
+// ***************************************************************************
+// Records a lazy tile being filled in
+void MeshStats::addTile( double projection, double validation ) throw()
+{
+  PmeshLock lock( d_timeMutex );
+
+  d_projectionSeconds += projection;
+  d_validationSeconds += validation;
+}
+
+
+// ***************************************************************************
+// Records a batch of projections
+void MeshStats::addQueries( long type, long points, long outOfMesh,
+                            long invalidCell, double seconds ) throw()
+{
+  if ( points <= 0 )
+    return;
+
+  atomicAdd( d_points, points );
+  if ( outOfMesh )
+    atomicAdd( d_outOfMesh, outOfMesh );
+  if ( invalidCell )
+    atomicAdd( d_invalidCell, invalidCell );
+  atomicAdd( d_latency[ histogram( type ) ][ bucket( seconds / points ) ],
+             points );
+}
+
+
+// ***************************************************************************
+// Records a getProjectedBoundingRect()
+void MeshStats::addBoundingRect( long exactNodes ) throw()
+{
+  atomicAdd( d_boundingRectCalls, 1 );
+  if ( exactNodes )
+  {
+    atomicAdd( d_boundingRectExact, 1 );
+    atomicAdd( d_boundingRectNodes, exactNodes );
+  }
+}
+
+
+// ***************************************************************************
+// Zeroes the counts.  Counts added while this runs may be lost.
+void MeshStats::reset() throw()
+{
+  PmeshLock lock( d_timeMutex );
+  int counter, bucket;
+
+  d_meshesCalculated  = 0;
+  d_points            = 0;
+  d_outOfMesh         = 0;
+  d_invalidCell       = 0;
+  d_boundingRectCalls = 0;
+  d_boundingRectExact = 0;
+  d_boundingRectNodes = 0;
+  for ( counter = 0; counter < MESH_STATS_INTERPOLATORS; counter++ )
+  {
+    for ( bucket = 0; bucket < MESH_STATS_BUCKETS; bucket++ )
+      d_latency[counter][bucket] = 0;
+  }
+  d_calculateSeconds  = 0.0;
+  d_projectionSeconds = 0.0;
+  d_validationSeconds = 0.0;
+}
+
+
+// ***************************************************************************
+// Picks the histogram for an interpolator
+int MeshStats::histogram( long type ) throw()
+{
+  switch ( type )
+  {
+  case MathLib::DlgViewer:         return 0;
+  case MathLib::LeastSquaresPlane: return 1;
+  case MathLib::BiPolynomial:      return 2;
+  case MathLib::BiLinear:          return 3;
+  case MathLib::BiCubic:           return 4;
+  case MathLib::BiCubicSpline:     return 5;
+  default:                         return MESH_STATS_INTERPOLATORS - 1;
+  }
+}
+
+
+// ***************************************************************************
+// Picks the power of two nanoseconds bucket for a time
+int MeshStats::bucket( double seconds ) throw()
+{
+  double nanoseconds = seconds * 1e9;
+  int index = 0;
+
+  while ( nanoseconds >= 2.0 && index < MESH_STATS_BUCKETS - 1 )
+  {
+    nanoseconds *= 0.5;
+    index++;
+  }
+  return index;
+}
+#endif
+
+
+// ***************************************************************************
+// Copies the counts out
+void MeshStats::getSnapshot( MeshStatsSnapshot& snapshot ) const throw()
+{
+  memset( &snapshot, 0, sizeof(snapshot) );
+
+#if defined(PMESH_STATS)
+  int counter, bucket;
+
+  snapshot.enabled           = true;
+  snapshot.meshesCalculated  = d_meshesCalculated;
+  snapshot.points            = d_points;
+  snapshot.outOfMesh         = d_outOfMesh;
+  snapshot.invalidCell       = d_invalidCell;
+  snapshot.boundingRectCalls = d_boundingRectCalls;
+  snapshot.boundingRectExact = d_boundingRectExact;
+  snapshot.boundingRectNodes = d_boundingRectNodes;
+  for ( counter = 0; counter < MESH_STATS_INTERPOLATORS; counter++ )
+  {
+    for ( bucket = 0; bucket < MESH_STATS_BUCKETS; bucket++ )
+      snapshot.latency[counter][bucket] = d_latency[counter][bucket];
+  }
+
+  PmeshLock lock( d_timeMutex );
+
+  snapshot.calculateSeconds  = d_calculateSeconds;
+  snapshot.projectionSeconds = d_projectionSeconds;
+  snapshot.validationSeconds = d_validationSeconds;
+#endif
+}
@@ -0,0 +1,185 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Instrumentation for ProjectionMesh.  When the library is built with
+// PMESH_STATS defined each mesh counts what it does: how long
+// calculateMesh() takes and how much of that is spent in the projection
+// library and in validating the nodes, how many points are projected and
+// why the ones that fail do, a histogram of projection latencies for each
+// interpolator, and how often getProjectedBoundingRect() has to project
+// nodes exactly.  ProjectionMesh::getStats() takes a snapshot of the
+// counts for a metrics exporter to poll.
+//
+// Without PMESH_STATS every recording function here is an empty inline,
+// so the instrumentation compiles out and costs nothing.
+//
+// The counters are updated with atomic adds so any number of threads can
+// project through a mesh while it is being counted.  They are unsigned
+// long and wrap like any counter.
+
+#ifndef _MESHSTATS_H_
+#define _MESHSTATS_H_
+
+#include "PmeshThread.h"
+
+namespace PmeshLib
+{
+
+// Latency histogram buckets.  Bucket i counts projections taking from 2^i
+// up to 2^(i+1) nanoseconds, the first also counts anything quicker and
+// the last anything slower.
+#define MESH_STATS_BUCKETS 24
+
+// Histograms are kept for the six MathLib interpolators in the order
+// DlgViewer, LeastSquaresPlane, BiPolynomial, BiLinear, BiCubic,
+// BiCubicSpline, then one for any other type
+#define MESH_STATS_INTERPOLATORS 7
+
+struct MeshStatsSnapshot
+{
+  bool          enabled;            // false if built without PMESH_STATS
+  unsigned long meshesCalculated;   // calculateMesh() calls
+  double        calculateSeconds;   // spent in calculateMesh()
+  double        projectionSeconds;  // of which in the projection library,
+                                    // plus lazy tiles filled in later
+  double        validationSeconds;  // of which validating nodes and cells,
+                                    // plus lazy tiles
+  unsigned long points;             // points asked for through projectPoint()
+                                    // and the batch and run functions
+  unsigned long outOfMesh;          // of which outside the mesh bounds
+  unsigned long invalidCell;        // of which in a cell with an invalid
+                                    // corner
+  unsigned long boundingRectCalls;  // getProjectedBoundingRect() calls
+  unsigned long boundingRectExact;  // of which projected a node exactly
+  unsigned long boundingRectNodes;  // nodes they projected exactly
+  unsigned long latency[MESH_STATS_INTERPOLATORS][MESH_STATS_BUCKETS];
+                                    // projections by time taken.  Batches
+                                    // count each point at the batch's
+                                    // average
+};
+
+class MeshStats
+{
+ public:
+  MeshStats() throw();
+
+  /* Returns true if the library was built with PMESH_STATS */
+  static bool isEnabled() throw();
+
+  /* Gets a time in seconds for measuring intervals with.  0 when stats
+     are off */
+  static double now() throw();
+
+  /* Records a calculateMesh() that took <seconds>, <projection> of them
+     in the projection library and <validation> validating */
+  void addCalculate( double seconds, double projection, double validation )
+    throw();
+
+  /* Records the time a lazy tile took to fill in */
+  void addTile( double projection, double validation ) throw();
+
+  /* Records a batch of <points> projected with interpolator <type> in
+     <seconds>, <outOfMesh> of which were outside the mesh and
+     <invalidCell> in invalid cells */
+  void addQueries( long type, long points, long outOfMesh, long invalidCell,
+                   double seconds ) throw();
+
+  /* Records a getProjectedBoundingRect() that projected <exactNodes>
+     nodes exactly */
+  void addBoundingRect( long exactNodes ) throw();
+
+  /* Copies the counts into <snapshot> */
+  void getSnapshot( MeshStatsSnapshot& snapshot ) const throw();
+
+  /* Sets everything back to zero */
+  void reset() throw();
+
+ private:
+  // Not copyable
+  MeshStats( const MeshStats& );
+  MeshStats& operator=( const MeshStats& );
+
+  /* Gets the histogram of interpolator <type> */
+  static int histogram( long type ) throw();
+
+  /* Gets the bucket for <seconds> */
+  static int bucket( double seconds ) throw();
+
+#if defined(PMESH_STATS)
+  volatile unsigned long d_meshesCalculated;
+  volatile unsigned long d_points;
+  volatile unsigned long d_outOfMesh;
+  volatile unsigned long d_invalidCell;
+  volatile unsigned long d_boundingRectCalls;
+  volatile unsigned long d_boundingRectExact;
+  volatile unsigned long d_boundingRectNodes;
+  volatile unsigned long
+    d_latency[MESH_STATS_INTERPOLATORS][MESH_STATS_BUCKETS];
+
+  // The times are doubles, which can't be added to atomically, so they
+  // are kept under a lock.  They only change once per calculateMesh() or
+  // lazy tile.
+  mutable PmeshMutex d_timeMutex;
+  double d_calculateSeconds;
+  double d_projectionSeconds;
+  double d_validationSeconds;
+#endif
+};
+
+
+#if !defined(PMESH_STATS)
+// ***************************************************************************
+// With stats compiled out all of the recording does nothing
+inline
+MeshStats::MeshStats() throw()
+{
+}
+
+inline
+bool MeshStats::isEnabled() throw()
+{
+  return false;
+}
+
+inline
+double MeshStats::now() throw()
+{
+  return 0.0;
+}
+
+inline
+void MeshStats::addCalculate( double, double, double ) throw()
+{
+}
+
+inline
+void MeshStats::addTile( double, double ) throw()
+{
+}
+
+inline
+void MeshStats::addQueries( long, long, long, long, double ) throw()
+{
+}
+
+inline
+void MeshStats::addBoundingRect( long ) throw()
+{
+}
+
+inline
+void MeshStats::reset() throw()
+{
+}
+#else
+// ***************************************************************************
+inline
+bool MeshStats::isEnabled() throw()
+{
+  return true;
+}
+#endif
+
+} // namespace
+
+#endif
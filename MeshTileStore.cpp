@@ -0,0 +1,439 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshTileStore class
+
+#include "MeshTileStore.h"
+#include <string.h>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace PmeshLib;
+
+
+// ***************************************************************************
+MeshTileStore::MeshTileStore() throw()
+  : d_width(0), d_height(0), d_tileSize(0), d_tileCols(0), d_tileRows(0),
+    d_slotCount(0), d_pSlots(NULL), d_pSlotNodes(NULL), d_pTileSlot(NULL),
+    d_useClock(0), d_faults(0), d_writeBacks(0), d_bFailed(false),
+#if defined(_WIN32)
+    d_hFile(NULL)
+#else
+    d_fd(-1)
+#endif
+{
+}
+
+
+// ***************************************************************************
+MeshTileStore::~MeshTileStore()
+{
+  close();
+}
+
+
+// ***************************************************************************
+// Sizes the file up front so that tiles never written read back as 0.  On
+// POSIX systems the file is unlinked straight away, so it goes away with
+// the descriptor even if the program doesn't get to close it.
+bool MeshTileStore::create( const char* path, long width, long height,
+                            long tileSize, size_t budget ) throw()
+{
+  size_t tileBytes, slotNodes;
+  double fileBytes;
+  long   tiles, counter;
+
+  close();
+  if ( !path || width < 1 || height < 1 || tileSize < 1 )
+    return false;
+
+  d_width    = width;
+  d_height   = height;
+  d_tileSize = tileSize;
+  d_tileCols = ( width + tileSize - 1 ) / tileSize;
+  d_tileRows = ( height + tileSize - 1 ) / tileSize;
+  tiles      = d_tileCols * d_tileRows;
+  tileBytes  = getTileBytes();
+  fileBytes  = static_cast<double>( tileBytes ) * tiles;
+
+  d_slotCount = static_cast<long>( budget / tileBytes );
+  if ( d_slotCount < MESH_TILE_STORE_MIN_TILES )
+    d_slotCount = MESH_TILE_STORE_MIN_TILES;
+  if ( d_slotCount > tiles )
+    d_slotCount = tiles;
+  slotNodes = static_cast<size_t>( tileSize ) * tileSize * 2;
+
+#if defined(_WIN32)
+  HANDLE hFile;
+  LONG   sizeHigh;
+  DWORD  sizeLow;
+
+  hFile = CreateFileA( path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                       CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                       NULL );
+  if ( INVALID_HANDLE_VALUE == hFile )
+  {
+    close();
+    return false;
+  }
+  d_hFile  = hFile;
+  sizeHigh = static_cast<LONG>( fileBytes / 4294967296.0 );
+  sizeLow  = SetFilePointer( hFile, static_cast<LONG>( static_cast<DWORD>(
+                               fileBytes - sizeHigh * 4294967296.0 ) ),
+                             &sizeHigh, FILE_BEGIN );
+  if ( ( INVALID_SET_FILE_POINTER == sizeLow &&
+         NO_ERROR != GetLastError() ) || !SetEndOfFile( hFile ) )
+  {
+    close();
+    return false;
+  }
+#else
+  if ( ( d_fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0600 ) ) < 0 )
+  {
+    close();
+    return false;
+  }
+  unlink( path );
+
+  // off_t has to be able to reach the end of the file
+  if ( fileBytes != static_cast<double>( static_cast<off_t>( fileBytes ) ) ||
+       0 != ftruncate( d_fd, static_cast<off_t>( fileBytes ) ) )
+  {
+    close();
+    return false;
+  }
+#endif
+
+  if ( !( d_pTileSlot = new (std::nothrow) long[tiles] ) ||
+       !( d_pSlotNodes = new (std::nothrow)
+            double[ slotNodes * d_slotCount ] ) ||
+       !( d_pSlots = new (std::nothrow) Slot[d_slotCount] ) )
+  {
+    close();
+    return false;
+  }
+
+  for ( counter = 0; counter < tiles; counter++ )
+    d_pTileSlot[counter] = -1;
+
+  for ( counter = 0; counter < d_slotCount; counter++ )
+  {
+    d_pSlots[counter].tile    = -1;
+    d_pSlots[counter].bDirty  = false;
+    d_pSlots[counter].lastUse = 0;
+    d_pSlots[counter].pNodes  = d_pSlotNodes + slotNodes * counter;
+  }
+  return true;
+}
+
+
+// ***************************************************************************
+void MeshTileStore::close() throw()
+{
+  delete [] d_pSlots;
+  delete [] d_pSlotNodes;
+  delete [] d_pTileSlot;
+  d_pSlots     = NULL;
+  d_pSlotNodes = NULL;
+  d_pTileSlot  = NULL;
+
+#if defined(_WIN32)
+  if ( d_hFile )
+    CloseHandle( d_hFile );
+  d_hFile = NULL;
+#else
+  if ( d_fd >= 0 )
+    ::close( d_fd );
+  d_fd = -1;
+#endif
+
+  d_width = d_height = d_tileSize = 0;
+  d_tileCols = d_tileRows = d_slotCount = 0;
+  d_useClock = d_faults = d_writeBacks = 0;
+  d_bFailed = false;
+}
+
+
+// ***************************************************************************
+void MeshTileStore::getNode( long col, long row, double& x, double& y ) const
+  throw()
+{
+  PmeshLock lock( d_mutex );
+  long offset;
+  const Slot& slot = locate( col, row, offset );
+
+  x = slot.pNodes[offset];
+  y = slot.pNodes[ offset + d_tileSize * d_tileSize ];
+}
+
+
+// ***************************************************************************
+void MeshTileStore::setNode( long col, long row, double x, double y ) throw()
+{
+  PmeshLock lock( d_mutex );
+  long offset;
+  Slot& slot = locate( col, row, offset );
+
+  slot.pNodes[offset] = x;
+  slot.pNodes[ offset + d_tileSize * d_tileSize ] = y;
+  slot.bDirty = true;
+}
+
+
+// ***************************************************************************
+// Each node is copied out as soon as its tile is looked up, so a tile
+// later in the block pushing an earlier one out doesn't matter
+void MeshTileStore::getBlock( long firstCol, long firstRow, long size,
+                              double* blockX, double* blockY ) const throw()
+{
+  PmeshLock lock( d_mutex );
+  const long tileNodes = d_tileSize * d_tileSize;
+  long r, k, col, row, offset;
+
+  for ( r = 0; r < size; r++ )
+  {
+    row = ( firstRow + r < d_height ) ? firstRow + r : d_height - 1;
+    for ( k = 0; k < size; k++ )
+    {
+      col = ( firstCol + k < d_width ) ? firstCol + k : d_width - 1;
+      const Slot& slot = locate( col, row, offset );
+
+      blockX[ r * size + k ] = slot.pNodes[offset];
+      blockY[ r * size + k ] = slot.pNodes[ offset + tileNodes ];
+    }
+  }
+}
+
+
+// ***************************************************************************
+void MeshTileStore::expand( double* nodeX, double* nodeY ) const throw()
+{
+  PmeshLock lock( d_mutex );
+  const long tileNodes = d_tileSize * d_tileSize;
+  long tile, firstCol, firstRow, col, row, node;
+
+  for ( tile = 0; tile < d_tileCols * d_tileRows; tile++ )
+  {
+    const Slot& slot = lookup( tile );
+
+    firstCol = ( tile % d_tileCols ) * d_tileSize;
+    firstRow = ( tile / d_tileCols ) * d_tileSize;
+    for ( row = firstRow; row < firstRow + d_tileSize && row < d_height;
+          row++ )
+    {
+      for ( col = firstCol; col < firstCol + d_tileSize && col < d_width;
+            col++ )
+      {
+        node = ( row - firstRow ) * d_tileSize + col - firstCol;
+        nodeX[ row * d_width + col ] = slot.pNodes[node];
+        nodeY[ row * d_width + col ] = slot.pNodes[ node + tileNodes ];
+      }
+    }
+  }
+}
+
+
+// ***************************************************************************
+bool MeshTileStore::hasFailed() const throw()
+{
+  PmeshLock lock( d_mutex );
+
+  return d_bFailed;
+}
+
+
+// ***************************************************************************
+long MeshTileStore::getResidentTileCount() const throw()
+{
+  PmeshLock lock( d_mutex );
+  long resident = 0;
+
+  for ( long counter = 0; counter < d_slotCount; counter++ )
+  {
+    if ( d_pSlots[counter].tile >= 0 )
+      resident++;
+  }
+  return resident;
+}
+
+
+// ***************************************************************************
+unsigned long MeshTileStore::getFaultCount() const throw()
+{
+  PmeshLock lock( d_mutex );
+
+  return d_faults;
+}
+
+
+// ***************************************************************************
+unsigned long MeshTileStore::getWriteBackCount() const throw()
+{
+  PmeshLock lock( d_mutex );
+
+  return d_writeBacks;
+}
+
+
+// ***************************************************************************
+void MeshTileStore::resetCounters() throw()
+{
+  PmeshLock lock( d_mutex );
+
+  d_faults = d_writeBacks = 0;
+}
+
+
+// ***************************************************************************
+size_t MeshTileStore::getMemoryUsage() const throw()
+{
+  if ( !isBuilt() )
+    return 0;
+
+  return d_slotCount * ( getTileBytes() + sizeof(Slot) ) +
+    static_cast<size_t>( d_tileCols ) * d_tileRows * sizeof(long);
+}
+
+
+// ***************************************************************************
+// Hands out the tile's slot if it's held, otherwise takes over the least
+// recently used slot.  There are only a few slots and a fault means going
+// to the disk anyway, so they are simply searched.
+MeshTileStore::Slot& MeshTileStore::lookup( long tile ) const throw()
+{
+  long counter, victim;
+
+  d_useClock++;
+  if ( d_pTileSlot[tile] >= 0 )
+  {
+    Slot& slot = d_pSlots[ d_pTileSlot[tile] ];
+
+    slot.lastUse = d_useClock;
+    return slot;
+  }
+
+  victim = 0;
+  for ( counter = 1; counter < d_slotCount; counter++ )
+  {
+    if ( d_pSlots[counter].lastUse < d_pSlots[victim].lastUse )
+      victim = counter;
+  }
+
+  Slot& slot = d_pSlots[victim];
+
+  if ( slot.tile >= 0 )
+  {
+    if ( slot.bDirty )
+    {
+      if ( !writeTile( slot.tile, slot.pNodes ) )
+        d_bFailed = true;
+      d_writeBacks++;
+    }
+    d_pTileSlot[ slot.tile ] = -1;
+  }
+
+  if ( !readTile( tile, slot.pNodes ) )
+  {
+    memset( slot.pNodes, 0, getTileBytes() );
+    d_bFailed = true;
+  }
+  d_faults++;
+
+  slot.tile    = tile;
+  slot.bDirty  = false;
+  slot.lastUse = d_useClock;
+  d_pTileSlot[tile] = victim;
+  return slot;
+}
+
+
+// ***************************************************************************
+// Finds the node's tile and where in it the node is
+MeshTileStore::Slot& MeshTileStore::locate( long col, long row,
+                                            long& offset ) const throw()
+{
+  const long tileCol = col / d_tileSize;
+  const long tileRow = row / d_tileSize;
+
+  offset = ( row - tileRow * d_tileSize ) * d_tileSize +
+    ( col - tileCol * d_tileSize );
+  return lookup( tileRow * d_tileCols + tileCol );
+}
+
+
+// ***************************************************************************
+bool MeshTileStore::readTile( long tile, double* pNodes ) const throw()
+{
+  const size_t bytes = getTileBytes();
+  char* buffer = reinterpret_cast<char*>( pNodes );
+
+#if defined(_WIN32)
+  const double start = static_cast<double>( bytes ) * tile;
+  OVERLAPPED overlapped;
+  DWORD read;
+
+  memset( &overlapped, 0, sizeof(overlapped) );
+  overlapped.OffsetHigh = static_cast<DWORD>( start / 4294967296.0 );
+  overlapped.Offset = static_cast<DWORD>(
+    start - overlapped.OffsetHigh * 4294967296.0 );
+  return ( ReadFile( d_hFile, buffer, static_cast<DWORD>( bytes ), &read,
+                     &overlapped ) && bytes == read );
+#else
+  off_t  start = static_cast<off_t>( bytes ) * tile;
+  size_t done = 0;
+  ssize_t result;
+
+  // Reads can come back short, so keep going until the tile is in
+  while ( done < bytes )
+  {
+    result = pread( d_fd, buffer + done, bytes - done, start + done );
+    if ( result <= 0 )
+      return false;
+    done += static_cast<size_t>( result );
+  }
+  return true;
+#endif
+}
+
+
+// ***************************************************************************
+bool MeshTileStore::writeTile( long tile, const double* pNodes ) const
+  throw()
+{
+  const size_t bytes = getTileBytes();
+  const char* buffer = reinterpret_cast<const char*>( pNodes );
+
+#if defined(_WIN32)
+  const double start = static_cast<double>( bytes ) * tile;
+  OVERLAPPED overlapped;
+  DWORD written;
+
+  memset( &overlapped, 0, sizeof(overlapped) );
+  overlapped.OffsetHigh = static_cast<DWORD>( start / 4294967296.0 );
+  overlapped.Offset = static_cast<DWORD>(
+    start - overlapped.OffsetHigh * 4294967296.0 );
+  return ( WriteFile( d_hFile, buffer, static_cast<DWORD>( bytes ), &written,
+                      &overlapped ) && bytes == written );
+#else
+  off_t  start = static_cast<off_t>( bytes ) * tile;
+  size_t done = 0;
+  ssize_t result;
+
+  while ( done < bytes )
+  {
+    result = pwrite( d_fd, buffer + done, bytes - done, start + done );
+    if ( result <= 0 )
+      return false;
+    done += static_cast<size_t>( result );
+  }
+  return true;
+#endif
+}
@@ -0,0 +1,193 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshTileStore keeps the projected nodes of a ProjectionMesh on disk, for
+// meshes too big to hold in memory alongside everything else.  The nodes
+// are split into tiles of tileSize x tileSize, each stored in a scratch
+// file as its x's then its y's:
+//
+//   tile 0: double x[tileSize * tileSize], double y[tileSize * tileSize]
+//   tile 1: ...
+//
+// with tiles numbered row by row and the tiles on the right and bottom
+// edges padded out to full size.  A fixed number of tiles are held in
+// memory at once, as many as fit in the budget the store is created with.
+// Reading or writing a node that isn't held faults its tile in, writing
+// the least recently used tile back out first if it was changed.
+//
+// A lock is held while a tile is looked up, so any number of threads can
+// read and write through one store.  Each call locks once, so reading a
+// block or a row of nodes at a time is much quicker than node by node.
+// If the file can't be read or written the store notes it (see
+// hasFailed()) and reads the nodes it couldn't as 0.
+
+#ifndef _MESHTILESTORE_H_
+#define _MESHTILESTORE_H_
+
+#include <stddef.h>
+#include "PmeshThread.h"
+
+namespace PmeshLib
+{
+
+// The fewest tiles held whatever the budget: enough for a block of nodes
+// that straddles the corner of four tiles
+#define MESH_TILE_STORE_MIN_TILES 4
+
+class MeshTileStore
+{
+ public:
+  MeshTileStore() throw();
+  ~MeshTileStore();
+
+  /* Creates the scratch file <path> for <width> x <height> nodes in tiles
+     of <tileSize> x <tileSize>, closing anything already open, and sets
+     aside as many tiles of memory as fit in <budget> bytes (but at least
+     MESH_TILE_STORE_MIN_TILES).  Every node starts out 0.  The file is
+     removed when the store is closed.  Returns false if the file can't be
+     created or there's no room for the tiles */
+  bool create( const char* path, long width, long height, long tileSize,
+               size_t budget ) throw();
+
+  /* Throws the nodes away and removes the file */
+  void close() throw();
+
+  /* Returns true if the store has been created */
+  bool isBuilt() const throw();
+
+  /* Gets the node at <col>, <row> */
+  void getNode( long col, long row, double& x, double& y ) const throw();
+
+  /* Sets the node at <col>, <row> */
+  void setNode( long col, long row, double x, double y ) throw();
+
+  /* Gets the <size> x <size> nodes from <firstCol>, <firstRow> into
+     <blockX> and <blockY> row by row.  Nodes past the last column or row
+     repeat it */
+  void getBlock( long firstCol, long firstRow, long size,
+                 double* blockX, double* blockY ) const throw();
+
+  /* Gets every node into <nodeX> and <nodeY>, which hold width x height
+     doubles each, a tile at a time */
+  void expand( double* nodeX, double* nodeY ) const throw();
+
+  /* Returns true if reading or writing the file has failed since the
+     store was created */
+  bool hasFailed() const throw();
+
+  /* Gets the tile size */
+  long getTileSize() const throw();
+
+  /* Gets the number of tiles in the file */
+  long getTileCount() const throw();
+
+  /* Gets the number of tiles the memory set aside holds */
+  long getSlotCount() const throw();
+
+  /* Gets the number of tiles in memory right now */
+  long getResidentTileCount() const throw();
+
+  /* Gets the number of times a tile has been read in from the file and
+     written back out to it since the store was created or
+     resetCounters() was called */
+  unsigned long getFaultCount() const throw();
+  unsigned long getWriteBackCount() const throw();
+
+  /* Zeroes the fault and write back counts */
+  void resetCounters() throw();
+
+  /* Gets the bytes a tile takes in the file and in memory */
+  size_t getTileBytes() const throw();
+
+  /* Gets the bytes of memory the store uses */
+  size_t getMemoryUsage() const throw();
+
+ private:
+  // Not copyable
+  MeshTileStore( const MeshTileStore& );
+  MeshTileStore& operator=( const MeshTileStore& );
+
+  // A tile's worth of memory
+  struct Slot
+  {
+    long          tile;          // held here, -1 if none
+    bool          bDirty;        // changed since read in
+    unsigned long lastUse;       // d_useClock when last looked up
+    double*       pNodes;        // x's then y's
+  };
+
+  /* Returns the slot holding <tile>, faulting it in if need be.  The
+     lock must be held */
+  Slot& lookup( long tile ) const throw();
+
+  /* Returns the slot holding the node at <col>, <row> and sets <offset>
+     to where the node's x is in it.  The lock must be held */
+  Slot& locate( long col, long row, long& offset ) const throw();
+
+  /* Reads or writes <tile> from or to <pNodes>.  Return false on
+     failure */
+  bool readTile( long tile, double* pNodes ) const throw();
+  bool writeTile( long tile, const double* pNodes ) const throw();
+
+  long    d_width, d_height;
+  long    d_tileSize;
+  long    d_tileCols, d_tileRows;
+  long    d_slotCount;
+  Slot*   d_pSlots;
+  double* d_pSlotNodes;           // every slot's nodes in one block
+  long*   d_pTileSlot;            // per tile, the slot it's in or -1
+  mutable unsigned long d_useClock;
+  mutable unsigned long d_faults;
+  mutable unsigned long d_writeBacks;
+  mutable bool          d_bFailed;
+  mutable PmeshMutex    d_mutex;  // held while looking a tile up
+#if defined(_WIN32)
+  void*   d_hFile;                // the scratch file, NULL if closed
+#else
+  int     d_fd;                   // the scratch file, -1 if closed
+#endif
+};
+
+
+// ***************************************************************************
+inline
+bool MeshTileStore::isBuilt() const throw()
+{
+  return ( NULL != d_pSlots );
+}
+
+
+// ***************************************************************************
+inline
+long MeshTileStore::getTileSize() const throw()
+{
+  return d_tileSize;
+}
+
+
+// ***************************************************************************
+inline
+long MeshTileStore::getTileCount() const throw()
+{
+  return d_tileCols * d_tileRows;
+}
+
+
+// ***************************************************************************
+inline
+long MeshTileStore::getSlotCount() const throw()
+{
+  return d_slotCount;
+}
+
+
+// ***************************************************************************
+inline
+size_t MeshTileStore::getTileBytes() const throw()
+{
+  return static_cast<size_t>( d_tileSize ) * d_tileSize * 2 * sizeof(double);
+}
+
+} // namespace
+
+#endif
@@ -0,0 +1,495 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the MeshWarp class
+
+#include "MeshWarp.h"
+#include "ProjectionMesh.h"
+#include "PmeshThread.h"
+#include <math.h>
+#include <new>
+
+using namespace PmeshLib;
+
+namespace
+{
+// The source image with what each row needs worked out ahead of time
+struct WarpSource
+{
+  const unsigned char* data;
+  long   width, height;
+  long   bands;
+  long   rowBytes;
+  double toPixel[6];     // projected coordinate to pixel, the inverse of
+                         // the geotransform
+};
+
+// What each thread gets handed.  Tiles <firstTile>, <firstTile> +
+// <tileStep>, ... are this job's.
+struct WarpJob
+{
+  const ProjectionMesh* mesh;
+  const WarpSource*     source;
+  const MeshWarpImage*  dest;
+  int    resampling;
+  double noData;
+  bool   bMeshIsInverse;
+  long   tileSize;
+  long   tileCols, tileCount;
+  long   firstTile, tileStep;
+  long   written;
+  bool   bSucceeded;
+};
+
+// ***************************************************************************
+// Converts a resampled value to a sample, rounding and clamping it to the
+// range of the integer types
+template <class T>
+T toSample( double value ) throw()
+{
+  return static_cast<T>( value );
+}
+
+template <>
+unsigned char toSample<unsigned char>( double value ) throw()
+{
+  value = floor( value + 0.5 );
+  return static_cast<unsigned char>( value < 0.0 ? 0.0 :
+                                     ( value > 255.0 ? 255.0 : value ) );
+}
+
+template <>
+short toSample<short>( double value ) throw()
+{
+  value = floor( value + 0.5 );
+  return static_cast<short>( value < -32768.0 ? -32768.0 :
+                             ( value > 32767.0 ? 32767.0 : value ) );
+}
+
+template <>
+unsigned short toSample<unsigned short>( double value ) throw()
+{
+  value = floor( value + 0.5 );
+  return static_cast<unsigned short>( value < 0.0 ? 0.0 :
+                                      ( value > 65535.0 ? 65535.0
+                                                        : value ) );
+}
+
+// ***************************************************************************
+// Gets sample <band> of source pixel <col>, <row>, which must be in the
+// image
+template <class T>
+inline
+double sourceSample( const WarpSource& source, long col, long row,
+                     long band ) throw()
+{
+  const T* samples = reinterpret_cast<const T*>( source.data +
+                                                 row * source.rowBytes );
+
+  return samples[ col * source.bands + band ];
+}
+
+// ***************************************************************************
+// Catmull-Rom weights for the four pixels around offset <t>
+inline
+void cubicWeights( double t, double weights[4] ) throw()
+{
+  weights[0] = ( ( -0.5 * t + 1.0 ) * t - 0.5 ) * t;
+  weights[1] = ( 1.5 * t - 2.5 ) * t * t + 1.0;
+  weights[2] = ( ( -1.5 * t + 2.0 ) * t + 0.5 ) * t;
+  weights[3] = ( 0.5 * t - 0.5 ) * t * t;
+}
+
+// ***************************************************************************
+// Clamps a source column or row index into the image
+inline
+long clampIndex( long index, long size ) throw()
+{
+  return ( index < 0 ) ? 0 : ( ( index >= size ) ? size - 1 : index );
+}
+
+// ***************************************************************************
+// Resamples <count> output pixels whose source coordinates are in <x>,
+// <y> into <out> with <RESAMPLING>, which being a template argument gets
+// its switch compiled away.  Returns how many of them were inside the
+// source.
+template <class T, int RESAMPLING>
+long resampleRow( const WarpSource& source, const double* x,
+                  const double* y, const bool* valid, long count,
+                  double noData, T* out ) throw()
+{
+  const double* toPixel = source.toPixel;
+  const long bands = source.bands;
+  const T noDataSample = toSample<T>( noData );
+  double px, py, tx, ty, value;
+  double weightX[4], weightY[4];
+  long col, row, band, taps[4], tapRows[4];
+  long written = 0;
+
+  for ( long counter = 0; counter < count; counter++, out += bands )
+  {
+    // Pixel coordinates with pixel centers on the integers
+    px = toPixel[0] + toPixel[1] * x[counter] + toPixel[2] * y[counter]
+      - 0.5;
+    py = toPixel[3] + toPixel[4] * x[counter] + toPixel[5] * y[counter]
+      - 0.5;
+
+    // Anything outside the area the source pixels cover gets no data
+    if ( !valid[counter] ||
+         !( px >= -0.5 && px < source.width - 0.5 &&
+            py >= -0.5 && py < source.height - 0.5 ) )
+    {
+      for ( band = 0; band < bands; band++ )
+        out[band] = noDataSample;
+      continue;
+    }
+
+    switch ( RESAMPLING )
+    {
+    case MESH_WARP_BILINEAR:
+      col = static_cast<long>( floor( px ) );
+      row = static_cast<long>( floor( py ) );
+      tx  = px - col;
+      ty  = py - row;
+      taps[0]    = clampIndex( col, source.width );
+      taps[1]    = clampIndex( col + 1, source.width );
+      tapRows[0] = clampIndex( row, source.height );
+      tapRows[1] = clampIndex( row + 1, source.height );
+
+      for ( band = 0; band < bands; band++ )
+      {
+        double top = sourceSample<T>( source, taps[0], tapRows[0], band );
+        double bottom = sourceSample<T>( source, taps[0], tapRows[1],
+                                         band );
+
+        top += ( sourceSample<T>( source, taps[1], tapRows[0], band ) -
+                 top ) * tx;
+        bottom += ( sourceSample<T>( source, taps[1], tapRows[1], band ) -
+                    bottom ) * tx;
+        out[band] = toSample<T>( top + ( bottom - top ) * ty );
+      }
+      break;
+
+    case MESH_WARP_CUBIC:
+      col = static_cast<long>( floor( px ) );
+      row = static_cast<long>( floor( py ) );
+      cubicWeights( px - col, weightX );
+      cubicWeights( py - row, weightY );
+      for ( int tap = 0; tap < 4; tap++ )
+      {
+        taps[tap]    = clampIndex( col + tap - 1, source.width );
+        tapRows[tap] = clampIndex( row + tap - 1, source.height );
+      }
+
+      for ( band = 0; band < bands; band++ )
+      {
+        value = 0.0;
+        for ( int tapRow = 0; tapRow < 4; tapRow++ )
+        {
+          value += weightY[tapRow] *
+            ( weightX[0] * sourceSample<T>( source, taps[0],
+                                            tapRows[tapRow], band ) +
+              weightX[1] * sourceSample<T>( source, taps[1],
+                                            tapRows[tapRow], band ) +
+              weightX[2] * sourceSample<T>( source, taps[2],
+                                            tapRows[tapRow], band ) +
+              weightX[3] * sourceSample<T>( source, taps[3],
+                                            tapRows[tapRow], band ) );
+        }
+        out[band] = toSample<T>( value );
+      }
+      break;
+
+    default:
+      col = clampIndex( static_cast<long>( floor( px + 0.5 ) ),
+                        source.width );
+      row = clampIndex( static_cast<long>( floor( py + 0.5 ) ),
+                        source.height );
+      for ( band = 0; band < bands; band++ )
+        out[band] = toSample<T>( sourceSample<T>( source, col, row, band ) );
+      break;
+    }
+    written++;
+  }
+  return written;
+}
+
+// ***************************************************************************
+// Picks the resampleRow() for <resampling>
+template <class T>
+long warpRow( const WarpSource& source, const double* x, const double* y,
+              const bool* valid, long count, int resampling,
+              double noData, T* out ) throw()
+{
+  switch ( resampling )
+  {
+  case MESH_WARP_BILINEAR:
+    return resampleRow<T, MESH_WARP_BILINEAR>( source, x, y, valid, count,
+                                               noData, out );
+  case MESH_WARP_CUBIC:
+    return resampleRow<T, MESH_WARP_CUBIC>( source, x, y, valid, count,
+                                            noData, out );
+  }
+  return resampleRow<T, MESH_WARP_NEAREST>( source, x, y, valid, count,
+                                            noData, out );
+}
+
+// ***************************************************************************
+// Warps this job's tiles.  The coordinate buffers are allocated once for
+// all of them.
+void warpTiles( void* arg ) throw()
+{
+  WarpJob* job = static_cast<WarpJob*>( arg );
+  const MeshWarpImage& dest = *job->dest;
+  const double* gt = dest.geoTransform;
+  double* x = NULL;
+  double* y = NULL;
+  bool*   valid = NULL;
+  long tile, firstCol, firstRow, lastCol, lastRow;
+  long col, row, count;
+
+  job->written = 0;
+  job->bSucceeded = false;
+
+  if ( !( x = new (std::nothrow) double[job->tileSize] ) ||
+       !( y = new (std::nothrow) double[job->tileSize] ) ||
+       !( valid = new (std::nothrow) bool[job->tileSize] ) )
+  {
+    delete [] x;
+    delete [] y;
+    delete [] valid;
+    return;
+  }
+
+  try
+  {
+    for ( tile = job->firstTile; tile < job->tileCount;
+          tile += job->tileStep )
+    {
+      firstCol = ( tile % job->tileCols ) * job->tileSize;
+      firstRow = ( tile / job->tileCols ) * job->tileSize;
+      lastCol  = firstCol + job->tileSize;
+      lastRow  = firstRow + job->tileSize;
+      lastCol  = ( lastCol > dest.width ) ? dest.width : lastCol;
+      lastRow  = ( lastRow > dest.height ) ? dest.height : lastRow;
+      count    = lastCol - firstCol;
+
+      for ( row = firstRow; row < lastRow; row++ )
+      {
+        // The output pixel centers along this row of the tile
+        for ( col = firstCol; col < lastCol; col++ )
+        {
+          x[col - firstCol] = gt[0] + ( col + 0.5 ) * gt[1] +
+            ( row + 0.5 ) * gt[2];
+          y[col - firstCol] = gt[3] + ( col + 0.5 ) * gt[4] +
+            ( row + 0.5 ) * gt[5];
+        }
+
+        // Find where they come from in the source
+        if ( job->bMeshIsInverse )
+          job->mesh->projectPoints( x, y, count, valid );
+        else
+          job->mesh->inverseProjectPoints( x, y, count, valid );
+
+        unsigned char* out = static_cast<unsigned char*>( dest.data ) +
+          row * dest.rowBytes;
+
+        switch ( dest.sampleType )
+        {
+        case MESH_WARP_BYTE:
+          job->written += warpRow( *job->source, x, y, valid, count,
+                                   job->resampling, job->noData,
+                                   reinterpret_cast<unsigned char*>( out ) +
+                                   firstCol * dest.bands );
+          break;
+        case MESH_WARP_INT16:
+          job->written += warpRow( *job->source, x, y, valid, count,
+                                   job->resampling, job->noData,
+                                   reinterpret_cast<short*>( out ) +
+                                   firstCol * dest.bands );
+          break;
+        case MESH_WARP_UINT16:
+          job->written += warpRow( *job->source, x, y, valid, count,
+                                   job->resampling, job->noData,
+                                   reinterpret_cast<unsigned short*>( out ) +
+                                   firstCol * dest.bands );
+          break;
+        case MESH_WARP_FLOAT32:
+          job->written += warpRow( *job->source, x, y, valid, count,
+                                   job->resampling, job->noData,
+                                   reinterpret_cast<float*>( out ) +
+                                   firstCol * dest.bands );
+          break;
+        case MESH_WARP_FLOAT64:
+          job->written += warpRow( *job->source, x, y, valid, count,
+                                   job->resampling, job->noData,
+                                   reinterpret_cast<double*>( out ) +
+                                   firstCol * dest.bands );
+          break;
+        }
+      }
+    }
+    job->bSucceeded = true;
+  }
+  catch(...)
+  {
+    job->bSucceeded = false;
+  }
+
+  delete [] x;
+  delete [] y;
+  delete [] valid;
+}
+
+// ***************************************************************************
+// Returns the size in bytes of a sample of <sampleType>, 0 if it isn't one
+size_t sampleSize( int sampleType ) throw()
+{
+  switch ( sampleType )
+  {
+  case MESH_WARP_BYTE:    return sizeof(unsigned char);
+  case MESH_WARP_INT16:   return sizeof(short);
+  case MESH_WARP_UINT16:  return sizeof(unsigned short);
+  case MESH_WARP_FLOAT32: return sizeof(float);
+  case MESH_WARP_FLOAT64: return sizeof(double);
+  }
+  return 0;
+}
+
+// ***************************************************************************
+// Returns true if <image> describes a usable buffer
+bool isUsable( const MeshWarpImage& image ) throw()
+{
+  size_t size = sampleSize( image.sampleType );
+
+  return image.data && size && image.width > 0 && image.height > 0 &&
+    image.bands > 0 &&
+    static_cast<size_t>( image.rowBytes ) >= image.width * image.bands * size;
+}
+}
+
+
+// ***************************************************************************
+MeshWarp::MeshWarp() throw()
+  : d_resampling(MESH_WARP_BILINEAR), d_threadCount(1), d_tileSize(64),
+    d_noData(0.0), d_bMeshIsInverse(false)
+{
+}
+
+
+// ***************************************************************************
+void MeshWarp::setResampling( int resampling ) throw()
+{
+  switch ( resampling )
+  {
+  case MESH_WARP_NEAREST:
+  case MESH_WARP_BILINEAR:
+  case MESH_WARP_CUBIC:
+    d_resampling = resampling;
+    break;
+  }
+}
+
+
+// ***************************************************************************
+void MeshWarp::setThreadCount( long threads ) throw()
+{
+  d_threadCount = ( threads > 1 ) ? threads : 1;
+}
+
+
+// ***************************************************************************
+void MeshWarp::setTileSize( long tileSize ) throw()
+{
+  d_tileSize = ( tileSize > 1 ) ? tileSize : 1;
+}
+
+
+// ***************************************************************************
+long MeshWarp::warp( const ProjectionMesh& mesh, const MeshWarpImage& source,
+                     const MeshWarpImage& dest ) const
+  throw(PmeshException)
+{
+  const double* gt = source.geoTransform;
+  WarpSource warpSource;
+  WarpJob*   jobs = NULL;
+  void**     args = NULL;
+  long       numJobs, tileCols, tileCount, counter;
+  long       written = 0;
+  bool       bSucceeded = true;
+  double     det;
+
+  if ( !isUsable( source ) || !isUsable( dest ) ||
+       source.sampleType != dest.sampleType || source.bands != dest.bands )
+    throw PmeshException(PMESH_INVALID_IMAGE);
+
+  det = gt[1] * gt[5] - gt[2] * gt[4];
+  if ( 0.0 == det )
+    throw PmeshException(PMESH_INVALID_IMAGE);
+
+  // Make sure the mesh can go the way we need before starting anything.
+  // An empty batch throws just as a real one would.
+  if ( d_bMeshIsInverse )
+    mesh.projectPoints( NULL, NULL, 0 );
+  else
+    mesh.inverseProjectPoints( NULL, NULL, 0 );
+
+  warpSource.data     = static_cast<const unsigned char*>( source.data );
+  warpSource.width    = source.width;
+  warpSource.height   = source.height;
+  warpSource.bands    = source.bands;
+  warpSource.rowBytes = source.rowBytes;
+  warpSource.toPixel[1] = gt[5] / det;
+  warpSource.toPixel[2] = -gt[2] / det;
+  warpSource.toPixel[4] = -gt[4] / det;
+  warpSource.toPixel[5] = gt[1] / det;
+  warpSource.toPixel[0] = -( warpSource.toPixel[1] * gt[0] +
+                             warpSource.toPixel[2] * gt[3] );
+  warpSource.toPixel[3] = -( warpSource.toPixel[4] * gt[0] +
+                             warpSource.toPixel[5] * gt[3] );
+
+  tileCols  = ( dest.width + d_tileSize - 1 ) / d_tileSize;
+  tileCount = tileCols * ( ( dest.height + d_tileSize - 1 ) / d_tileSize );
+  numJobs   = ( d_threadCount < tileCount ) ? d_threadCount : tileCount;
+
+  if ( !( jobs = new (std::nothrow) WarpJob[numJobs] ) ||
+       !( args = new (std::nothrow) void*[numJobs] ) )
+  {
+    delete [] jobs;
+    throw PmeshException(PMESH_ERROR_UNKOWN);
+  }
+
+  // Tiles are dealt out round robin so the threads share any expensive
+  // part of the image
+  for ( counter = 0; counter < numJobs; counter++ )
+  {
+    jobs[counter].mesh           = &mesh;
+    jobs[counter].source         = &warpSource;
+    jobs[counter].dest           = &dest;
+    jobs[counter].resampling     = d_resampling;
+    jobs[counter].noData         = d_noData;
+    jobs[counter].bMeshIsInverse = d_bMeshIsInverse;
+    jobs[counter].tileSize       = d_tileSize;
+    jobs[counter].tileCols       = tileCols;
+    jobs[counter].tileCount      = tileCount;
+    jobs[counter].firstTile      = counter;
+    jobs[counter].tileStep       = numJobs;
+    args[counter]                = &jobs[counter];
+  }
+
+  runThreads( warpTiles, args, numJobs );
+
+  for ( counter = 0; counter < numJobs; counter++ )
+  {
+    bSucceeded = bSucceeded && jobs[counter].bSucceeded;
+    written += jobs[counter].written;
+  }
+
+  delete [] jobs;
+  delete [] args;
+
+  if ( !bSucceeded )
+    throw PmeshException(PMESH_ERROR_UNKOWN);
+
+  return written;
+}
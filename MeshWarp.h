@@ -0,0 +1,154 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// MeshWarp reprojects a whole raster through a ProjectionMesh.  For each
+// output pixel it finds the source location its center comes from and
+// resamples the source image there, so every output pixel gets a value
+// and none are written twice.
+//
+// Images are described by a MeshWarpImage: a buffer of interleaved
+// samples and a geotransform in the usual affine form, where the
+// coordinate of the corner of pixel <col>, <row> is
+//
+//   x = gt[0] + col * gt[1] + row * gt[2]
+//   y = gt[3] + col * gt[4] + row * gt[5]
+//
+// The output is worked in square tiles small enough to stay in cache, and
+// the tiles are shared out over a number of threads.  Each row of a tile
+// is projected through the mesh as one batch, and the sample type and
+// resampling method are resolved once per row, so there are no calls
+// through virtual functions or allocations per pixel.
+
+#ifndef _MESHWARP_H_
+#define _MESHWARP_H_
+
+#include "PmeshException.h"
+
+namespace PmeshLib
+{
+
+class ProjectionMesh;
+
+// Sample types of a MeshWarpImage
+#define MESH_WARP_BYTE     0    // unsigned char
+#define MESH_WARP_INT16    1    // short
+#define MESH_WARP_UINT16   2    // unsigned short
+#define MESH_WARP_FLOAT32  3    // float
+#define MESH_WARP_FLOAT64  4    // double
+
+// Resampling methods
+#define MESH_WARP_NEAREST  0
+#define MESH_WARP_BILINEAR 1
+#define MESH_WARP_CUBIC    2    // Catmull-Rom over 4x4 source pixels
+
+struct MeshWarpImage
+{
+  void*  data;              // first sample of the top row
+  long   width, height;     // in pixels
+  long   bands;             // samples per pixel, interleaved
+  long   rowBytes;          // bytes from the start of one row to the next
+  int    sampleType;        // one of the MESH_WARP_ sample types
+  double geoTransform[6];   // see above
+};
+
+class MeshWarp
+{
+ public:
+  MeshWarp() throw();
+
+  /* Sets the resampling method, one of the MESH_WARP_ methods */
+  void setResampling( int resampling ) throw();
+  int getResampling() const throw();
+
+  /* Sets how many threads share the tiles out.  1, the default, does
+     everything on the calling thread */
+  void setThreadCount( long threads ) throw();
+  long getThreadCount() const throw();
+
+  /* Sets the width and height in pixels of the output tiles */
+  void setTileSize( long tileSize ) throw();
+  long getTileSize() const throw();
+
+  /* Sets the value written to output pixels that fall outside the source
+     image or the valid part of the mesh */
+  void setNoData( double noData ) throw();
+  double getNoData() const throw();
+
+  /* By default the mesh is expected to project from the source image's
+     coordinates to the output's, with ProjectionMesh::setInverse() turned
+     on, and is used backwards.  Setting this says it was calculated the
+     other way around, from output to source, so it is used forwards with
+     whatever interpolator it has */
+  void setMeshIsInverse( bool bMeshIsInverse ) throw();
+  bool getMeshIsInverse() const throw();
+
+  /* Fills <dest> with <source> reprojected through <mesh>.  The images
+     must have the same sample type and number of bands.  Returns the
+     number of output pixels that got a value from the source.  Throws
+     PMESH_INVALID_IMAGE if the images don't fit together and
+     PMESH_NOT_CREATED_YET if the mesh can't be used in the direction
+     asked for */
+  long warp( const ProjectionMesh& mesh, const MeshWarpImage& source,
+             const MeshWarpImage& dest ) const throw(PmeshException);
+
+ private:
+  int    d_resampling;
+  long   d_threadCount;
+  long   d_tileSize;
+  double d_noData;
+  bool   d_bMeshIsInverse;
+};
+
+
+// ***************************************************************************
+inline
+int MeshWarp::getResampling() const throw()
+{
+  return d_resampling;
+}
+
+// ***************************************************************************
+inline
+long MeshWarp::getThreadCount() const throw()
+{
+  return d_threadCount;
+}
+
+// ***************************************************************************
+inline
+long MeshWarp::getTileSize() const throw()
+{
+  return d_tileSize;
+}
+
+// ***************************************************************************
+inline
+void MeshWarp::setNoData( double noData ) throw()
+{
+  d_noData = noData;
+}
+
+// ***************************************************************************
+inline
+double MeshWarp::getNoData() const throw()
+{
+  return d_noData;
+}
+
+// ***************************************************************************
+inline
+void MeshWarp::setMeshIsInverse( bool bMeshIsInverse ) throw()
+{
+  d_bMeshIsInverse = bMeshIsInverse;
+}
+
+// ***************************************************************************
+inline
+bool MeshWarp::getMeshIsInverse() const throw()
+{
+  return d_bMeshIsInverse;
+}
+
+} // namespace
+
+#endif
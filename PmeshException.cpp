@@ -19,7 +19,7 @@ PmeshException::~PmeshException()
 }
 
 PmeshException::PmeshException(short int inexception) throw()
-  : exception(PMESH_ERROR_UNKOWN)
+  : exception(inexception)
 {
 }
 
@@ -46,6 +46,15 @@ void PmeshException::getString(std::string &instring) const throw()
     case PMESH_NOT_CREATED_YET:
       instring = "PMESH: Not created yet";
       break;
+    case PMESH_FILE_ERROR:
+      instring = "PMESH: Unable to write mesh file";
+      break;
+    case PMESH_INVALID_IMAGE:
+      instring = "PMESH: Invalid image";
+      break;
+    case PMESH_CANT_COMPOSE:
+      instring = "PMESH: Meshes can not be composed";
+      break;
     default:
       instring = "PMESH: Unkown error";
     }
@@ -14,6 +14,9 @@ namespace PmeshLib    //use namespace to identify errors
 //The execptions thrown by Projection Mesh
 #define PMESH_OUT_OF_BOUNDS   0
 #define PMESH_NOT_CREATED_YET 1
+#define PMESH_FILE_ERROR      2
+#define PMESH_INVALID_IMAGE   3
+#define PMESH_CANT_COMPOSE    4
 #define PMESH_ERROR_UNKOWN    255
 
 class PmeshException
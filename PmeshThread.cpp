@@ -0,0 +1,164 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Implementation of the Projection Mesh thread helpers
+
+#include "PmeshThread.h"
+#include <new>
+
+using namespace PmeshLib;
+
+namespace
+{
+// What each started thread gets handed
+struct ThreadStart
+{
+  PmeshThreadFunction function;
+  void*               arg;
+};
+
+#if defined(_WIN32)
+DWORD WINAPI threadEntry( LPVOID arg )
+{
+  ThreadStart* start = static_cast<ThreadStart*>( arg );
+  start->function( start->arg );
+  return 0;
+}
+#else
+extern "C" void* threadEntry( void* arg )
+{
+  ThreadStart* start = static_cast<ThreadStart*>( arg );
+  start->function( start->arg );
+  return NULL;
+}
+#endif
+}
+
+
+// ***************************************************************************
+void PmeshLib::runThreads( PmeshThreadFunction function, void** args,
+                           long count ) throw()
+{
+  ThreadStart* starts = NULL;
+  bool*        started = NULL;
+  long         counter;
+#if defined(_WIN32)
+  HANDLE*      threads = NULL;
+#else
+  pthread_t*   threads = NULL;
+#endif
+
+  if ( count <= 0 )
+    return;
+
+  // Just do the work here if there is only one piece of it or we can't
+  // get the memory to keep track of the threads
+  if ( count > 1 )
+  {
+    starts  = new (std::nothrow) ThreadStart[count];
+    started = new (std::nothrow) bool[count];
+#if defined(_WIN32)
+    threads = new (std::nothrow) HANDLE[count];
+#else
+    threads = new (std::nothrow) pthread_t[count];
+#endif
+  }
+
+  if ( !starts || !started || !threads )
+  {
+    for ( counter = 0; counter < count; counter++ )
+      function( args[counter] );
+
+    delete [] starts;
+    delete [] started;
+    delete [] threads;
+    return;
+  }
+
+  // Start everything but the last entry on its own thread
+  for ( counter = 0; counter < count - 1; counter++ )
+  {
+    starts[counter].function = function;
+    starts[counter].arg      = args[counter];
+#if defined(_WIN32)
+    threads[counter] = CreateThread( NULL, 0, threadEntry,
+                                     &starts[counter], 0, NULL );
+    started[counter] = ( NULL != threads[counter] );
+#else
+    started[counter] = ( 0 == pthread_create( &threads[counter], NULL,
+                                              threadEntry,
+                                              &starts[counter] ) );
+#endif
+  }
+
+  // The calling thread takes the last entry and any that didn't start
+  function( args[count - 1] );
+
+  for ( counter = 0; counter < count - 1; counter++ )
+  {
+    if ( !started[counter] )
+      function( args[counter] );
+  }
+
+  // Wait for everyone
+  for ( counter = 0; counter < count - 1; counter++ )
+  {
+    if ( started[counter] )
+    {
+#if defined(_WIN32)
+      WaitForSingleObject( threads[counter], INFINITE );
+      CloseHandle( threads[counter] );
+#else
+      pthread_join( threads[counter], NULL );
+#endif
+    }
+  }
+
+  delete [] starts;
+  delete [] started;
+  delete [] threads;
+}
+
+
+// ***************************************************************************
+PmeshMutex::PmeshMutex() throw()
+{
+#if defined(_WIN32)
+  InitializeCriticalSection( &d_section );
+#else
+  pthread_mutex_init( &d_mutex, NULL );
+#endif
+}
+
+
+// ***************************************************************************
+PmeshMutex::~PmeshMutex()
+{
+#if defined(_WIN32)
+  DeleteCriticalSection( &d_section );
+#else
+  pthread_mutex_destroy( &d_mutex );
+#endif
+}
+
+
+// ***************************************************************************
+void PmeshMutex::lock() throw()
+{
+#if defined(_WIN32)
+  EnterCriticalSection( &d_section );
+#else
+  pthread_mutex_lock( &d_mutex );
+#endif
+}
+
+
+// ***************************************************************************
+void PmeshMutex::unlock() throw()
+{
+#if defined(_WIN32)
+  LeaveCriticalSection( &d_section );
+#else
+  pthread_mutex_unlock( &d_mutex );
+#endif
+}
@@ -0,0 +1,213 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Thin wrapper around the platform threads used by the Projection Mesh
+// library.  Only what the mesh needs is here: running a function on a
+// number of worker threads and waiting for them all to finish, a mutex,
+// flags for publishing data to other threads, atomic counters and bit
+// operations, and words any thread may read or write.
+
+#ifndef _PMESHTHREAD_H_
+#define _PMESHTHREAD_H_
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace PmeshLib
+{
+
+// Signature of a function run by runThreads()
+typedef void (*PmeshThreadFunction)( void* arg );
+
+// Runs <function> once for each of the <count> entries in <args> with each
+// call on its own thread, and returns when all of them have finished.  The
+// last entry is run on the calling thread.  If a thread can not be
+// started its entry is run on the calling thread instead, so every entry
+// is always run exactly once.  <function> must not throw.
+void runThreads( PmeshThreadFunction function, void** args, long count )
+  throw();
+
+
+// A plain non-recursive mutex
+class PmeshMutex
+{
+ public:
+  PmeshMutex() throw();
+  ~PmeshMutex();
+
+  void lock() throw();
+  void unlock() throw();
+
+ private:
+  // Not copyable
+  PmeshMutex( const PmeshMutex& );
+  PmeshMutex& operator=( const PmeshMutex& );
+
+#if defined(_WIN32)
+  CRITICAL_SECTION d_section;
+#else
+  pthread_mutex_t  d_mutex;
+#endif
+};
+
+// Holds a PmeshMutex locked for as long as it is in scope
+class PmeshLock
+{
+ public:
+  explicit PmeshLock( PmeshMutex& mutex ) throw() : d_mutex(mutex)
+  {
+    d_mutex.lock();
+  }
+
+  ~PmeshLock()
+  {
+    d_mutex.unlock();
+  }
+
+ private:
+  PmeshLock( const PmeshLock& );
+  PmeshLock& operator=( const PmeshLock& );
+
+  PmeshMutex& d_mutex;
+};
+
+// Orders the memory accesses before it against those after it
+inline
+void memoryBarrier() throw()
+{
+#if defined(_WIN32)
+  MemoryBarrier();
+#else
+  __sync_synchronize();
+#endif
+}
+
+// Sets <flag> once the data it guards has been written, so that a thread
+// seeing it set with readFlag() also sees that data
+inline
+void publishFlag( volatile char& flag ) throw()
+{
+#if defined(_WIN32)
+  memoryBarrier();
+  flag = 1;
+#else
+  __atomic_store_n( &flag, 1, __ATOMIC_RELEASE );
+#endif
+}
+
+// Returns true if <flag> has been set by publishFlag()
+inline
+bool readFlag( const volatile char& flag ) throw()
+{
+#if defined(_WIN32)
+  bool bSet = ( 0 != flag );
+
+  memoryBarrier();
+  return bSet;
+#else
+  return 0 != __atomic_load_n( &flag, __ATOMIC_ACQUIRE );
+#endif
+}
+
+// Adds <amount> to the counter <value> as one indivisible operation
+inline
+void atomicAdd( volatile unsigned long& value, unsigned long amount ) throw()
+{
+#if defined(_WIN32)
+  InterlockedExchangeAdd( reinterpret_cast<volatile LONG*>( &value ),
+                          static_cast<LONG>( amount ) );
+#else
+  __sync_fetch_and_add( &value, amount );
+#endif
+}
+
+// Adds one to <value> as one indivisible operation and returns the result
+inline
+long atomicIncrement( volatile long& value ) throw()
+{
+#if defined(_WIN32)
+  return InterlockedIncrement( reinterpret_cast<volatile LONG*>( &value ) );
+#else
+  return __sync_add_and_fetch( &value, 1L );
+#endif
+}
+
+// Takes one from <value> as one indivisible operation and returns the
+// result
+inline
+long atomicDecrement( volatile long& value ) throw()
+{
+#if defined(_WIN32)
+  return InterlockedDecrement( reinterpret_cast<volatile LONG*>( &value ) );
+#else
+  return __sync_sub_and_fetch( &value, 1L );
+#endif
+}
+
+// Reads <value> as one indivisible operation, for words other threads may
+// be writing with atomicWrite().  Nothing is ordered by it, so it costs no
+// more than a plain read.
+inline
+long atomicRead( const volatile long& value ) throw()
+{
+#if defined(_WIN32)
+  return value;
+#else
+  return __atomic_load_n( &value, __ATOMIC_RELAXED );
+#endif
+}
+
+// Sets <value> as one indivisible operation, for words other threads may
+// be reading with atomicRead()
+inline
+void atomicWrite( volatile long& value, long newValue ) throw()
+{
+#if defined(_WIN32)
+  value = newValue;
+#else
+  __atomic_store_n( &value, newValue, __ATOMIC_RELAXED );
+#endif
+}
+
+// Same as atomicRead() for words other threads may be changing with
+// atomicOr() and atomicAnd()
+inline
+unsigned int atomicRead( const volatile unsigned int& value ) throw()
+{
+#if defined(_WIN32)
+  return value;
+#else
+  return __atomic_load_n( &value, __ATOMIC_RELAXED );
+#endif
+}
+
+// Sets the bits of <mask> in <value> as one indivisible operation
+inline
+void atomicOr( volatile unsigned int& value, unsigned int mask ) throw()
+{
+#if defined(_WIN32)
+  InterlockedOr( reinterpret_cast<volatile LONG*>( &value ),
+                 static_cast<LONG>( mask ) );
+#else
+  __sync_fetch_and_or( &value, mask );
+#endif
+}
+
+// Clears the bits not in <mask> from <value> as one indivisible operation
+inline
+void atomicAnd( volatile unsigned int& value, unsigned int mask ) throw()
+{
+#if defined(_WIN32)
+  InterlockedAnd( reinterpret_cast<volatile LONG*>( &value ),
+                  static_cast<LONG>( mask ) );
+#else
+  __sync_fetch_and_and( &value, mask );
+#endif
+}
+
+} // namespace
+
+#endif
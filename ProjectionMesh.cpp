@@ -4,31 +4,130 @@
 // Modified to use mathlib interpolators by Chris Bilderback
 
 #include "ProjectionMesh.h"
+#include "PmeshThread.h"
+#include "MeshBatchProjection.h"
 #include <math.h>
+#include <time.h>
+#include <string.h>
+#include <new>
 
 using namespace PmeshLib;
 
+namespace
+{
+// The piece of calculateMesh() handed to each thread
+struct MeshRowsJob
+{
+  ProjectionMesh*      mesh;
+  ProjLib::Projection* sourceProj;   // this thread's own clones
+  ProjLib::Projection* destProj;
+  long                 firstRow;
+  long                 rowStep;
+  bool                 bSucceeded;
+};
+
+// Fills <xs>, <ys> with the same <count> pseudo random points inside the
+// given bounds every time it's called
+void fillSamplePoints( double* xs, double* ys, long count,
+                       double left, double bottom, double right, double top )
+  throw()
+{
+  unsigned long seed = 12345;
+
+  for ( long counter = 0; counter < count; counter++ )
+  {
+    seed = seed * 1103515245UL + 12345UL;
+    xs[counter] = left + ( right - left ) *
+      ( ( seed >> 8 ) & 0xffff ) / 65536.0;
+    seed = seed * 1103515245UL + 12345UL;
+    ys[counter] = bottom + ( top - bottom ) *
+      ( ( seed >> 8 ) & 0xffff ) / 65536.0;
+  }
+}
+
+// Points projectRun() steps through a cell before setting it up again, so
+// the rounding in the forward differences can't build up
+const long RUN_RESTART_STEPS = 64;
+
+// Sets up forward differencing of the bilinear through the corners <ul>,
+// <ur>, <ll>, <lr> from the offset <u>, <v>, stepping <du>, <dv> a point.
+// <value> is the bilinear there, <delta> the change to the next point and
+// <delta2> the (constant) change in <delta>.
+void startDifferences( double ul, double ur, double ll, double lr,
+                       double u, double v, double du, double dv,
+                       double& value, double& delta, double& delta2 )
+  throw()
+{
+  double b = ur - ul;
+  double c = ll - ul;
+  double d = ( lr - ll ) - b;
+
+  value  = bilinearBlend( ul, ur, ll, lr, u, v );
+  delta  = b * du + c * dv + d * ( u * dv + v * du + du * dv );
+  delta2 = 2.0 * d * du * dv;
+}
+
+// True if points can be projected with the interpolator of type <type>
+// through the packed nodes of a <width> x <height> mesh
+bool compactFits( long type, long width, long height ) throw()
+{
+  switch ( type )
+  {
+  case MathLib::DlgViewer:
+  case MathLib::BiLinear:
+  case MathLib::BiPolynomial:
+  case MathLib::LeastSquaresPlane:
+    return true;
+
+  case MathLib::BiCubic:
+    return MeshBicubicPolicy::fits( width, height );
+  }
+  return false;
+}
+
+// Projects a run of points with the MeshQuery policy for the interpolator
+// of type <type> through <nodes>, which compactFits() has said will do
+template <class Nodes>
+long queryNodes( long type, const MeshKernelGrid& grid, const Nodes& nodes,
+                 double* x, double* y, long stride, long count, bool* valid )
+  throw()
+{
+  switch ( type )
+  {
+  case MathLib::LeastSquaresPlane:
+    return MeshCompactQuery<MeshPlanePolicy, Nodes>( grid, nodes ).
+      projectPoints( x, y, stride, count, valid );
+
+  case MathLib::BiCubic:
+    return MeshCompactQuery<MeshBicubicPolicy, Nodes>( grid, nodes ).
+      projectPoints( x, y, stride, count, valid );
+  }
+
+  return MeshCompactQuery<MeshBilinearPolicy, Nodes>( grid, nodes ).
+    projectPoints( x, y, stride, count, valid );
+}
+}
+
 // ***************************************************************************
 //Main constructor for the Projection mesh class 
 //which just inits the class data members
 ProjectionMesh::ProjectionMesh() throw()
-  : interpolator(NULL), interpolator2(NULL), d_left(0.0), d_top(0.0), 
+  : d_interpolatorType(MathLib::DlgViewer), d_left(0.0), d_top(0.0), 
   d_sourceWidth(0.0), d_sourceHeight(0.0),
   d_horizMeshSpacing(0.0), d_vertMeshSpacing(0.0),
-  d_meshWidth(0), d_meshHeight(0), d_pNodes(0),
-  d_pFromProj(NULL), d_pToProj(NULL)
+  d_meshWidth(0), d_meshHeight(0), d_threadCount(1),
+  d_bPrecompute(false), d_bVectorized(false), d_bClosedForm(false),
+  d_bInverse(false),
+  d_bGlobalSpline(false), d_bCompact(false), d_precomputeSeconds(0.0),
+  d_adaptiveTolerance(0.0), d_adaptiveMaxDepth(8), d_adaptiveSeconds(0.0),
+  d_hybridTolerance(0.0), d_hybridSeconds(0.0), d_pCellError(NULL),
+  d_hybridPoints(0), d_hybridExactPoints(0),
+  d_pNodeX(NULL), d_pNodeY(NULL), d_tiledTileSize(0), d_tiledBudget(0),
+  d_pNodeValid(NULL), d_pCellValid(NULL),
+  d_pFromProj(NULL), d_pToProj(NULL), d_lazyTileSize(0),
+  d_tileCols(0), d_tileRows(0), d_pTileReady(NULL), d_pNodeProjected(NULL),
+  d_materializedTiles(0)
 {
-  //setup the default interpolator
-  try
-  {
-    if (!(interpolator = new (std::nothrow) MathLib::DlgViewerInterpolator))
-      throw std::bad_alloc();
-      
-  }
-  catch(...)
-  {
-    delete interpolator;
-  }
 }
 
 // ***************************************************************************
@@ -37,11 +136,11 @@ ProjectionMesh::~ProjectionMesh()
 {
   try
   {
-    delete[] d_pNodes;
+    freeNodes();
+    freeTiles();
+    freeCellErrors();
     delete d_pFromProj;
     delete d_pToProj;
-    delete interpolator;
-    delete interpolator2;
   }
   catch(...)
   {
@@ -91,12 +190,16 @@ void ProjectionMesh::setMeshSize( long width, long height )
     d_meshHeight = 3;
   }
 
+  // Any coefficients or refinement are for the old mesh
+  d_coefficients.clear();
+  d_quadtree.clear();
+  d_inverse.clear();
+  d_spline.clear();
+  freeCellErrors();
+  freeTiles();
+
   // Allocate the mesh
-  if (d_pNodes)
-    delete [] d_pNodes;
-  
-  if (!(d_pNodes = new(std::nothrow) MeshNode[width * height]))
-    throw std::bad_alloc();
+  allocateNodes();
   
   // Compute the horizontal mesh spacing
   if ( 0.0 != d_meshWidth )
@@ -112,103 +215,94 @@ void ProjectionMesh::setMeshSize( long width, long height )
 }
 
 
+// ***************************************************************************
+// Allocates the node arrays.  The coordinates, the node validity bits and
+// the cell validity bits are kept in separate arrays so that checking
+// validity or streaming over the coordinates only touches what it needs.
+// A tiled mesh keeps its coordinates in the tile file instead, which
+// starts out all 0 too.
+void ProjectionMesh::allocateNodes() throw(std::bad_alloc)
+{
+  size_t nodes = static_cast<size_t>( d_meshWidth ) * d_meshHeight;
+  size_t words = bitmapWords( d_meshWidth * d_meshHeight );
+
+  freeNodes();
+
+  if ( d_tiledTileSize > 0 )
+  {
+    if ( !d_tiledNodes.create( d_tiledPath.c_str(), d_meshWidth,
+                               d_meshHeight, d_tiledTileSize,
+                               d_tiledBudget ) )
+      throw std::bad_alloc();
+  }
+  else if ( !( d_pNodeX = new (std::nothrow) double[nodes] ) ||
+            !( d_pNodeY = new (std::nothrow) double[nodes] ) )
+  {
+    freeNodes();
+    throw std::bad_alloc();
+  }
+
+  if ( !( d_pNodeValid = new (std::nothrow) MeshBitWord[words] ) ||
+       !( d_pCellValid = new (std::nothrow) MeshBitWord[words] ) )
+  {
+    freeNodes();
+    throw std::bad_alloc();
+  }
+
+  for ( size_t counter = 0; d_pNodeX && counter < nodes; counter++ )
+    d_pNodeX[counter] = d_pNodeY[counter] = 0.0;
+
+  for ( size_t counter = 0; counter < words; counter++ )
+    d_pNodeValid[counter] = d_pCellValid[counter] = 0;
+}
+
+
+// ***************************************************************************
+// Frees the node arrays, or unmaps them if they came from a file, and any
+// packed or tiled nodes
+void ProjectionMesh::freeNodes() throw()
+{
+  d_compact.clear();
+  d_tiledNodes.close();
+  if ( d_meshFile.isMapped() )
+  {
+    d_meshFile.unmap();
+  }
+  else
+  {
+    delete [] d_pNodeX;
+    delete [] d_pNodeY;
+    delete [] d_pNodeValid;
+    delete [] d_pCellValid;
+  }
+  d_pNodeX = d_pNodeY = NULL;
+  d_pNodeValid = d_pCellValid = NULL;
+}
+
+
 // ***************************************************************************
 //Set interpolator function allows you to set the interpolator to use
-//with the projection calculation
+//with the projection calculation.  The interpolators themselves are
+//created by each projection call so that the mesh holds no state that
+//changes while projecting.
 void ProjectionMesh::setInterpolator(long int in) throw (std::bad_alloc)
 {
-  //create the Interpolator
   switch(in)
   {
   case MathLib::LeastSquaresPlane:
-    //create the interpolators
-    delete interpolator;
-    delete interpolator2;
-
-    interpolator = NULL;
-    interpolator2 = NULL;
-
-    if (!(interpolator = new (std::nothrow) 
-          MathLib::LeastSquaresPlaneInterpolator))
-      throw std::bad_alloc();
-    if (!(interpolator2 = new (std::nothrow) 
-          MathLib::LeastSquaresPlaneInterpolator))
-      throw std::bad_alloc();
-    break;
-          
   case MathLib::BiPolynomial:
-    delete interpolator;
-    delete interpolator2;
-    
-    interpolator = NULL;
-    interpolator2 = NULL;
-
-    if (!(interpolator = new (std::nothrow) 
-          MathLib::BiPolynomialInterpolator))
-      throw std::bad_alloc();
-    if (!(interpolator2 = new (std::nothrow) 
-          MathLib::BiPolynomialInterpolator))
-      throw std::bad_alloc();
-    break;
-      
   case MathLib::DlgViewer:
-    delete interpolator;
-    delete interpolator2;
-
-    interpolator = NULL;
-    interpolator2 = NULL;
-
-    if (!(interpolator = new (std::nothrow) 
-          MathLib::DlgViewerInterpolator))
-      throw std::bad_alloc();
-    break;
   case MathLib::BiLinear:
-    delete interpolator;
-    delete interpolator2;
-    
-    interpolator = NULL;
-    interpolator2 = NULL;
-
-    if (!(interpolator = new (std::nothrow)
-          MathLib::BiLinearInterpolator))
-      throw std::bad_alloc();
-    
-    if (!(interpolator2 = new (std::nothrow)
-          MathLib::BiLinearInterpolator))
-      throw std::bad_alloc();
-    break;
   case MathLib::BiCubic:
-    delete interpolator;
-    delete interpolator2;
-    
-    interpolator = NULL;
-    interpolator2 = NULL;
-
-    if (!(interpolator = new (std::nothrow)
-          MathLib::BiCubicInterpolator))
-      throw std::bad_alloc();
-    
-    if (!(interpolator2 = new (std::nothrow)
-          MathLib::BiCubicInterpolator))
-      throw std::bad_alloc();
-    break;
-  
   case MathLib::BiCubicSpline:
-    delete interpolator;
-    delete interpolator2;
-    
-    interpolator = NULL;
-    interpolator2 = NULL;
-
-    if (!(interpolator = new (std::nothrow)
-          MathLib::BiCubicSplineInterpolator))
-      throw std::bad_alloc();
-    
-    if (!(interpolator2 = new (std::nothrow)
-          MathLib::BiCubicSplineInterpolator))
-      throw std::bad_alloc();
+    d_interpolatorType = in;
     break;
   }
+
+  // Packed nodes can only be read by some of the interpolators
+  if ( d_compact.isBuilt() &&
+       !compactFits( d_interpolatorType, d_meshWidth, d_meshHeight ) )
+    expandNodes();
   return; // to stop spurious compiler warnings
 }
 
@@ -218,508 +312,2359 @@ void ProjectionMesh::setInterpolator(long int in) throw (std::bad_alloc)
 bool ProjectionMesh::projectPoint( double& x, double& y )
   const throw(PmeshException)
 {
-  float col, row;
-  long leftCol, rightCol, topRow, bottomRow;
-  MathLib::Point * grid = NULL;
-  MathLib::Point temp, temp2;
-  int counter;
-  
-  try
-  {
-    
-    // Determine which mesh grid the point is in
-    col = ( x - d_left ) / d_horizMeshSpacing;
-    row = ( d_top - y  ) / d_vertMeshSpacing;
-      
-    // Determine which mesh nodes to get
-    leftCol   = static_cast<long>( col );
-    rightCol  = leftCol + 1;
-    topRow    = static_cast<long>( row );
-    bottomRow = topRow + 1;
-      
-    // Make sure the point is in the mesh
-    if ( leftCol < 0 || rightCol  > d_meshWidth ||
-         topRow  < 0 || bottomRow > d_meshHeight )
-      return false;
-  
-  
-    // Make sure we didn't go off the edge with nodes
-    if ( rightCol == d_meshWidth )
-    {
-      rightCol = leftCol;
-    }
-      
-    if ( bottomRow == d_meshHeight )
-    {
-      bottomRow = topRow;
-    }
-  
-    // Get the needed mesh nodes
-    MeshNode* pULNode = getMeshNode( leftCol, topRow );
-    MeshNode* pURNode = getMeshNode( rightCol, topRow );
-    MeshNode* pLLNode = getMeshNode( leftCol, bottomRow );
-    MeshNode* pLRNode = getMeshNode( rightCol, bottomRow );
-  
-    // Fail if any of the surrounding nodes are invalid
-    if ( !pULNode->isValid() || !pURNode->isValid() ||
-         !pLLNode->isValid() || !pLRNode->isValid() )
-      return false;
-      
-    switch(interpolator->getInterpolatorType())
-    {
-    case MathLib::DlgViewer:
-      /*Use the viewer's bilinear interpolation to determine the 
-        projected point*/
-      if (!(grid = new (std::nothrow) MathLib::Point[4]))
-        throw std::bad_alloc();
-      // Calculate the source coordinates of the node at <col>, <row>
-      grid[0].x = d_left + leftCol * d_horizMeshSpacing;
-      grid[0].y = d_top  - topRow  * d_vertMeshSpacing;
-      grid[1].x = grid[0].x + d_horizMeshSpacing;
-      grid[1].y = grid[0].y;
-      grid[2].x = grid[0].x + d_horizMeshSpacing;
-      grid[2].y = grid[0].y - d_vertMeshSpacing;
-      grid[3].x = grid[0].x;
-      grid[3].y = grid[0].y - d_vertMeshSpacing;
-
-      // Do a (modified) bilinear interpolation to get the results
-      pULNode->getXY(grid[0].z, grid[0].w);
-      pURNode->getXY(grid[1].z, grid[1].w);
-      pLRNode->getXY(grid[2].z, grid[2].w);
-      pLLNode->getXY(grid[3].z, grid[3].w);
-                              
-      temp.x = x;
-      temp.y = y;
-      interpolator->setPoints(grid, 4);
-      temp = interpolator->interpolatePoint(temp);
-      x = temp.z;
-      y = temp.w;
-      break;
+  // No mesh means nothing to project with
+  if ( !hasNodes() )
+    return false;
 
-    case MathLib::LeastSquaresPlane:
-      /* use the leastSquaresPlane to find the point */
-      //setup the grid
-      if (!(grid = new (std::nothrow) MathLib::Point[4]))
-        throw std::bad_alloc();
-      grid[0].x = d_left + leftCol * d_horizMeshSpacing;
-      grid[0].y = d_top  - topRow  * d_vertMeshSpacing;
-      grid[1].x = grid[0].x + d_horizMeshSpacing;
-      grid[1].y = grid[0].y;
-      grid[2].x = grid[0].x;
-      grid[2].y = grid[0].y - d_vertMeshSpacing;
-      grid[3].x = grid[0].x + d_horizMeshSpacing;
-      grid[3].y = grid[0].y - d_vertMeshSpacing;
-      
-      pULNode->getXY(grid[0].z, grid[0].w);
-      pURNode->getXY(grid[1].z, grid[1].w);
-      pLLNode->getXY(grid[2].z, grid[2].w);
-      pLRNode->getXY(grid[3].z, grid[3].w);
+  return ( 1 == projectStrided( &x, &y, 1, 1, NULL ) );
+}
 
-      temp.x = x;
-      temp.y = y;
-      
-      interpolator->setPoints(grid, 4);
-      temp = interpolator->interpolatePoint(temp);
-      
-      for(counter = 0; counter < 4; counter++)
-      {
-        grid[counter].z = grid[counter].w;
-      }
-          
-      temp2.x = x;
-      temp2.y = y;
-          
-      interpolator2->setPoints(grid, 4);
-      temp2 = interpolator2->interpolatePoint(temp2);
-      
-      x = temp.z;
-      y = temp2.z;
-      break;
-          
-    case MathLib::BiPolynomial:
-      /* use the biPolynomial to find the point */
-      //setup the grid
-      if (!(grid = new (std::nothrow) MathLib::Point[4]))
-        throw std::bad_alloc();
-      grid[0].x = d_left + leftCol * d_horizMeshSpacing;
-      grid[0].y = d_top  - topRow  * d_vertMeshSpacing;
-      grid[1].x = grid[0].x + d_horizMeshSpacing;
-      grid[1].y = grid[0].y;
-      grid[2].x = grid[0].x;
-      grid[2].y = grid[0].y - d_vertMeshSpacing;
-      grid[3].x = grid[0].x + d_horizMeshSpacing;
-      grid[3].y = grid[0].y - d_vertMeshSpacing;
-
-      pULNode->getXY(grid[0].z, grid[0].w);
-      pURNode->getXY(grid[1].z, grid[1].w);
-      pLLNode->getXY(grid[2].z, grid[2].w);
-      pLRNode->getXY(grid[3].z, grid[3].w);
-      
-      temp.x = x;
-      temp.y = y;
-          
-      interpolator->setPoints(grid, 4);
-      temp = interpolator->interpolatePoint(temp);
-      
-      for(counter = 0; counter < 4; counter++)
-      {
-        grid[counter].z = grid[counter].w;
-      }
-          
-      temp2.x = x;
-      temp2.y = y;
-          
-      interpolator2->setPoints(grid, 4);
-      temp2 = interpolator2->interpolatePoint(temp2);
-          
-      x = temp.z;
-      y = temp2.z;
-      break;
-    case MathLib::BiLinear:
-      if (!(grid = new (std::nothrow) MathLib::Point[4]))
-        throw std::bad_alloc();
-      grid[0].x = d_left + leftCol * d_horizMeshSpacing;
-      grid[0].y = d_top  - topRow  * d_vertMeshSpacing;
-      grid[1].x = grid[0].x + d_horizMeshSpacing;
-      grid[1].y = grid[0].y;
-      grid[2].x = grid[0].x;
-      grid[2].y = grid[0].y - d_vertMeshSpacing;
-      grid[3].x = grid[0].x + d_horizMeshSpacing;
-      grid[3].y = grid[0].y - d_vertMeshSpacing;
-      
-      pULNode->getXY(grid[0].z, grid[0].w);
-      pURNode->getXY(grid[1].z, grid[1].w);
-      pLLNode->getXY(grid[2].z, grid[2].w);
-      pLRNode->getXY(grid[3].z, grid[3].w);
-      
-      temp.x = x;
-      temp.y = y;
-          
-      interpolator->setPoints(grid, 4);
-      temp = interpolator->interpolatePoint(temp);
-      
-      for(counter = 0; counter < 4; counter++)
-      {
-        grid[counter].z = grid[counter].w;
-      }
-          
-      temp2.x = x;
-      temp2.y = y;
-          
-      interpolator2->setPoints(grid, 4);
-      temp2 = interpolator2->interpolatePoint(temp2);
-          
-      x = temp.z;
-      y = temp2.z;
-      break;
-      
-  
-    case MathLib::BiCubic: 
-      if (!(grid = new (std::nothrow) MathLib::Point[16]))
-        throw std::bad_alloc();
-       
-      //find the nearest sixteen by sixteen grid
-      getGrid(leftCol, topRow,grid, 4);
-               
-      temp.x = x;
-      temp.y = y;
-      
-      interpolator->setPoints(grid, 16);
-      temp = interpolator->interpolatePoint(temp);
-      
-      for(counter = 0; counter < 16; counter++)
-      {
-        grid[counter].z = grid[counter].w;
-      }
-          
-      temp2.x = x;
-      temp2.y = y;
-          
-      interpolator2->setPoints(grid, 16);
-      temp2 = interpolator2->interpolatePoint(temp2);
-          
-      x = temp.z;
-      y = temp2.z;
-      break;
-    case MathLib::BiCubicSpline:
-      if (!(grid = new (std::nothrow) MathLib::Point[16]))
-        throw std::bad_alloc();
-       
-      //find the nearest 9x9 grid
-      getGrid(leftCol, topRow,grid, 4);
-      
-      temp.x = x;
-      temp.y = y;
-      //dynamic_cast<MathLib::BiCubicSplineInterpolator *>
-						//				(interpolator2)->setParabolic();          
-      interpolator->setPoints(grid, 16);
-      temp = interpolator->interpolatePoint(temp);
-      
-      for(counter = 0; counter < 4; counter++)
-      {
-        grid[counter].z = grid[counter].w;
-      }
-          
-      temp2.x = x;
-      temp2.y = y;
-      //dynamic_cast<MathLib::BiCubicSplineInterpolator *>
-						//				(interpolator2)->setParabolic();          
-      interpolator2->setPoints(grid, 16);
-      temp2 = interpolator2->interpolatePoint(temp2);
-          
-      x = temp.z;
-      y = temp2.z;
-      break;
+
+// ***************************************************************************
+// Batch projection of separate x and y arrays
+long ProjectionMesh::projectPoints( double* x, double* y, long count,
+                                    bool* valid ) const
+  throw(PmeshException)
+{
+  return projectStrided( x, y, 1, count, valid );
+}
 
 
-    }
-    delete [] grid;
-  }
-  catch(...)
-  { //something went wrong
-    delete [] grid;
-    return false;
-  }
-  return true;
+// ***************************************************************************
+// Batch projection of an interleaved xy buffer
+long ProjectionMesh::projectInterleavedPoints( double* xy, long count,
+                                               bool* valid ) const
+  throw(PmeshException)
+{
+  return projectStrided( xy, xy + 1, 2, count, valid );
 }
 
-//**************************************************************************
-void ProjectionMesh::getGrid(int Col, int Row, MathLib::Point * in, int size)
-const throw(PmeshException)
+
+// ***************************************************************************
+// Projection of evenly spaced points
+long ProjectionMesh::projectRun( double x, double y,
+                                 double stepX, double stepY, long count,
+                                 double* outX, double* outY,
+                                 bool* valid ) const throw(PmeshException)
 {
-  int counter, counter1;
-  int grow, gcol;
-  int index =0;
-  try
-    {
-      if ((size > d_meshHeight) || (size > d_meshWidth))
-        throw PmeshException();
-      grow =0; gcol = 0;
-      for (counter = 0; counter < d_meshHeight-size; counter++)
-        if (counter+size-1 > Row)
-         { 
-           grow = counter;
-           break;
-         }
-      for (counter = 0; counter < d_meshWidth-size; counter++)
-        if (counter+size-1 > Col)
-          {
-            gcol = counter;
-            break;
-          }
-      
-      //now should be able to get the grid
-      for (counter = grow; counter < grow+size; counter++)
-        {
-          for (counter1 = gcol; counter1 < gcol+size; counter1++)
-            {
-               getMeshNode( counter1, counter)->getXY
-                 (in[index].z, 
-                  in[index].w);
-               in[index].x =  d_left + counter1 * d_horizMeshSpacing;
-               in[index].y = d_top  -  counter * d_vertMeshSpacing;
-               index++;
-            }
-        }
+  double start;
+  long counter, projected, outOfMesh;
 
-    }
-  catch(...)
-    {
-      throw PmeshException();
-    }
-}
-                 
+  if ( !hasNodes() )
+    throw PmeshException(PMESH_NOT_CREATED_YET);
+
+  if ( d_bClosedForm && d_pNodeX && !d_quadtree.isBuilt() &&
+       !d_pCellError &&
+       ( MathLib::DlgViewer == d_interpolatorType ||
+         MathLib::BiLinear == d_interpolatorType ) )
+  {
+    start = MeshStats::now();
+    projected = stepBilinearRun( x, y, stepX, stepY, count, outX, outY,
+                                 valid, outOfMesh );
+    d_stats.addQueries( d_interpolatorType, count, outOfMesh,
+                        count - projected - outOfMesh,
+                        MeshStats::now() - start );
+    return projected;
+  }
 
+  // Anything else isn't linear along the run
+  for ( counter = 0; counter < count; counter++ )
+  {
+    outX[counter] = x + counter * stepX;
+    outY[counter] = y + counter * stepY;
+  }
+  return projectStrided( outX, outY, 1, count, valid );
+}
 
 
 // ***************************************************************************
-void ProjectionMesh::validateNodes() throw()
+// Steps a run of points through the bilinear of each cell it crosses.
+// Each point is still located so that it gets exactly the cell
+// projectPoint() would give it, but only the first point in a cell
+// evaluates the bilinear; the rest add on the forward differences.
+long ProjectionMesh::stepBilinearRun( double x, double y,
+                                      double stepX, double stepY,
+                                      long count, double* outX, double* outY,
+                                      bool* valid, long& outOfMesh ) const
+  throw()
 {
-  int row, col;
-  double centerX, centerY;
-  MeshNode* pTopNode;
-  MeshNode* pLeftNode;
-  MeshNode* pRightNode;
-  MeshNode* pBottomNode;
-  MeshNode* pCenterNode;
-  
-  for ( row = 0; row < d_meshHeight; row++ )
+  const double du = stepX / d_horizMeshSpacing;
+  const double dv = -stepY / d_vertMeshSpacing;
+  double valueX = 0.0, deltaX = 0.0, delta2X = 0.0;
+  double valueY = 0.0, deltaY = 0.0, delta2Y = 0.0;
+  double u, v;
+  long leftCol, topRow, rightCol, bottomRow;
+  long lastCol = -1, lastRow = -1;       // cell the differences are for
+  long steps = 0;
+  long counter;
+  long projected = 0;
+  bool bCellValid = false;
+  bool bProjected;
+
+  outOfMesh = 0;
+  for ( counter = 0; counter < count; counter++ )
   {
-    for ( col = 0; col < d_meshWidth; col++ )
+    bProjected = false;
+
+    if ( !locateCell( x + counter * stepX, y + counter * stepY,
+                      leftCol, topRow, u, v ) )
     {
-      pCenterNode = getMeshNode( col, row );
-	  
-      // Don't check this node if it's already been marked invalid
-      if ( !pCenterNode->isValid() )
-      {
-        continue;
-      }
-	  
-      // Handle top row case
-      if ( 0 == row )
-      {
-        pTopNode    = pCenterNode;
-        pBottomNode = getMeshNode( col, row + 1 );
-      }
-      // Handle bottom row case
-      else if ( ( d_meshHeight - 1 ) == row )
-      {
-        pTopNode    = getMeshNode( col, row - 1 );
-        pBottomNode = pCenterNode;
-      }
-      else
-      {
-        pTopNode    = getMeshNode( col, row - 1 );
-        pBottomNode = getMeshNode( col, row + 1 );
-      }
-      
-      // Handle left column case
-      if ( 0 == col )
-      {
-        pLeftNode  = pCenterNode;
-        pRightNode = getMeshNode( col + 1, row );
-      }
-      // Handle right column case
-      else if ( ( d_meshWidth - 1 ) == col )
-      {
-        pLeftNode  = getMeshNode( col - 1, row );
-        pRightNode = pCenterNode;
-      }
-      else
-      {
-        pLeftNode  = getMeshNode( col - 1, row );
-        pRightNode = getMeshNode( col + 1, row );
-      }
-	  
-      // Determine the validity of the node
-      pCenterNode->getXY(centerX, centerY);
-      
-      if ( ( ( pRightNode->getX() - centerX ) *
-             ( centerX - pLeftNode->getX() ) < 0.0 ) ||
-           ( ( pTopNode->getY() - centerY ) *
-             ( centerY - pBottomNode->getY() ) < 0.0 ) )
+      lastCol = lastRow = -1;
+      outOfMesh++;
+    }
+    else
+    {
+      if ( leftCol != lastCol || topRow != lastRow )
       {
-        pCenterNode->setValid( false );
+        lastCol = leftCol;
+        lastRow = topRow;
+        ensureTile( leftCol, topRow );
+        bCellValid = isCellValid( leftCol, topRow );
+        steps = RUN_RESTART_STEPS;
       }
-      else
+
+      if ( bCellValid )
       {
-        pCenterNode->setValid( true );
+        if ( RUN_RESTART_STEPS == steps )
+        {
+          rightCol  = ( leftCol + 1 < d_meshWidth ) ? leftCol + 1 : leftCol;
+          bottomRow = ( topRow + 1 < d_meshHeight ) ? topRow + 1 : topRow;
+
+          const long ul = topRow * d_meshWidth + leftCol;
+          const long ur = topRow * d_meshWidth + rightCol;
+          const long ll = bottomRow * d_meshWidth + leftCol;
+          const long lr = bottomRow * d_meshWidth + rightCol;
+
+          startDifferences( d_pNodeX[ul], d_pNodeX[ur], d_pNodeX[ll],
+                            d_pNodeX[lr], u, v, du, dv,
+                            valueX, deltaX, delta2X );
+          startDifferences( d_pNodeY[ul], d_pNodeY[ur], d_pNodeY[ll],
+                            d_pNodeY[lr], u, v, du, dv,
+                            valueY, deltaY, delta2Y );
+          steps = 0;
+        }
+        else
+        {
+          valueX += deltaX;
+          deltaX += delta2X;
+          valueY += deltaY;
+          deltaY += delta2Y;
+        }
+
+        outX[counter] = valueX;
+        outY[counter] = valueY;
+        steps++;
+        bProjected = true;
       }
     }
+
+    if ( !bProjected )
+    {
+      outX[counter] = x + counter * stepX;
+      outY[counter] = y + counter * stepY;
+    }
+
+    if ( valid )
+      valid[counter] = bProjected;
+    if ( bProjected )
+      projected++;
   }
-  
+  return projected;
 }
 
 
 // ***************************************************************************
-void ProjectionMesh::getProjectedBoundingRect( double& left, double& bottom,
-                                               double& right, double& top ) 
-  const throw (PmeshException)
+// Sets up the interpolation grids for a single mesh cell
+bool ProjectionMesh::loadCell( long type, long leftCol, long topRow,
+                               MathLib::Point* gridX, MathLib::Point* gridY )
+  const throw(PmeshException)
 {
-  double x, y;                 //projected point
-  bool   bFirstPoint = true;   //first point
-  long   row, col;             //counters
- 
-  for ( row = 0; row < getMeshHeight(); row++ )
+  long rightCol, bottomRow;
+  int counter, numPoints;
+  double ulX, ulY, urX, urY, llX, llY, lrX, lrY;
+
+  rightCol  = leftCol + 1;
+  bottomRow = topRow + 1;
+
+  // Make sure we didn't go off the edge with nodes
+  if ( rightCol == d_meshWidth )
+  {
+    rightCol = leftCol;
+  }
+
+  if ( bottomRow == d_meshHeight )
+  {
+    bottomRow = topRow;
+  }
+
+  // Fail if any of the surrounding nodes are invalid
+  if ( !isCellValid( leftCol, topRow ) )
+    return false;
+
+  // Get the corners.  locateCell() has already done the bounds checking.
+  readNode( leftCol, topRow, ulX, ulY );
+  readNode( rightCol, topRow, urX, urY );
+  readNode( leftCol, bottomRow, llX, llY );
+  readNode( rightCol, bottomRow, lrX, lrY );
+
+  switch ( type )
+  {
+  case MathLib::DlgViewer:
+    /*The viewer's interpolator wants the nodes clockwise from the upper
+      left and returns both coordinates from a single grid*/
+    gridX[0].x = d_left + leftCol * d_horizMeshSpacing;
+    gridX[0].y = d_top  - topRow  * d_vertMeshSpacing;
+    gridX[1].x = gridX[0].x + d_horizMeshSpacing;
+    gridX[1].y = gridX[0].y;
+    gridX[2].x = gridX[0].x + d_horizMeshSpacing;
+    gridX[2].y = gridX[0].y - d_vertMeshSpacing;
+    gridX[3].x = gridX[0].x;
+    gridX[3].y = gridX[0].y - d_vertMeshSpacing;
+
+    gridX[0].z = ulX;  gridX[0].w = ulY;
+    gridX[1].z = urX;  gridX[1].w = urY;
+    gridX[2].z = lrX;  gridX[2].w = lrY;
+    gridX[3].z = llX;  gridX[3].w = llY;
+    return true;
+
+  case MathLib::LeastSquaresPlane:
+  case MathLib::BiPolynomial:
+  case MathLib::BiLinear:
+    /*These want the nodes in row order*/
+    gridX[0].x = d_left + leftCol * d_horizMeshSpacing;
+    gridX[0].y = d_top  - topRow  * d_vertMeshSpacing;
+    gridX[1].x = gridX[0].x + d_horizMeshSpacing;
+    gridX[1].y = gridX[0].y;
+    gridX[2].x = gridX[0].x;
+    gridX[2].y = gridX[0].y - d_vertMeshSpacing;
+    gridX[3].x = gridX[0].x + d_horizMeshSpacing;
+    gridX[3].y = gridX[0].y - d_vertMeshSpacing;
+
+    gridX[0].z = ulX;  gridX[0].w = ulY;
+    gridX[1].z = urX;  gridX[1].w = urY;
+    gridX[2].z = llX;  gridX[2].w = llY;
+    gridX[3].z = lrX;  gridX[3].w = lrY;
+    numPoints = 4;
+    break;
+
+  case MathLib::BiCubic:
+  case MathLib::BiCubicSpline:
+    //find the nearest four by four grid
+    getGrid(leftCol, topRow, gridX, 4);
+    numPoints = 16;
+    break;
+
+  default:
+    return false;
+  }
+
+  // The second interpolator works on the y values.  It gets its own copy
+  // so that both interpolators can keep their setup between points.
+  for ( counter = 0; counter < numPoints; counter++ )
+  {
+    gridY[counter] = gridX[counter];
+    gridY[counter].z = gridX[counter].w;
+  }
+  return true;
+}
+
+
+// ***************************************************************************
+// Projects a run of points spaced <stride> doubles apart, counting them if
+// the stats are on
+long ProjectionMesh::projectStrided( double* x, double* y, long stride,
+                                     long count, bool* valid ) const
+  throw(PmeshException)
+{
+  double start;
+  long outOfMesh, projected;
+
+  if ( !MeshStats::isEnabled() )
+    return dispatchStrided( x, y, stride, count, valid );
+
+  // The points are projected in place so look at them first, outside the
+  // time taken
+  outOfMesh = countOutOfMesh( x, y, stride, count );
+  start = MeshStats::now();
+  projected = dispatchStrided( x, y, stride, count, valid );
+  d_stats.addQueries( d_interpolatorType, count, outOfMesh,
+                      count - projected - outOfMesh,
+                      MeshStats::now() - start );
+  return projected;
+}
+
+
+// ***************************************************************************
+// Counts the points locateCell() would turn down
+long ProjectionMesh::countOutOfMesh( const double* x, const double* y,
+                                     long stride, long count ) const throw()
+{
+  double u, v;
+  long leftCol, topRow;
+  long counter, outOfMesh = 0;
+
+  for ( counter = 0; counter < count; counter++ )
+  {
+    if ( !locateCell( x[ counter * stride ], y[ counter * stride ],
+                      leftCol, topRow, u, v ) )
+      outOfMesh++;
+  }
+  return outOfMesh;
+}
+
+
+// ***************************************************************************
+// Picks how to project a run of points
+long ProjectionMesh::dispatchStrided( double* x, double* y, long stride,
+                                      long count, bool* valid ) const
+  throw(PmeshException)
+{
+  long projected;
+
+  //check for the existance of the nodes
+  if (!hasNodes())
+    throw PmeshException(PMESH_NOT_CREATED_YET);
+
+  // Fill in any tiles of a lazy mesh the points need first, after which
+  // the tiles are read like any other mesh
+  if ( d_pTileReady )
+    prepareTiles( x, y, stride, count );
+
+  // Cells the interpolation is too far off in are projected exactly
+  projected = d_pCellError ?
+    projectHybrid( x, y, stride, count, valid ) :
+    interpolateStrided( x, y, stride, count, valid );
+
+  // Nodes a tiled mesh couldn't read were taken as 0
+  if ( d_tiledNodes.isBuilt() && d_tiledNodes.hasFailed() )
+    throw PmeshException(PMESH_FILE_ERROR);
+  return projected;
+}
+
+
+// ***************************************************************************
+// Picks how to interpolate a run of points.  The interpolators live on the
+// stack of projectInterpolated(), which is what lets any number of threads
+// project through the same mesh at once.
+long ProjectionMesh::interpolateStrided( double* x, double* y, long stride,
+                                         long count, bool* valid ) const
+  throw(PmeshException)
+{
+  // A refined mesh has to go through the quadtree
+  if ( d_quadtree.isBuilt() )
+    return projectAdaptive( x, y, stride, count, valid );
+
+  // Packed nodes are unpacked a cell at a time for the closed forms,
+  // unless the coefficients already hold everything the cells need
+  if ( d_bClosedForm && d_compact.isBuilt() &&
+       !( d_coefficients.isBuilt() &&
+          d_coefficients.getType() == d_interpolatorType ) )
+    return projectCompact( x, y, stride, count, valid );
+
+  // Tiles are read a cell at a time the same way
+  if ( d_bClosedForm && d_tiledNodes.isBuilt() &&
+       compactFits( d_interpolatorType, d_meshWidth, d_meshHeight ) )
+    return projectTiled( x, y, stride, count, valid );
+
+  // The vector kernels do the bilinear interpolators straight off the nodes
+  if ( d_bVectorized && d_pNodeX &&
+       ( MathLib::DlgViewer == d_interpolatorType ||
+         MathLib::BiLinear == d_interpolatorType ) )
+  {
+    MeshKernelGrid grid;
+
+    getKernelGrid( grid );
+    return MeshKernels::bilinear( grid, x, y, stride, count, valid );
+  }
+
+  // Use the precomputed coefficients if they match the interpolator
+  if ( d_coefficients.isBuilt() &&
+       d_coefficients.getType() == d_interpolatorType )
+    return projectPrecomputed( x, y, stride, count, valid );
+
+  // The global spline stands in for the MathLib spline once it's fitted
+  if ( d_spline.isBuilt() && MathLib::BiCubicSpline == d_interpolatorType )
+    return projectSpline( x, y, stride, count, valid );
+
+  // The interpolators with closed forms are inlined into a MeshQuery
+  // each, so this is the only switch on the type per batch
+  if ( d_bClosedForm )
+  {
+    MeshKernelGrid grid;
+
+    getKernelGrid( grid );
+    switch ( d_interpolatorType )
+    {
+    case MathLib::DlgViewer:
+    case MathLib::BiLinear:
+    case MathLib::BiPolynomial:
+      return MeshQuery<MeshBilinearPolicy>( grid ).projectPoints(
+        x, y, stride, count, valid );
+
+    case MathLib::LeastSquaresPlane:
+      return MeshQuery<MeshPlanePolicy>( grid ).projectPoints(
+        x, y, stride, count, valid );
+
+    case MathLib::BiCubic:
+      if ( MeshBicubicPolicy::fits( d_meshWidth, d_meshHeight ) )
+        return MeshQuery<MeshBicubicPolicy>( grid ).projectPoints(
+          x, y, stride, count, valid );
+      break;
+    }
+  }
+
+  return projectInterpolated( x, y, stride, count, valid );
+}
+
+
+// ***************************************************************************
+// Interpolates the points a batch at a time, noting the ones in cells over
+// the tolerance first since the points are projected in place, then
+// projects those again exactly from their source coordinates.  The
+// projections aren't guaranteed to be thread safe, so threads take turns
+// with them.
+long ProjectionMesh::projectHybrid( double* x, double* y, long stride,
+                                    long count, bool* valid ) const
+  throw(PmeshException)
+{
+  double exactX[MESH_PROJECTOR_BATCH], exactY[MESH_PROJECTOR_BATCH];
+  double sourceX[MESH_PROJECTOR_BATCH], sourceY[MESH_PROJECTOR_BATCH];
+  long   exactIndex[MESH_PROJECTOR_BATCH];
+  bool   batchValid[MESH_PROJECTOR_BATCH], exactValid[MESH_PROJECTOR_BATCH];
+  double u, v;
+  long   leftCol, topRow;
+  long   first, batch, counter, point, exact;
+  long   projected = 0, exactPoints = 0;
+
+  for ( first = 0; first < count; first += batch )
   {
-    for ( col = 0; col < getMeshWidth(); col++ )
+    batch = ( count - first < MESH_PROJECTOR_BATCH ) ?
+            count - first : MESH_PROJECTOR_BATCH;
+
+    exact = 0;
+    for ( counter = 0; counter < batch; counter++ )
     {
-      // Get the projected point at this position
-      if (!getProjectedCoordinate( col, row, x, y ))
+      point = ( first + counter ) * stride;
+      if ( locateCell( x[point], y[point], leftCol, topRow, u, v ) &&
+           d_pCellError[ topRow * d_meshWidth + leftCol ] >
+             d_hybridTolerance )
       {
-        // Try and get the point the slow way
-        getSourceCoordinate( col, row, x, y );
-        
-        if ( !d_pFromProj->projectToGeo( x, y, y, x ) )
-        {
-          //This should not, to my knowledge happen
-          //continue;
-          throw PmeshException(PMESH_ERROR_UNKOWN);
-        }
-	      
-        if ( !d_pToProj->projectFromGeo( y, x, x, y ) )
-        {
-          //continue;
-          //again this should not happen
-          throw PmeshException(PMESH_ERROR_UNKOWN);
-        }
+        exactIndex[exact] = counter;
+        exactX[exact] = sourceX[exact] = x[point];
+        exactY[exact] = sourceY[exact] = y[point];
+        exact++;
       }
-	  
-      // Init the bounds if this is the first point
-      if ( bFirstPoint )
+    }
+
+    projected += interpolateStrided( x + first * stride, y + first * stride,
+                                     stride, batch, batchValid );
+
+    if ( exact > 0 )
+    {
       {
-        left = right = x;
-        top = bottom = y;
-        bFirstPoint = false;
+        PmeshLock lock( d_hybridMutex );
+        MeshProjector projector( *d_pFromProj, *d_pToProj );
+
+        projector.project( exactX, exactY, exact, exactValid );
       }
-      else
+      for ( counter = 0; counter < exact; counter++ )
       {
-        left   = ( left < x ) ? left : x;
-        right  = ( right > x ) ? right : x;
-        top    = ( top > y ) ? top : y;
-        bottom = ( bottom < y ) ? bottom : y;
+        // Failures are left as the source point like any other
+        point = ( first + exactIndex[counter] ) * stride;
+        x[point] = exactValid[counter] ? exactX[counter] : sourceX[counter];
+        y[point] = exactValid[counter] ? exactY[counter] : sourceY[counter];
+        if ( exactValid[counter] && !batchValid[ exactIndex[counter] ] )
+          projected++;
+        else if ( !exactValid[counter] && batchValid[ exactIndex[counter] ] )
+          projected--;
+        batchValid[ exactIndex[counter] ] = exactValid[counter];
       }
+      exactPoints += exact;
     }
+
+    if ( valid )
+      memcpy( valid + first, batchValid, batch * sizeof(bool) );
   }
+
+  atomicAdd( d_hybridPoints, count );
+  atomicAdd( d_hybridExactPoints, exactPoints );
+  return projected;
 }
 
 
 // ***************************************************************************
-// This function iterates through the source mesh and projects selective
-// points in a grid
-void ProjectionMesh::calculateMesh( const ProjLib::Projection& sourceProj,
-                                    const ProjLib::Projection& destProj )
-  throw (PmeshException)
+// Projects through the packed nodes with the MeshQuery policy for the
+// interpolator.  compactFits() has made sure there is one.
+long ProjectionMesh::projectCompact( double* x, double* y, long stride,
+                                     long count, bool* valid ) const throw()
 {
-  // Set all the points in the mesh grid
-  double x, y;
-   
+  MeshKernelGrid grid;
 
-  try
+  getKernelGrid( grid );
+  return queryNodes( d_interpolatorType, grid, d_compact,
+                     x, y, stride, count, valid );
+}
+
+
+// ***************************************************************************
+// Projects through the tile file with the MeshQuery policy for the
+// interpolator.  Each new cell reads its nodes from the tiles in one go.
+long ProjectionMesh::projectTiled( double* x, double* y, long stride,
+                                   long count, bool* valid ) const throw()
+{
+  MeshKernelGrid grid;
+
+  getKernelGrid( grid );
+  return queryNodes( d_interpolatorType, grid, d_tiledNodes,
+                     x, y, stride, count, valid );
+}
+
+
+// ***************************************************************************
+// Describes the mesh for the kernels and the quadtree
+void ProjectionMesh::getKernelGrid( MeshKernelGrid& grid ) const throw()
+{
+  grid.nodeX        = d_pNodeX;
+  grid.nodeY        = d_pNodeY;
+  grid.cellValid    = d_pCellValid;
+  grid.width        = d_meshWidth;
+  grid.height       = d_meshHeight;
+  grid.left         = d_left;
+  grid.top          = d_top;
+  grid.horizSpacing = d_horizMeshSpacing;
+  grid.vertSpacing  = d_vertMeshSpacing;
+}
+
+
+// ***************************************************************************
+// Hands the mesh out for MeshQuery
+void ProjectionMesh::getQueryGrid( MeshKernelGrid& grid ) const
+  throw(PmeshException)
+{
+  if ( !hasNodes() )
+    throw PmeshException(PMESH_NOT_CREATED_YET);
+
+  materializeAll();
+  getKernelGrid( grid );
+}
+
+
+// ***************************************************************************
+// Projects a run of points through the global spline.  A cell is only
+// set up once a second point in a row lands in it, so scattered points
+// don't pay for setting up cells they only use once.
+long ProjectionMesh::projectSpline( double* x, double* y, long stride,
+                                    long count, bool* valid ) const throw()
+{
+  MeshKernelGrid grid;
+  double cell[MeshSpline::CELL_SIZE];
+  double u, v;
+  long leftCol, topRow;
+  long lastCol = -1, lastRow = -1;
+  long counter;
+  long projected = 0;
+  bool bProjected, bLoaded = false;
+
+  getKernelGrid( grid );
+
+  for ( counter = 0; counter < count; counter++ )
   {
-    delete d_pFromProj;
-    delete d_pToProj;
-      
-    d_pFromProj = sourceProj.clone();
-    d_pToProj = destProj.clone();
+    double& px = x[ counter * stride ];
+    double& py = y[ counter * stride ];
 
-    for ( long row = 0; row < d_meshHeight; row++ )
+    bProjected = locateCell( px, py, leftCol, topRow, u, v ) &&
+      isCellValid( leftCol, topRow );
+
+    if ( bProjected )
     {
-      for ( long col = 0; col < d_meshWidth; col++ )
+      if ( leftCol != lastCol || topRow != lastRow )
+      {
+        d_spline.evaluate( grid, leftCol, topRow, u, v, px, py );
+        lastCol = leftCol;
+        lastRow = topRow;
+        bLoaded = false;
+      }
+      else
       {
-        // Get the grs point at this position
-        getSourceCoordinate( col, row, x, y );
-              
-        // Convert the coordinate to geographic
-        if ( sourceProj.projectToGeo( x, y, y, x ) )
+        if ( !bLoaded )
         {
-          // Convert from geographic to the destination coordinates
-          if ( destProj.projectFromGeo( y, x, x, y ) )
-          {
-            // Set the projected coordinates in the mesh
-            setMeshPoint( col, row, x, y );
-          }
+          d_spline.loadCell( grid, leftCol, topRow, cell );
+          bLoaded = true;
         }
-        /*the orginal class had no error handling for this
-         *and just marked the node as invalid later*/
-        else
-          {
-            //we be screwed so throw
-            throw PmeshException(PMESH_ERROR_UNKOWN);
-          }
+        MeshSpline::evaluateCell( cell, u, v, px, py );
       }
-    }	
-    // Validate the projection mesh
-    validateNodes();
+    }
+
+    if ( valid )
+      valid[counter] = bProjected;
+    if ( bProjected )
+      projected++;
   }
-  catch(PmeshException &e)
+  return projected;
+}
+
+
+// ***************************************************************************
+// Projects a run of points through the adaptive quadtree
+long ProjectionMesh::projectAdaptive( double* x, double* y, long stride,
+                                      long count, bool* valid ) const
+  throw()
+{
+  MeshKernelGrid grid;
+  double u, v;
+  long leftCol, topRow;
+  long counter;
+  long projected = 0;
+  bool bProjected;
+
+  getKernelGrid( grid );
+
+  for ( counter = 0; counter < count; counter++ )
   {
-    throw e; //catch possible out of bounds or not created
+    double& px = x[ counter * stride ];
+    double& py = y[ counter * stride ];
+
+    bProjected = locateCell( px, py, leftCol, topRow, u, v ) &&
+      isCellValid( leftCol, topRow );
+
+    if ( bProjected )
+      d_quadtree.evaluate( grid, leftCol, topRow, u, v, px, py );
+
+    if ( valid )
+      valid[counter] = bProjected;
+    if ( bProjected )
+      projected++;
+  }
+  return projected;
+}
+
+
+// ***************************************************************************
+// Inverse projection of a single point
+bool ProjectionMesh::inverseProjectPoint( double& x, double& y ) const
+  throw(PmeshException)
+{
+  return ( 1 == inverseProjectPoints( &x, &y, 1, NULL ) );
+}
+
+
+// ***************************************************************************
+// Batch inverse projection.  Each point starts its search from the cell
+// the last one was found in.
+long ProjectionMesh::inverseProjectPoints( double* x, double* y, long count,
+                                           bool* valid ) const
+  throw(PmeshException)
+{
+  MeshKernelGrid grid;
+  long hintCell = -1;
+  long counter;
+  long projected = 0;
+  bool bProjected;
+
+  if ( !d_inverse.isBuilt() )
+    throw PmeshException(PMESH_NOT_CREATED_YET);
+
+  getKernelGrid( grid );
+
+  for ( counter = 0; counter < count; counter++ )
+  {
+    bProjected = d_inverse.invert( grid, x[counter], y[counter], hintCell );
+
+    if ( valid )
+      valid[counter] = bProjected;
+    if ( bProjected )
+      projected++;
+  }
+  return projected;
+}
+
+
+// ***************************************************************************
+// Turns the global spline on or off
+void ProjectionMesh::setGlobalSpline( bool bGlobalSpline ) throw()
+{
+  d_bGlobalSpline = bGlobalSpline;
+
+  if ( !d_bGlobalSpline )
+    d_spline.clear();
+}
+
+
+// ***************************************************************************
+// Turns the inverse index on or off
+void ProjectionMesh::setInverse( bool bInverse ) throw()
+{
+  d_bInverse = bInverse;
+
+  if ( !d_bInverse )
+    d_inverse.clear();
+}
+
+
+// ***************************************************************************
+// Projects a run of points through the MathLib interpolators
+long ProjectionMesh::projectInterpolated( double* x, double* y, long stride,
+                                          long count, bool* valid ) const
+  throw(PmeshException)
+{
+  switch ( d_interpolatorType )
+  {
+  case MathLib::DlgViewer:
+    {
+      MathLib::DlgViewerInterpolator first;
+      return projectWith( first, first, x, y, stride, count, valid );
+    }
+  case MathLib::LeastSquaresPlane:
+    {
+      MathLib::LeastSquaresPlaneInterpolator first, second;
+      return projectWith( first, second, x, y, stride, count, valid );
+    }
+  case MathLib::BiPolynomial:
+    {
+      MathLib::BiPolynomialInterpolator first, second;
+      return projectWith( first, second, x, y, stride, count, valid );
+    }
+  case MathLib::BiLinear:
+    {
+      MathLib::BiLinearInterpolator first, second;
+      return projectWith( first, second, x, y, stride, count, valid );
+    }
+  case MathLib::BiCubic:
+    {
+      MathLib::BiCubicInterpolator first, second;
+      return projectWith( first, second, x, y, stride, count, valid );
+    }
+  case MathLib::BiCubicSpline:
+    {
+      MathLib::BiCubicSplineInterpolator first, second;
+      return projectWith( first, second, x, y, stride, count, valid );
+    }
+  }
+  return 0;
+}
+
+
+// ***************************************************************************
+// Projects a run of points with the precomputed cell coefficients
+long ProjectionMesh::projectPrecomputed( double* x, double* y, long stride,
+                                         long count, bool* valid ) const
+  throw()
+{
+  double u, v;
+  long leftCol, topRow;
+  long counter;
+  long projected = 0;
+  bool bProjected;
+
+  for ( counter = 0; counter < count; counter++ )
+  {
+    double& px = x[ counter * stride ];
+    double& py = y[ counter * stride ];
+
+    bProjected = locateCell( px, py, leftCol, topRow, u, v ) &&
+      isCellValid( leftCol, topRow );
+
+    if ( bProjected )
+      d_coefficients.evaluate( leftCol, topRow, u, v, px, py );
+
+    if ( valid )
+      valid[counter] = bProjected;
+    if ( bProjected )
+      projected++;
   }
+  return projected;
 }
 
 
+// ***************************************************************************
+// Projects a run of points using the caller's interpolators.  <first>
+// interpolates x (and y for the DlgViewer) and <second> interpolates y.
+long ProjectionMesh::projectWith( MathLib::Interpolator& first,
+                                  MathLib::Interpolator& second,
+                                  double* x, double* y, long stride,
+                                  long count, bool* valid ) const
+  throw(PmeshException)
+{
+  MathLib::Point gridX[16], gridY[16];   // cell grids, no per point new
+  MathLib::Point temp, temp2;
+  double u, v;
+  long type, numPoints;
+  long leftCol, topRow;
+  long lastCol = -1, lastRow = -1;       // cell the grids were built for
+  bool bCellValid = false;
+  bool bProjected;
+  long counter = 0;
+  long projected = 0;
+
+  type = d_interpolatorType;
+  numPoints = ( MathLib::BiCubic == type || MathLib::BiCubicSpline == type )
+    ? 16 : 4;
+
+  // The try is only re-entered when an interpolator throws, which fails
+  // just the point that caused it
+  while ( counter < count )
+  {
+    try
+    {
+      for ( ; counter < count; counter++ )
+      {
+        double& px = x[ counter * stride ];
+        double& py = y[ counter * stride ];
+
+        bProjected = false;
+
+        if ( locateCell( px, py, leftCol, topRow, u, v ) )
+        {
+          // Only rebuild the interpolators when we change cells
+          if ( leftCol != lastCol || topRow != lastRow )
+          {
+            lastCol = leftCol;
+            lastRow = topRow;
+            bCellValid = loadCell( type, leftCol, topRow, gridX, gridY );
 
+            if ( bCellValid )
+            {
+              first.setPoints(gridX, numPoints);
+              if ( MathLib::DlgViewer != type )
+                second.setPoints(gridY, numPoints);
+            }
+          }
 
+          if ( bCellValid )
+          {
+            temp.x = px;
+            temp.y = py;
+            temp = first.interpolatePoint(temp);
 
+            if ( MathLib::DlgViewer == type )
+            {
+              px = temp.z;
+              py = temp.w;
+            }
+            else
+            {
+              temp2.x = temp.x;
+              temp2.y = temp.y;
+              temp2 = second.interpolatePoint(temp2);
+              px = temp.z;
+              py = temp2.z;
+            }
+            bProjected = true;
+          }
+        }
 
+        if ( valid )
+          valid[counter] = bProjected;
+        if ( bProjected )
+          projected++;
+      }
+    }
+    catch(...)
+    { //something went wrong with this point so fail it and move on
+      if ( valid )
+        valid[counter] = false;
+      lastCol = lastRow = -1;
+      counter++;
+    }
+  }
+
+  return projected;
+}
+
+//**************************************************************************
+void ProjectionMesh::getGrid(int Col, int Row, MathLib::Point * in, int size)
+const throw(PmeshException)
+{
+  int counter, counter1;
+  int grow, gcol;
+  int index =0;
+  try
+    {
+      if ((size > d_meshHeight) || (size > d_meshWidth))
+        throw PmeshException();
+      // The stencil starts size/2 nodes before the cell and is slid back
+      // inside the mesh at the edges
+      grow = Row - size / 2;
+      if (grow > d_meshHeight - size)
+        grow = d_meshHeight - size;
+      if (grow < 0)
+        grow = 0;
+
+      gcol = Col - size / 2;
+      if (gcol > d_meshWidth - size)
+        gcol = d_meshWidth - size;
+      if (gcol < 0)
+        gcol = 0;
+      
+      //now should be able to get the grid
+      for (counter = grow; counter < grow+size; counter++)
+        {
+          for (counter1 = gcol; counter1 < gcol+size; counter1++)
+            {
+               readNode( counter1, counter, in[index].z, in[index].w );
+               in[index].x =  d_left + counter1 * d_horizMeshSpacing;
+               in[index].y = d_top  -  counter * d_vertMeshSpacing;
+               index++;
+            }
+        }
+
+    }
+  catch(...)
+    {
+      throw PmeshException();
+    }
+}
+                 
+
+
+
+// ***************************************************************************
+// A node's validity only depends on its neighbors' coordinates, so the
+// nodes can be gone through in any order.  A tiled mesh is gone through a
+// tile at a time so that each tile is only read in once or twice.
+void ProjectionMesh::validateNodes() throw()
+{
+  const long tileSize = d_tiledNodes.isBuilt() ?
+    d_tiledNodes.getTileSize() : 0;
+  const long bandHeight = tileSize ? tileSize : d_meshHeight;
+  const long spanWidth  = tileSize ? tileSize : d_meshWidth;
+  long band, left, row, col;
+  
+  for ( band = 0; band < d_meshHeight; band += bandHeight )
+  {
+    for ( left = 0; left < d_meshWidth; left += spanWidth )
+    {
+      for ( row = band; row < band + bandHeight && row < d_meshHeight;
+            row++ )
+      {
+        for ( col = left; col < left + spanWidth && col < d_meshWidth;
+              col++ )
+        {
+          validateNode( col, row );
+        }
+      }
+    }
+  }
+  
+}
+
+
+// ***************************************************************************
+// A node is invalid if it doesn't lie between its neighbors, which means
+// the projection folded over there
+void ProjectionMesh::validateNode( long col, long row ) throw()
+{
+  long center, top, bottom, left, right;
+  double centerX, centerY, leftX, rightX, topY, bottomY, unused;
+
+  center = row * d_meshWidth + col;
+
+  // Don't check this node if it's already been marked invalid
+  if ( !testBit( d_pNodeValid, center ) )
+  {
+    return;
+  }
+
+  // The edge rows and columns use themselves for the missing neighbor
+  top    = ( 0 == row ) ? center : center - d_meshWidth;
+  bottom = ( ( d_meshHeight - 1 ) == row ) ? center
+                                           : center + d_meshWidth;
+  left   = ( 0 == col ) ? center : center - 1;
+  right  = ( ( d_meshWidth - 1 ) == col ) ? center : center + 1;
+
+  // Determine the validity of the node
+  if ( d_pNodeX )
+  {
+    centerX = d_pNodeX[center];
+    centerY = d_pNodeY[center];
+    leftX   = d_pNodeX[left];
+    rightX  = d_pNodeX[right];
+    topY    = d_pNodeY[top];
+    bottomY = d_pNodeY[bottom];
+  }
+  else
+  {
+    d_tiledNodes.getNode( col, row, centerX, centerY );
+    d_tiledNodes.getNode( left % d_meshWidth, row, leftX, unused );
+    d_tiledNodes.getNode( right % d_meshWidth, row, rightX, unused );
+    d_tiledNodes.getNode( col, top / d_meshWidth, unused, topY );
+    d_tiledNodes.getNode( col, bottom / d_meshWidth, unused, bottomY );
+  }
+
+  if ( ( ( rightX - centerX ) * ( centerX - leftX ) < 0.0 ) ||
+       ( ( topY - centerY ) * ( centerY - bottomY ) < 0.0 ) )
+  {
+    setSharedBit( d_pNodeValid, center, false );
+  }
+}
+
+
+// ***************************************************************************
+// A cell is valid if all four of its corners are.  Working a row of bits at
+// a time would be quicker but this only runs once per calculateMesh().
+void ProjectionMesh::updateCellValidity() throw()
+{
+  long row, col;
+
+  for ( row = 0; row < d_meshHeight; row++ )
+  {
+    for ( col = 0; col < d_meshWidth; col++ )
+    {
+      updateCellValidity( col, row );
+    }
+  }
+}
+
+
+// ***************************************************************************
+// Sets the validity of a single cell
+void ProjectionMesh::updateCellValidity( long col, long row ) throw()
+{
+  long bottomRow = ( row + 1 < d_meshHeight ) ? row + 1 : row;
+  long rightCol  = ( col + 1 < d_meshWidth ) ? col + 1 : col;
+
+  setSharedBit( d_pCellValid, row * d_meshWidth + col,
+                testBit( d_pNodeValid, row * d_meshWidth + col ) &&
+                testBit( d_pNodeValid, row * d_meshWidth + rightCol ) &&
+                testBit( d_pNodeValid, bottomRow * d_meshWidth + col ) &&
+                testBit( d_pNodeValid,
+                         bottomRow * d_meshWidth + rightCol ) );
+}
+
+
+// ***************************************************************************
+void ProjectionMesh::getProjectedBoundingRect( double& left, double& bottom,
+                                               double& right, double& top ) 
+  const throw (PmeshException)
+{
+  double x, y;                 //projected point
+  bool   bFirstPoint = true;   //first point
+  long   row, col;             //counters
+  long   exactNodes = 0;       //nodes projected the slow way
+  long   tile, tiles, tileCols;
+  long   firstRow, firstCol, endRow, endCol;
+  const long tileSize = d_tiledNodes.isBuilt() ?
+    d_tiledNodes.getTileSize() : 0;
+  const long tileWidth  = tileSize ? tileSize : getMeshWidth();
+  const long tileHeight = tileSize ? tileSize : getMeshHeight();
+ 
+  // A tiled mesh is read a tile at a time, which doesn't change the
+  // bounds.  Any other is one big tile.
+  tileCols = ( getMeshWidth() + tileWidth - 1 ) / tileWidth;
+  tiles = tileCols * ( ( getMeshHeight() + tileHeight - 1 ) / tileHeight );
+  for ( tile = 0; tile < tiles; tile++ )
+  {
+    firstCol = ( tile % tileCols ) * tileWidth;
+    firstRow = ( tile / tileCols ) * tileHeight;
+    endCol = ( firstCol + tileWidth < getMeshWidth() ) ?
+             firstCol + tileWidth : getMeshWidth();
+    endRow = ( firstRow + tileHeight < getMeshHeight() ) ?
+             firstRow + tileHeight : getMeshHeight();
+
+    for ( row = firstRow; row < endRow; row++ )
+    {
+      for ( col = firstCol; col < endCol; col++ )
+      {
+        // Get the projected point at this position
+        if (!getProjectedCoordinate( col, row, x, y ))
+        {
+          // Try and get the point the slow way
+          getSourceCoordinate( col, row, x, y );
+          exactNodes++;
+        
+          if ( !d_pFromProj->projectToGeo( x, y, y, x ) )
+          {
+            //This should not, to my knowledge happen
+            //continue;
+            throw PmeshException(PMESH_ERROR_UNKOWN);
+          }
+	      
+          if ( !d_pToProj->projectFromGeo( y, x, x, y ) )
+          {
+            //continue;
+            //again this should not happen
+            throw PmeshException(PMESH_ERROR_UNKOWN);
+          }
+        }
+	  
+        // Init the bounds if this is the first point
+        if ( bFirstPoint )
+        {
+          left = right = x;
+          top = bottom = y;
+          bFirstPoint = false;
+        }
+        else
+        {
+          left   = ( left < x ) ? left : x;
+          right  = ( right > x ) ? right : x;
+          top    = ( top > y ) ? top : y;
+          bottom = ( bottom < y ) ? bottom : y;
+        }
+      }
+    }
+  }
+
+  // Nodes a tiled mesh couldn't read were taken as 0
+  if ( d_tiledNodes.isBuilt() && d_tiledNodes.hasFailed() )
+    throw PmeshException(PMESH_FILE_ERROR);
+
+  d_stats.addBoundingRect( exactNodes );
+}
+
+
+// ***************************************************************************
+// Projects every <rowStep>th row of the mesh starting at <firstRow>.  A
+// tiled mesh is projected a tile at a time, each thread doing its rows of
+// the tile, so the threads all write to the same few tiles and each tile
+// is only written out once.
+bool ProjectionMesh::calculateRows( const ProjLib::Projection& sourceProj,
+                                    const ProjLib::Projection& destProj,
+                                    long firstRow, long rowStep )
+  throw (PmeshException)
+{
+  MeshProjector projector( sourceProj, destProj );
+  double xs[MESH_PROJECTOR_BATCH], ys[MESH_PROJECTOR_BATCH];
+  bool   valid[MESH_PROJECTOR_BATCH];
+  const long tileSize = d_tiledNodes.isBuilt() ?
+    d_tiledNodes.getTileSize() : 0;
+  const long bandHeight = tileSize ? tileSize : d_meshHeight;
+  const long spanWidth  = tileSize ? tileSize : d_meshWidth;
+  long   band, left, right, row, firstCol, count, counter;
+
+  for ( band = 0; band < d_meshHeight; band += bandHeight )
+  {
+    for ( left = 0; left < d_meshWidth; left += spanWidth )
+    {
+      right = ( left + spanWidth < d_meshWidth ) ? left + spanWidth :
+              d_meshWidth;
+
+      // Start at the first of our rows in the band
+      for ( row = band + ( firstRow - band % rowStep + rowStep ) % rowStep;
+            row < band + bandHeight && row < d_meshHeight; row += rowStep )
+      {
+        // The row goes to the projections a batch of nodes at a time
+        for ( firstCol = left; firstCol < right;
+              firstCol += MESH_PROJECTOR_BATCH )
+        {
+          count = right - firstCol;
+          if ( count > MESH_PROJECTOR_BATCH )
+            count = MESH_PROJECTOR_BATCH;
+
+          // Get the grs points at these positions
+          for ( counter = 0; counter < count; counter++ )
+            getSourceCoordinate( firstCol + counter, row,
+                                 xs[counter], ys[counter] );
+
+          // Convert them to geographic and on to the destination.  A node
+          // that can't be converted to geographic fails the mesh; the
+          // orginal class had no error handling for one that can't be
+          // converted to the destination and just marked it invalid
+          // later.
+          if ( projector.project( xs, ys, count, valid ) > 0 )
+            return false;
+
+          // Set the projected coordinates in the mesh
+          for ( counter = 0; counter < count; counter++ )
+          {
+            if ( valid[counter] )
+              setMeshPoint( firstCol + counter, row,
+                            xs[counter], ys[counter] );
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+
+// ***************************************************************************
+// Runs a calculateRows() job on a worker thread
+void ProjectionMesh::calculateRowsThread( void* arg ) throw()
+{
+  MeshRowsJob* job = static_cast<MeshRowsJob*>( arg );
+
+  try
+  {
+    job->bSucceeded = job->mesh->calculateRows( *job->sourceProj,
+                                                *job->destProj,
+                                                job->firstRow,
+                                                job->rowStep );
+  }
+  catch(...)
+  {
+    job->bSucceeded = false;
+  }
+}
+
+
+// ***************************************************************************
+// Splits the rows of the mesh across d_threadCount threads.  Rows are dealt
+// out round robin so the expensive parts of a projection get shared out,
+// and since every node is projected with the same calls as the serial
+// path the resulting mesh is identical to it.
+void ProjectionMesh::calculateMeshThreaded(
+  const ProjLib::Projection& sourceProj,
+  const ProjLib::Projection& destProj ) throw (PmeshException)
+{
+  long         numJobs, counter;
+  MeshRowsJob* jobs = NULL;
+  void**       args = NULL;
+  bool         bSucceeded = true;
+
+  numJobs = ( d_threadCount < d_meshHeight ) ? d_threadCount : d_meshHeight;
+
+  try
+  {
+    if ( !( jobs = new (std::nothrow) MeshRowsJob[numJobs] ) ||
+         !( args = new (std::nothrow) void*[numJobs] ) )
+      throw std::bad_alloc();
+
+    for ( counter = 0; counter < numJobs; counter++ )
+    {
+      jobs[counter].mesh       = this;
+      jobs[counter].sourceProj = NULL;
+      jobs[counter].destProj   = NULL;
+      jobs[counter].firstRow   = counter;
+      jobs[counter].rowStep    = numJobs;
+      jobs[counter].bSucceeded = false;
+      args[counter]            = &jobs[counter];
+    }
+
+    // The projections aren't guaranteed to be thread safe so each thread
+    // gets its own copies
+    for ( counter = 0; counter < numJobs; counter++ )
+    {
+      if ( !( jobs[counter].sourceProj = sourceProj.clone() ) ||
+           !( jobs[counter].destProj = destProj.clone() ) )
+        throw std::bad_alloc();
+    }
+
+    runThreads( calculateRowsThread, args, numJobs );
+
+    for ( counter = 0; counter < numJobs; counter++ )
+      bSucceeded = bSucceeded && jobs[counter].bSucceeded;
+  }
+  catch(...)
+  {
+    bSucceeded = false;
+  }
+
+  if ( jobs )
+  {
+    for ( counter = 0; counter < numJobs; counter++ )
+    {
+      delete jobs[counter].sourceProj;
+      delete jobs[counter].destProj;
+    }
+  }
+  delete [] jobs;
+  delete [] args;
+
+  if ( !bSucceeded )
+    throw PmeshException(PMESH_ERROR_UNKOWN);
+}
+
+
+// ***************************************************************************
+// This function iterates through the source mesh and projects selective
+// points in a grid
+void ProjectionMesh::calculateMesh( const ProjLib::Projection& sourceProj,
+                                    const ProjLib::Projection& destProj )
+  throw (PmeshException)
+{
+  double start, mark, projection, validation;
+
+  start = MeshStats::now();
+
+  try
+  {
+    delete d_pFromProj;
+    delete d_pToProj;
+      
+    d_pFromProj = sourceProj.clone();
+    d_pToProj = destProj.clone();
+
+    // A mapped mesh is read only and a packed one can't be written, so
+    // get nodes of our own to calculate
+    reallocateNodes();
+
+    // A lazy mesh is projected as it gets used.  If there's no room for
+    // the tile flags just calculate the whole thing.
+    freeTiles();
+    d_coefficients.clear();
+    d_quadtree.clear();
+    d_inverse.clear();
+    d_spline.clear();
+    freeCellErrors();
+    if ( d_lazyTileSize > 0 && d_pNodeX && d_pFromProj && d_pToProj )
+    {
+      try
+      {
+        allocateTiles();
+        d_stats.addCalculate( MeshStats::now() - start, 0.0, 0.0 );
+        return;
+      }
+      catch(std::bad_alloc &)
+      {
+      }
+    }
+
+    mark = MeshStats::now();
+    if ( d_threadCount > 1 && d_meshHeight > 1 )
+    {
+      calculateMeshThreaded( sourceProj, destProj );
+    }
+    else if ( !calculateRows( sourceProj, destProj, 0, 1 ) )
+    {
+      //we be screwed so throw
+      throw PmeshException(PMESH_ERROR_UNKOWN);
+    }
+    projection = MeshStats::now() - mark;
+
+    // Validate the projection mesh
+    mark = MeshStats::now();
+    validateNodes();
+    updateCellValidity();
+    validation = MeshStats::now() - mark;
+
+    buildCellData( sourceProj, destProj );
+    d_stats.addCalculate( MeshStats::now() - start, projection, validation );
+
+    if ( d_tiledNodes.isBuilt() && d_tiledNodes.hasFailed() )
+      throw PmeshException(PMESH_FILE_ERROR);
+  }
+  catch(PmeshException &e)
+  {
+    throw e; //catch possible out of bounds or not created
+  }
+  catch(std::bad_alloc &)
+  {
+    //no room for the coefficients or the refinement, the mesh still
+    //works without them
+    d_coefficients.clear();
+    d_quadtree.clear();
+    d_inverse.clear();
+    d_spline.clear();
+    freeCellErrors();
+  }
+}
+
+
+// ***************************************************************************
+// Calculates a mesh through a file cache
+void ProjectionMesh::calculateMesh( const ProjLib::Projection& sourceProj,
+                                    const ProjLib::Projection& destProj,
+                                    const char* cachePath )
+  throw (PmeshException)
+{
+  if ( loadMesh( cachePath, sourceProj, destProj ) )
+    return;
+
+  calculateMesh( sourceProj, destProj );
+
+  try
+  {
+    saveMesh( cachePath );
+  }
+  catch(PmeshException &)
+  {
+    //the mesh is fine, it'll just get calculated again next time
+  }
+}
+
+
+// ***************************************************************************
+// Calculates a mesh by chaining two others
+void ProjectionMesh::composeMesh( const ProjectionMesh& first,
+                                  const ProjectionMesh& second,
+                                  ComposeReport* report, long samples )
+  throw(PmeshException)
+{
+  double xs[MESH_PROJECTOR_BATCH], ys[MESH_PROJECTOR_BATCH];
+  bool   firstValid[MESH_PROJECTOR_BATCH], secondValid[MESH_PROJECTOR_BATCH];
+  long   row, firstCol, count, counter, invalid = 0;
+  double start, mark, projection, validation;
+  clock_t composeStart = clock();
+
+  if ( !first.hasNodes() || !first.d_pFromProj || !first.d_pToProj ||
+       !second.hasNodes() || !second.d_pFromProj || !second.d_pToProj )
+    throw PmeshException(PMESH_NOT_CREATED_YET);
+
+  if ( &first == this || &second == this ||
+       first.d_pToProj->toString() != second.d_pFromProj->toString() )
+    throw PmeshException(PMESH_CANT_COMPOSE);
+
+  start = MeshStats::now();
+
+  try
+  {
+    delete d_pFromProj;
+    delete d_pToProj;
+
+    d_pFromProj = first.d_pFromProj->clone();
+    d_pToProj = second.d_pToProj->clone();
+
+    // A mapped mesh is read only and a packed one can't be written, so
+    // get nodes of our own to calculate
+    reallocateNodes();
+
+    freeTiles();
+    d_coefficients.clear();
+    d_quadtree.clear();
+    d_inverse.clear();
+    d_spline.clear();
+    freeCellErrors();
+
+    if ( !d_pNodeX && !d_tiledNodes.isBuilt() )
+      throw PmeshException(PMESH_NOT_CREATED_YET);
+
+    // Send each row through the two meshes a batch at a time
+    mark = MeshStats::now();
+    for ( row = 0; row < d_meshHeight; row++ )
+    {
+      for ( firstCol = 0; firstCol < d_meshWidth;
+            firstCol += MESH_PROJECTOR_BATCH )
+      {
+        count = d_meshWidth - firstCol;
+        if ( count > MESH_PROJECTOR_BATCH )
+          count = MESH_PROJECTOR_BATCH;
+
+        for ( counter = 0; counter < count; counter++ )
+          getSourceCoordinate( firstCol + counter, row,
+                               xs[counter], ys[counter] );
+
+        first.projectPoints( xs, ys, count, firstValid );
+        second.projectPoints( xs, ys, count, secondValid );
+
+        for ( counter = 0; counter < count; counter++ )
+        {
+          if ( firstValid[counter] && secondValid[counter] )
+            setMeshPoint( firstCol + counter, row, xs[counter], ys[counter] );
+          else
+            setBit( d_pNodeValid, row * d_meshWidth + firstCol + counter,
+                    false );
+        }
+      }
+    }
+    projection = MeshStats::now() - mark;
+
+    // Validate the projection mesh
+    mark = MeshStats::now();
+    validateNodes();
+    updateCellValidity();
+    validation = MeshStats::now() - mark;
+
+    if ( report )
+    {
+      report->seconds =
+        static_cast<double>( clock() - composeStart ) / CLOCKS_PER_SEC;
+      report->nodes = d_meshWidth * d_meshHeight;
+      for ( counter = 0; counter < report->nodes; counter++ )
+      {
+        if ( !testBit( d_pNodeValid, counter ) )
+          invalid++;
+      }
+      report->invalidNodes = invalid;
+    }
+
+    buildCellData( *d_pFromProj, *d_pToProj );
+    d_stats.addCalculate( MeshStats::now() - start, projection, validation );
+
+    if ( d_tiledNodes.isBuilt() && d_tiledNodes.hasFailed() )
+      throw PmeshException(PMESH_FILE_ERROR);
+
+    if ( report )
+      measureComposition( first, second, *report, samples );
+  }
+  catch(PmeshException &e)
+  {
+    throw e; //catch possible out of bounds or not created
+  }
+  catch(std::bad_alloc &)
+  {
+    //no room for the coefficients or the refinement, the mesh still
+    //works without them
+    d_coefficients.clear();
+    d_quadtree.clear();
+    d_inverse.clear();
+    d_spline.clear();
+    freeCellErrors();
+  }
+}
+
+
+// ***************************************************************************
+// Compares the composed mesh at cell centers with going through the two
+// meshes it came from, and with the projections
+void ProjectionMesh::measureComposition( const ProjectionMesh& first,
+                                         const ProjectionMesh& second,
+                                         ComposeReport& report,
+                                         long samples ) const
+  throw(PmeshException)
+{
+  const long cells = ( d_meshWidth - 1 ) * ( d_meshHeight - 1 );
+  double composedX, composedY, chainX, chainY, exactX, exactY;
+  double distance, chainSum = 0.0, exactSum = 0.0;
+  long   sample, cell;
+  bool   bComposed, bChain;
+
+  report.samples = report.exactSamples = 0;
+  report.chainMaxError = report.chainRmsError = 0.0;
+  report.exactMaxError = report.exactRmsError = 0.0;
+
+  if ( samples > cells )
+    samples = cells;
+
+  for ( sample = 0; sample < samples; sample++ )
+  {
+    // Spread the samples evenly over the cells
+    cell = static_cast<long>( static_cast<double>( sample ) * cells /
+                              samples );
+    getSourceCoordinate( cell % ( d_meshWidth - 1 ),
+                         cell / ( d_meshWidth - 1 ), composedX, composedY );
+    composedX += 0.5 * d_horizMeshSpacing;
+    composedY -= 0.5 * d_vertMeshSpacing;
+    chainX = exactX = composedX;
+    chainY = exactY = composedY;
+
+    bComposed = ( 1 == dispatchStrided( &composedX, &composedY, 1, 1,
+                                        NULL ) );
+    bChain = first.projectPoint( chainX, chainY ) &&
+      second.projectPoint( chainX, chainY );
+    if ( !bComposed || !bChain )
+      continue;
+
+    distance = hypot( composedX - chainX, composedY - chainY );
+    chainSum += distance * distance;
+    if ( distance > report.chainMaxError )
+      report.chainMaxError = distance;
+    report.samples++;
+
+    if ( d_pFromProj->projectToGeo( exactX, exactY, exactY, exactX ) &&
+         d_pToProj->projectFromGeo( exactY, exactX, exactX, exactY ) )
+    {
+      distance = hypot( composedX - exactX, composedY - exactY );
+      exactSum += distance * distance;
+      if ( distance > report.exactMaxError )
+        report.exactMaxError = distance;
+      report.exactSamples++;
+    }
+  }
+
+  if ( report.samples )
+    report.chainRmsError = sqrt( chainSum / report.samples );
+  if ( report.exactSamples )
+    report.exactRmsError = sqrt( exactSum / report.exactSamples );
+}
+
+
+// ***************************************************************************
+// Works out what calculateMesh() has been asked to on top of the nodes.
+// Only hybrid projection works on the nodes of a tiled mesh; the rest read
+// the double nodes.
+void ProjectionMesh::buildCellData( const ProjLib::Projection& sourceProj,
+                                    const ProjLib::Projection& destProj )
+  throw(std::bad_alloc)
+{
+  // Work out the cell coefficients if they've been asked for
+  if ( d_bPrecompute && d_pNodeX )
+  {
+    clock_t start = clock();
+    d_coefficients.build( d_interpolatorType, d_pNodeX, d_pNodeY,
+                          d_meshWidth, d_meshHeight );
+    d_precomputeSeconds =
+      static_cast<double>( clock() - start ) / CLOCKS_PER_SEC;
+  }
+
+  // Split the cells that interpolate too far from the projections
+  if ( d_adaptiveTolerance > 0.0 && d_pNodeX )
+  {
+    MeshKernelGrid grid;
+    clock_t start = clock();
+
+    getKernelGrid( grid );
+    d_quadtree.build( grid, sourceProj, destProj,
+                      d_adaptiveTolerance, d_adaptiveMaxDepth );
+    d_adaptiveSeconds =
+      static_cast<double>( clock() - start ) / CLOCKS_PER_SEC;
+  }
+
+  // Fit the spline through the whole mesh
+  if ( d_bGlobalSpline && MathLib::BiCubicSpline == d_interpolatorType &&
+       d_pNodeX )
+  {
+    MeshKernelGrid grid;
+
+    getKernelGrid( grid );
+    d_spline.build( grid, d_pNodeValid );
+  }
+
+  // Check how far off the cells are once everything the interpolation
+  // uses is in place
+  if ( d_hybridTolerance > 0.0 )
+    measureCellErrors( sourceProj, destProj );
+
+  // Index the projected cells for going back the other way
+  if ( d_bInverse && d_pNodeX )
+  {
+    MeshKernelGrid grid;
+
+    getKernelGrid( grid );
+    d_inverse.build( grid );
+  }
+
+  // Pack the nodes last, once nothing else needs to be built from them
+  compactNodes();
+}
+
+
+// ***************************************************************************
+// Swaps the double nodes for packed ones.  Anything that reads the doubles
+// while projecting keeps them, as do mapped meshes since their pages are
+// shared with whatever else maps the file.  If there's no room to pack
+// them the doubles just stay.
+void ProjectionMesh::compactNodes() throw()
+{
+  if ( !d_bCompact || !d_pNodeX || d_meshFile.isMapped() || d_pTileReady ||
+       d_quadtree.isBuilt() || d_inverse.isBuilt() || d_spline.isBuilt() ||
+       !compactFits( d_interpolatorType, d_meshWidth, d_meshHeight ) )
+    return;
+
+  try
+  {
+    d_compact.build( d_pNodeX, d_pNodeY, d_pNodeValid,
+                     d_meshWidth, d_meshHeight );
+  }
+  catch(std::bad_alloc &)
+  {
+    return;
+  }
+
+  delete [] d_pNodeX;
+  delete [] d_pNodeY;
+  d_pNodeX = d_pNodeY = NULL;
+}
+
+
+// ***************************************************************************
+// Moves the mesh into nodes calculateMesh() can write, or out of or into a
+// tile file.  A mesh that hasn't been given a size has nothing to move.
+// Running out of room is thrown as a PmeshException so that the callers'
+// catch of std::bad_alloc, which is for what a mesh can do without, can't
+// take it for that.
+void ProjectionMesh::reallocateNodes() throw(PmeshException)
+{
+  if ( !hasNodes() ||
+       ( !d_meshFile.isMapped() && !d_compact.isBuilt() &&
+         d_tiledNodes.getTileSize() == d_tiledTileSize ) )
+    return;
+
+  try
+  {
+    allocateNodes();
+  }
+  catch(std::bad_alloc &)
+  {
+    if ( d_tiledTileSize > 0 )
+      throw PmeshException(PMESH_FILE_ERROR);
+    throw PmeshException(PMESH_NOT_CREATED_YET);
+  }
+}
+
+
+// ***************************************************************************
+// Puts packed nodes back into doubles
+void ProjectionMesh::expandNodes() throw(std::bad_alloc)
+{
+  const size_t nodes = static_cast<size_t>( d_meshWidth ) * d_meshHeight;
+  double* pNodeX;
+  double* pNodeY;
+
+  if ( !d_compact.isBuilt() )
+    return;
+
+  if ( !( pNodeX = new (std::nothrow) double[nodes] ) )
+    throw std::bad_alloc();
+  if ( !( pNodeY = new (std::nothrow) double[nodes] ) )
+  {
+    delete [] pNodeX;
+    throw std::bad_alloc();
+  }
+
+  d_compact.expand( pNodeX, pNodeY );
+  d_compact.clear();
+  d_pNodeX = pNodeX;
+  d_pNodeY = pNodeY;
+}
+
+
+// ***************************************************************************
+// Writes the mesh out
+void ProjectionMesh::saveMesh( const char* path ) const
+  throw(PmeshException)
+{
+  MeshFileHeader header;
+  const size_t nodes = static_cast<size_t>( d_meshWidth ) * d_meshHeight;
+  double* pNodeX = d_pNodeX;
+  double* pNodeY = d_pNodeY;
+  bool bWritten;
+
+  if ( !hasNodes() || !d_pFromProj || !d_pToProj )
+    throw PmeshException(PMESH_NOT_CREATED_YET);
+
+  // Every tile of a lazy mesh has to be there to be saved
+  materializeAll();
+
+  memset( &header, 0, sizeof(header) );
+  MeshFile::makeKey( *d_pFromProj, *d_pToProj, d_left, d_top,
+                     d_sourceWidth, d_sourceHeight,
+                     d_meshWidth, d_meshHeight, header.key );
+  header.width        = d_meshWidth;
+  header.height       = d_meshHeight;
+  header.interpolator = d_interpolatorType;
+  header.left         = d_left;
+  header.top          = d_top;
+  header.sourceWidth  = d_sourceWidth;
+  header.sourceHeight = d_sourceHeight;
+  header.horizSpacing = d_horizMeshSpacing;
+  header.vertSpacing  = d_vertMeshSpacing;
+
+  // Files hold doubles, so packed and tiled nodes are written unpacked
+  if ( !d_pNodeX )
+  {
+    pNodeX = new (std::nothrow) double[nodes];
+    pNodeY = new (std::nothrow) double[nodes];
+    if ( !pNodeX || !pNodeY )
+    {
+      delete [] pNodeX;
+      delete [] pNodeY;
+      throw PmeshException(PMESH_FILE_ERROR);
+    }
+    if ( d_tiledNodes.isBuilt() )
+      d_tiledNodes.expand( pNodeX, pNodeY );
+    else
+      d_compact.expand( pNodeX, pNodeY );
+  }
+
+  bWritten = !( d_tiledNodes.isBuilt() && d_tiledNodes.hasFailed() ) &&
+    MeshFile::write( path, header, pNodeX, pNodeY,
+                     d_pNodeValid, d_pCellValid );
+  if ( !d_pNodeX )
+  {
+    delete [] pNodeX;
+    delete [] pNodeY;
+  }
+  if ( !bWritten )
+    throw PmeshException(PMESH_FILE_ERROR);
+}
+
+
+// ***************************************************************************
+// Maps a saved mesh in if it's the one we'd calculate
+bool ProjectionMesh::loadMesh( const char* path,
+                               const ProjLib::Projection& sourceProj,
+                               const ProjLib::Projection& destProj )
+  throw(PmeshException)
+{
+  MeshFile file;
+  unsigned int key[2];
+  ProjLib::Projection* pFromProj;
+  ProjLib::Projection* pToProj;
+
+  if ( !file.map( path ) )
+    return false;
+
+  const MeshFileHeader& header = file.getHeader();
+
+  MeshFile::makeKey( sourceProj, destProj, d_left, d_top,
+                     d_sourceWidth, d_sourceHeight,
+                     d_meshWidth, d_meshHeight, key );
+  if ( key[0] != header.key[0] || key[1] != header.key[1] ||
+       d_meshWidth != header.width || d_meshHeight != header.height )
+    return false;
+
+  pFromProj = sourceProj.clone();
+  pToProj   = destProj.clone();
+  if ( !pFromProj || !pToProj )
+  {
+    delete pFromProj;
+    delete pToProj;
+    return false;
+  }
+
+  // Drop whatever the mesh had and use the file's nodes in place
+  freeNodes();
+  freeTiles();
+  d_coefficients.clear();
+  d_quadtree.clear();
+  d_inverse.clear();
+  d_spline.clear();
+  freeCellErrors();
+  delete d_pFromProj;
+  delete d_pToProj;
+  d_pFromProj = pFromProj;
+  d_pToProj   = pToProj;
+
+  d_meshFile.swap( file );
+  d_pNodeX     = const_cast<double*>( d_meshFile.getNodeX() );
+  d_pNodeY     = const_cast<double*>( d_meshFile.getNodeY() );
+  d_pNodeValid = const_cast<MeshBitWord*>( d_meshFile.getNodeValid() );
+  d_pCellValid = const_cast<MeshBitWord*>( d_meshFile.getCellValid() );
+  d_horizMeshSpacing = d_meshFile.getHeader().horizSpacing;
+  d_vertMeshSpacing  = d_meshFile.getHeader().vertSpacing;
+
+  try
+  {
+    buildCellData( sourceProj, destProj );
+  }
+  catch(std::bad_alloc &)
+  {
+    //no room for the coefficients or the refinement, the mesh still
+    //works without them
+    d_coefficients.clear();
+    d_quadtree.clear();
+    d_inverse.clear();
+    d_spline.clear();
+    freeCellErrors();
+  }
+  return true;
+}
+
+
+// ***************************************************************************
+// Sets up a lazy mesh.  Every node starts out unprojected and invalid.
+void ProjectionMesh::allocateTiles() throw(std::bad_alloc)
+{
+  size_t words = bitmapWords( d_meshWidth * d_meshHeight );
+  long   tiles;
+
+  freeTiles();
+
+  d_tileCols = ( d_meshWidth + d_lazyTileSize - 1 ) / d_lazyTileSize;
+  d_tileRows = ( d_meshHeight + d_lazyTileSize - 1 ) / d_lazyTileSize;
+  tiles = d_tileCols * d_tileRows;
+
+  if ( !( d_pTileReady = new (std::nothrow) char[tiles] ) ||
+       !( d_pNodeProjected = new (std::nothrow) MeshBitWord[words] ) )
+  {
+    freeTiles();
+    throw std::bad_alloc();
+  }
+
+  for ( long counter = 0; counter < tiles; counter++ )
+    d_pTileReady[counter] = 0;
+
+  for ( size_t counter = 0; counter < words; counter++ )
+    d_pNodeProjected[counter] = d_pNodeValid[counter] =
+      d_pCellValid[counter] = 0;
+
+  d_materializedTiles = 0;
+}
+
+
+// ***************************************************************************
+// Frees the lazy tile flags
+void ProjectionMesh::freeTiles() throw()
+{
+  delete [] d_pTileReady;
+  delete [] d_pNodeProjected;
+  d_pTileReady = NULL;
+  d_pNodeProjected = NULL;
+  d_tileCols = d_tileRows = 0;
+  d_materializedTiles = 0;
+}
+
+
+// ***************************************************************************
+// Fills in a tile of a lazy mesh.  Only one tile is filled in at a time, so
+// the projections the mesh keeps can be used without their own copies.
+// Other threads may be reading tiles that are already filled in, which is
+// fine since nothing they use changes value.  Their validity bits share
+// words with this tile's though, so the bits are set with setSharedBit().
+void ProjectionMesh::materializeTile( long tile ) const throw()
+{
+  PmeshLock lock( d_tileMutex );
+  ProjectionMesh* self = const_cast<ProjectionMesh*>( this );
+  MeshProjector projector( *d_pFromProj, *d_pToProj );
+  double xs[MESH_PROJECTOR_BATCH], ys[MESH_PROJECTOR_BATCH];
+  long   nodes[MESH_PROJECTOR_BATCH];
+  bool   valid[MESH_PROJECTOR_BATCH];
+  long firstCol, lastCol, firstRow, lastRow;
+  long spanLeft, spanTop, spanWidth, spanHeight, spanNode;
+  long col, row, node, count, counter;
+  double mark, projection;
+
+  // Someone else may have got here first
+  if ( d_pTileReady[tile] )
+    return;
+
+  mark = MeshStats::now();
+
+  firstCol = ( tile % d_tileCols ) * d_lazyTileSize;
+  firstRow = ( tile / d_tileCols ) * d_lazyTileSize;
+  lastCol  = firstCol + d_lazyTileSize - 1;
+  lastRow  = firstRow + d_lazyTileSize - 1;
+  if ( lastCol >= d_meshWidth )
+    lastCol = d_meshWidth - 1;
+  if ( lastRow >= d_meshHeight )
+    lastRow = d_meshHeight - 1;
+
+  // Project the tile's nodes and enough around them for the bicubic
+  // stencils of its cells and for validating its corners.  The ones not
+  // done yet are gathered into batches for the projections.
+  spanLeft   = ( firstCol - 3 > 0 ) ? firstCol - 3 : 0;
+  spanTop    = ( firstRow - 3 > 0 ) ? firstRow - 3 : 0;
+  spanWidth  = ( ( lastCol + 3 < d_meshWidth ) ? lastCol + 3 :
+                 d_meshWidth - 1 ) - spanLeft + 1;
+  spanHeight = ( ( lastRow + 3 < d_meshHeight ) ? lastRow + 3 :
+                 d_meshHeight - 1 ) - spanTop + 1;
+  count = 0;
+  for ( spanNode = 0; spanNode < spanWidth * spanHeight; spanNode++ )
+  {
+    col  = spanLeft + spanNode % spanWidth;
+    row  = spanTop + spanNode / spanWidth;
+    node = row * d_meshWidth + col;
+
+    if ( !testBit( d_pNodeProjected, node ) )
+    {
+      setSharedBit( d_pNodeProjected, node, true );
+      getSourceCoordinate( col, row, xs[count], ys[count] );
+      nodes[count++] = node;
+    }
+
+    // Send the batch off when it's full or there are no more nodes
+    if ( count > 0 && ( MESH_PROJECTOR_BATCH == count ||
+                        spanNode == spanWidth * spanHeight - 1 ) )
+    {
+      projector.project( xs, ys, count, valid );
+      for ( counter = 0; counter < count; counter++ )
+      {
+        if ( valid[counter] )
+        {
+          d_pNodeX[ nodes[counter] ] = xs[counter];
+          d_pNodeY[ nodes[counter] ] = ys[counter];
+          setSharedBit( d_pNodeValid, nodes[counter], true );
+        }
+      }
+      count = 0;
+    }
+  }
+
+  projection = MeshStats::now() - mark;
+  mark = MeshStats::now();
+
+  // Validate the corners of the tile's cells, which includes the first
+  // row and column of the next tiles over.  Validating a node twice
+  // gives the same answer so it doesn't matter if they've been done.
+  for ( row = firstRow; row <= lastRow + 1 && row < d_meshHeight; row++ )
+  {
+    for ( col = firstCol; col <= lastCol + 1 && col < d_meshWidth; col++ )
+      self->validateNode( col, row );
+  }
+
+  for ( row = firstRow; row <= lastRow; row++ )
+  {
+    for ( col = firstCol; col <= lastCol; col++ )
+      self->updateCellValidity( col, row );
+  }
+
+  d_stats.addTile( projection, MeshStats::now() - mark );
+  d_materializedTiles++;
+  publishFlag( d_pTileReady[tile] );
+}
+
+
+// ***************************************************************************
+// Fills in whatever tiles haven't been
+void ProjectionMesh::materializeAll() const throw()
+{
+  if ( !d_pTileReady )
+    return;
+
+  for ( long tile = 0; tile < d_tileCols * d_tileRows; tile++ )
+  {
+    if ( !readFlag( d_pTileReady[tile] ) )
+      materializeTile( tile );
+  }
+}
+
+
+// ***************************************************************************
+// Walks a batch filling in the tiles its points land in.  Consecutive
+// points usually share a tile so the last one checked is remembered.
+void ProjectionMesh::prepareTiles( const double* x, const double* y,
+                                   long stride, long count ) const throw()
+{
+  double u, v;
+  long leftCol, topRow;
+  long tile;
+  long lastTile = -1;
+
+  for ( long counter = 0; counter < count; counter++ )
+  {
+    if ( !locateCell( x[ counter * stride ], y[ counter * stride ],
+                      leftCol, topRow, u, v ) )
+      continue;
+
+    tile = ( topRow / d_lazyTileSize ) * d_tileCols +
+      leftCol / d_lazyTileSize;
+    if ( tile != lastTile )
+    {
+      if ( !readFlag( d_pTileReady[tile] ) )
+        materializeTile( tile );
+      lastTile = tile;
+    }
+  }
+}
+
+
+// ***************************************************************************
+// Sets the lazy tile size.  It takes effect at the next calculateMesh().
+void ProjectionMesh::setLazyTileSize( long tileSize ) throw()
+{
+  d_lazyTileSize = ( tileSize > 0 ) ? tileSize : 0;
+}
+
+
+// ***************************************************************************
+// Reports how many tiles have been filled in
+long ProjectionMesh::getMaterializedTileCount() const throw()
+{
+  PmeshLock lock( d_tileMutex );
+
+  return d_materializedTiles;
+}
+
+
+// ***************************************************************************
+// Turns adaptive refinement on or off.  It takes effect at the next
+// calculateMesh().
+void ProjectionMesh::setAdaptive( double tolerance, long maxDepth ) throw()
+{
+  d_adaptiveTolerance = ( tolerance > 0.0 ) ? tolerance : 0.0;
+  d_adaptiveMaxDepth  = ( maxDepth > 0 ) ? maxDepth : 0;
+
+  if ( 0.0 == d_adaptiveTolerance )
+    d_quadtree.clear();
+}
+
+
+// ***************************************************************************
+// Reports what adaptive refinement did
+void ProjectionMesh::getAdaptiveReport( AdaptiveReport& report ) const
+  throw()
+{
+  report.refinedCells = d_quadtree.getRefinedCellCount();
+  report.addedPoints  = d_quadtree.getAddedPointCount();
+  report.leaves       = d_quadtree.getLeafCount();
+  report.treeBytes    = d_quadtree.getMemoryUsage();
+  report.buildSeconds = d_quadtree.isBuilt() ? d_adaptiveSeconds : 0.0;
+}
+
+
+// ***************************************************************************
+// Turns hybrid projection on or off.  Turning it on takes effect at the
+// next calculateMesh().
+void ProjectionMesh::setHybrid( double tolerance ) throw()
+{
+  d_hybridTolerance = ( tolerance > 0.0 ) ? tolerance : 0.0;
+
+  if ( 0.0 == d_hybridTolerance )
+    freeCellErrors();
+}
+
+
+// ***************************************************************************
+// Gets a cell's estimated error
+double ProjectionMesh::getCellError( long col, long row ) const throw()
+{
+  if ( !d_pCellError || col < 0 || col >= d_meshWidth ||
+       row < 0 || row >= d_meshHeight )
+    return 0.0;
+
+  return d_pCellError[ row * d_meshWidth + col ];
+}
+
+
+// ***************************************************************************
+// Reports what hybrid projection found and has done.  The counts of cells
+// are worked out here so that they follow the tolerance.
+void ProjectionMesh::getHybridReport( HybridReport& report ) const throw()
+{
+  const long cells = d_meshWidth * d_meshHeight;
+  long cell;
+
+  report.checkedCells = 0;
+  report.exactCells   = 0;
+  report.maxError     = 0.0;
+  report.buildSeconds = d_pCellError ? d_hybridSeconds : 0.0;
+  report.points       = d_hybridPoints;
+  report.exactPoints  = d_hybridExactPoints;
+
+  if ( !d_pCellError )
+    return;
+
+  for ( cell = 0; cell < cells; cell++ )
+  {
+    if ( !testBit( d_pCellValid, cell ) )
+      continue;
+
+    report.checkedCells++;
+    if ( d_pCellError[cell] > d_hybridTolerance )
+      report.exactCells++;
+    if ( d_pCellError[cell] > report.maxError &&
+         d_pCellError[cell] < HUGE_VAL )
+      report.maxError = d_pCellError[cell];
+  }
+}
+
+
+// ***************************************************************************
+// Compares each valid cell's interpolated center with its exact one a batch
+// at a time.  The errors are kept as floats since they're only compared
+// with the tolerance.
+void ProjectionMesh::measureCellErrors( const ProjLib::Projection& sourceProj,
+                                        const ProjLib::Projection& destProj )
+  throw(std::bad_alloc)
+{
+  const long cells = d_meshWidth * d_meshHeight;
+  MeshProjector projector( sourceProj, destProj );
+  double interpolatedX[MESH_PROJECTOR_BATCH];
+  double interpolatedY[MESH_PROJECTOR_BATCH];
+  double exactX[MESH_PROJECTOR_BATCH], exactY[MESH_PROJECTOR_BATCH];
+  bool   interpolatedValid[MESH_PROJECTOR_BATCH];
+  bool   exactValid[MESH_PROJECTOR_BATCH];
+  long   first, batch, counter, cell;
+  clock_t start = clock();
+  float* pCellError;
+
+  freeCellErrors();
+  pCellError = new (std::nothrow) float[cells];
+  if ( !pCellError )
+    throw std::bad_alloc();
+
+  for ( first = 0; first < cells; first += batch )
+  {
+    batch = ( cells - first < MESH_PROJECTOR_BATCH ) ?
+            cells - first : MESH_PROJECTOR_BATCH;
+
+    for ( counter = 0; counter < batch; counter++ )
+    {
+      cell = first + counter;
+      exactX[counter] = interpolatedX[counter] =
+        d_left + ( cell % d_meshWidth + 0.5 ) * d_horizMeshSpacing;
+      exactY[counter] = interpolatedY[counter] =
+        d_top - ( cell / d_meshWidth + 0.5 ) * d_vertMeshSpacing;
+    }
+
+    try
+    {
+      interpolateStrided( interpolatedX, interpolatedY, 1, batch,
+                          interpolatedValid );
+    }
+    catch(PmeshException &)
+    {
+      memset( interpolatedValid, 0, sizeof(interpolatedValid) );
+    }
+    projector.project( exactX, exactY, batch, exactValid );
+
+    // Invalid cells are never interpolated so are never off
+    for ( counter = 0; counter < batch; counter++ )
+    {
+      if ( !interpolatedValid[counter] )
+        pCellError[ first + counter ] = 0.0f;
+      else if ( !exactValid[counter] )
+        pCellError[ first + counter ] = static_cast<float>( HUGE_VAL );
+      else
+        pCellError[ first + counter ] = static_cast<float>(
+          hypot( interpolatedX[counter] - exactX[counter],
+                 interpolatedY[counter] - exactY[counter] ) );
+    }
+  }
+
+  d_pCellError = pCellError;
+  d_hybridSeconds = static_cast<double>( clock() - start ) / CLOCKS_PER_SEC;
+}
+
+
+// ***************************************************************************
+// Frees the cell errors
+void ProjectionMesh::freeCellErrors() throw()
+{
+  delete [] d_pCellError;
+  d_pCellError = NULL;
+}
+
+
+// ***************************************************************************
+// Turns compact node storage on or off.  Turning it on takes effect at the
+// next calculateMesh().
+void ProjectionMesh::setCompact( bool bCompact ) throw()
+{
+  d_bCompact = bCompact;
+
+  // Keep the packed nodes if there's no room to unpack them
+  if ( !d_bCompact )
+  {
+    try
+    {
+      expandNodes();
+    }
+    catch(std::bad_alloc &)
+    {
+    }
+  }
+}
+
+
+// ***************************************************************************
+// Reports what packing the nodes saved
+void ProjectionMesh::getCompactReport( CompactReport& report ) const
+  throw()
+{
+  const size_t nodes = static_cast<size_t>( d_meshWidth ) * d_meshHeight;
+
+  report.compact         = d_compact.isBuilt();
+  report.doubleNodeBytes = nodes * 2 * sizeof(double);
+  report.nodeBytes       = report.compact ? d_compact.getMemoryUsage() :
+                           report.doubleNodeBytes;
+  report.maxNodeError    = d_compact.getMaxError();
+}
+
+
+// ***************************************************************************
+// Sets up keeping the nodes in a tile file.  It takes effect the next time
+// the nodes are allocated.
+void ProjectionMesh::setTiled( const char* path, long tileSize,
+                               size_t budgetBytes ) throw()
+{
+  d_tiledPath     = path ? path : "";
+  d_tiledTileSize = ( path && tileSize > 0 ) ? tileSize : 0;
+  d_tiledBudget   = budgetBytes;
+}
+
+
+// ***************************************************************************
+// Reports how the tile file has been used
+void ProjectionMesh::getTiledReport( TiledReport& report ) const throw()
+{
+  report.tiled         = d_tiledNodes.isBuilt();
+  report.tileSize      = d_tiledNodes.getTileSize();
+  report.tiles         = d_tiledNodes.getTileCount();
+  report.cacheTiles    = d_tiledNodes.getSlotCount();
+  report.residentTiles = d_tiledNodes.getResidentTileCount();
+  report.cacheBytes    = d_tiledNodes.getMemoryUsage();
+  report.fileBytes     = static_cast<double>( d_tiledNodes.getTileBytes() ) *
+                         d_tiledNodes.getTileCount();
+  report.faults        = d_tiledNodes.getFaultCount();
+  report.writeBacks    = d_tiledNodes.getWriteBackCount();
+}
+
+
+// ***************************************************************************
+// Turns the cell coefficients on or off
+void ProjectionMesh::setPrecompute( bool bPrecompute ) throw()
+{
+  d_bPrecompute = bPrecompute;
+
+  if ( !d_bPrecompute )
+    d_coefficients.clear();
+}
+
+
+// ***************************************************************************
+// Adds up the mesh's memory
+size_t ProjectionMesh::getMemoryUsage() const throw()
+{
+  const long nodes = d_meshWidth * d_meshHeight;
+  size_t bytes = 0;
+
+  if ( d_pNodeX )
+    bytes += static_cast<size_t>( nodes ) * 2 * sizeof(double);
+  if ( hasNodes() )
+    bytes += 2 * bitmapWords( nodes ) * sizeof(MeshBitWord);
+  if ( d_pTileReady )
+    bytes += d_tileCols * d_tileRows + bitmapWords( nodes ) *
+      sizeof(MeshBitWord);
+
+  if ( d_pCellError )
+    bytes += static_cast<size_t>( nodes ) * sizeof(float);
+
+  return bytes + d_coefficients.getMemoryUsage() +
+    d_quadtree.getMemoryUsage() + d_inverse.getMemoryUsage() +
+    d_spline.getMemoryUsage() + d_compact.getMemoryUsage() +
+    d_tiledNodes.getMemoryUsage();
+}
+
+
+// ***************************************************************************
+// Reports what the cell coefficients cost and buy
+void ProjectionMesh::getPrecomputeReport( PrecomputeReport& report,
+                                          long samples ) const
+  throw(PmeshException)
+{
+  double* xs = NULL;
+  double* ys = NULL;
+  double left, bottom, right, top;
+  clock_t start;
+  double seconds;
+
+  report.cells = d_meshWidth * d_meshHeight;
+  report.coefficientsPerCell =
+    MeshCoefficients::coefficientsPerCell( d_interpolatorType );
+  report.nodeBytes = ( d_compact.isBuilt() ? d_compact.getMemoryUsage() :
+    d_tiledNodes.isBuilt() ? d_tiledNodes.getMemoryUsage() :
+    static_cast<size_t>( report.cells ) * 2 * sizeof(double) ) +
+    2 * bitmapWords( report.cells ) * sizeof(MeshBitWord);
+  report.coefficientBytes = static_cast<size_t>( report.cells ) *
+    report.coefficientsPerCell * sizeof(double);
+  report.splineBytes = d_spline.getMemoryUsage();
+  report.buildSeconds = d_coefficients.isBuilt() ? d_precomputeSeconds : 0.0;
+  report.interpolatorRate = 0.0;
+  report.precomputedRate = 0.0;
+
+  if ( samples <= 0 || !d_pNodeX )
+    return;
+
+  if ( !( xs = new (std::nothrow) double[samples] ) ||
+       !( ys = new (std::nothrow) double[samples] ) )
+  {
+    delete [] xs;
+    return;
+  }
+
+  // Time the same pseudo random points through each path
+  getSourceMesh( left, bottom, right, top );
+
+  try
+  {
+    fillSamplePoints( xs, ys, samples, left, bottom, right, top );
+    start = clock();
+    projectInterpolated( xs, ys, 1, samples, NULL );
+    seconds = static_cast<double>( clock() - start ) / CLOCKS_PER_SEC;
+    if ( seconds > 0.0 )
+      report.interpolatorRate = samples / seconds;
+
+    if ( d_coefficients.isBuilt() &&
+         d_coefficients.getType() == d_interpolatorType )
+    {
+      fillSamplePoints( xs, ys, samples, left, bottom, right, top );
+      start = clock();
+      projectPrecomputed( xs, ys, 1, samples, NULL );
+      seconds = static_cast<double>( clock() - start ) / CLOCKS_PER_SEC;
+      if ( seconds > 0.0 )
+        report.precomputedRate = samples / seconds;
+    }
+  }
+  catch(...)
+  {
+    delete [] xs;
+    delete [] ys;
+    throw;
+  }
+
+  delete [] xs;
+  delete [] ys;
+}
@@ -20,10 +20,108 @@
 #include "MathLib/BiCubicSplineInterpolator.h"
 #include "PmeshException.h"
 #include "MeshNode.h"
+#include "MeshBitmap.h"
+#include "MeshCoefficients.h"
+#include "MeshKernels.h"
+#include "MeshQuadtree.h"
+#include "PmeshThread.h"
+#include "MeshFile.h"
+#include "MeshInverse.h"
+#include "MeshStats.h"
+#include "MeshQuery.h"
+#include "MeshSpline.h"
+#include "MeshCompact.h"
+#include "MeshTileStore.h"
 
 namespace PmeshLib    //namespace
 {
 
+/* What precomputing the cell coefficients costs and buys for a mesh.
+   Filled in by ProjectionMesh::getPrecomputeReport() */
+struct PrecomputeReport
+{
+  long   cells;               // cells in the mesh
+  long   coefficientsPerCell; // doubles stored per cell, 0 if the
+                              // interpolator can't be precomputed
+  size_t nodeBytes;           // memory used by the mesh nodes
+  size_t coefficientBytes;    // memory the coefficients use or would use
+  size_t splineBytes;         // memory the global spline uses, 0 if it
+                              // isn't fitted
+  double buildSeconds;        // time the last precompute took
+  double interpolatorRate;    // points/second through the interpolators
+  double precomputedRate;     // points/second through the coefficients,
+                              // 0 if they aren't built
+};
+
+/* What adaptive refinement did to the last calculated mesh.  Filled in
+   by ProjectionMesh::getAdaptiveReport() */
+struct AdaptiveReport
+{
+  long   refinedCells;        // mesh cells that were split
+  long   addedPoints;         // points projected on top of the mesh nodes
+  long   leaves;              // cells after refinement, counting unsplit ones
+  size_t treeBytes;           // memory used by the quadtree
+  double buildSeconds;        // time the refinement took
+};
+
+/* How far hybrid projection found the cells of the last calculated mesh
+   to be off and how often it has fallen back to projecting exactly.
+   Filled in by ProjectionMesh::getHybridReport() */
+struct HybridReport
+{
+  long   checkedCells;        // valid cells whose centers were compared
+  long   exactCells;          // of which over the tolerance, or whose
+                              // center couldn't be projected exactly
+  double maxError;            // largest distance between an interpolated
+                              // and an exactly projected center
+  double buildSeconds;        // time checking the cells took
+  unsigned long points;       // points projected since the mesh was made
+                              // or resetStats() was called
+  unsigned long exactPoints;  // of which landed in an exact cell
+};
+
+/* What compact node storage saved on the last calculated mesh.  Filled
+   in by ProjectionMesh::getCompactReport() */
+struct CompactReport
+{
+  bool   compact;             // true if the nodes are packed
+  size_t nodeBytes;           // memory the nodes use
+  size_t doubleNodeBytes;     // memory they'd use as doubles
+  double maxNodeError;        // largest distance between a packed valid
+                              // node and the original
+};
+
+/* How the tile file of a tiled mesh is being used.  Filled in by
+   ProjectionMesh::getTiledReport() */
+struct TiledReport
+{
+  bool   tiled;               // true if the nodes are kept in a tile file
+  long   tileSize;            // nodes across a tile
+  long   tiles;               // tiles in the file
+  long   cacheTiles;          // tiles the memory budget holds
+  long   residentTiles;       // of which in memory right now
+  size_t cacheBytes;          // memory the tiles and their index take
+  double fileBytes;           // size of the tile file
+  unsigned long faults;       // tiles read in from the file since the
+                              // mesh was made or resetStats() was called
+  unsigned long writeBacks;   // changed tiles written back out to it
+};
+
+/* How far a mesh made by ProjectionMesh::composeMesh() is from the two it
+   was made from, measured at a sample of cell centers */
+struct ComposeReport
+{
+  long   nodes;               // nodes in the composed mesh
+  long   invalidNodes;        // of which invalid
+  long   samples;             // cell centers compared
+  double chainMaxError;       // largest and RMS distance from projecting
+  double chainRmsError;       // through both meshes
+  long   exactSamples;        // of which projected exactly as well
+  double exactMaxError;       // largest and RMS distance from projecting
+  double exactRmsError;       // exactly with the projections
+  double seconds;             // time composing the nodes took
+};
+
 class ProjectionMesh
 {
  public:
@@ -36,15 +134,127 @@ class ProjectionMesh
   /* This function projects a Point from the source mesh coordinate space
      into the target mesh (set in calculate mesh) using the 
      interpolator specified in setInterpolator() If no interpolator is set 
-     then the original bilinear interpolation from the veiwer is used.*/ 
+     then the original bilinear interpolation from the veiwer is used.
+     The MathLib interpolators are used unless a faster way of evaluating
+     them has been turned on with setClosedForm(), setPrecompute(),
+     setVectorized() or setGlobalSpline().
+     Once calculateMesh() has returned, this and the other projection
+     functions only read the mesh, so any number of threads can project
+     through one mesh at the same time without locking.  Lazy meshes
+     (see setLazyTileSize()) lock only while filling in a tile and hybrid
+     meshes (see setHybrid()) while projecting points exactly.*/ 
   bool projectPoint( double& x, double& y ) const throw(PmeshException);
+
+  /* Projects <count> points held in the separate <x> and <y> arrays in
+     place.  The interpolator is resolved once for the whole batch and
+     consecutive points falling in the same mesh cell reuse its setup.
+     If <valid> is not NULL, valid[i] is set to whether point i was
+     projected; points that fail are left untouched.  Returns the number
+     of points successfully projected.*/
+  long projectPoints( double* x, double* y, long count,
+                      bool* valid = NULL ) const throw(PmeshException);
+
+  /* Same as projectPoints() but for an interleaved x0,y0,x1,y1,...
+     buffer holding <count> points*/
+  long projectInterleavedPoints( double* xy, long count,
+                                 bool* valid = NULL ) const
+    throw(PmeshException);
+
+  /* Projects the <count> evenly spaced points <x> + i * <stepX>,
+     <y> + i * <stepY>, such as the pixel centers along a row, into
+     <outX> and <outY>.  For the DlgViewer and BiLinear interpolators with
+     setClosedForm() on, the interpolation within a cell is stepped from
+     point to point by forward differences and only set up again when the
+     run enters a new cell, whose validity is checked then.  The results
+     agree with projectPoint() to within the tolerance documented in
+     MeshKernels.h.  Other meshes project the points one by one.
+     Points that fail are left as the unprojected source points.  <valid>
+     and the return value are as for projectPoints()*/
+  long projectRun( double x, double y, double stepX, double stepY,
+                   long count, double* outX, double* outY,
+                   bool* valid = NULL ) const throw(PmeshException);
   
   
+  /* Projects the destination point <x>, <y> back to the source space
+     through the mesh, inverting the bilinear interpolation of the cell it
+     falls in.  The result is consistent with projectPoint() for the
+     DlgViewer and BiLinear interpolators and within the interpolators'
+     differences for the others.  Needs setInverse() to have been turned
+     on before calculateMesh().  Returns false if no valid cell covers the
+     point, and throws PMESH_NOT_CREATED_YET if there is no inverse
+     index */
+  bool inverseProjectPoint( double& x, double& y ) const
+    throw(PmeshException);
+
+  /* Inverse projects <count> points held in <x> and <y> in place, the
+     way projectPoints() does forwards.  Nearby points are found fastest
+     when they come one after another */
+  long inverseProjectPoints( double* x, double* y, long count,
+                             bool* valid = NULL ) const
+    throw(PmeshException);
+
   /* Projects each source coordinate in the mesh from <sourceProj> to
-     <destProj> and validates all the nodes when it's done */ 
+     <destProj> and validates all the nodes when it's done.  Projections
+     that also implement MeshBatchProjection are handed rows of nodes at
+     a time.  Throws PMESH_NOT_CREATED_YET, leaving no mesh, if the nodes
+     have to be moved to be written (see loadMesh(), setCompact() and
+     setTiled()) and there's no room for them */ 
   void calculateMesh( const ProjLib::Projection& sourceProj, 
 		      const ProjLib::Projection& destProj )  
     throw(PmeshException);
+
+  /* Same as calculateMesh() above, but loads the mesh from <cachePath>
+     with loadMesh() if it matches, and otherwise calculates it and saves
+     it there for next time.  A mesh that can't be saved is still
+     calculated.  Lazy meshes are filled in completely to be saved */
+  void calculateMesh( const ProjLib::Projection& sourceProj,
+                      const ProjLib::Projection& destProj,
+                      const char* cachePath )
+    throw(PmeshException);
+
+  /* Calculates the mesh from the source of <first> to the destination
+     of <second> by projecting each node through <first> and then through
+     <second>, rather than through the projection library.  The
+     destination projection of <first> must be the source of <second>.
+     A node is invalid if either mesh can't project it, and the nodes are
+     then validated as calculateMesh() does.  The mesh is never lazy.  If
+     <report> isn't NULL it is filled in from up to <samples> cell
+     centers.  Throws PMESH_NOT_CREATED_YET if either mesh hasn't been
+     calculated and PMESH_CANT_COMPOSE if they don't join up or one of
+     them is this mesh */
+  void composeMesh( const ProjectionMesh& first,
+                    const ProjectionMesh& second,
+                    ComposeReport* report = NULL, long samples = 1000 )
+    throw(PmeshException);
+
+  /* Writes the calculated mesh to <path> in the MeshFile format, along
+     with a key made from the projections it was calculated with, the
+     source bounds and the mesh size.  Throws PMESH_NOT_CREATED_YET if the
+     mesh hasn't been calculated and PMESH_FILE_ERROR if the file can't be
+     written */
+  void saveMesh( const char* path ) const throw(PmeshException);
+
+  /* Maps the mesh saved in <path> in place of calculating it, if it was
+     calculated from <sourceProj> to <destProj> with the current source
+     bounds and mesh size.  The interpolator set on this mesh is kept, not
+     the one the mesh was saved with.  The nodes are used straight out of
+     the read only mapping, so processes loading the same file share one
+     copy of it.  Returns false, leaving the mesh as it was, if the file
+     is missing or doesn't match */
+  bool loadMesh( const char* path, const ProjLib::Projection& sourceProj,
+                 const ProjLib::Projection& destProj )
+    throw(PmeshException);
+
+  /* Returns true if the nodes are mapped from a file by loadMesh() */
+  bool isMapped() const throw();
+
+  /* Fills <grid> with the calculated mesh for a MeshQuery, or the
+     MeshKernels, to read directly.  A lazy mesh is filled in completely
+     first.  Compact and tiled meshes have no double nodes to read, so
+     their grids have none and no MeshQuery fits them.  The grid is good
+     until the mesh is next calculated, loaded or resized.  Throws
+     PMESH_NOT_CREATED_YET if there is no mesh */
+  void getQueryGrid( MeshKernelGrid& grid ) const throw(PmeshException);
     
   /* This function sets the bounding rectangle for the source mesh*/
   void setSourceMeshBounds( double left, double bottom,
@@ -53,10 +263,220 @@ class ProjectionMesh
   /* Set the number of points to place in the mesh */
   void setMeshSize( long width, long height ) throw(std::bad_alloc);
  
+  /* Sets the number of threads calculateMesh() splits the rows of the
+     mesh across.  Each thread projects with its own clone() of the
+     projections.  The default of 1 does all the work on the calling
+     thread */
+  void setThreadCount( long threads ) throw();
+
+  /* Gets the number of threads calculateMesh() uses */
+  long getThreadCount() const throw();
+
   /* Set interpolator function sets the interpolator for use *
    * with projection calculation                             */ 
   void setInterpolator(long int in)  throw(std::bad_alloc);
+
+  /* Gets the type of interpolator in use */
+  long getInterpolator() const throw();
+
+  /* Turns on working out the interpolation coefficients of every cell at
+     the end of calculateMesh().  Projecting a point then only takes
+     finding its cell and evaluating a polynomial, which agrees with the
+     interpolators to within the tolerance documented in
+     MeshCoefficients.h, at the cost of the memory reported by
+     getPrecomputeReport().  Supported for the DlgViewer, BiLinear,
+     LeastSquaresPlane, BiPolynomial and BiCubic interpolators; others, or
+     an interpolator changed after calculateMesh(), keep using the
+     interpolators */
+  void setPrecompute( bool bPrecompute ) throw();
+
+  /* Gets whether the cell coefficients are precomputed */
+  bool getPrecompute() const throw();
+
+  /* Turns on building an index of the projected cells at the end of
+     calculateMesh() (or loadMesh()) so that inverseProjectPoint() can be
+     used.  The index takes a few longs per cell.  Lazy meshes can't be
+     inverted */
+  void setInverse( bool bInverse ) throw();
+
+  /* Gets whether the inverse index is built */
+  bool getInverse() const throw();
+
+  /* Turns on interpolating the DlgViewer, BiLinear, BiPolynomial,
+     LeastSquaresPlane and BiCubic interpolators from their closed forms,
+     each inlined into a MeshQuery (see MeshQuery.h), instead of through
+     the MathLib objects.  They agree with the interpolators to within the
+     tolerance documented in MeshCoefficients.h.  BiCubic meshes smaller
+     than 4 x 4 and BiCubicSpline keep using MathLib */
+  void setClosedForm( bool bClosedForm ) throw();
+
+  /* Gets whether the closed forms are used */
+  bool getClosedForm() const throw();
+
+  /* Turns on the vectorized kernels in MeshKernels for the DlgViewer and
+     BiLinear interpolators.  They project 4 or 8 points at a time on CPUs
+     with AVX2 or AVX-512 and agree with the interpolators to within the
+     tolerance documented in MeshKernels.h.  Other interpolators ignore
+     this */
+  void setVectorized( bool bVectorized ) throw();
+
+  /* Gets whether the vectorized kernels are used */
+  bool getVectorized() const throw();
+
+  /* Turns on fitting one bicubic spline through every node at the end of
+     calculateMesh() (or loadMesh()) for the BiCubicSpline interpolator.
+     Projecting a point then only takes finding its cell and evaluating a
+     cubic, and the surface is C2 across the whole mesh.  It is not the
+     same surface the MathLib interpolator fits through the 4x4 nodes
+     around each point, though both pass through the nodes.  The fit takes
+     three times the memory of the nodes.  Lazy and adaptively refined
+     meshes don't use it */
+  void setGlobalSpline( bool bGlobalSpline ) throw();
+
+  /* Gets whether the global spline is fitted */
+  bool getGlobalSpline() const throw();
+
+  /* Turns on adaptive refinement.  calculateMesh() then checks each cell
+     of the (usually coarse) mesh by projecting its center exactly, and
+     splits cells into quarters until the interpolated centers are within
+     <tolerance> destination units of the exact ones or a cell has been
+     split <maxDepth> times.  Refined meshes are projected through
+     bilinearly whatever the interpolator.  A <tolerance> of 0 turns
+     refinement off */
+  void setAdaptive( double tolerance, long maxDepth = 8 ) throw();
+
+  /* Gets the adaptive refinement tolerance, 0 if it is off */
+  double getAdaptiveTolerance() const throw();
+
+  /* Gets how many times adaptive refinement may split a cell */
+  long getAdaptiveMaxDepth() const throw();
+
+  /* Fills <report> with what adaptive refinement did to the mesh */
+  void getAdaptiveReport( AdaptiveReport& report ) const throw();
+
+  /* Turns on hybrid projection.  calculateMesh() (or loadMesh()) then
+     estimates how far off each valid cell is by projecting its center
+     exactly and comparing it with the interpolated center, and points
+     that land in a cell more than <tolerance> destination units off are
+     projected exactly with the projections the mesh was calculated with
+     instead of being interpolated.  Cells whose centers can't be
+     projected exactly are always projected exactly.  A coarse mesh can
+     then be used everywhere and exact projection paid for only where it
+     is needed.  The cells are checked with the interpolator set when the
+     mesh is calculated.  Changing the tolerance of a checked mesh takes
+     effect straight away, a <tolerance> of 0 turns it off.  Lazy meshes
+     aren't checked.  Threads projecting through a hybrid mesh at once
+     take turns projecting points exactly */
+  void setHybrid( double tolerance ) throw();
+
+  /* Gets the hybrid projection tolerance, 0 if it is off */
+  double getHybridTolerance() const throw();
+
+  /* Gets how far off the cell whose upper left node is <col>, <row> was
+     estimated to be, HUGE_VAL if its center couldn't be projected
+     exactly, or 0 if it is invalid or hybrid projection is off */
+  double getCellError( long col, long row ) const throw();
+
+  /* Fills <report> with the cells hybrid projection checked and the
+     points it has projected exactly */
+  void getHybridReport( HybridReport& report ) const throw();
+
+  /* Turns on compact node storage.  Once calculateMesh() or composeMesh()
+     has built everything else from them, the nodes are packed into float
+     offsets from a line through every eighth node of their row, in under
+     two thirds of the memory of the doubles, and unpacked as points are
+     projected (see MeshCompact.h), a cell at a time with setClosedForm()
+     on and otherwise a node at a time as the MathLib interpolators ask
+     for them.  Packing rounds each node by at most the error
+     getCompactReport() gives, 0.02 mm across the conterminous US.  The
+     bilinear interpolators and the plane are then off by at most that
+     much more and BiCubic by three times it.  Only those interpolators
+     can be packed, so setting BiCubicSpline unpacks the nodes again.
+     Meshes that are lazy, loaded from a file, adaptively refined,
+     inverted or have a global spline fitted keep their doubles.  Takes
+     effect at the next calculateMesh() */
+  void setCompact( bool bCompact ) throw();
+
+  /* Gets whether the nodes are packed when the mesh is calculated */
+  bool getCompact() const throw();
+
+  /* Fills <report> with the memory the nodes take and the rounding
+     packing them caused */
+  void getCompactReport( CompactReport& report ) const throw();
+
+  /* Turns on keeping the nodes on disk, for meshes too big to hold in
+     memory.  The nodes then go in the scratch file <path> in tiles of
+     <tileSize> x <tileSize>, and only as many tiles as fit in
+     <budgetBytes> of memory are held at once, the least recently used
+     going back out to the file when another is needed (see
+     MeshTileStore.h).  The validity bits stay in memory.  Everything
+     projects and is calculated as before, tile by tile where it can be,
+     and getTiledReport() counts how often tiles had to be read in.  With
+     setClosedForm() on the bilinear interpolators, the plane and BiCubic
+     read a cell's nodes from the tiles in one go, otherwise the nodes
+     are read one at a time.  Tiled meshes aren't lazy, precomputed,
+     adaptively refined, inverted or fitted with a global spline.  The
+     file is removed when the mesh is done with it.  A NULL <path> or
+     <tileSize> of 0 turns it off.  Takes effect at the next
+     setMeshSize(), or calculateMesh() if that turns tiling on or off or
+     changes the tile size, so setting it before setMeshSize() means the
+     double nodes are never allocated.
+     If the file can't be created setMeshSize() throws std::bad_alloc
+     and calculateMesh() PMESH_FILE_ERROR, as do the projection functions
+     if the file can't be read */
+  void setTiled( const char* path, long tileSize = 256,
+                 size_t budgetBytes = 64 * 1024 * 1024 ) throw();
+
+  /* Returns true if the nodes are kept in a tile file */
+  bool isTiled() const throw();
+
+  /* Fills <report> with the size of the tile file and how its tiles have
+     been held */
+  void getTiledReport( TiledReport& report ) const throw();
+
+  /* Turns on lazy calculation.  calculateMesh() then only sets the mesh
+     up, and the nodes are projected and validated a tile of <tileSize> x
+     <tileSize> cells at a time, the first time a projection lands in the
+     tile.  Tiles are filled in under a lock so any number of threads can
+     project through a lazy mesh at once.  Lazy meshes aren't precomputed
+     or adaptively refined, and nodes that can't be converted to
+     geographic are marked invalid rather than failing calculateMesh().
+     A <tileSize> of 0 turns it off.  Takes effect at the next
+     calculateMesh() */
+  void setLazyTileSize( long tileSize ) throw();
+
+  /* Gets the lazy tile size, 0 if lazy calculation is off */
+  long getLazyTileSize() const throw();
+
+  /* Gets how many tiles a lazy mesh has, 0 if the mesh isn't lazy */
+  long getTileCount() const throw();
+
+  /* Gets how many tiles of a lazy mesh have been filled in so far */
+  long getMaterializedTileCount() const throw();
+
+  /* Fills <snapshot> with what the mesh has counted since it was made or
+     resetStats() was called.  Only counts anything if the library was
+     built with PMESH_STATS defined, see MeshStats.h.  Safe to call while
+     other threads are projecting */
+  void getStats( MeshStatsSnapshot& snapshot ) const throw();
+
+  /* Zeroes the stats, the hybrid projection counts and the tile fault
+     counts */
+  void resetStats() throw();
+
+  /* Fills <report> with the memory the cell coefficients take or would
+     take for the current interpolator and mesh size, and times <samples>
+     points through the interpolators and, if built, the coefficients */
+  void getPrecomputeReport( PrecomputeReport& report,
+                            long samples = 10000 ) const
+    throw(PmeshException);
   
+  /* Gets the bytes the mesh takes: its nodes and validity bits, whether
+     mapped from a file or not, and whatever calculateMesh() built on top
+     of them.  Only the tiles a tiled mesh holds in memory count, not its
+     file */
+  size_t getMemoryUsage() const throw();
+
   /* Get the bounding value from the source mesh */
   void getSourceMesh(double & left, double & bottom,
 		     double & right, double & top) const throw();
@@ -89,10 +509,161 @@ class ProjectionMesh
   
 
  private:    
+  // Reads the nodes and cell data directly
+  friend class MeshCursor;
   
   /* Helper functions */
-  MeshNode* getMeshNode( long col, long row ) const throw(PmeshException);
+  MeshNode getMeshNode( long col, long row ) const throw(PmeshException);
+
+  /* Returns true if the mesh has nodes, as doubles or packed */
+  bool hasNodes() const throw();
+
+  /* Gets the node at <col>, <row> from wherever it is kept */
+  void readNode( long col, long row, double& x, double& y ) const throw();
+
+  /* Packs the nodes if that has been asked for and nothing built from
+     them still reads the doubles */
+  void compactNodes() throw();
+
+  /* Unpacks packed nodes back into doubles */
+  void expandNodes() throw(std::bad_alloc);
+
+  /* Gets nodes for calculateMesh() or composeMesh() to write if the ones
+     there can't be or are in the wrong place: double ones of our own, or
+     a tile file if one has been asked for.  Throws PMESH_FILE_ERROR if
+     the tile file can't be created and PMESH_NOT_CREATED_YET if there's
+     no room for the doubles, leaving no mesh either way */
+  void reallocateNodes() throw(PmeshException);
+
+  /* Returns true if all four corners of the cell whose upper left node is
+     <col>, <row> are valid.  The cells on the right and bottom edges use
+     their own column or row for the missing corners */
+  bool isCellValid( long col, long row ) const throw();
+
+  /* Allocates the node arrays for the current mesh size, all invalid */
+  void allocateNodes() throw(std::bad_alloc);
+
+  /* Frees the node arrays */
+  void freeNodes() throw();
+
+  /* Sets the cell validity bits from the node validity bits.  This
+     should be called after validateNodes() */
+  void updateCellValidity() throw();
+
+  /* Builds the precomputed coefficients and the adaptive quadtree if
+     they have been asked for, once the nodes are in place */
+  void buildCellData( const ProjLib::Projection& sourceProj,
+                      const ProjLib::Projection& destProj )
+    throw(std::bad_alloc);
+
+  /* Sets the validity bit of the cell at <col>, <row> from its corners */
+  void updateCellValidity( long col, long row ) throw();
+
+  /* Sets up the tile flags of a lazy mesh and marks every node
+     unprojected */
+  void allocateTiles() throw(std::bad_alloc);
+
+  /* Frees the tile flags, making the mesh not lazy */
+  void freeTiles() throw();
+
+  /* Makes sure the tile of a lazy mesh holding the cell at <col>, <row>
+     has been filled in.  Does nothing if the mesh isn't lazy */
+  void ensureTile( long col, long row ) const throw();
+
+  /* Projects and validates everything the cells of lazy tile <tile>
+     need */
+  void materializeTile( long tile ) const throw();
+
+  /* Fills in every tile of a lazy mesh */
+  void materializeAll() const throw();
+
+  /* Makes sure the tiles the points of a batch fall in are filled in */
+  void prepareTiles( const double* x, const double* y, long stride,
+                     long count ) const throw();
   
+  /* Fills <grid> with the mesh for the MeshKernels and MeshQuadtree */
+  void getKernelGrid( MeshKernelGrid& grid ) const throw();
+
+  /* Does projectRun() for the bilinear interpolators.  Sets <outOfMesh>
+     to the number of points outside the mesh */
+  long stepBilinearRun( double x, double y, double stepX, double stepY,
+                        long count, double* outX, double* outY,
+                        bool* valid, long& outOfMesh ) const throw();
+
+  /* Projects a run of points through the packed nodes */
+  long projectCompact( double* x, double* y, long stride, long count,
+                       bool* valid ) const throw();
+
+  /* Projects a run of points through the nodes in the tile file */
+  long projectTiled( double* x, double* y, long stride, long count,
+                     bool* valid ) const throw();
+
+  /* Projects a run of points through the global spline */
+  long projectSpline( double* x, double* y, long stride, long count,
+                      bool* valid ) const throw();
+
+  /* Projects a run of points through the adaptive quadtree */
+  long projectAdaptive( double* x, double* y, long stride, long count,
+                        bool* valid ) const throw();
+
+  /* Does the work of the batch projection functions.  <stride> is the
+     distance in doubles between consecutive points */
+  long projectStrided( double* x, double* y, long stride, long count,
+                       bool* valid ) const throw(PmeshException);
+
+  /* Picks the way projectStrided() projects and counts nothing */
+  long dispatchStrided( double* x, double* y, long stride, long count,
+                        bool* valid ) const throw(PmeshException);
+
+  /* Picks the way dispatchStrided() interpolates */
+  long interpolateStrided( double* x, double* y, long stride, long count,
+                           bool* valid ) const throw(PmeshException);
+
+  /* Interpolates a run of points and projects the ones in cells over the
+     hybrid tolerance exactly */
+  long projectHybrid( double* x, double* y, long stride, long count,
+                      bool* valid ) const throw(PmeshException);
+
+  /* Estimates how far off each cell is for hybrid projection */
+  void measureCellErrors( const ProjLib::Projection& sourceProj,
+                          const ProjLib::Projection& destProj )
+    throw(std::bad_alloc);
+
+  /* Frees the cell errors, turning hybrid projection off until the mesh
+     is next calculated */
+  void freeCellErrors() throw();
+
+  /* Counts the points of a batch outside the mesh, for the stats */
+  long countOutOfMesh( const double* x, const double* y, long stride,
+                       long count ) const throw();
+
+  /* Projects a run of points through the MathLib interpolators */
+  long projectInterpolated( double* x, double* y, long stride, long count,
+                            bool* valid ) const throw(PmeshException);
+
+  /* Projects a run of points with the precomputed coefficients */
+  long projectPrecomputed( double* x, double* y, long stride, long count,
+                           bool* valid ) const throw();
+
+  /* Projects a run of points through the caller's interpolators */
+  long projectWith( MathLib::Interpolator& first,
+                    MathLib::Interpolator& second,
+                    double* x, double* y, long stride, long count,
+                    bool* valid ) const throw(PmeshException);
+
+  /* Finds the upper left node of the mesh cell containing <x>, <y> and
+     the offset <u>, <v> in cells of the point from it.  Returns false if
+     the point is outside of the mesh */
+  bool locateCell( double x, double y, long& leftCol, long& topRow,
+                   double& u, double& v ) const throw();
+
+  /* Fills <gridX> and <gridY> with the nodes the interpolator of type
+     <type> needs for the cell at <leftCol>, <topRow>.  Returns false if
+     any corner of the cell is invalid */
+  bool loadCell( long type, long leftCol, long topRow,
+                 MathLib::Point* gridX, MathLib::Point* gridY ) const
+    throw(PmeshException);
+
   /* This gets a sizexsize grid */
   void ProjectionMesh::getGrid(int Col, int Row, MathLib::Point * in, int size)
    const throw(PmeshException);
@@ -100,24 +671,94 @@ class ProjectionMesh
   /*Determines the validity of each node in the mesh.  This should be
     called after setMeshPoint has been called for each point in the mesh*/
   void validateNodes() throw();
+
+  /* Validates the node at <col>, <row>.  Its neighbors must have been
+     projected */
+  void validateNode( long col, long row ) throw();
   
-  /* Set a particular projected point in the mesh */
+  /* Projects rows <firstRow>, <firstRow> + <rowStep>, ... of the mesh
+     from <sourceProj> to <destProj>.  Returns false if a source
+     coordinate could not be converted to geographic */
+  bool calculateRows( const ProjLib::Projection& sourceProj,
+                      const ProjLib::Projection& destProj,
+                      long firstRow, long rowStep )
+    throw(PmeshException);
+
+  /* Does calculateMesh()'s projecting on d_threadCount threads */
+  void calculateMeshThreaded( const ProjLib::Projection& sourceProj,
+                              const ProjLib::Projection& destProj )
+    throw(PmeshException);
+
+  /* Fills <report> for composeMesh() */
+  void measureComposition( const ProjectionMesh& first,
+                           const ProjectionMesh& second,
+                           ComposeReport& report, long samples ) const
+    throw(PmeshException);
+
+  /* Thread entry point for calculateMeshThreaded() */
+  static void calculateRowsThread( void* arg ) throw();
+
+  /* Set a particular projected point in the mesh.  Threads may set
+     different points at the same time */
   void setMeshPoint( long col, long row,
                      double projectedX, double projectedY )
     throw(PmeshException);
 
   /* Data members */
-  MathLib::Interpolator *interpolator;  //the interpolators to use.
+  long      d_interpolatorType;         //the type of interpolator to use.
                                         //by default this is the 
                                         //dlgveiwer interpolator
-  MathLib::Interpolator *interpolator2; //some need extra interpolator
   double    d_left, d_top;
   double    d_sourceWidth, d_sourceHeight;
   double    d_horizMeshSpacing, d_vertMeshSpacing;
   long      d_meshWidth, d_meshHeight;
-  MeshNode* d_pNodes;
+  long      d_threadCount;
+  bool      d_bPrecompute;
+  bool      d_bVectorized;
+  bool      d_bClosedForm;
+  bool      d_bInverse;
+  bool      d_bGlobalSpline;
+  bool      d_bCompact;
+  double    d_precomputeSeconds;
+  MeshCoefficients d_coefficients;      //per cell coefficients if
+                                        //d_bPrecompute is set
+  double    d_adaptiveTolerance;
+  long      d_adaptiveMaxDepth;
+  double    d_adaptiveSeconds;
+  MeshQuadtree d_quadtree;              //refined cells if
+                                        //d_adaptiveTolerance is set
+  MeshInverse  d_inverse;               //cell index if d_bInverse is set
+  MeshSpline   d_spline;                //fit if d_bGlobalSpline is set
+  double    d_hybridTolerance;
+  double    d_hybridSeconds;
+  float*    d_pCellError;               //per cell, how far off it is if
+                                        //d_hybridTolerance is set
+  mutable volatile unsigned long d_hybridPoints;
+  mutable volatile unsigned long d_hybridExactPoints;
+  mutable PmeshMutex d_hybridMutex;     //held while projecting exactly
+  double*      d_pNodeX;              //projected coordinates of the
+  double*      d_pNodeY;              //nodes, row by row.  NULL if packed
+                                      //or tiled
+  MeshCompactNodes d_compact;         //the nodes if packed
+  std::string  d_tiledPath;           //tile file to keep the nodes in,
+  long         d_tiledTileSize;       //its tile size, 0 if not tiled,
+  size_t       d_tiledBudget;         //and the memory for its tiles
+  MeshTileStore d_tiledNodes;         //the nodes if tiled
+  MeshBitWord* d_pNodeValid;          //one bit per node
+  MeshBitWord* d_pCellValid;          //one bit per cell, set if all four
+                                      //of its corners are valid
   ProjLib::Projection* d_pFromProj;
   ProjLib::Projection* d_pToProj;
+  long           d_lazyTileSize;
+  long           d_tileCols, d_tileRows;
+  volatile char* d_pTileReady;        //per tile, set once its cells can
+                                      //be used.  NULL unless lazy
+  MeshBitWord*   d_pNodeProjected;    //nodes a lazy mesh has projected
+  mutable long       d_materializedTiles;
+  mutable PmeshMutex d_tileMutex;     //held while filling in a tile
+  MeshFile  d_meshFile;               //the file the nodes are mapped
+                                      //from if loadMesh() was used
+  mutable MeshStats d_stats;          //counts if built with PMESH_STATS
 };
 
 
@@ -128,19 +769,28 @@ void ProjectionMesh::setMeshPoint( long col, long row,
                                    double projectedX, double projectedY )
      throw(PmeshException)
 {
-  int tempindex;    //temporary index
-  //check for the existance of the d_pNodes
-  if (!d_pNodes)
+  long tempindex;    //temporary index
+  //check for the existance of the nodes
+  if (!d_pNodeX && !d_tiledNodes.isBuilt())
     throw PmeshException(PMESH_NOT_CREATED_YET);
   
   //now check to see if the pmesh is in the bounding array
   tempindex = row * d_meshWidth + col;
 
-  if ((tempindex < 0) || (tempindex > (d_meshWidth * d_meshHeight)))
+  if ((tempindex < 0) || (tempindex >= (d_meshWidth * d_meshHeight)))
     throw PmeshException(PMESH_OUT_OF_BOUNDS);
 	  
-  d_pNodes[tempindex].setXY( projectedX, projectedY );
-  d_pNodes[tempindex].setValid( true );
+  if ( d_pNodeX )
+  {
+    d_pNodeX[tempindex] = projectedX;
+    d_pNodeY[tempindex] = projectedY;
+  }
+  else
+    d_tiledNodes.setNode( col, row, projectedX, projectedY );
+
+  // The threads calculating a mesh set nodes in neighbouring rows, which
+  // can share a word of the map
+  setSharedBit( d_pNodeValid, tempindex, true );
 }
 
 
@@ -183,6 +833,204 @@ long ProjectionMesh::getMeshHeight() const throw()
   return d_meshHeight;
 }
 
+// ***************************************************************************
+// Get the type of interpolator in use
+inline
+long ProjectionMesh::getInterpolator() const throw()
+{
+  return d_interpolatorType;
+}
+
+
+// ***************************************************************************
+// Get whether the cell coefficients are precomputed
+inline
+bool ProjectionMesh::getPrecompute() const throw()
+{
+  return d_bPrecompute;
+}
+
+
+// ***************************************************************************
+// Get whether the inverse index is built
+inline
+bool ProjectionMesh::getInverse() const throw()
+{
+  return d_bInverse;
+}
+
+
+// ***************************************************************************
+// Turn the closed forms on or off
+inline
+void ProjectionMesh::setClosedForm( bool bClosedForm ) throw()
+{
+  d_bClosedForm = bClosedForm;
+}
+
+
+// ***************************************************************************
+// Get whether the closed forms are used
+inline
+bool ProjectionMesh::getClosedForm() const throw()
+{
+  return d_bClosedForm;
+}
+
+
+// ***************************************************************************
+// Turn the vectorized kernels on or off
+inline
+void ProjectionMesh::setVectorized( bool bVectorized ) throw()
+{
+  d_bVectorized = bVectorized;
+}
+
+
+// ***************************************************************************
+// Get whether the vectorized kernels are used
+inline
+bool ProjectionMesh::getVectorized() const throw()
+{
+  return d_bVectorized;
+}
+
+
+// ***************************************************************************
+// Get whether the global spline is fitted
+inline
+bool ProjectionMesh::getGlobalSpline() const throw()
+{
+  return d_bGlobalSpline;
+}
+
+
+// ***************************************************************************
+// Get whether the nodes are mapped from a file
+inline
+bool ProjectionMesh::isMapped() const throw()
+{
+  return d_meshFile.isMapped();
+}
+
+
+// ***************************************************************************
+// Get whether the nodes are kept in a tile file
+inline
+bool ProjectionMesh::isTiled() const throw()
+{
+  return d_tiledNodes.isBuilt();
+}
+
+
+// ***************************************************************************
+// Get the lazy tile size
+inline
+long ProjectionMesh::getLazyTileSize() const throw()
+{
+  return d_lazyTileSize;
+}
+
+
+// ***************************************************************************
+// Get how many tiles a lazy mesh has
+inline
+long ProjectionMesh::getTileCount() const throw()
+{
+  return d_pTileReady ? d_tileCols * d_tileRows : 0;
+}
+
+
+// ***************************************************************************
+// Fill in the tile holding a cell if it hasn't been yet
+inline
+void ProjectionMesh::ensureTile( long col, long row ) const throw()
+{
+  long tile;
+
+  if ( !d_pTileReady )
+    return;
+
+  tile = ( row / d_lazyTileSize ) * d_tileCols + col / d_lazyTileSize;
+  if ( !readFlag( d_pTileReady[tile] ) )
+    materializeTile( tile );
+}
+
+
+// ***************************************************************************
+// Takes a snapshot of the stats
+inline
+void ProjectionMesh::getStats( MeshStatsSnapshot& snapshot ) const throw()
+{
+  d_stats.getSnapshot( snapshot );
+}
+
+
+// ***************************************************************************
+// Zeroes the stats
+inline
+void ProjectionMesh::resetStats() throw()
+{
+  d_stats.reset();
+  d_hybridPoints = 0;
+  d_hybridExactPoints = 0;
+  d_tiledNodes.resetCounters();
+}
+
+
+// ***************************************************************************
+// Get the adaptive refinement tolerance
+inline
+double ProjectionMesh::getAdaptiveTolerance() const throw()
+{
+  return d_adaptiveTolerance;
+}
+
+
+// ***************************************************************************
+// Get the hybrid projection tolerance
+inline
+double ProjectionMesh::getHybridTolerance() const throw()
+{
+  return d_hybridTolerance;
+}
+
+
+// ***************************************************************************
+// Get whether the nodes are packed
+inline
+bool ProjectionMesh::getCompact() const throw()
+{
+  return d_bCompact;
+}
+
+
+// ***************************************************************************
+// Get how deep adaptive refinement may go
+inline
+long ProjectionMesh::getAdaptiveMaxDepth() const throw()
+{
+  return d_adaptiveMaxDepth;
+}
+
+
+// ***************************************************************************
+// Set the number of threads to build the mesh with
+inline
+void ProjectionMesh::setThreadCount( long threads ) throw()
+{
+  d_threadCount = ( threads < 1 ) ? 1 : threads;
+}
+
+
+// ***************************************************************************
+// Get the number of threads to build the mesh with
+inline
+long ProjectionMesh::getThreadCount() const throw()
+{
+  return d_threadCount;
+}
+
 // ***************************************************************************
 //Gets a coordinate in the source projected space
 inline
@@ -194,6 +1042,33 @@ void ProjectionMesh::getSourceCoordinate( long col, long row,
   y = d_top  - row * d_vertMeshSpacing;
 }
 
+// ***************************************************************************
+// Finds the cell a source point lies in
+inline
+bool ProjectionMesh::locateCell( double x, double y,
+                                 long& leftCol, long& topRow,
+                                 double& u, double& v ) const throw()
+{
+  double col, row;
+
+  // Determine which mesh grid the point is in
+  col = ( x - d_left ) / d_horizMeshSpacing;
+  row = ( d_top - y  ) / d_vertMeshSpacing;
+
+  // Make sure the point is in the mesh.  The casts below truncate toward
+  // zero so this accepts the same points the original leftCol/rightCol
+  // test did, and it rejects NaN and values too large to cast.
+  if ( !( col > -1.0 && col < d_meshWidth &&
+          row > -1.0 && row < d_meshHeight ) )
+    return false;
+
+  leftCol = static_cast<long>( col );
+  topRow  = static_cast<long>( row );
+  u = col - leftCol;
+  v = row - topRow;
+  return true;
+}
+
 // ***************************************************************************
 //Gets a coordinate in the Projected coordinate space
 inline
@@ -201,48 +1076,86 @@ bool ProjectionMesh::getProjectedCoordinate( long col, long row,
                                              double& x, double& y ) const
      throw(PmeshException)
 {
-  int tempindex;    //temporary index
-  //check on the existance of d_pNodes
-  if (!d_pNodes)
+  long tempindex;    //temporary index
+  //check on the existance of the nodes
+  if (!hasNodes())
     throw PmeshException(PMESH_NOT_CREATED_YET);
   
   //check the validity of the index
   tempindex = row * d_meshWidth + col;
   
-  if ((tempindex < 0) || (tempindex > d_meshWidth*d_meshHeight))
+  if ((tempindex < 0) || (tempindex >= d_meshWidth*d_meshHeight))
     throw PmeshException(PMESH_OUT_OF_BOUNDS);
   
   //proceed
-  MeshNode node = d_pNodes[ row * d_meshWidth + col ];
-  node.getXY(x, y);
+  ensureTile( tempindex % d_meshWidth, tempindex / d_meshWidth );
+  readNode( tempindex % d_meshWidth, tempindex / d_meshWidth, x, y );
   
-  if (!node.isValid())
-    return false;
-  return true;
+  return testBit( d_pNodeValid, tempindex );
 }
 
 
 // ***************************************************************************
 //Gets a node from the mesh by row or col
 inline
-MeshNode* ProjectionMesh::getMeshNode( long col, long row ) const
+MeshNode ProjectionMesh::getMeshNode( long col, long row ) const
      throw (PmeshException)
 {
-  int tempindex;    //temporary index
+  long tempindex;    //temporary index
+  double x, y;       //the node
   
-  //check for the existance of the d_pNodes
-  if (!d_pNodes)
+  //check for the existance of the nodes
+  if (!hasNodes())
     throw PmeshException(PMESH_NOT_CREATED_YET);
   
   tempindex = row * d_meshWidth + col;
   
-  if ((tempindex < 0) || (tempindex > d_meshWidth*d_meshHeight))
+  if ((tempindex < 0) || (tempindex >= d_meshWidth*d_meshHeight))
     throw PmeshException(PMESH_OUT_OF_BOUNDS);
   //proceed
-  return &d_pNodes[ row * d_meshWidth + col ];
+  ensureTile( tempindex % d_meshWidth, tempindex / d_meshWidth );
+  readNode( tempindex % d_meshWidth, tempindex / d_meshWidth, x, y );
+  MeshNode node( x, y );
+  node.setValid( testBit( d_pNodeValid, tempindex ) );
+  return node;
+}
+
+
+// ***************************************************************************
+// Checks whether there are nodes
+inline
+bool ProjectionMesh::hasNodes() const throw()
+{
+  return ( d_pNodeX || d_compact.isBuilt() || d_tiledNodes.isBuilt() );
+}
+
+
+// ***************************************************************************
+// Reads a node as doubles, unpacks it or gets it from its tile
+inline
+void ProjectionMesh::readNode( long col, long row, double& x, double& y )
+  const throw()
+{
+  if ( d_pNodeX )
+  {
+    x = d_pNodeX[ row * d_meshWidth + col ];
+    y = d_pNodeY[ row * d_meshWidth + col ];
+  }
+  else if ( d_tiledNodes.isBuilt() )
+    d_tiledNodes.getNode( col, row, x, y );
+  else
+    d_compact.getNode( col, row, x, y );
+}
+
+
+// ***************************************************************************
+//Checks the corners of a cell
+inline
+bool ProjectionMesh::isCellValid( long col, long row ) const throw()
+{
+  return testBit( d_pCellValid, row * d_meshWidth + col );
 }
 
 
 }//namespace
 #endif
-
@@ -0,0 +1,547 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Measures how far meshes of different sizes and interpolators are from
+// projecting exactly, and what each one costs, so the cheapest mesh that
+// meets an accuracy spec can be picked rather than guessed.
+//
+// For every mesh size and interpolator in the sweep it builds the mesh and
+// compares it against projecting straight through projectToGeo() and
+// projectFromGeo() at
+//   - random points over the bounds, and
+//   - the centers and edge midpoints of the mesh cells, where the
+//     interpolation is furthest from the nodes and the error peaks.
+// It reports the largest and RMS distance between the two, the points
+// only one of them could project, the calculateMesh() time, the
+// projectPoints() throughput and the memory the nodes take.  GlobalSpline
+// is BiCubicSpline with ProjectionMesh::setGlobalSpline() on.  Given a
+// spec, it also measures Hybrid, DlgViewer with ProjectionMesh::setHybrid()
+// at the spec, and the share of its points projected exactly, then names
+// the smallest and the fastest meshes that meet the spec.  The Compact
+// meshes are BiLinear and BiCubic with ProjectionMesh::setCompact() on,
+// for which it also reports the largest rounding packing the nodes
+// caused.  It grows with how far the rows of the mesh curve, so try them
+// from platecarree to lambert, e.g.
+//   AccuracyHarness -source platecarree:-96 -dest lambert:-96
+//                   -geo -125,24,-67,49 -sizes 257
+//
+// Usage: AccuracyHarness [options]
+//   -source name[:cm]    source projection, default mercator:0
+//   -dest name[:cm]      destination projection, default sinusoidal:10
+//                        names are platecarree, mercator, sinusoidal and
+//                        lambert, cm the central meridian in degrees
+//   -geo w,s,e,n         bounds as longitudes and latitudes in degrees,
+//                        default -30,10,30,60
+//   -bounds l,b,r,t      bounds in source units, instead of -geo
+//   -sizes n,n,...       mesh sizes in nodes, default 5,9,17,33,65,129,257
+//   -points n            random points, default 100000
+//   -spec error          largest error allowed, in destination units
+//   -json                one JSON object per line instead of a table
+//
+// Other projections can be measured by calling sweep() with them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "ProjectionMesh.h"
+#include "SyntheticProjection.h"
+#include "BenchTimer.h"
+
+using namespace PmeshLib;
+using namespace PmeshBench;
+
+namespace
+{
+const double RADIUS = 6370997.0;
+
+// Cells whose centers and edges are checked, at most
+const long MAX_WORST_CELLS = 40000;
+
+struct InterpolatorName
+{
+  long        type;
+  const char* name;
+  bool        bGlobalSpline;
+  bool        bHybrid;
+  bool        bCompact;
+};
+
+const InterpolatorName INTERPOLATORS[] =
+{
+  { MathLib::DlgViewer,         "DlgViewer",         false, false, false },
+  { MathLib::BiLinear,          "BiLinear",          false, false, false },
+  { MathLib::LeastSquaresPlane, "LeastSquaresPlane", false, false, false },
+  { MathLib::BiPolynomial,      "BiPolynomial",      false, false, false },
+  { MathLib::BiCubic,           "BiCubic",           false, false, false },
+  { MathLib::BiCubicSpline,     "BiCubicSpline",     false, false, false },
+  { MathLib::BiCubicSpline,     "GlobalSpline",      true,  false, false },
+  { MathLib::DlgViewer,         "Hybrid",            false, true,  false },
+  { MathLib::BiLinear,          "CompactBiLinear",   false, false, true },
+  { MathLib::BiCubic,           "CompactBiCubic",    false, false, true }
+};
+const int INTERPOLATOR_COUNT =
+  sizeof( INTERPOLATORS ) / sizeof( INTERPOLATORS[0] );
+
+// Points and where they project to exactly
+struct SamplePoints
+{
+  std::vector<double> x, y;          // source
+  std::vector<double> exactX, exactY;
+  std::vector<char>   exactValid;
+};
+
+struct SweepResult
+{
+  const char* interpolator;
+  long        size;
+  double      maxError;        // over both sets of points
+  double      rmsError;        // over the random points
+  double      worstCaseMax;    // over the cell centers and edges
+  long        missed;          // projected exactly but not by the mesh
+  long        spurious;        // projected by the mesh but not exactly
+  double      buildSeconds;
+  double      rate;            // points a second through projectPoints()
+  size_t      memory;          // bytes of nodes, and spline or cell
+                               // errors if there are any
+  double      exactShare;      // of the points, projected exactly
+  double      packError;       // largest rounding of a packed node
+};
+
+// Projects every point of <points> exactly
+void projectExactly( const ProjLib::Projection& source,
+                     const ProjLib::Projection& dest, SamplePoints& points )
+{
+  size_t count = points.x.size();
+  double lat, lon;
+
+  points.exactX.resize( count );
+  points.exactY.resize( count );
+  points.exactValid.resize( count );
+  for ( size_t counter = 0; counter < count; counter++ )
+  {
+    points.exactValid[counter] =
+      source.projectToGeo( points.x[counter], points.y[counter], lat, lon ) &&
+      dest.projectFromGeo( lat, lon, points.exactX[counter],
+                           points.exactY[counter] );
+  }
+}
+
+void makeRandomPoints( double left, double bottom, double right, double top,
+                       long count, SamplePoints& points )
+{
+  unsigned long seed = 77;
+
+  points.x.resize( count );
+  points.y.resize( count );
+  for ( long counter = 0; counter < count; counter++ )
+  {
+    seed = seed * 1103515245UL + 12345UL;
+    points.x[counter] = left + ( right - left ) *
+      ( ( seed >> 8 ) & 0xffffff ) / 16777216.0;
+    seed = seed * 1103515245UL + 12345UL;
+    points.y[counter] = bottom + ( top - bottom ) *
+      ( ( seed >> 8 ) & 0xffffff ) / 16777216.0;
+  }
+}
+
+// The center and the middles of the top and left edges of each cell of a
+// <size> x <size> mesh, or of evenly spread cells if there are too many
+void makeWorstPoints( double left, double bottom, double right, double top,
+                      long size, SamplePoints& points )
+{
+  const double cellWidth  = ( right - left ) / ( size - 1 );
+  const double cellHeight = ( top - bottom ) / ( size - 1 );
+  const long   cells      = ( size - 1 ) * ( size - 1 );
+  const long   step       = ( cells + MAX_WORST_CELLS - 1 ) / MAX_WORST_CELLS;
+  double x, y;
+
+  points.x.clear();
+  points.y.clear();
+  for ( long cell = 0; cell < cells; cell += step )
+  {
+    x = left + ( cell % ( size - 1 ) ) * cellWidth;
+    y = top  - ( cell / ( size - 1 ) ) * cellHeight;
+
+    points.x.push_back( x + cellWidth / 2.0 );
+    points.y.push_back( y - cellHeight / 2.0 );
+    points.x.push_back( x + cellWidth / 2.0 );
+    points.y.push_back( y );
+    points.x.push_back( x );
+    points.y.push_back( y - cellHeight / 2.0 );
+  }
+}
+
+// Compares <mesh> with the exact projections of <points>.  Adds the
+// squared errors to <sumSquares> and returns the largest
+double compare( const ProjectionMesh& mesh, const SamplePoints& points,
+                double& sumSquares, long& compared, long& missed,
+                long& spurious )
+{
+  std::vector<double> x( points.x ), y( points.y );
+  std::vector<char> valid( x.size() );
+  double maxError = 0.0, error;
+
+  mesh.projectPoints( &x[0], &y[0], static_cast<long>( x.size() ),
+                      reinterpret_cast<bool*>( &valid[0] ) );
+
+  for ( size_t counter = 0; counter < x.size(); counter++ )
+  {
+    if ( !points.exactValid[counter] )
+    {
+      spurious += ( 0 != valid[counter] );
+      continue;
+    }
+    if ( !valid[counter] )
+    {
+      missed++;
+      continue;
+    }
+
+    error = hypot( x[counter] - points.exactX[counter],
+                   y[counter] - points.exactY[counter] );
+    sumSquares += error * error;
+    compared++;
+    if ( error > maxError )
+      maxError = error;
+  }
+  return maxError;
+}
+}
+
+
+// ***************************************************************************
+// Measures every interpolator at every size in <sizes> for meshes from
+// <source> to <dest> over the given source bounds.  Hybrid is only
+// measured if <hybridTolerance> is above 0.
+void sweep( const ProjLib::Projection& source,
+            const ProjLib::Projection& dest,
+            double left, double bottom, double right, double top,
+            const std::vector<long>& sizes, long pointCount,
+            double hybridTolerance, std::vector<SweepResult>& results )
+{
+  SamplePoints random, worst;
+  PrecomputeReport report;
+  HybridReport hybrid;
+  CompactReport compact;
+  SweepResult result;
+  double sumSquares, start, worstSum;
+  long compared, worstCompared;
+
+  makeRandomPoints( left, bottom, right, top, pointCount, random );
+  projectExactly( source, dest, random );
+
+  for ( size_t size = 0; size < sizes.size(); size++ )
+  {
+    makeWorstPoints( left, bottom, right, top, sizes[size], worst );
+    projectExactly( source, dest, worst );
+
+    for ( int type = 0; type < INTERPOLATOR_COUNT; type++ )
+    {
+      ProjectionMesh mesh;
+
+      if ( INTERPOLATORS[type].bHybrid && hybridTolerance <= 0.0 )
+        continue;
+
+      mesh.setSourceMeshBounds( left, bottom, right, top );
+      mesh.setMeshSize( sizes[size], sizes[size] );
+      mesh.setInterpolator( INTERPOLATORS[type].type );
+      mesh.setGlobalSpline( INTERPOLATORS[type].bGlobalSpline );
+      if ( INTERPOLATORS[type].bHybrid )
+        mesh.setHybrid( hybridTolerance );
+      mesh.setCompact( INTERPOLATORS[type].bCompact );
+
+      result.interpolator = INTERPOLATORS[type].name;
+      result.size         = sizes[size];
+      result.missed       = 0;
+      result.spurious     = 0;
+
+      try
+      {
+        start = wallSeconds();
+        mesh.calculateMesh( source, dest );
+        result.buildSeconds = wallSeconds() - start;
+      }
+      catch ( PmeshException& )
+      {
+        // Some of the bounds can't be projected, so no mesh
+        continue;
+      }
+
+      sumSquares = worstSum = 0.0;
+      compared = worstCompared = 0;
+      result.maxError = compare( mesh, random, sumSquares, compared,
+                                 result.missed, result.spurious );
+      result.rmsError = compared ? sqrt( sumSquares / compared ) : 0.0;
+      result.worstCaseMax = compare( mesh, worst, worstSum, worstCompared,
+                                     result.missed, result.spurious );
+      if ( result.worstCaseMax > result.maxError )
+        result.maxError = result.worstCaseMax;
+
+      std::vector<double> x( random.x ), y( random.y );
+
+      mesh.resetStats();
+      start = wallSeconds();
+      mesh.projectPoints( &x[0], &y[0], static_cast<long>( x.size() ) );
+      result.rate = x.size() / ( wallSeconds() - start );
+
+      mesh.getPrecomputeReport( report, 0 );
+      result.memory = report.nodeBytes + report.splineBytes;
+      mesh.getHybridReport( hybrid );
+      result.exactShare = hybrid.points ?
+        static_cast<double>( hybrid.exactPoints ) / hybrid.points : 0.0;
+      if ( hybrid.checkedCells )
+        result.memory += sizes[size] * sizes[size] * sizeof(float);
+      mesh.getCompactReport( compact );
+      result.packError = compact.compact ? compact.maxNodeError : 0.0;
+
+      results.push_back( result );
+    }
+  }
+}
+
+
+namespace
+{
+bool parseProjection( const char* text, SyntheticProjection::Kind& kind,
+                      double& centralMeridian )
+{
+  const char* colon = strchr( text, ':' );
+  size_t length = colon ? static_cast<size_t>( colon - text ) : strlen( text );
+
+  if ( 0 == strncmp( text, "platecarree", length ) )
+    kind = SyntheticProjection::PLATE_CARREE;
+  else if ( 0 == strncmp( text, "mercator", length ) )
+    kind = SyntheticProjection::MERCATOR;
+  else if ( 0 == strncmp( text, "sinusoidal", length ) )
+    kind = SyntheticProjection::SINUSOIDAL;
+  else if ( 0 == strncmp( text, "lambert", length ) )
+    kind = SyntheticProjection::LAMBERT_CONIC;
+  else
+    return false;
+
+  centralMeridian = colon ? atof( colon + 1 ) : 0.0;
+  return true;
+}
+
+bool parseNumbers( const char* text, std::vector<double>& numbers )
+{
+  char* end;
+
+  numbers.clear();
+  for ( ;; )
+  {
+    numbers.push_back( strtod( text, &end ) );
+    if ( end == text )
+      return false;
+    if ( ',' != *end )
+      return ( '\0' == *end );
+    text = end + 1;
+  }
+}
+
+// The source bounds around the geographic box <w>, <s>, <e>, <n>,
+// following its edges since they needn't be straight in the source
+bool geoToBounds( const ProjLib::Projection& source, double w, double s,
+                  double e, double n, double& left, double& bottom,
+                  double& right, double& top )
+{
+  const int steps = 64;
+  double lat, lon, x, y;
+  bool bFirst = true;
+
+  for ( int edge = 0; edge < 4; edge++ )
+  {
+    for ( int step = 0; step <= steps; step++ )
+    {
+      double t = static_cast<double>( step ) / steps;
+
+      lon = ( edge < 2 ) ? w + ( e - w ) * t : ( 2 == edge ? w : e );
+      lat = ( edge < 2 ) ? ( 0 == edge ? s : n ) : s + ( n - s ) * t;
+      if ( !source.projectFromGeo( lat, lon, x, y ) )
+        return false;
+
+      if ( bFirst || x < left )   left = x;
+      if ( bFirst || x > right )  right = x;
+      if ( bFirst || y < bottom ) bottom = y;
+      if ( bFirst || y > top )    top = y;
+      bFirst = false;
+    }
+  }
+  return true;
+}
+
+void printResult( bool bJson, const char* label, const SweepResult& result )
+{
+  if ( bJson )
+  {
+    printf( "{%s\"interpolator\":\"%s\",\"meshSize\":%ld,"
+            "\"maxError\":%.6g,\"rmsError\":%.6g,\"worstCaseMax\":%.6g,"
+            "\"missed\":%ld,\"spurious\":%ld,\"buildSeconds\":%.6g,"
+            "\"rate\":%.6g,\"memoryBytes\":%lu,\"exactShare\":%.6g,"
+            "\"packError\":%.6g}\n",
+            label, result.interpolator, result.size, result.maxError,
+            result.rmsError, result.worstCaseMax, result.missed,
+            result.spurious, result.buildSeconds, result.rate,
+            static_cast<unsigned long>( result.memory ), result.exactShare,
+            result.packError );
+  }
+  else
+  {
+    printf( "%-18s %5ld %12.6g %12.6g %12.6g %6ld %6ld %9.4f %8.2f %10lu "
+            "%7.2f %10.4g %s\n", result.interpolator, result.size,
+            result.maxError, result.rmsError, result.worstCaseMax,
+            result.missed, result.spurious, result.buildSeconds,
+            result.rate / 1e6, static_cast<unsigned long>( result.memory ),
+            result.exactShare * 100.0, result.packError, label );
+  }
+}
+}
+
+
+int main( int argc, char** argv )
+{
+  SyntheticProjection::Kind sourceKind = SyntheticProjection::MERCATOR;
+  SyntheticProjection::Kind destKind = SyntheticProjection::SINUSOIDAL;
+  double sourceMeridian = 0.0, destMeridian = 10.0;
+  double geo[4] = { -30.0, 10.0, 30.0, 60.0 };
+  double left = 0.0, bottom = 0.0, right = 0.0, top = 0.0;
+  bool bBounds = false, bJson = false;
+  double spec = -1.0;
+  long points = 100000;
+  std::vector<long> sizes;
+  std::vector<double> numbers;
+  int arg;
+
+  for ( arg = 1; arg < argc; arg++ )
+  {
+    const char* value = ( arg + 1 < argc ) ? argv[arg + 1] : "";
+    bool bOk = true;
+
+    if ( 0 == strcmp( argv[arg], "-json" ) )
+    {
+      bJson = true;
+      continue;
+    }
+
+    if ( 0 == strcmp( argv[arg], "-source" ) )
+      bOk = parseProjection( value, sourceKind, sourceMeridian );
+    else if ( 0 == strcmp( argv[arg], "-dest" ) )
+      bOk = parseProjection( value, destKind, destMeridian );
+    else if ( 0 == strcmp( argv[arg], "-geo" ) ||
+              0 == strcmp( argv[arg], "-bounds" ) )
+    {
+      bOk = parseNumbers( value, numbers ) && 4 == numbers.size();
+      if ( bOk && 'b' == argv[arg][1] )
+      {
+        left   = numbers[0];
+        bottom = numbers[1];
+        right  = numbers[2];
+        top    = numbers[3];
+        bBounds = true;
+      }
+      else if ( bOk )
+        memcpy( geo, &numbers[0], sizeof( geo ) );
+    }
+    else if ( 0 == strcmp( argv[arg], "-sizes" ) )
+    {
+      bOk = parseNumbers( value, numbers );
+      for ( size_t counter = 0; bOk && counter < numbers.size(); counter++ )
+      {
+        bOk = ( numbers[counter] >= 2 );
+        sizes.push_back( static_cast<long>( numbers[counter] ) );
+      }
+    }
+    else if ( 0 == strcmp( argv[arg], "-points" ) )
+      bOk = ( ( points = atol( value ) ) > 0 );
+    else if ( 0 == strcmp( argv[arg], "-spec" ) )
+      bOk = ( ( spec = atof( value ) ) > 0.0 );
+    else
+      bOk = false;
+
+    if ( !bOk )
+    {
+      fprintf( stderr, "%s: bad option %s, see the top of "
+               "AccuracyHarness.cpp\n", argv[0], argv[arg] );
+      return 1;
+    }
+    arg++;
+  }
+
+  if ( sizes.empty() )
+  {
+    const long defaults[] = { 5, 9, 17, 33, 65, 129, 257 };
+
+    sizes.assign( defaults, defaults + sizeof( defaults ) /
+                  sizeof( defaults[0] ) );
+  }
+
+  SyntheticProjection source( sourceKind, sourceMeridian, RADIUS );
+  SyntheticProjection dest( destKind, destMeridian, RADIUS );
+
+  if ( !bBounds &&
+       !geoToBounds( source, geo[0], geo[1], geo[2], geo[3],
+                     left, bottom, right, top ) )
+  {
+    fprintf( stderr, "%s: the bounds can't be projected\n", argv[0] );
+    return 1;
+  }
+
+  std::vector<SweepResult> results;
+  const SweepResult* smallest = NULL;
+  const SweepResult* fastest = NULL;
+
+  sweep( source, dest, left, bottom, right, top, sizes, points, spec,
+         results );
+
+  if ( !bJson )
+  {
+    printf( "%s to %s\nbounds %.10g %.10g %.10g %.10g, %ld random points, "
+            "errors in destination units\n\n",
+            source.toString().c_str(), dest.toString().c_str(),
+            left, bottom, right, top, points );
+    printf( "%-18s %5s %12s %12s %12s %6s %6s %9s %8s %10s %7s %10s\n",
+            "interpolator", "size", "max error", "rms error", "cell max",
+            "missed", "extra", "build s", "Mpt/s", "bytes", "exact%",
+            "pack error" );
+  }
+
+  for ( size_t counter = 0; counter < results.size(); counter++ )
+  {
+    const SweepResult& result = results[counter];
+
+    printResult( bJson, "", result );
+    if ( spec <= 0.0 || result.maxError > spec || result.spurious )
+      continue;
+
+    if ( !smallest || result.memory < smallest->memory ||
+         ( result.memory == smallest->memory &&
+           result.rate > smallest->rate ) )
+      smallest = &result;
+    if ( !fastest || result.rate > fastest->rate )
+      fastest = &result;
+  }
+
+  if ( spec > 0.0 )
+  {
+    if ( !bJson )
+      printf( "\nMeeting a max error of %g:\n", spec );
+
+    if ( !smallest )
+    {
+      if ( bJson )
+        printf( "{\"spec\":%.6g,\"met\":false}\n", spec );
+      else
+        printf( "nothing in the sweep\n" );
+    }
+    else
+    {
+      printResult( bJson, bJson ? "\"choice\":\"smallest\"," : "smallest",
+                   *smallest );
+      printResult( bJson, bJson ? "\"choice\":\"fastest\"," : "fastest",
+                   *fastest );
+    }
+  }
+  return 0;
+}
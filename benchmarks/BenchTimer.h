@@ -0,0 +1,47 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Wall clock timing for the benchmarks.  clock() counts the CPU time of
+// every thread, which hides what threading buys, and ticks too coarsely to
+// time single queries, so this reads the finest real time clock there is.
+
+#ifndef _BENCHTIMER_H_
+#define _BENCHTIMER_H_
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+namespace PmeshBench
+{
+
+// Returns the time in seconds since some fixed point
+inline
+double wallSeconds() throw()
+{
+#if defined(_WIN32)
+  LARGE_INTEGER count, frequency;
+
+  QueryPerformanceCounter( &count );
+  QueryPerformanceFrequency( &frequency );
+  return static_cast<double>( count.QuadPart ) / frequency.QuadPart;
+#elif defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#else
+  struct timeval now;
+
+  gettimeofday( &now, NULL );
+  return now.tv_sec + now.tv_usec * 1e-6;
+#endif
+}
+
+} // namespace
+
+#endif
@@ -0,0 +1,337 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Checks that the faster ways of evaluating the interpolators agree with
+// the MathLib interpolators to the tolerances documented for them.  For
+// every case and interpolator it projects a set of points through a plain
+// mesh, which uses MathLib, and through the same mesh with each of
+//   - setPrecompute(), the cell coefficients of MeshCoefficients.h,
+//   - setVectorized(), once with each kernel in MeshKernels.h the machine
+//     can run, picked with MeshKernels::setKernel(),
+//   - setClosedForm(), the policies of MeshQuery.h,
+// where the interpolator has one.  A point passes if both meshes agree on
+// whether it projects and its coordinates differ by no more than the
+// tolerance, counted in units in the last place of the largest coordinate
+// of the nodes it was interpolated from: the cell's corners, or the 4 x 4
+// nodes around it for BiCubic.  Some of the points are off the mesh.  It
+// prints the worst difference for each and exits with 1 if any is over,
+// so it can be run as a check.  It means nothing without the real
+// MathLib, so it links the same libraries as the benchmarks.
+//
+// Usage: InterpolatorCheck [points]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "ProjectionMesh.h"
+#include "MeshKernels.h"
+#include "SyntheticProjection.h"
+
+using namespace PmeshLib;
+using namespace PmeshBench;
+
+namespace
+{
+const double RADIUS = 6370997.0;
+const double DEGREE = RADIUS * M_PI / 180.0;
+const long   MESH_WIDTH = 65;
+const long   MESH_HEIGHT = 49;
+
+// The tolerances in units in the last place documented in
+// MeshCoefficients.h, MeshKernels.h and MeshQuery.h
+const double LINEAR_ULPS  = 32.0;      // bilinear interpolators and plane
+const double BICUBIC_ULPS = 128.0;
+
+// The faster ways of evaluating the interpolators
+enum Path
+{
+  PRECOMPUTE,
+  VECTORIZED,
+  CLOSED_FORM
+};
+
+struct CheckInterpolator
+{
+  long        type;
+  const char* name;
+};
+
+const CheckInterpolator INTERPOLATORS[] =
+{
+  { MathLib::DlgViewer,         "DlgViewer" },
+  { MathLib::BiLinear,          "BiLinear" },
+  { MathLib::LeastSquaresPlane, "LeastSquaresPlane" },
+  { MathLib::BiPolynomial,      "BiPolynomial" },
+  { MathLib::BiCubic,           "BiCubic" }
+};
+const int INTERPOLATOR_COUNT =
+  sizeof( INTERPOLATORS ) / sizeof( INTERPOLATORS[0] );
+
+const char* const KERNELS[] = { "avx512", "avx2", "scalar" };
+const int KERNEL_COUNT = sizeof( KERNELS ) / sizeof( KERNELS[0] );
+
+// A pair of projections and the source bounds to mesh between them
+struct CheckCase
+{
+  const char*                name;
+  const ProjLib::Projection* source;
+  const ProjLib::Projection* dest;
+  double                     left, bottom, right, top;
+};
+
+// What a set of points projects to
+struct CheckResults
+{
+  std::vector<double> x, y;
+  std::vector<bool>   valid;
+};
+
+// Same points every run, a tenth of the way past the bounds on each side
+void makePoints( const CheckCase& check, long count,
+                 std::vector<double>& xs, std::vector<double>& ys )
+{
+  const double width  = check.right - check.left;
+  const double height = check.top - check.bottom;
+  unsigned long seed = 2024;
+
+  xs.resize( count );
+  ys.resize( count );
+  for ( long counter = 0; counter < count; counter++ )
+  {
+    seed = seed * 1103515245UL + 12345UL;
+    xs[counter] = check.left - 0.1 * width + 1.2 * width *
+      ( ( seed >> 8 ) & 0xffffff ) / 16777216.0;
+    seed = seed * 1103515245UL + 12345UL;
+    ys[counter] = check.bottom - 0.1 * height + 1.2 * height *
+      ( ( seed >> 8 ) & 0xffffff ) / 16777216.0;
+  }
+}
+
+void setUp( ProjectionMesh& mesh, const CheckCase& check, long type )
+{
+  mesh.setSourceMeshBounds( check.left, check.bottom, check.right,
+                            check.top );
+  mesh.setMeshSize( MESH_WIDTH, MESH_HEIGHT );
+  mesh.setInterpolator( type );
+}
+
+void project( const ProjectionMesh& mesh, const std::vector<double>& xs,
+              const std::vector<double>& ys, CheckResults& results )
+{
+  const long count = static_cast<long>( xs.size() );
+  bool* valid = new bool[count];
+
+  results.x = xs;
+  results.y = ys;
+  mesh.projectPoints( &results.x[0], &results.y[0], count, valid );
+  results.valid.assign( valid, valid + count );
+  delete [] valid;
+}
+
+// One unit in the last place of the largest coordinate of the nodes the
+// point <x>, <y> is interpolated from
+double unitInLastPlace( const ProjectionMesh& mesh, const CheckCase& check,
+                        long type, double x, double y )
+{
+  const double horizSpacing = ( check.right - check.left ) /
+                              ( MESH_WIDTH - 1 );
+  const double vertSpacing  = ( check.top - check.bottom ) /
+                              ( MESH_HEIGHT - 1 );
+  const long   leftCol = static_cast<long>(
+    floor( ( x - check.left ) / horizSpacing ) );
+  const long   topRow  = static_cast<long>(
+    floor( ( check.top - y ) / vertSpacing ) );
+  const long   border = ( MathLib::BiCubic == type ) ? 1 : 0;
+  double nodeX, nodeY, largest = 0.0;
+  long col, row;
+  int exponent;
+
+  for ( row = topRow - border; row <= topRow + 1 + border; row++ )
+  {
+    for ( col = leftCol - border; col <= leftCol + 1 + border; col++ )
+    {
+      if ( col < 0 || col >= MESH_WIDTH || row < 0 || row >= MESH_HEIGHT ||
+           !mesh.getProjectedCoordinate( col, row, nodeX, nodeY ) )
+        continue;
+      if ( fabs( nodeX ) > largest )
+        largest = fabs( nodeX );
+      if ( fabs( nodeY ) > largest )
+        largest = fabs( nodeY );
+    }
+  }
+  frexp( largest, &exponent );
+  return ldexp( 1.0, exponent - 53 );
+}
+
+// Compares <results> with <expected>, returning the number of points
+// that differ by more than <tolerance> and setting <worst> to the largest
+// difference
+long compare( const ProjectionMesh& mesh, const CheckCase& check, long type,
+              const std::vector<double>& xs, const std::vector<double>& ys,
+              const CheckResults& results, const CheckResults& expected,
+              double tolerance, double& worst )
+{
+  const long count = static_cast<long>( xs.size() );
+  double ulp, difference;
+  long counter, failures = 0;
+
+  worst = 0.0;
+  for ( counter = 0; counter < count; counter++ )
+  {
+    if ( results.valid[counter] != expected.valid[counter] )
+    {
+      failures++;
+      continue;
+    }
+    if ( !expected.valid[counter] )
+      continue;
+
+    ulp = unitInLastPlace( mesh, check, type, xs[counter], ys[counter] );
+    difference = fabs( results.x[counter] - expected.x[counter] ) / ulp;
+    if ( fabs( results.y[counter] - expected.y[counter] ) / ulp >
+         difference )
+      difference = fabs( results.y[counter] - expected.y[counter] ) / ulp;
+
+    if ( difference > worst )
+      worst = difference;
+    if ( difference > tolerance )
+      failures++;
+  }
+  return failures;
+}
+
+// Checks one interpolator through <path> against <expected>, with
+// <kernel> for the vectorized kernels.  Returns the number of points
+// that are off.
+long checkOne( const CheckCase& check, const CheckInterpolator& type,
+               Path path, const char* kernel,
+               const std::vector<double>& xs, const std::vector<double>& ys,
+               const CheckResults& expected )
+{
+  const double tolerance = ( MathLib::BiCubic == type.type ) ?
+                           BICUBIC_ULPS : LINEAR_ULPS;
+  ProjectionMesh mesh;
+  CheckResults results;
+  char name[64];
+  double worst;
+  long failures;
+
+  setUp( mesh, check, type.type );
+  mesh.setPrecompute( PRECOMPUTE == path );
+  mesh.setVectorized( VECTORIZED == path );
+  mesh.setClosedForm( CLOSED_FORM == path );
+  mesh.calculateMesh( *check.source, *check.dest );
+
+  if ( VECTORIZED == path )
+    MeshKernels::setKernel( kernel );
+  project( mesh, xs, ys, results );
+  MeshKernels::setKernel( NULL );
+
+  failures = compare( mesh, check, type.type, xs, ys, results, expected,
+                      tolerance, worst );
+
+  sprintf( name, "%s", ( PRECOMPUTE == path ) ? "precompute" :
+           ( CLOSED_FORM == path ) ? "closed form" : kernel );
+  printf( "%-22s %-18s %-12s %8.1f %6.0f %8ld\n", check.name, type.name,
+          name, worst, tolerance, failures );
+  fflush( stdout );
+  return failures;
+}
+}
+
+
+int main( int argc, char** argv )
+{
+  long points = ( argc > 1 ) ? atol( argv[1] ) : 100000;
+
+  SyntheticProjection mercator( SyntheticProjection::MERCATOR, 0.0,
+                                RADIUS );
+  SyntheticProjection sinusoidal( SyntheticProjection::SINUSOIDAL, 10.0,
+                                  RADIUS );
+  SyntheticProjection plateCarree( SyntheticProjection::PLATE_CARREE,
+                                   -95.0, RADIUS );
+  std::vector<double> xs, ys;
+  CheckResults expected;
+  long failures = 0;
+
+  if ( points < 1 )
+  {
+    fprintf( stderr, "Usage: %s [points]\n", argv[0] );
+    return 1;
+  }
+
+  // Mercator over 30W to 30E, 10N to 60N
+  const double mercBottom = RADIUS * log( tan( M_PI / 4.0 + 10.0 * M_PI /
+                                               360.0 ) );
+  const double mercTop    = RADIUS * log( tan( M_PI / 4.0 + 60.0 * M_PI /
+                                               360.0 ) );
+  const CheckCase cases[] =
+  {
+    { "mercator-sinusoidal", &mercator, &sinusoidal,
+      -30.0 * DEGREE, mercBottom, 30.0 * DEGREE, mercTop },
+    { "platecarree-mercator", &plateCarree, &mercator,
+      -20.0 * DEGREE, 20.0 * DEGREE, 20.0 * DEGREE, 70.0 * DEGREE }
+  };
+  const int caseCount = sizeof( cases ) / sizeof( cases[0] );
+
+  printf( "%ld points, %ld x %ld meshes, differences in units in the last "
+          "place\n\n%-22s %-18s %-12s %8s %6s %8s\n", points, MESH_WIDTH,
+          MESH_HEIGHT, "case", "interpolator", "path", "worst", "limit",
+          "failures" );
+
+  for ( int counter = 0; counter < caseCount; counter++ )
+  {
+    const CheckCase& check = cases[counter];
+
+    makePoints( check, points, xs, ys );
+    for ( int type = 0; type < INTERPOLATOR_COUNT; type++ )
+    {
+      const CheckInterpolator& interpolator = INTERPOLATORS[type];
+
+      try
+      {
+        ProjectionMesh reference;
+
+        setUp( reference, check, interpolator.type );
+        reference.calculateMesh( *check.source, *check.dest );
+        project( reference, xs, ys, expected );
+
+        failures += checkOne( check, interpolator, PRECOMPUTE, NULL, xs,
+                              ys, expected );
+
+        if ( MathLib::DlgViewer == interpolator.type ||
+             MathLib::BiLinear == interpolator.type )
+        {
+          for ( int kernel = 0; kernel < KERNEL_COUNT; kernel++ )
+          {
+            if ( !MeshKernels::setKernel( KERNELS[kernel] ) )
+            {
+              printf( "%-22s %-18s %-12s not run on this machine\n",
+                      check.name, interpolator.name, KERNELS[kernel] );
+              continue;
+            }
+            failures += checkOne( check, interpolator, VECTORIZED,
+                                  KERNELS[kernel], xs, ys, expected );
+          }
+          MeshKernels::setKernel( NULL );
+        }
+
+        failures += checkOne( check, interpolator, CLOSED_FORM, NULL, xs,
+                              ys, expected );
+      }
+      catch ( PmeshException& e )
+      {
+        std::string message;
+
+        e.getString( message );
+        fprintf( stderr, "%s %s: %s\n", check.name, interpolator.name,
+                 message.c_str() );
+        failures++;
+      }
+    }
+  }
+
+  printf( "\n%s\n", failures ? "FAILED" : "passed" );
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,437 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Measures what a mesh costs to build and to project through, for every
+// MathLib interpolator over a range of mesh sizes, so changes to
+// calculateMesh(), projectPoint() and the code under them can be checked
+// for regressions.
+//
+// For each case, interpolator and mesh size it reports (GlobalSpline is
+// BiCubicSpline with ProjectionMesh::setGlobalSpline() on)
+//   - the calculateMesh() time, best of a few runs,
+//   - projectPoint() throughput over random points in the mesh,
+//   - projectPoints() throughput over the same points,
+//   - projectPoint() latency percentiles, timing each call on its own and
+//     taking off what the timer itself costs,
+//   - how many times operator new was called per calculateMesh() and per
+//     projectPoint().  Allocations the MathLib interpolators make with
+//     malloc() aren't seen.
+//
+// Most cases use SyntheticProjection so the numbers only depend on the
+// code and the machine.  geographic-utm goes through the real projection
+// library, geographic degrees to UTM zone 15 meters on WGS 84, so its
+// build times are what calculateMesh() costs with a real projection.
+// Other projections can be benchmarked by adding a BenchCase built from
+// them to main().
+//
+// Usage: MeshBenchmark [-json] [-closed] [-batch] [-points count]
+//
+// -json writes one JSON object per result line instead of a table.
+// -closed turns on ProjectionMesh::setClosedForm(), so the interpolators
+// with closed forms are evaluated through MeshQuery instead of MathLib.
+// -batch uses SyntheticBatchProjection, so calculateMesh() projects
+// arrays of nodes through MeshBatchProjection.  The real projections
+// still go a point at a time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include "ProjectionLib/GeographicProjection.h"
+#include "ProjectionLib/UTMProjection.h"
+#include "ProjectionMesh.h"
+#include "SyntheticProjection.h"
+#include "BenchTimer.h"
+
+using namespace PmeshLib;
+using namespace PmeshBench;
+
+// ***************************************************************************
+// Counting allocations.  Replacing the global operators counts everything
+// the library allocates through new, not just what this file does.  They
+// are kept out of line: inlined into a caller, GCC would see free() called
+// on what the caller got from operator new and warn about the mismatch.
+#if defined(__GNUC__)
+#define BENCH_ALLOCATOR __attribute__((noinline))
+#else
+#define BENCH_ALLOCATOR
+#endif
+
+namespace
+{
+long g_allocations = 0;
+}
+
+BENCH_ALLOCATOR
+void* operator new( size_t size ) throw(std::bad_alloc)
+{
+  void* p;
+
+  g_allocations++;
+  p = malloc( size ? size : 1 );
+  if ( !p )
+    throw std::bad_alloc();
+  return p;
+}
+
+BENCH_ALLOCATOR
+void* operator new[]( size_t size ) throw(std::bad_alloc)
+{
+  return operator new( size );
+}
+
+BENCH_ALLOCATOR
+void* operator new( size_t size, const std::nothrow_t& ) throw()
+{
+  g_allocations++;
+  return malloc( size ? size : 1 );
+}
+
+BENCH_ALLOCATOR
+void* operator new[]( size_t size, const std::nothrow_t& ) throw()
+{
+  return operator new( size, std::nothrow );
+}
+
+BENCH_ALLOCATOR
+void operator delete( void* p ) throw()
+{
+  free( p );
+}
+
+BENCH_ALLOCATOR
+void operator delete[]( void* p ) throw()
+{
+  free( p );
+}
+
+BENCH_ALLOCATOR
+void operator delete( void* p, const std::nothrow_t& ) throw()
+{
+  free( p );
+}
+
+BENCH_ALLOCATOR
+void operator delete[]( void* p, const std::nothrow_t& ) throw()
+{
+  free( p );
+}
+
+// C++14 and later also delete with the size
+#if __cplusplus >= 201402L
+BENCH_ALLOCATOR
+void operator delete( void* p, size_t ) throw()
+{
+  free( p );
+}
+
+BENCH_ALLOCATOR
+void operator delete[]( void* p, size_t ) throw()
+{
+  free( p );
+}
+#endif
+
+
+namespace
+{
+const double RADIUS = 6370997.0;
+const double DEGREE = RADIUS * M_PI / 180.0;
+const int    BUILD_RUNS = 3;
+
+// A pair of projections and the source bounds to mesh between them
+struct BenchCase
+{
+  const char*                name;
+  const ProjLib::Projection* source;
+  const ProjLib::Projection* dest;
+  double                     left, bottom, right, top;
+};
+
+struct BenchResult
+{
+  double buildSeconds;
+  double buildAllocations;
+  double pointRate;             // projectPoint() calls a second
+  double batchRate;             // points a second through projectPoints()
+  double p50, p90, p99, p999;   // latency in nanoseconds
+  double queryAllocations;      // per projectPoint()
+  double invalidFraction;
+};
+
+struct InterpolatorName
+{
+  long        type;
+  const char* name;
+  bool        bGlobalSpline;
+};
+
+const InterpolatorName INTERPOLATORS[] =
+{
+  { MathLib::DlgViewer,         "DlgViewer",         false },
+  { MathLib::BiLinear,          "BiLinear",          false },
+  { MathLib::LeastSquaresPlane, "LeastSquaresPlane", false },
+  { MathLib::BiPolynomial,      "BiPolynomial",      false },
+  { MathLib::BiCubic,           "BiCubic",           false },
+  { MathLib::BiCubicSpline,     "BiCubicSpline",     false },
+  { MathLib::BiCubicSpline,     "GlobalSpline",      true }
+};
+const int INTERPOLATOR_COUNT =
+  sizeof( INTERPOLATORS ) / sizeof( INTERPOLATORS[0] );
+
+const long MESH_SIZES[] = { 17, 65, 257, 1025 };
+const int  MESH_SIZE_COUNT = sizeof( MESH_SIZES ) / sizeof( MESH_SIZES[0] );
+
+// Same points every run
+void makePoints( const BenchCase& bench, long count,
+                 std::vector<double>& xs, std::vector<double>& ys )
+{
+  unsigned long seed = 2024;
+
+  xs.resize( count );
+  ys.resize( count );
+  for ( long counter = 0; counter < count; counter++ )
+  {
+    seed = seed * 1103515245UL + 12345UL;
+    xs[counter] = bench.left + ( bench.right - bench.left ) *
+      ( ( seed >> 8 ) & 0xffffff ) / 16777216.0;
+    seed = seed * 1103515245UL + 12345UL;
+    ys[counter] = bench.bottom + ( bench.top - bench.bottom ) *
+      ( ( seed >> 8 ) & 0xffffff ) / 16777216.0;
+  }
+}
+
+// What reading the clock twice costs, to take off the latencies
+double timerOverhead()
+{
+  std::vector<double> samples( 10000 );
+  double start;
+
+  for ( size_t counter = 0; counter < samples.size(); counter++ )
+  {
+    start = wallSeconds();
+    samples[counter] = wallSeconds() - start;
+  }
+  std::sort( samples.begin(), samples.end() );
+  return samples[ samples.size() / 2 ];
+}
+
+double percentile( const std::vector<double>& sorted, double fraction )
+{
+  size_t index = static_cast<size_t>( fraction * ( sorted.size() - 1 ) );
+
+  return sorted[index];
+}
+
+void runOne( const BenchCase& bench, const InterpolatorName& type,
+             long size, const std::vector<double>& xs,
+             const std::vector<double>& ys, double overhead,
+             bool bClosedForm, BenchResult& result )
+{
+  const long count = static_cast<long>( xs.size() );
+  std::vector<double> latencies( count );
+  std::vector<double> bx( xs ), by( ys );
+  ProjectionMesh mesh;
+  double start, seconds, x, y;
+  long allocations, invalid = 0;
+  long counter;
+  int run;
+
+  mesh.setSourceMeshBounds( bench.left, bench.bottom, bench.right,
+                            bench.top );
+  mesh.setMeshSize( size, size );
+  mesh.setInterpolator( type.type );
+  mesh.setGlobalSpline( type.bGlobalSpline );
+  mesh.setClosedForm( bClosedForm );
+
+  // Build time
+  result.buildSeconds = 0.0;
+  allocations = g_allocations;
+  for ( run = 0; run < BUILD_RUNS; run++ )
+  {
+    start = wallSeconds();
+    mesh.calculateMesh( *bench.source, *bench.dest );
+    seconds = wallSeconds() - start;
+    if ( 0 == run || seconds < result.buildSeconds )
+      result.buildSeconds = seconds;
+  }
+  result.buildAllocations =
+    static_cast<double>( g_allocations - allocations ) / BUILD_RUNS;
+
+  // Throughput
+  allocations = g_allocations;
+  start = wallSeconds();
+  for ( counter = 0; counter < count; counter++ )
+  {
+    x = xs[counter];
+    y = ys[counter];
+    if ( !mesh.projectPoint( x, y ) )
+      invalid++;
+  }
+  seconds = wallSeconds() - start;
+  result.pointRate = count / seconds;
+  result.queryAllocations =
+    static_cast<double>( g_allocations - allocations ) / count;
+  result.invalidFraction = static_cast<double>( invalid ) / count;
+
+  start = wallSeconds();
+  mesh.projectPoints( &bx[0], &by[0], count );
+  result.batchRate = count / ( wallSeconds() - start );
+
+  // Latency
+  for ( counter = 0; counter < count; counter++ )
+  {
+    x = xs[counter];
+    y = ys[counter];
+    start = wallSeconds();
+    mesh.projectPoint( x, y );
+    latencies[counter] = ( wallSeconds() - start - overhead ) * 1e9;
+  }
+  std::sort( latencies.begin(), latencies.end() );
+  result.p50  = percentile( latencies, 0.5 );
+  result.p90  = percentile( latencies, 0.9 );
+  result.p99  = percentile( latencies, 0.99 );
+  result.p999 = percentile( latencies, 0.999 );
+}
+
+void printResult( bool bJson, const BenchCase& bench, const char* name,
+                  long size, const BenchResult& result )
+{
+  if ( bJson )
+  {
+    printf( "{\"case\":\"%s\",\"interpolator\":\"%s\",\"meshSize\":%ld,"
+            "\"buildSeconds\":%.6g,\"buildAllocations\":%.6g,"
+            "\"pointRate\":%.6g,\"batchRate\":%.6g,"
+            "\"p50ns\":%.4g,\"p90ns\":%.4g,\"p99ns\":%.4g,\"p999ns\":%.4g,"
+            "\"allocationsPerQuery\":%.6g,\"invalidFraction\":%.6g}\n",
+            bench.name, name, size, result.buildSeconds,
+            result.buildAllocations, result.pointRate, result.batchRate,
+            result.p50, result.p90, result.p99, result.p999,
+            result.queryAllocations, result.invalidFraction );
+  }
+  else
+  {
+    printf( "%-18s %5ld %9.4f %7.0f %8.2f %8.2f %7.0f %7.0f %7.0f %7.0f "
+            "%6.2f\n", name, size, result.buildSeconds,
+            result.buildAllocations, result.pointRate / 1e6,
+            result.batchRate / 1e6, result.p50, result.p90, result.p99,
+            result.p999, result.queryAllocations );
+  }
+  fflush( stdout );
+}
+}
+
+
+int main( int argc, char** argv )
+{
+  bool bJson = false;
+  bool bClosedForm = false;
+  bool bBatch = false;
+  long points = 200000;
+  int arg, type, size;
+
+  for ( arg = 1; arg < argc; arg++ )
+  {
+    if ( 0 == strcmp( argv[arg], "-json" ) )
+      bJson = true;
+    else if ( 0 == strcmp( argv[arg], "-closed" ) )
+      bClosedForm = true;
+    else if ( 0 == strcmp( argv[arg], "-batch" ) )
+      bBatch = true;
+    else if ( 0 == strcmp( argv[arg], "-points" ) && arg + 1 < argc )
+      points = atol( argv[++arg] );
+    else
+    {
+      fprintf( stderr,
+               "Usage: %s [-json] [-closed] [-batch] [-points count]\n",
+               argv[0] );
+      return 1;
+    }
+  }
+
+  SyntheticProjection mercatorPoints( SyntheticProjection::MERCATOR, 0.0,
+                                      RADIUS );
+  SyntheticProjection sinusoidalPoints( SyntheticProjection::SINUSOIDAL,
+                                        10.0, RADIUS );
+  SyntheticProjection plateCarreePoints( SyntheticProjection::PLATE_CARREE,
+                                         -95.0, RADIUS );
+  SyntheticBatchProjection mercatorBatch( SyntheticProjection::MERCATOR,
+                                          0.0, RADIUS );
+  SyntheticBatchProjection sinusoidalBatch( SyntheticProjection::SINUSOIDAL,
+                                            10.0, RADIUS );
+  SyntheticBatchProjection plateCarreeBatch(
+    SyntheticProjection::PLATE_CARREE, -95.0, RADIUS );
+  const ProjLib::Projection& mercator =
+    bBatch ? static_cast<const ProjLib::Projection&>( mercatorBatch ) :
+    mercatorPoints;
+  const ProjLib::Projection& sinusoidal =
+    bBatch ? static_cast<const ProjLib::Projection&>( sinusoidalBatch ) :
+    sinusoidalPoints;
+  const ProjLib::Projection& plateCarree =
+    bBatch ? static_cast<const ProjLib::Projection&>( plateCarreeBatch ) :
+    plateCarreePoints;
+  ProjLib::GeographicProjection geographic( ProjLib::WGS_84,
+                                            ProjLib::ARC_DEGREES );
+  ProjLib::UTMProjection utm( 15, ProjLib::WGS_84, ProjLib::METERS );
+
+  // Mercator over 30W to 30E, 10N to 60N
+  const double mercBottom = RADIUS * log( tan( M_PI / 4.0 + 10.0 * M_PI /
+                                               360.0 ) );
+  const double mercTop    = RADIUS * log( tan( M_PI / 4.0 + 60.0 * M_PI /
+                                               360.0 ) );
+  const BenchCase cases[] =
+  {
+    { "mercator-sinusoidal", &mercator, &sinusoidal,
+      -30.0 * DEGREE, mercBottom, 30.0 * DEGREE, mercTop },
+    { "platecarree-mercator", &plateCarree, &mercator,
+      -20.0 * DEGREE, 20.0 * DEGREE, 20.0 * DEGREE, 70.0 * DEGREE },
+    // Zone 15 and a degree and a half either side, 30N to 45N
+    { "geographic-utm", &geographic, &utm, -97.5, 30.0, -88.5, 45.0 }
+  };
+  const int caseCount = sizeof( cases ) / sizeof( cases[0] );
+  const double overhead = timerOverhead();
+  std::vector<double> xs, ys;
+  BenchResult result;
+
+  if ( !bJson )
+    printf( "%ld points a query run, timer overhead %.0f ns taken off the "
+            "latencies\n", points, overhead * 1e9 );
+
+  for ( int counter = 0; counter < caseCount; counter++ )
+  {
+    const BenchCase& bench = cases[counter];
+
+    makePoints( bench, points, xs, ys );
+    if ( !bJson )
+      printf( "\n%s\n%-18s %5s %9s %7s %8s %8s %7s %7s %7s %7s %6s\n",
+              bench.name, "interpolator", "size", "build s", "allocs",
+              "Mpt/s", "batch", "p50 ns", "p90", "p99", "p99.9",
+              "new/pt" );
+
+    for ( type = 0; type < INTERPOLATOR_COUNT; type++ )
+    {
+      for ( size = 0; size < MESH_SIZE_COUNT; size++ )
+      {
+        try
+        {
+          runOne( bench, INTERPOLATORS[type], MESH_SIZES[size], xs, ys,
+                  overhead, bClosedForm, result );
+          printResult( bJson, bench, INTERPOLATORS[type].name,
+                       MESH_SIZES[size], result );
+        }
+        catch ( PmeshException& e )
+        {
+          std::string message;
+
+          e.getString( message );
+          fprintf( stderr, "%s %s %ld: %s\n", bench.name,
+                   INTERPOLATORS[type].name, MESH_SIZES[size],
+                   message.c_str() );
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,254 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// SyntheticProjection is a deterministic stand-in for a ProjLib
+// projection, so the benchmarks can run without projection parameter
+// files and give the same numbers from run to run.  It implements the
+// members of ProjLib::Projection the mesh uses with closed form spherical
+// projections, in meters on a sphere of <radius>, with latitude and
+// longitude in degrees.  The Lambert conformal conic bends the rows of a
+// mesh from the others into arcs, which the cylindrical ones never do.
+//
+// SyntheticBatchProjection is the same projection with the
+// MeshBatchProjection interface as well, converting arrays with the
+// switch on the kind taken out of the loop, to measure what batching
+// buys calculateMesh().
+
+#ifndef _SYNTHETICPROJECTION_H_
+#define _SYNTHETICPROJECTION_H_
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include "ProjectionLib/Projection.h"
+#include "MeshBatchProjection.h"
+
+namespace PmeshBench
+{
+
+class SyntheticProjection : public ProjLib::Projection
+{
+ public:
+  enum Kind
+  {
+    PLATE_CARREE,     // x and y proportional to longitude and latitude
+    MERCATOR,
+    SINUSOIDAL,       // equal area, curved meridians
+    LAMBERT_CONIC     // conformal, standard parallels 33N and 45N,
+                      // origin 39N, curved parallels
+  };
+
+  SyntheticProjection( Kind kind, double centralMeridian = 0.0,
+                       double radius = 6370997.0 ) throw()
+    : d_kind(kind), d_centralMeridian(centralMeridian), d_radius(radius)
+  {
+    const double first  = 33.0 * M_PI / 180.0;
+    const double second = 45.0 * M_PI / 180.0;
+
+    d_coneN = log( cos( first ) / cos( second ) ) /
+      log( tan( M_PI / 4.0 + second / 2.0 ) /
+           tan( M_PI / 4.0 + first / 2.0 ) );
+    d_coneF = cos( first ) * pow( tan( M_PI / 4.0 + first / 2.0 ), d_coneN ) /
+      d_coneN;
+    d_coneRho0 = d_radius * d_coneF /
+      pow( tan( M_PI / 4.0 + 39.0 * M_PI / 360.0 ), d_coneN );
+  }
+
+  ProjLib::Projection* clone() const throw()
+  {
+    return new SyntheticProjection( d_kind, d_centralMeridian, d_radius );
+  }
+
+  bool projectToGeo( double x, double y, double& lat, double& lon ) const
+    throw()
+  {
+    double phi, lambda, rho;
+
+    switch ( d_kind )
+    {
+    case MERCATOR:
+      phi    = 2.0 * atan( exp( y / d_radius ) ) - M_PI / 2.0;
+      lambda = x / d_radius;
+      break;
+    case SINUSOIDAL:
+      phi = y / d_radius;
+      if ( fabs( cos( phi ) ) < 1e-12 )
+        return false;
+      lambda = x / ( d_radius * cos( phi ) );
+      break;
+    case LAMBERT_CONIC:
+      rho = sqrt( x * x + ( d_coneRho0 - y ) * ( d_coneRho0 - y ) );
+      if ( rho < 1e-9 )
+        return false;
+      phi    = 2.0 * atan( pow( d_radius * d_coneF / rho,
+                                1.0 / d_coneN ) ) - M_PI / 2.0;
+      lambda = atan2( x, d_coneRho0 - y ) / d_coneN;
+      break;
+    default:
+      phi    = y / d_radius;
+      lambda = x / d_radius;
+      break;
+    }
+
+    if ( fabs( phi ) > M_PI / 2.0 || fabs( lambda ) > M_PI )
+      return false;
+
+    lat = phi * 180.0 / M_PI;
+    lon = lambda * 180.0 / M_PI + d_centralMeridian;
+    return true;
+  }
+
+  bool projectFromGeo( double lat, double lon, double& x, double& y ) const
+    throw()
+  {
+    double phi    = lat * M_PI / 180.0;
+    double lambda = ( lon - d_centralMeridian ) * M_PI / 180.0;
+    double rho;
+
+    switch ( d_kind )
+    {
+    case MERCATOR:
+      if ( fabs( lat ) >= 89.5 )
+        return false;
+      x = d_radius * lambda;
+      y = d_radius * log( tan( M_PI / 4.0 + phi / 2.0 ) );
+      break;
+    case SINUSOIDAL:
+      x = d_radius * lambda * cos( phi );
+      y = d_radius * phi;
+      break;
+    case LAMBERT_CONIC:
+      if ( lat <= -89.5 )
+        return false;
+      rho = d_radius * d_coneF /
+        pow( tan( M_PI / 4.0 + phi / 2.0 ), d_coneN );
+      x = rho * sin( d_coneN * lambda );
+      y = d_coneRho0 - rho * cos( d_coneN * lambda );
+      break;
+    default:
+      x = d_radius * lambda;
+      y = d_radius * phi;
+      break;
+    }
+    return true;
+  }
+
+  std::string toString() const throw()
+  {
+    static const char* names[] = { "PLATE_CARREE", "MERCATOR",
+                                   "SINUSOIDAL", "LAMBERT_CONIC" };
+    char description[96];
+
+    sprintf( description, "SYNTHETIC %s %.17g %.17g", names[d_kind],
+             d_centralMeridian, d_radius );
+    return description;
+  }
+
+ protected:
+  Kind   d_kind;
+  double d_centralMeridian;
+  double d_radius;
+  double d_coneN, d_coneF, d_coneRho0;   // LAMBERT_CONIC's constants
+};
+
+
+class SyntheticBatchProjection : public SyntheticProjection,
+                                 public PmeshLib::MeshBatchProjection
+{
+ public:
+  SyntheticBatchProjection( Kind kind, double centralMeridian = 0.0,
+                            double radius = 6370997.0 ) throw()
+    : SyntheticProjection( kind, centralMeridian, radius )
+  {
+  }
+
+  ProjLib::Projection* clone() const throw()
+  {
+    return new SyntheticBatchProjection( d_kind, d_centralMeridian,
+                                         d_radius );
+  }
+
+  long projectArrayToGeo( const double* x, const double* y, long count,
+                          double* lat, double* lon, bool* valid ) const
+    throw()
+  {
+    long counter, converted = 0;
+    double phi, lambda;
+
+    // The conic isn't worth a loop of its own
+    if ( LAMBERT_CONIC == d_kind )
+    {
+      for ( counter = 0; counter < count; counter++ )
+      {
+        valid[counter] = projectToGeo( x[counter], y[counter],
+                                       lat[counter], lon[counter] );
+        converted += valid[counter];
+      }
+      return converted;
+    }
+
+    for ( counter = 0; counter < count; counter++ )
+    {
+      if ( MERCATOR == d_kind )
+        phi = 2.0 * atan( exp( y[counter] / d_radius ) ) - M_PI / 2.0;
+      else
+        phi = y[counter] / d_radius;
+      if ( SINUSOIDAL == d_kind )
+        lambda = x[counter] / ( d_radius * cos( phi ) );
+      else
+        lambda = x[counter] / d_radius;
+
+      valid[counter] = ( fabs( phi ) <= M_PI / 2.0 &&
+                         fabs( lambda ) <= M_PI &&
+                         ( SINUSOIDAL != d_kind ||
+                           fabs( cos( phi ) ) >= 1e-12 ) );
+      if ( valid[counter] )
+      {
+        lat[counter] = phi * 180.0 / M_PI;
+        lon[counter] = lambda * 180.0 / M_PI + d_centralMeridian;
+        converted++;
+      }
+    }
+    return converted;
+  }
+
+  long projectArrayFromGeo( const double* lat, const double* lon,
+                            long count, double* x, double* y,
+                            bool* valid ) const throw()
+  {
+    long counter, converted = 0;
+    double phi, lambda;
+
+    if ( LAMBERT_CONIC == d_kind )
+    {
+      for ( counter = 0; counter < count; counter++ )
+      {
+        valid[counter] = projectFromGeo( lat[counter], lon[counter],
+                                         x[counter], y[counter] );
+        converted += valid[counter];
+      }
+      return converted;
+    }
+
+    for ( counter = 0; counter < count; counter++ )
+    {
+      valid[counter] = ( MERCATOR != d_kind || fabs( lat[counter] ) < 89.5 );
+      if ( !valid[counter] )
+        continue;
+
+      phi    = lat[counter] * M_PI / 180.0;
+      lambda = ( lon[counter] - d_centralMeridian ) * M_PI / 180.0;
+      x[counter] = d_radius * lambda;
+      if ( SINUSOIDAL == d_kind )
+        x[counter] *= cos( phi );
+      y[counter] = ( MERCATOR == d_kind ) ?
+        d_radius * log( tan( M_PI / 4.0 + phi / 2.0 ) ) : d_radius * phi;
+      converted++;
+    }
+    return converted;
+  }
+};
+
+} // namespace
+
+#endif
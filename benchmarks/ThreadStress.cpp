@@ -0,0 +1,378 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Checks that threads sharing one mesh get exactly what a single thread
+// gets.  For every interpolator and the options that change how a mesh is
+// built or read it
+//   - builds a reference mesh on one thread and projects a set of points
+//     through it with projectPoint() and, in batches, projectPoints(),
+//   - builds the same mesh with setThreadCount( threads ), so the nodes
+//     are calculated on that many threads,
+//   - runs that many threads against the second mesh at once, each
+//     projecting every point with projectPoint() and then every batch with
+//     projectPoints(), starting at a different batch so they reach the
+//     cells (and the tiles of a lazy mesh) in different orders,
+//   - and compares every result and then every node and its validity
+//     with the reference, bit for bit.
+// The mesh is one node wider than a multiple of 32 so that neighbouring
+// rows share words of the validity maps.  Some of the points are off the
+// mesh.  The batches are always the same points, since the vectorized
+// kernels only agree with projectPoint() to a tolerance and which points
+// they take depends on where the batch starts.  It prints a line per mesh
+// and exits with 1 if anything differs, so it can be run as a check.
+// Races seldom change a result, so it is also worth building with
+// -fsanitize=thread now and then.
+//
+// Usage: ThreadStress [threads [points]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "ProjectionMesh.h"
+#include "PmeshThread.h"
+#include "SyntheticProjection.h"
+
+using namespace PmeshLib;
+using namespace PmeshBench;
+
+namespace
+{
+const double RADIUS = 6370997.0;
+const double DEGREE = RADIUS * M_PI / 180.0;
+const long   MESH_SIZE = 129;
+const long   LAZY_TILE_SIZE = 16;
+const long   BATCH = 256;
+const double HYBRID_TOLERANCE = 40.0;  // meters, some cells either side
+
+// How a mesh is set up besides its interpolator
+enum Setup
+{
+  PLAIN,
+  CLOSED_FORM,
+  GLOBAL_SPLINE,
+  VECTORIZED,
+  PRECOMPUTE,
+  LAZY,
+  HYBRID
+};
+
+struct StressMesh
+{
+  long        type;
+  const char* name;
+  Setup       setup;
+};
+
+const StressMesh MESHES[] =
+{
+  { MathLib::DlgViewer,         "DlgViewer",         PLAIN },
+  { MathLib::BiLinear,          "BiLinear",          PLAIN },
+  { MathLib::LeastSquaresPlane, "LeastSquaresPlane", PLAIN },
+  { MathLib::BiPolynomial,      "BiPolynomial",      PLAIN },
+  { MathLib::BiCubic,           "BiCubic",           PLAIN },
+  { MathLib::BiCubicSpline,     "BiCubicSpline",     PLAIN },
+  { MathLib::BiLinear,          "ClosedBiLinear",    CLOSED_FORM },
+  { MathLib::LeastSquaresPlane, "ClosedPlane",       CLOSED_FORM },
+  { MathLib::BiCubic,           "ClosedBiCubic",     CLOSED_FORM },
+  { MathLib::BiCubicSpline,     "GlobalSpline",      GLOBAL_SPLINE },
+  { MathLib::BiLinear,          "Vectorized",        VECTORIZED },
+  { MathLib::BiCubic,           "Precompute",        PRECOMPUTE },
+  { MathLib::DlgViewer,         "Lazy",              LAZY },
+  { MathLib::BiCubic,           "LazyBiCubic",       LAZY },
+  { MathLib::BiLinear,          "Hybrid",            HYBRID }
+};
+const int MESH_COUNT = sizeof( MESHES ) / sizeof( MESHES[0] );
+
+// A pair of projections and the source bounds to mesh between them
+struct StressCase
+{
+  const char*                name;
+  const ProjLib::Projection* source;
+  const ProjLib::Projection* dest;
+  double                     left, bottom, right, top;
+};
+
+// What a set of points projects to
+struct StressResults
+{
+  std::vector<double> x, y;
+  std::vector<bool>   valid;
+};
+
+// What each thread projects and what it should get
+struct StressJob
+{
+  const ProjectionMesh*      mesh;
+  const std::vector<double>* xs;
+  const std::vector<double>* ys;
+  const StressResults*       points;      // from projectPoint()
+  const StressResults*       batches;     // from projectPoints()
+  long                       first;       // batch to start at
+  long                       mismatches;
+  bool                       bThrew;
+};
+
+// Same points every run, a tenth of the way past the bounds on each side
+void makePoints( const StressCase& stress, long count,
+                 std::vector<double>& xs, std::vector<double>& ys )
+{
+  const double width  = stress.right - stress.left;
+  const double height = stress.top - stress.bottom;
+  unsigned long seed = 2024;
+
+  xs.resize( count );
+  ys.resize( count );
+  for ( long counter = 0; counter < count; counter++ )
+  {
+    seed = seed * 1103515245UL + 12345UL;
+    xs[counter] = stress.left - 0.1 * width + 1.2 * width *
+      ( ( seed >> 8 ) & 0xffffff ) / 16777216.0;
+    seed = seed * 1103515245UL + 12345UL;
+    ys[counter] = stress.bottom - 0.1 * height + 1.2 * height *
+      ( ( seed >> 8 ) & 0xffffff ) / 16777216.0;
+  }
+}
+
+void setUp( ProjectionMesh& mesh, const StressCase& stress,
+            const StressMesh& kind, long threads )
+{
+  mesh.setSourceMeshBounds( stress.left, stress.bottom, stress.right,
+                            stress.top );
+  mesh.setMeshSize( MESH_SIZE, MESH_SIZE );
+  mesh.setInterpolator( kind.type );
+  mesh.setClosedForm( CLOSED_FORM == kind.setup );
+  mesh.setGlobalSpline( GLOBAL_SPLINE == kind.setup );
+  mesh.setVectorized( VECTORIZED == kind.setup );
+  mesh.setPrecompute( PRECOMPUTE == kind.setup );
+  mesh.setLazyTileSize( ( LAZY == kind.setup ) ? LAZY_TILE_SIZE : 0 );
+  mesh.setHybrid( ( HYBRID == kind.setup ) ? HYBRID_TOLERANCE : 0.0 );
+  mesh.setThreadCount( threads );
+  mesh.calculateMesh( *stress.source, *stress.dest );
+}
+
+bool same( bool bValid, double x, double y, long point,
+           const StressResults& expected )
+{
+  if ( bValid != expected.valid[point] )
+    return false;
+  return !bValid || ( x == expected.x[point] && y == expected.y[point] );
+}
+
+// Projects the points from <first> to <first> + <count> as one batch
+void projectBatch( const ProjectionMesh& mesh, const std::vector<double>& xs,
+                   const std::vector<double>& ys, long first, long count,
+                   double* batchX, double* batchY, bool* valid )
+{
+  for ( long point = 0; point < count; point++ )
+  {
+    batchX[point] = xs[ first + point ];
+    batchY[point] = ys[ first + point ];
+  }
+  mesh.projectPoints( batchX, batchY, count, valid );
+}
+
+// Projects every point one at a time and then every batch, from batch
+// job->first round to the one before it
+void runJob( void* arg )
+{
+  StressJob* job = static_cast<StressJob*>( arg );
+  const long count = static_cast<long>( job->xs->size() );
+  const long batches = ( count + BATCH - 1 ) / BATCH;
+  double xs[BATCH], ys[BATCH];
+  bool   valid[BATCH];
+  long   counter, point, first, size;
+  double x, y;
+  bool   bValid;
+
+  try
+  {
+    for ( counter = 0; counter < count; counter++ )
+    {
+      point = ( job->first * BATCH + counter ) % count;
+      x = ( *job->xs )[point];
+      y = ( *job->ys )[point];
+      bValid = job->mesh->projectPoint( x, y );
+      if ( !same( bValid, x, y, point, *job->points ) )
+        job->mismatches++;
+    }
+
+    for ( counter = 0; counter < batches; counter++ )
+    {
+      first = ( ( job->first + counter ) % batches ) * BATCH;
+      size = ( count - first < BATCH ) ? count - first : BATCH;
+      projectBatch( *job->mesh, *job->xs, *job->ys, first, size, xs, ys,
+                    valid );
+      for ( point = 0; point < size; point++ )
+      {
+        if ( !same( valid[point], xs[point], ys[point], first + point,
+                    *job->batches ) )
+          job->mismatches++;
+      }
+    }
+  }
+  catch(...)
+  {
+    job->bThrew = true;
+  }
+}
+
+// Counts the nodes that differ between <mesh> and <reference>
+long compareNodes( const ProjectionMesh& mesh,
+                   const ProjectionMesh& reference )
+{
+  double x, y, referenceX, referenceY;
+  bool   bValid, bReferenceValid;
+  long   col, row, differences = 0;
+
+  for ( row = 0; row < MESH_SIZE; row++ )
+  {
+    for ( col = 0; col < MESH_SIZE; col++ )
+    {
+      bValid = mesh.getProjectedCoordinate( col, row, x, y );
+      bReferenceValid = reference.getProjectedCoordinate( col, row,
+                                                          referenceX,
+                                                          referenceY );
+      if ( bValid != bReferenceValid ||
+           ( bValid && ( x != referenceX || y != referenceY ) ) )
+        differences++;
+    }
+  }
+  return differences;
+}
+
+// Runs one mesh, returning the number of results and nodes that differ
+long runOne( const StressCase& stress, const StressMesh& kind, long threads,
+             const std::vector<double>& xs, const std::vector<double>& ys )
+{
+  const long count = static_cast<long>( xs.size() );
+  const long batches = ( count + BATCH - 1 ) / BATCH;
+  StressResults points, batched;
+  std::vector<StressJob> jobs( threads );
+  std::vector<void*>     args( threads );
+  double batchX[BATCH], batchY[BATCH];
+  bool   batchValid[BATCH];
+  long counter, first, size, mismatches = 0, nodes;
+  bool bThrew = false;
+  double x, y;
+
+  ProjectionMesh reference;
+  setUp( reference, stress, kind, 1 );
+  points.x.resize( count );
+  points.y.resize( count );
+  points.valid.resize( count );
+  for ( counter = 0; counter < count; counter++ )
+  {
+    x = xs[counter];
+    y = ys[counter];
+    points.valid[counter] = reference.projectPoint( x, y );
+    points.x[counter] = x;
+    points.y[counter] = y;
+  }
+
+  batched = points;
+  for ( first = 0; first < count; first += BATCH )
+  {
+    size = ( count - first < BATCH ) ? count - first : BATCH;
+    projectBatch( reference, xs, ys, first, size, batchX, batchY,
+                  batchValid );
+    for ( counter = 0; counter < size; counter++ )
+    {
+      batched.x[ first + counter ] = batchX[counter];
+      batched.y[ first + counter ] = batchY[counter];
+      batched.valid[ first + counter ] = batchValid[counter];
+    }
+  }
+
+  ProjectionMesh mesh;
+  setUp( mesh, stress, kind, threads );
+  for ( counter = 0; counter < threads; counter++ )
+  {
+    jobs[counter].mesh          = &mesh;
+    jobs[counter].xs            = &xs;
+    jobs[counter].ys            = &ys;
+    jobs[counter].points        = &points;
+    jobs[counter].batches       = &batched;
+    jobs[counter].first         = counter * batches / threads;
+    jobs[counter].mismatches    = 0;
+    jobs[counter].bThrew        = false;
+    args[counter]               = &jobs[counter];
+  }
+  runThreads( runJob, &args[0], threads );
+
+  for ( counter = 0; counter < threads; counter++ )
+  {
+    mismatches += jobs[counter].mismatches;
+    bThrew = bThrew || jobs[counter].bThrew;
+  }
+  nodes = compareNodes( mesh, reference );
+
+  printf( "%-22s %-18s %10ld %8ld %s\n", stress.name, kind.name,
+          mismatches, nodes, bThrew ? "threw" : "" );
+  fflush( stdout );
+  return mismatches + nodes + ( bThrew ? 1 : 0 );
+}
+}
+
+
+int main( int argc, char** argv )
+{
+  long threads = ( argc > 1 ) ? atol( argv[1] ) : 8;
+  long points  = ( argc > 2 ) ? atol( argv[2] ) : 100000;
+  SyntheticProjection mercator( SyntheticProjection::MERCATOR, 0.0,
+                                RADIUS );
+  SyntheticProjection sinusoidal( SyntheticProjection::SINUSOIDAL, 10.0,
+                                  RADIUS );
+  SyntheticProjection plateCarree( SyntheticProjection::PLATE_CARREE,
+                                   -95.0, RADIUS );
+  std::vector<double> xs, ys;
+  long failures = 0;
+
+  if ( threads < 1 || points < 1 )
+  {
+    fprintf( stderr, "Usage: %s [threads [points]]\n", argv[0] );
+    return 1;
+  }
+
+  // Mercator over 30W to 30E, 10N to 60N
+  const double mercBottom = RADIUS * log( tan( M_PI / 4.0 + 10.0 * M_PI /
+                                               360.0 ) );
+  const double mercTop    = RADIUS * log( tan( M_PI / 4.0 + 60.0 * M_PI /
+                                               360.0 ) );
+  const StressCase cases[] =
+  {
+    { "mercator-sinusoidal", &mercator, &sinusoidal,
+      -30.0 * DEGREE, mercBottom, 30.0 * DEGREE, mercTop },
+    { "platecarree-mercator", &plateCarree, &mercator,
+      -20.0 * DEGREE, 20.0 * DEGREE, 20.0 * DEGREE, 70.0 * DEGREE }
+  };
+  const int caseCount = sizeof( cases ) / sizeof( cases[0] );
+
+  printf( "%ld threads, %ld points each way, %ld x %ld meshes\n\n"
+          "%-22s %-18s %10s %8s\n", threads, points, MESH_SIZE, MESH_SIZE,
+          "case", "mesh", "mismatches", "nodes" );
+
+  for ( int counter = 0; counter < caseCount; counter++ )
+  {
+    makePoints( cases[counter], points, xs, ys );
+    for ( int kind = 0; kind < MESH_COUNT; kind++ )
+    {
+      try
+      {
+        failures += runOne( cases[counter], MESHES[kind], threads, xs, ys );
+      }
+      catch ( PmeshException& e )
+      {
+        std::string message;
+
+        e.getString( message );
+        fprintf( stderr, "%s %s: %s\n", cases[counter].name,
+                 MESHES[kind].name, message.c_str() );
+        failures++;
+      }
+    }
+  }
+
+  printf( "\n%s\n", failures ? "FAILED" : "passed" );
+  return failures ? 1 : 0;
+}
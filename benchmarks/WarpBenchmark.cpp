@@ -0,0 +1,198 @@
+// $Id$
+// Last modified by $Author$ on $Date$
+
+// Times reprojecting a raster with MeshWarp against the loop of
+// projectPoint() calls it replaces.
+//
+// A plate carree source image is warped to Mercator.  The baseline builds
+// a mesh from the output projection back to the source, as callers had
+// to, and projects and bilinearly samples every output pixel itself.
+// MeshWarp is then run on that same mesh, on a forward mesh with the
+// inverse index, and with several threads.
+//
+// Usage: WarpBenchmark [threads [size]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "ProjectionMesh.h"
+#include "MeshWarp.h"
+#include "SyntheticProjection.h"
+#include "BenchTimer.h"
+
+using namespace PmeshLib;
+using namespace PmeshBench;
+
+namespace
+{
+const double RADIUS = 6370997.0;
+const double DEGREE = RADIUS * M_PI / 180.0;
+
+// Bilinear sample of a byte image with centers on the integers, the same
+// way MeshWarp does it
+double sampleBilinear( const std::vector<unsigned char>& image, long size,
+                       double px, double py )
+{
+  long col = static_cast<long>( floor( px ) );
+  long row = static_cast<long>( floor( py ) );
+  double tx = px - col, ty = py - row;
+  long col1 = ( col + 1 < size ) ? col + 1 : size - 1;
+  long row1 = ( row + 1 < size ) ? row + 1 : size - 1;
+  double top, bottom;
+
+  col = ( col < 0 ) ? 0 : col;
+  row = ( row < 0 ) ? 0 : row;
+  top    = image[ row * size + col ];
+  bottom = image[ row1 * size + col ];
+  top    += ( image[ row * size + col1 ] - top ) * tx;
+  bottom += ( image[ row1 * size + col1 ] - bottom ) * tx;
+  return top + ( bottom - top ) * ty;
+}
+
+void report( const char* name, double seconds, long pixels,
+             double baseline )
+{
+  printf( "%-34s %8.3f s %9.2f Mpixel/s %7.2fx\n", name, seconds,
+          pixels / seconds / 1e6, baseline / seconds );
+}
+}
+
+
+int main( int argc, char** argv )
+{
+  long threads = ( argc > 1 ) ? atol( argv[1] ) : 4;
+  long size    = ( argc > 2 ) ? atol( argv[2] ) : 2048;
+  SyntheticProjection plateCarree( SyntheticProjection::PLATE_CARREE,
+                                   -95.0, RADIUS );
+  SyntheticProjection mercator( SyntheticProjection::MERCATOR,
+                                -95.0, RADIUS );
+  std::vector<unsigned char> source( size * size );
+  std::vector<unsigned char> baseline( size * size );
+  std::vector<unsigned char> warped( size * size );
+  double srcLeft, srcTop, srcPixel, dstLeft, dstTop, dstBottom, dstPixelY;
+  double start, baselineSeconds, seconds;
+  long row, col, differences;
+
+  // 10 x 10 degrees of plate carree, 30N to 40N, and the Mercator box
+  // around it
+  srcLeft  = -5.0 * DEGREE;
+  srcTop   = 40.0 * DEGREE;
+  srcPixel = 10.0 * DEGREE / size;
+  dstLeft  = srcLeft;
+  dstTop   = RADIUS * log( tan( M_PI / 4.0 + 40.0 * M_PI / 360.0 ) );
+  dstBottom = RADIUS * log( tan( M_PI / 4.0 + 30.0 * M_PI / 360.0 ) );
+  dstPixelY = ( dstTop - dstBottom ) / size;
+
+  for ( row = 0; row < size; row++ )
+  {
+    for ( col = 0; col < size; col++ )
+      source[ row * size + col ] =
+        static_cast<unsigned char>( ( row * 7 + col * 13 + ( row ^ col ) ) );
+  }
+
+  // The mesh callers build today, from the output back to the source
+  ProjectionMesh backward;
+  backward.setSourceMeshBounds( dstLeft, dstBottom, dstLeft + 10.0 * DEGREE,
+                                dstTop );
+  backward.setMeshSize( 65, 65 );
+  backward.calculateMesh( mercator, plateCarree );
+
+  // A forward mesh with the inverse index
+  ProjectionMesh forward;
+  forward.setSourceMeshBounds( srcLeft, srcTop - 10.0 * DEGREE,
+                               srcLeft + 10.0 * DEGREE, srcTop );
+  forward.setMeshSize( 65, 65 );
+  forward.setInverse( true );
+  forward.calculateMesh( plateCarree, mercator );
+
+  printf( "Warping %ld x %ld bytes, plate carree to Mercator, 65 x 65 "
+          "mesh\n\n", size, size );
+
+  // The per pixel loop
+  start = wallSeconds();
+  for ( row = 0; row < size; row++ )
+  {
+    for ( col = 0; col < size; col++ )
+    {
+      double x = dstLeft + ( col + 0.5 ) * srcPixel;
+      double y = dstTop - ( row + 0.5 ) * dstPixelY;
+      double px, py;
+
+      baseline[ row * size + col ] = 0;
+      if ( !backward.projectPoint( x, y ) )
+        continue;
+
+      px = ( x - srcLeft ) / srcPixel - 0.5;
+      py = ( srcTop - y ) / srcPixel - 0.5;
+      if ( px >= -0.5 && px < size - 0.5 && py >= -0.5 && py < size - 0.5 )
+        baseline[ row * size + col ] = static_cast<unsigned char>(
+          floor( sampleBilinear( source, size, px, py ) + 0.5 ) );
+    }
+  }
+  baselineSeconds = wallSeconds() - start;
+  report( "projectPoint() loop", baselineSeconds, size * size,
+          baselineSeconds );
+
+  MeshWarpImage sourceImage, destImage;
+
+  sourceImage.data        = &source[0];
+  sourceImage.width       = size;
+  sourceImage.height      = size;
+  sourceImage.bands       = 1;
+  sourceImage.rowBytes    = size;
+  sourceImage.sampleType  = MESH_WARP_BYTE;
+  sourceImage.geoTransform[0] = srcLeft;
+  sourceImage.geoTransform[1] = srcPixel;
+  sourceImage.geoTransform[2] = 0.0;
+  sourceImage.geoTransform[3] = srcTop;
+  sourceImage.geoTransform[4] = 0.0;
+  sourceImage.geoTransform[5] = -srcPixel;
+
+  destImage = sourceImage;
+  destImage.data = &warped[0];
+  destImage.geoTransform[0] = dstLeft;
+  destImage.geoTransform[3] = dstTop;
+  destImage.geoTransform[5] = -dstPixelY;
+
+  MeshWarp warp;
+
+  // Same mesh and arithmetic as the loop, so the images should match
+  warp.setMeshIsInverse( true );
+  start = wallSeconds();
+  warp.warp( backward, sourceImage, destImage );
+  seconds = wallSeconds() - start;
+  report( "MeshWarp, backward mesh", seconds, size * size,
+          baselineSeconds );
+
+  differences = 0;
+  for ( row = 0; row < size * size; row++ )
+    differences += ( warped[row] != baseline[row] );
+
+  warp.setMeshIsInverse( false );
+  start = wallSeconds();
+  warp.warp( forward, sourceImage, destImage );
+  seconds = wallSeconds() - start;
+  report( "MeshWarp, forward mesh inverted", seconds, size * size,
+          baselineSeconds );
+
+  warp.setThreadCount( threads );
+  start = wallSeconds();
+  warp.warp( forward, sourceImage, destImage );
+  seconds = wallSeconds() - start;
+
+  char name[64];
+  sprintf( name, "MeshWarp, inverted, %ld threads", threads );
+  report( name, seconds, size * size, baselineSeconds );
+
+  warp.setResampling( MESH_WARP_CUBIC );
+  start = wallSeconds();
+  warp.warp( forward, sourceImage, destImage );
+  seconds = wallSeconds() - start;
+  sprintf( name, "  cubic, %ld threads", threads );
+  report( name, seconds, size * size, baselineSeconds );
+
+  printf( "\n%ld pixels differ between the loop and MeshWarp on the same "
+          "mesh\n", differences );
+  return 0;
+}